@@ -0,0 +1,104 @@
+// lib/LoRaCom/airtime.hpp: the time on air LoRaCom works out for every
+// packet it queues or starts, and a check of it against the simulator
+// radio's floating point model (host::loraTimeOnAir() in RadioLib.cpp). The
+// check aborts on the first case the two disagree on.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include "LoRaCom.hpp"
+#include "RadioLib.h"
+#include "airtime.hpp"
+#include "bench.hpp"
+
+namespace {
+
+[[noreturn]] void checkFailed(const char *check, const char *what) {
+  fprintf(stderr, "%s: %s\n", check, what);
+  abort();
+}
+
+void Airtime_timeOnAir(bench::State &state) {
+  airtime::Modem modem = LoRaCom::BOOT_MODEM;
+  size_t len = 0;
+  for (auto _ : state) {
+    uint32_t us = airtime::timeOnAirUs(modem, len);
+    bench::doNotOptimize(us);
+    len = (len + 37) & 0xff;
+    bench::doNotOptimize(modem);
+  }
+}
+BENCHMARK(Airtime_timeOnAir);
+
+// Every SF, coding rate, header and CRC setting and length, at three
+// preambles and the bandwidths the SX126x takes. Those that are a whole
+// number of Hz have to match to the microsecond. The model takes the others
+// as a float (20.8f), airtime.hpp rounds them to Hz, which puts the two up
+// to 2e-5 apart. The longest preamble at the slowest rates takes more than
+// the 71 minutes airtime.hpp saturates at.
+void Airtime_modelCheck(bench::State &state) {
+  const char *check = "Airtime_modelCheck";
+  struct Bandwidth {
+    float kHz;
+    bool exact;
+  };
+  constexpr Bandwidth BANDWIDTHS[] = {
+      {7.8f, false},  {10.4f, false}, {15.6f, false}, {20.8f, false},
+      {31.25f, true}, {41.7f, false}, {62.5f, true},  {125.0f, true},
+      {250.0f, true}, {500.0f, true},
+  };
+  constexpr uint16_t PREAMBLES[] = {6, LoRaCom::BOOT_MODEM.preamble, 65535};
+
+  uint32_t cases = 0;
+  uint32_t exactCases = 0;
+  uint32_t worstUs = 0;  // at the fractional bandwidths, below 1 s
+  for (auto _ : state) {
+    cases = 0;
+    exactCases = 0;
+    for (const Bandwidth &bw : BANDWIDTHS) {
+      for (uint8_t sf = 5; sf <= 12; sf++) {
+        for (uint8_t cr = 5; cr <= 8; cr++) {
+          for (uint16_t preamble : PREAMBLES) {
+            for (int flags = 0; flags < 4; flags++) {
+              airtime::Modem modem{sf, airtime::bandwidthHz(bw.kHz), cr,
+                                   preamble, (flags & 1) != 0,
+                                   (flags & 2) != 0};
+              host::LoRaProfile profile;
+              profile.bwKHz = bw.kHz;
+              profile.sf = sf;
+              profile.cr = cr;
+              profile.preambleLength = preamble;
+              profile.implicitHeader = modem.implicitHeader;
+              profile.crcOn = modem.crc;
+              for (size_t len = 0; len <= TxPacket::MAX_LEN; len++) {
+                uint64_t ours = airtime::timeOnAirUs(modem, len);
+                uint64_t model = std::min<uint64_t>(
+                    host::loraTimeOnAir(profile, len), UINT32_MAX);
+                uint64_t diff = ours > model ? ours - model : model - ours;
+                if (bw.exact && diff != 0) {
+                  checkFailed(check, "differs from the model");
+                }
+                if (diff > model / 50'000 + 1) {
+                  checkFailed(check, "more than rounding off the model");
+                }
+                if (model < 1'000'000 && diff > worstUs) worstUs = diff;
+                if (bw.exact) exactCases++;
+                cases++;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  char label[64];
+  snprintf(label, sizeof(label), "%u cases, %u exact, others up to %u us",
+           static_cast<unsigned>(cases), static_cast<unsigned>(exactCases),
+           static_cast<unsigned>(worstUs));
+  state.setLabel(label);
+}
+BENCHMARK(Airtime_modelCheck);
+
+}  // namespace
@@ -0,0 +1,194 @@
+#include "bench.hpp"
+
+#include <time.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "heapCounter.hpp"
+
+namespace bench {
+
+namespace {
+
+struct Benchmark {
+  const char *name;
+  Function function;
+};
+
+struct Result {
+  const char *name;
+  uint64_t iterations;
+  double realNs;  // all per iteration
+  double cpuNs;
+  double allocations;
+  double bytes;
+  std::string label;
+};
+
+// Built by the BENCHMARK() initialisers, so constructed on first use
+std::vector<Benchmark> &registry() {
+  static std::vector<Benchmark> benchmarks;
+  return benchmarks;
+}
+
+int64_t clockNs(clockid_t clock) {
+  timespec ts;
+  clock_gettime(clock, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+// The CPU time of this thread. Tasks run as fibers on the kernel thread, so
+// that is the benchmark and nothing else.
+int64_t cpuNow() { return clockNs(CLOCK_THREAD_CPUTIME_ID); }
+int64_t realNow() { return clockNs(CLOCK_MONOTONIC); }
+
+// Grows the iteration count until one run takes `minTimeS`, like Google
+// Benchmark: aim 40 % past the target, at most 10 times more per step
+Result measure(const Benchmark &benchmark, double minTimeS) {
+  constexpr uint64_t MAX_ITERATIONS = 1'000'000'000;
+  uint64_t iterations = 1;
+  while (true) {
+    State state(iterations);
+    benchmark.function(state);
+
+    double seconds = state.realNs / 1e9;
+    if (seconds >= minTimeS || iterations >= MAX_ITERATIONS) {
+      return {benchmark.name,
+              iterations,
+              state.realNs / iterations,
+              state.cpuNs / iterations,
+              static_cast<double>(state.allocations) / iterations,
+              static_cast<double>(state.bytes) / iterations,
+              state.label()};
+    }
+
+    double multiplier = seconds > 0 ? minTimeS * 1.4 / seconds : 10.0;
+    if (multiplier > 10.0) multiplier = 10.0;
+    uint64_t next = static_cast<uint64_t>(iterations * multiplier);
+    iterations = next > iterations ? next : iterations + 1;
+    if (iterations > MAX_ITERATIONS) iterations = MAX_ITERATIONS;
+  }
+}
+
+/* ================================ OUTPUT ================================= */
+
+void printConsoleHeader() {
+  printf("%-40s %12s %12s %12s %10s %10s\n", "Benchmark", "Time", "CPU",
+         "Iterations", "Allocs", "Bytes");
+  printf("%.*s\n", 101,
+         "----------------------------------------------------------------"
+         "-------------------------------------");
+}
+
+void printConsole(const Result &r) {
+  printf("%-40s %9.1f ns %9.1f ns %12llu %10.2f %10.1f %s\n", r.name,
+         r.realNs, r.cpuNs, static_cast<unsigned long long>(r.iterations),
+         r.allocations, r.bytes, r.label.c_str());
+  fflush(stdout);
+}
+
+// The layout of Google Benchmark's JSON reporter, so the same tools (e.g.
+// compare.py) read it, with allocations and bytes per iteration added
+void writeJson(FILE *out, const std::vector<Result> &results) {
+  char date[32];
+  time_t now = time(nullptr);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+  fprintf(out, "{\n  \"context\": {\n");
+  fprintf(out, "    \"date\": \"%s\",\n", date);
+  fprintf(out, "    \"executable\": \"bench\",\n");
+  fprintf(out, "    \"library_build_type\": \"release\"\n  },\n");
+  fprintf(out, "  \"benchmarks\": [\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    fprintf(out,
+            "    {\n"
+            "      \"name\": \"%s\",\n"
+            "      \"run_name\": \"%s\",\n"
+            "      \"run_type\": \"iteration\",\n"
+            "      \"iterations\": %llu,\n"
+            "      \"real_time\": %.3f,\n"
+            "      \"cpu_time\": %.3f,\n"
+            "      \"time_unit\": \"ns\",\n"
+            "      \"allocs_per_iter\": %.3f,\n"
+            "      \"bytes_per_iter\": %.3f,\n"
+            "      \"label\": \"%s\"\n"
+            "    }%s\n",
+            r.name, r.name, static_cast<unsigned long long>(r.iterations),
+            r.realNs, r.cpuNs, r.allocations, r.bytes, r.label.c_str(),
+            i + 1 < results.size() ? "," : "");
+  }
+  fprintf(out, "  ]\n}\n");
+}
+
+}  // namespace
+
+/* ================================= STATE ================================= */
+
+void State::start() {
+  realNs = cpuNs = 0;
+  allocations = bytes = 0;
+  resumeTiming();
+}
+
+void State::finish() {
+  if (m_running) pauseTiming();
+}
+
+void State::pauseTiming() {
+  if (!m_running) return;
+  // Read the heap first, the clocks do not allocate
+  allocations += heapCounter::allocations() - m_allocStart;
+  bytes += heapCounter::bytes() - m_bytesStart;
+  cpuNs += cpuNow() - m_cpuStart;
+  realNs += realNow() - m_realStart;
+  m_running = false;
+}
+
+void State::resumeTiming() {
+  if (m_running) return;
+  m_running = true;
+  m_realStart = realNow();
+  m_cpuStart = cpuNow();
+  m_allocStart = heapCounter::allocations();
+  m_bytesStart = heapCounter::bytes();
+}
+
+/* ================================= RUNNER ================================ */
+
+bool add(const char *name, Function function) {
+  registry().push_back({name, function});
+  return true;
+}
+
+size_t runAll(const char *filter, const char *format, const char *outPath,
+              double minTimeS) {
+  bool json = strcmp(format, "json") == 0;
+  if (!json) printConsoleHeader();
+
+  std::vector<Result> results;
+  for (const Benchmark &benchmark : registry()) {
+    if (filter && *filter && strstr(benchmark.name, filter) == nullptr) {
+      continue;
+    }
+    results.push_back(measure(benchmark, minTimeS));
+    if (!json) printConsole(results.back());
+  }
+
+  if (json) writeJson(stdout, results);
+  if (outPath) {
+    FILE *out = fopen(outPath, "w");
+    if (out == nullptr) {
+      fprintf(stderr, "Cannot write %s\n", outPath);
+    } else {
+      writeJson(out, results);
+      fclose(out);
+    }
+  }
+  return results.size();
+}
+
+}  // namespace bench
@@ -0,0 +1,105 @@
+#pragma once
+
+// Small benchmark harness in the style of Google Benchmark, for the host
+// build of the firmware (`pio run -e bench`, see benchMain.cpp):
+//
+//   void Commander_checkCommand(bench::State &state) {
+//     ...setup...
+//     for (auto _ : state) {
+//       ...the code to measure, once per iteration...
+//     }
+//   }
+//   BENCHMARK(Commander_checkCommand);
+//
+// Every benchmark runs with more and more iterations until one run takes at
+// least the minimum time, that run is reported: wall time, CPU time, heap
+// allocations and allocated bytes, all per iteration. Allocations come from
+// heapCounter, so the build needs HEAP_COUNTER and its linker flags.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace bench {
+
+class State {
+ public:
+  explicit State(uint64_t iterations) : m_iterations(iterations) {}
+
+  // Setup or cleanup inside the loop that should not be measured
+  void pauseTiming();
+  void resumeTiming();
+
+  uint64_t iterations() const { return m_iterations; }
+
+  // Shown after the numbers, e.g. a compression ratio. Set it after the loop.
+  void setLabel(const std::string &label) { m_label = label; }
+  const std::string &label() const { return m_label; }
+
+  // What `auto _` holds, marked unused so the loop variable warns nowhere
+  struct __attribute__((unused)) Value {};
+
+  struct Iterator {
+    State *state;
+    uint64_t left;
+
+    bool operator!=(const Iterator &) {
+      if (left != 0) return true;
+      state->finish();
+      return false;
+    }
+    void operator++() { left--; }
+    Value operator*() const { return Value(); }
+  };
+  Iterator begin() {
+    start();
+    return Iterator{this, m_iterations};
+  }
+  Iterator end() { return Iterator{this, 0}; }
+
+  // Totals over the timed part, filled in by finish()
+  double realNs = 0;
+  double cpuNs = 0;
+  uint64_t allocations = 0;
+  uint64_t bytes = 0;
+
+ private:
+  void start();
+  void finish();
+
+  uint64_t m_iterations;
+  bool m_running = false;
+  int64_t m_realStart = 0;
+  int64_t m_cpuStart = 0;
+  uint32_t m_allocStart = 0;
+  uint32_t m_bytesStart = 0;
+  std::string m_label;
+};
+
+typedef void (*Function)(State &state);
+
+// Adds a benchmark to the ones run by runAll(), see BENCHMARK()
+bool add(const char *name, Function function);
+
+// Runs every benchmark whose name contains `filter` and prints the results
+// in `format` ("console" or "json") to stdout, and as JSON to `outPath`
+// unless that is nullptr. Returns the number of benchmarks run.
+size_t runAll(const char *filter, const char *format, const char *outPath,
+              double minTimeS);
+
+// Keeps the compiler from dropping a result that is otherwise unused
+template <typename T>
+inline void doNotOptimize(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Keeps the compiler from dropping writes to memory that is never read
+inline void clobberMemory() { asm volatile("" : : : "memory"); }
+
+}  // namespace bench
+
+#define BENCH_CONCAT2(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT2(a, b)
+#define BENCHMARK(function)                                 \
+  static const bool BENCH_CONCAT(s_registered_, __LINE__) = \
+      bench::add(#function, function)
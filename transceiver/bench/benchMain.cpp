@@ -0,0 +1,95 @@
+// Microbenchmarks of the firmware hot paths, built for the host with
+// `pio run -e bench`. The benchmarks run as a task on the virtual time host
+// kernel, so the FreeRTOS calls in the code under test work as on the board.
+//
+// Options, named like Google Benchmark's:
+//   --benchmark_filter=<text>     only benchmarks whose name contains it
+//   --benchmark_format=console|json
+//   --benchmark_out=<file>        also write the results there as JSON
+//   --benchmark_min_time=<s>      minimum time of a measured run (0.2)
+//
+// Every row gives the wall and CPU time, heap allocations and allocated bytes
+// per iteration. The hot paths are meant to stay at 0 allocations.
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+#include "bench.hpp"
+#include "benchSerial.hpp"
+#include "esp_log.h"
+#include "hostKernel.hpp"
+
+BenchSerialPort &benchSerial() {
+  static BenchSerialPort port;
+  return port;
+}
+
+namespace {
+
+// Value of `--name=value`, or nullptr if `arg` is a different option
+const char *option(const char *arg, const char *name) {
+  size_t len = strlen(name);
+  if (strncmp(arg, name, len) != 0 || arg[len] != '=') return nullptr;
+  return arg + len + 1;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const char *filter = "";
+  const char *format = "console";
+  const char *outPath = nullptr;
+  double minTimeS = 0.2;
+  for (int i = 1; i < argc; i++) {
+    const char *value;
+    if ((value = option(argv[i], "--benchmark_filter"))) {
+      filter = value;
+    } else if ((value = option(argv[i], "--benchmark_format"))) {
+      format = value;
+    } else if ((value = option(argv[i], "--benchmark_out"))) {
+      outPath = value;
+    } else if ((value = option(argv[i], "--benchmark_min_time"))) {
+      minTimeS = atof(value);  // "0.5" or "0.5s"
+    } else {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (strcmp(format, "console") != 0 && strcmp(format, "json") != 0) {
+    fprintf(stderr, "Unknown format: %s\n", format);
+    return 1;
+  }
+
+  // Warnings of the code under test would only measure printf
+  esp_log_level_set("*", ESP_LOG_NONE);
+
+  host::Kernel &kernel = host::Kernel::get();
+  kernel.useVirtualTime(true);
+  host::Node &node = kernel.defaultNode();
+  node.name = "bench";
+  node.serial = &benchSerial();
+  namespace stdfs = std::filesystem;
+  stdfs::path fsRoot = stdfs::temp_directory_path() /
+                       ("lora_bench_" + std::to_string(getpid()));
+  node.fsRoot = fsRoot.string();
+
+  size_t count = 0;
+  kernel.spawn(
+      [&] { count = bench::runAll(filter, format, outPath, minTimeS); },
+      "bench", 1, &node);
+  kernel.run();
+
+  std::error_code ec;
+  stdfs::remove_all(fsRoot, ec);
+  stdfs::remove(fsRoot.string() + ".log.bin", ec);  // see esp_partition.h
+  if (count == 0) {
+    fprintf(stderr, "No benchmark matches \"%s\"\n", filter);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+// Serial port of the benchmark node. Reads replay `feed` over and over, as if
+// a host kept typing the same lines, and writes go nowhere. It never runs
+// dry, so SerialCom always finds a full driver buffer. After arrive() it
+// hands out only that many bytes of the feed instead, as a UART that
+// received them since it was last polled, and is dry until the next one.
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "HardwareSerial.h"
+
+class BenchSerialPort : public host::SerialPort {
+ public:
+  void feed(const std::string &text) {
+    m_feed = text;
+    m_offset = 0;
+    m_bursts = false;
+  }
+  void arrive(size_t bytes) {
+    m_bursts = true;
+    m_burstLeft = bytes;
+  }
+
+  size_t available() override {
+    if (m_feed.empty()) return 0;
+    return m_bursts ? std::min(RX_BUFFER, m_burstLeft) : RX_BUFFER;
+  }
+  int peek() override {
+    return available() == 0 ? -1 : static_cast<uint8_t>(m_feed[m_offset]);
+  }
+  size_t read(uint8_t *buffer, size_t size) override {
+    size = std::min(size, available());
+    for (size_t done = 0; done < size;) {
+      size_t count = std::min(size - done, m_feed.size() - m_offset);
+      memcpy(buffer + done, m_feed.data() + m_offset, count);
+      done += count;
+      m_offset = (m_offset + count) % m_feed.size();
+    }
+    if (m_bursts) m_burstLeft -= size;
+    return size;
+  }
+  size_t write(const uint8_t *, size_t size) override { return size; }
+
+ private:
+  static constexpr size_t RX_BUFFER = 256;  // like the UART driver's FIFO
+
+  std::string m_feed;
+  size_t m_offset = 0;
+  bool m_bursts = false;
+  size_t m_burstLeft = 0;
+};
+
+// The port `Serial` stands for, set up by benchMain.cpp
+BenchSerialPort &benchSerial();
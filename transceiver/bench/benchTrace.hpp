@@ -0,0 +1,40 @@
+#pragma once
+
+// Recorded traces in bench/traces, read once and kept for the whole run. The
+// benchmarks that use them have to run from the project directory, like
+// `.pio/build/bench/program`. How each trace was recorded is in
+// bench/traces/README.
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// The whole trace `name` (bench/traces/<name>.log)
+inline const std::string &benchTrace(const std::string &name) {
+  static std::map<std::string, std::string> traces;
+  auto found = traces.find(name);
+  if (found != traces.end()) return found->second;
+
+  std::string path = "bench/traces/" + name + ".log";
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    fprintf(stderr, "Cannot read %s, run from the project directory\n",
+            path.c_str());
+    exit(1);
+  }
+  std::stringstream text;
+  text << file.rdbuf();
+  return traces[name] = text.str();
+}
+
+// Its lines, without their line endings
+inline std::vector<std::string> benchTraceLines(const std::string &name) {
+  std::vector<std::string> lines;
+  std::istringstream text(benchTrace(name));
+  for (std::string line; std::getline(text, line);) lines.push_back(line);
+  return lines;
+}
@@ -0,0 +1,191 @@
+// CircularLog on the emulated "log" partition (esp_partition.h): appending a
+// batch while the ring wraps, and mounting a full log. The last two are
+// checks rather than benchmarks, of what the ring has to keep through many
+// laps and through a power loss in the middle of a record. They abort on
+// the first thing that is wrong.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+#include "bench.hpp"
+#include "circularLog.hpp"
+#include "esp_partition.h"
+#include "saveFlash.hpp"
+
+namespace {
+
+constexpr const char *LABEL = "log";
+
+const esp_partition_t *partition() {
+  return esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                  ESP_PARTITION_SUBTYPE_ANY, LABEL);
+}
+
+[[noreturn]] void checkFailed(const char *check, const char *what) {
+  fprintf(stderr, "%s: %s\n", check, what);
+  abort();
+}
+
+// Log lines of 10 to 200 bytes, like a mix of status and telemetry
+std::string randomLine(std::mt19937 &rng) {
+  std::string line = "data ";
+  size_t len = 5 + rng() % 195;
+  while (line.size() < len) line += static_cast<char>('0' + rng() % 75);
+  return line + '\n';
+}
+
+// Whole lines up to FLUSH_BYTES, as SaveFlash hands them over
+std::string randomBatch(std::mt19937 &rng) {
+  std::string batch;
+  size_t limit = 1 + rng() % SaveFlash::FLUSH_BYTES;
+  while (true) {
+    std::string line = randomLine(rng);
+    if (!batch.empty() && batch.size() + line.size() > limit) return batch;
+    batch += line;
+  }
+}
+
+void collect(void *context, const char *data, size_t len) {
+  static_cast<std::string *>(context)->append(data, len);
+}
+
+std::string readAll(CircularLog &log) {
+  std::string out;
+  log.read(log.startOffset(), log.endOffset(), collect, &out);
+  return out;
+}
+
+// One iteration is a batch of FLUSH_BYTES, over and over around the ring
+void CircularLog_appendBatch(bench::State &state) {
+  CircularLog log(LABEL);
+  log.begin();
+  log.clear();
+  std::mt19937 rng(1);
+  std::string batch;
+  while (batch.size() + 64 <= SaveFlash::FLUSH_BYTES) {
+    batch += randomLine(rng);
+  }
+  for (auto _ : state) {
+    log.append(batch.data(), batch.size());
+  }
+}
+BENCHMARK(CircularLog_appendBatch);
+
+// Mounting a full ring, which reads every sector header and scans the head
+void CircularLog_mountFull(bench::State &state) {
+  state.pauseTiming();
+  {
+    CircularLog log(LABEL);
+    log.begin();
+    std::mt19937 rng(2);
+    while (log.stats().overwrittenSectors == 0) {
+      std::string batch = randomBatch(rng);
+      log.append(batch.data(), batch.size());
+    }
+  }
+  state.resumeTiming();
+  for (auto _ : state) {
+    CircularLog log(LABEL);
+    log.begin();
+    bench::doNotOptimize(log.endOffset());
+  }
+}
+BENCHMARK(CircularLog_mountFull);
+
+void verifyWrapped(CircularLog &log, const std::string &logged) {
+  const char *check = "CircularLog_wrapCheck";
+  uint32_t start = log.startOffset();
+  if (log.endOffset() != logged.size()) checkFailed(check, "wrong end offset");
+  if (log.endOffset() - start < log.totalBytes() * 9 / 10) {
+    checkFailed(check, "less than 90% of the partition kept");
+  }
+  if (start > 0 && logged[start - 1] != '\n') {
+    checkFailed(check, "oldest data does not start on a line");
+  }
+  if (readAll(log) != logged.substr(start)) {
+    checkFailed(check, "data read back differs");
+  }
+}
+
+// Three laps of random batches. What is left has to read back byte for byte
+// as the newest part of what was logged, start on a line, hold nearly the
+// whole partition and survive a remount. Every sector is erased once per
+// lap, so the wear spread grows by at most one.
+void CircularLog_wrapCheck(bench::State &state) {
+  const char *check = "CircularLog_wrapCheck";
+  std::mt19937 rng(3);
+  for (auto _ : state) {
+    CircularLog log(LABEL);
+    log.begin();
+    log.clear();
+    host::FlashStats before = host::partitionStats(partition());
+
+    std::string logged;
+    while (logged.size() < 3 * log.totalBytes()) {
+      std::string batch = randomBatch(rng);
+      if (!log.append(batch.data(), batch.size())) {
+        checkFailed(check, "append failed");
+      }
+      logged += batch;
+    }
+
+    host::FlashStats after = host::partitionStats(partition());
+    uint32_t erases = after.sectorErases - before.sectorErases;
+    if (erases > logged.size() / (CircularLog::SECTOR_SIZE * 7 / 8) + 1) {
+      checkFailed(check, "more than one erase per 3.5 KiB logged");
+    }
+    if (after.maxSectorErases - after.minSectorErases >
+        before.maxSectorErases - before.minSectorErases + 1) {
+      checkFailed(check, "uneven wear");
+    }
+
+    CircularLog remounted(LABEL);
+    remounted.begin();
+    verifyWrapped(log, logged);
+    verifyWrapped(remounted, logged);
+  }
+}
+BENCHMARK(CircularLog_wrapCheck);
+
+// The power fails a random number of bytes into a one line record, right
+// after a batch that leaves room for it in the same sector. After a remount
+// the log holds exactly what was appended before, and what is appended
+// after the remount follows it.
+void CircularLog_tornRecord(bench::State &state) {
+  const char *check = "CircularLog_tornRecord";
+  std::mt19937 rng(4);
+  for (auto _ : state) {
+    std::string before = randomBatch(rng);
+    std::string torn = randomLine(rng);
+    std::string after = randomBatch(rng);
+    {
+      CircularLog log(LABEL);
+      log.begin();
+      log.clear();
+      log.append(before.data(), before.size());
+      // The record has a length and a CRC around the data
+      host::cutPowerAfter(partition(), rng() % (torn.size() + 4));
+      if (log.append(torn.data(), torn.size())) {
+        checkFailed(check, "append went through without power");
+      }
+      host::restorePower(partition());
+    }
+
+    CircularLog log(LABEL);
+    log.begin();
+    if (readAll(log) != before) checkFailed(check, "data before the cut");
+    log.append(after.data(), after.size());
+
+    CircularLog remounted(LABEL);
+    remounted.begin();
+    if (readAll(remounted) != before + after) {
+      checkFailed(check, "data after the cut");
+    }
+  }
+}
+BENCHMARK(CircularLog_tornRecord);
+
+}  // namespace
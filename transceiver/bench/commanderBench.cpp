@@ -0,0 +1,57 @@
+// Command parsing: tokenising a line, and the whole lookup and dispatch down
+// to a handler. The radio is not set up, so "update sf" stops at
+// LoRaCom::beginConfigure() and only the parsing is measured.
+
+#include "bench.hpp"
+#include "commander.hpp"
+
+namespace {
+
+void Commander_readAndRemove(bench::State &state) {
+  SerialCom serialCom;
+  LoRaCom loraCom;
+  Commander commander(&serialCom, &loraCom);
+  for (auto _ : state) {
+    commander.setCommand("update  freqMhz 868.1 extra token");
+    for (std::string_view token = commander.readAndRemove(); !token.empty();
+         token = commander.readAndRemove()) {
+      bench::doNotOptimize(token);
+    }
+  }
+}
+BENCHMARK(Commander_readAndRemove);
+
+void Commander_updateSf(bench::State &state) {
+  SerialCom serialCom;
+  LoRaCom loraCom;
+  Commander commander(&serialCom, &loraCom);
+  for (auto _ : state) {
+    commander.setCommand("update sf 7");
+    commander.checkCommand();
+  }
+}
+BENCHMARK(Commander_updateSf);
+
+void Commander_badArgument(bench::State &state) {
+  SerialCom serialCom;
+  LoRaCom loraCom;
+  Commander commander(&serialCom, &loraCom);
+  for (auto _ : state) {
+    commander.setCommand("update gain 99");
+    commander.checkCommand();
+  }
+}
+BENCHMARK(Commander_badArgument);
+
+void Commander_unknown(bench::State &state) {
+  SerialCom serialCom;
+  LoRaCom loraCom;
+  Commander commander(&serialCom, &loraCom);
+  for (auto _ : state) {
+    commander.setCommand("frobnicate now");
+    commander.checkCommand();
+  }
+}
+BENCHMARK(Commander_unknown);
+
+}  // namespace
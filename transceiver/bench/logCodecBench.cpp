@@ -0,0 +1,318 @@
+// Log batch compression (lib/logCodec) on the recorded traces: the status
+// lines a node of a 20 node network logs (bench/traces/status.log), typed
+// telemetry (telemetry.log), and random text that does not compress.
+//
+// The compress benchmarks take batches of 2 lines, 10 lines or
+// SaveFlash::FLUSH_BYTES of whole lines, one per iteration, and label the
+// row with the compression ratio (text bytes over stored bytes, a batch that
+// does not shrink being stored as it is) and the time per KB of text. The
+// decode benchmarks feed the stored 2 KB batches through a Decoder and abort
+// unless the text comes back byte for byte.
+//
+// The two checks at the end abort on the first thing that is wrong:
+// starting to read at random offsets has to give the exact text from the
+// next batch on, and garbage must neither crash the decoder nor make it
+// hand out more than it may. Build with -fsanitize=address to also catch
+// reads and writes out of bounds.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "benchTrace.hpp"
+#include "logCodec.hpp"
+#include "saveFlash.hpp"
+
+namespace {
+
+using logCodec::DICT_SIZE;
+using logCodec::MAX_RAW;
+
+[[noreturn]] void checkFailed(const char *check, const char *what) {
+  fprintf(stderr, "%s: %s\n", check, what);
+  abort();
+}
+
+std::vector<std::string> randomLines() {
+  std::vector<std::string> lines;
+  std::mt19937 rng(1);
+  for (int i = 0; i < 1000; i++) {
+    std::string line;
+    size_t len = 20 + rng() % 60;
+    while (line.size() < len) line += static_cast<char>(' ' + rng() % 95);
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+const std::vector<std::string> &traceLines(const char *name) {
+  static std::map<std::string, std::vector<std::string>> lines;
+  auto found = lines.find(name);
+  if (found != lines.end()) return found->second;
+  if (strcmp(name, "random") == 0) return lines[name] = randomLines();
+  return lines[name] = benchTraceLines(name);
+}
+
+// A batch of text and the bytes SaveFlash would store for it
+struct Batch {
+  std::vector<uint8_t> base;  // DICTIONARY followed by the text
+  std::vector<uint8_t> stored;
+  bool packed;
+
+  size_t textLen() const { return base.size() - DICT_SIZE; }
+  const char *text() const {
+    return reinterpret_cast<const char *>(base.data() + DICT_SIZE);
+  }
+};
+
+// The trace cut into batches of `lines` lines, or of whole lines up to
+// FLUSH_BYTES when `lines` is 0
+std::vector<Batch> batches(const char *name, size_t lines) {
+  std::vector<Batch> out;
+  std::vector<uint8_t> packed(MAX_RAW);
+  uint16_t table[logCodec::HASH_SIZE];
+  const std::vector<std::string> &trace = traceLines(name);
+
+  std::string text;
+  size_t count = 0;
+  auto finish = [&] {
+    Batch batch;
+    batch.base.assign(logCodec::DICTIONARY, logCodec::DICTIONARY + DICT_SIZE);
+    batch.base.insert(batch.base.end(), text.begin(), text.end());
+    size_t len = logCodec::compress(batch.base.data(), text.size(),
+                                    packed.data(), packed.size(), table);
+    batch.packed = len > 0;
+    if (batch.packed) {
+      batch.stored.assign(packed.begin(), packed.begin() + len);
+    } else {
+      batch.stored.assign(text.begin(), text.end());
+    }
+    out.push_back(std::move(batch));
+    text.clear();
+    count = 0;
+  };
+  for (const std::string &line : trace) {
+    if (lines == 0 && !text.empty() &&
+        text.size() + line.size() + 1 > SaveFlash::FLUSH_BYTES) {
+      finish();
+    }
+    text += line + '\n';
+    if (lines != 0 && ++count == lines) finish();
+  }
+  if (!text.empty()) finish();
+  return out;
+}
+
+void compressBatches(bench::State &state, const char *name, size_t lines) {
+  state.pauseTiming();
+  std::vector<Batch> input = batches(name, lines);
+  std::vector<uint8_t> packed(MAX_RAW);
+  uint16_t table[logCodec::HASH_SIZE];
+  uint64_t textBytes = 0;
+  uint64_t storedBytes = 0;
+  size_t next = 0;
+  state.resumeTiming();
+
+  for (auto _ : state) {
+    const Batch &batch = input[next];
+    size_t len = logCodec::compress(batch.base.data(), batch.textLen(),
+                                    packed.data(), packed.size(), table);
+    bench::doNotOptimize(len);
+    textBytes += batch.textLen();
+    storedBytes += len > 0 ? len : batch.textLen();
+    next = (next + 1) % input.size();
+  }
+
+  char label[64];
+  snprintf(label, sizeof(label), "ratio %.2f, %.2f us/KB",
+           static_cast<double>(textBytes) / storedBytes,
+           state.realNs / 1000 / (textBytes / 1024.0));
+  state.setLabel(label);
+}
+
+// Text the decoder hands out, compared with what was logged as it arrives
+struct Expected {
+  const char *text;
+  size_t len;
+  size_t at;
+  bool ok;
+};
+
+void compare(void *context, const char *data, size_t len) {
+  Expected &expected = *static_cast<Expected *>(context);
+  if (len > expected.len - expected.at ||
+      memcmp(data, expected.text + expected.at, len) != 0) {
+    expected.ok = false;
+    return;
+  }
+  expected.at += len;
+}
+
+void decodeBatches(bench::State &state, const char *name) {
+  state.pauseTiming();
+  std::vector<Batch> input = batches(name, 0);
+  std::vector<uint8_t> packed(MAX_RAW);
+  std::vector<uint8_t> base(DICT_SIZE + MAX_RAW);
+  Expected expected = {nullptr, 0, 0, true};
+  logCodec::Decoder decoder(packed.data(), base.data(), compare, &expected);
+  uint64_t textBytes = 0;
+  size_t next = 0;
+  state.resumeTiming();
+
+  for (auto _ : state) {
+    const Batch &batch = input[next];
+    expected = {batch.text(), batch.textLen(), 0, true};
+    decoder.feed(reinterpret_cast<const char *>(batch.stored.data()),
+                 batch.stored.size());
+    if (!expected.ok || expected.at != expected.len) {
+      checkFailed("LogCodec_decode", "text differs after the round trip");
+    }
+    textBytes += batch.textLen();
+    next = (next + 1) % input.size();
+  }
+
+  char label[64];
+  snprintf(label, sizeof(label), "%.2f us/KB",
+           state.realNs / 1000 / (textBytes / 1024.0));
+  state.setLabel(label);
+}
+
+void LogCodec_status2Lines(bench::State &state) {
+  compressBatches(state, "status", 2);
+}
+BENCHMARK(LogCodec_status2Lines);
+
+void LogCodec_status10Lines(bench::State &state) {
+  compressBatches(state, "status", 10);
+}
+BENCHMARK(LogCodec_status10Lines);
+
+void LogCodec_status2KB(bench::State &state) {
+  compressBatches(state, "status", 0);
+}
+BENCHMARK(LogCodec_status2KB);
+
+void LogCodec_telemetry2Lines(bench::State &state) {
+  compressBatches(state, "telemetry", 2);
+}
+BENCHMARK(LogCodec_telemetry2Lines);
+
+void LogCodec_telemetry10Lines(bench::State &state) {
+  compressBatches(state, "telemetry", 10);
+}
+BENCHMARK(LogCodec_telemetry10Lines);
+
+void LogCodec_telemetry2KB(bench::State &state) {
+  compressBatches(state, "telemetry", 0);
+}
+BENCHMARK(LogCodec_telemetry2KB);
+
+void LogCodec_random2KB(bench::State &state) {
+  compressBatches(state, "random", 0);
+}
+BENCHMARK(LogCodec_random2KB);
+
+void LogCodec_decodeStatus2KB(bench::State &state) {
+  decodeBatches(state, "status");
+}
+BENCHMARK(LogCodec_decodeStatus2KB);
+
+void LogCodec_decodeTelemetry2KB(bench::State &state) {
+  decodeBatches(state, "telemetry");
+}
+BENCHMARK(LogCodec_decodeTelemetry2KB);
+
+void collect(void *context, const char *data, size_t len) {
+  static_cast<std::string *>(context)->append(data, len);
+}
+
+// The stored status log, read from 300 random offsets to its end. What comes
+// out has to end with the exact text of every batch after the one the
+// offset falls in.
+void LogCodec_resyncCheck(bench::State &state) {
+  const char *check = "LogCodec_resyncCheck";
+  std::vector<Batch> input = batches("status", 0);
+  std::string stored;
+  std::vector<size_t> starts;  // of each batch in `stored`
+  for (const Batch &batch : input) {
+    starts.push_back(stored.size());
+    stored.append(batch.stored.begin(), batch.stored.end());
+  }
+  std::vector<uint8_t> packed(MAX_RAW);
+  std::vector<uint8_t> base(DICT_SIZE + MAX_RAW);
+  std::mt19937 rng(2);
+
+  for (auto _ : state) {
+    for (int i = 0; i < 300; i++) {
+      size_t offset = rng() % stored.size();
+      size_t current =
+          std::upper_bound(starts.begin(), starts.end(), offset) -
+          starts.begin() - 1;
+      std::string rest;
+      for (size_t b = current + 1; b < input.size(); b++) {
+        rest.append(input[b].text(), input[b].textLen());
+      }
+
+      std::string out;
+      logCodec::Decoder decoder(packed.data(), base.data(), collect, &out);
+      decoder.feed(stored.data() + offset, stored.size() - offset);
+      if (out.size() < rest.size() ||
+          out.compare(out.size() - rest.size(), rest.size(), rest) != 0) {
+        checkFailed(check, "text after a random start differs");
+      }
+    }
+  }
+}
+BENCHMARK(LogCodec_resyncCheck);
+
+// 20k garbage inputs: random bytes with block markers in them, and real
+// blocks with bytes of their payload changed. The decoder may skip them or
+// hand out text, but never more text than the blocks could hold.
+void LogCodec_garbageCheck(bench::State &state) {
+  const char *check = "LogCodec_garbageCheck";
+  std::vector<Batch> input = batches("status", 0);
+  std::vector<uint8_t> packed(MAX_RAW);
+  std::vector<uint8_t> base(DICT_SIZE + MAX_RAW);
+  std::mt19937 rng(3);
+
+  for (auto _ : state) {
+    for (int i = 0; i < 20'000; i++) {
+      std::vector<uint8_t> garbage;
+      if (i % 2 == 0) {
+        garbage.resize(1 + rng() % 1024);
+        for (uint8_t &byte : garbage) {
+          byte = rng() % 8 == 0 ? logCodec::BLOCK_MARKER : rng() & 0xFF;
+        }
+      } else {
+        const Batch &batch = input[rng() % input.size()];
+        garbage = batch.stored;
+        for (int flips = 1 + rng() % 4; flips > 0; flips--) {
+          size_t at = logCodec::BLOCK_HEADER +
+                      rng() % (garbage.size() - logCodec::BLOCK_HEADER);
+          garbage[at] = rng() & 0xFF;
+        }
+      }
+
+      std::string out;
+      logCodec::Decoder decoder(packed.data(), base.data(), collect, &out);
+      decoder.feed(reinterpret_cast<const char *>(garbage.data()),
+                   garbage.size());
+      // Each byte comes out as itself or starts a block of at most MAX_RAW
+      if (out.size() > garbage.size() * MAX_RAW) {
+        checkFailed(check, "more text than the input could hold");
+      }
+      if (memcmp(base.data(), logCodec::DICTIONARY, DICT_SIZE) != 0) {
+        checkFailed(check, "the dictionary was overwritten");
+      }
+    }
+  }
+}
+BENCHMARK(LogCodec_garbageCheck);
+
+}  // namespace
@@ -0,0 +1,46 @@
+// The metrics updates on the TX, RX and serial paths, some of them in the
+// DIO1 interrupt: a counter, a gauge and a histogram each, and the snapshot
+// "stats" takes. On the host every update is one atomic instruction, on the
+// C3 the toolchain masks interrupts around it instead.
+
+#include "bench.hpp"
+#include "metrics.hpp"
+
+namespace {
+
+void Metrics_add(bench::State &state) {
+  for (auto _ : state) {
+    metrics::add(metrics::Counter::TxSent);
+  }
+}
+BENCHMARK(Metrics_add);
+
+void Metrics_set(bench::State &state) {
+  int32_t depth = 0;
+  for (auto _ : state) {
+    metrics::set(metrics::Gauge::TxDepth, depth);
+    depth = (depth + 1) & 7;  // at or below the maximum, the usual case
+  }
+}
+BENCHMARK(Metrics_set);
+
+void Metrics_record(bench::State &state) {
+  // Latencies up to about 4 ms, spread over a dozen buckets
+  uint32_t seed = 1;
+  for (auto _ : state) {
+    seed = seed * 1103515245u + 12345u;
+    metrics::record(metrics::Histogram::TxWaitUs, seed >> 20);
+  }
+}
+BENCHMARK(Metrics_record);
+
+void Metrics_snapshot(bench::State &state) {
+  for (auto _ : state) {
+    metrics::Snapshot snap = metrics::snapshot(0);
+    bench::doNotOptimize(snap);
+    bench::clobberMemory();
+  }
+}
+BENCHMARK(Metrics_snapshot);
+
+}  // namespace
@@ -0,0 +1,81 @@
+// Staging log lines with SaveFlash, which runs on every data line, and the
+// batch write that follows on the flush task. The staging benchmarks write
+// out each batch with the timer paused, like the flush task does behind the
+// writers' backs.
+
+#include <cstring>
+
+#include "SerialCom.hpp"
+#include "bench.hpp"
+#include "saveFlash.hpp"
+
+namespace {
+
+constexpr const char *LINE = "data t=21.43 rh=48.2 p=1013.2 bat=3.97";
+constexpr const char *LINE_LF = "data t=21.43 rh=48.2 p=1013.2 bat=3.97\n";
+
+// Batches between two erases, 512 KB of log. Past the size of the file
+// system the appends would fail and only the failure would be measured.
+constexpr uint32_t BATCHES_PER_LOG = 256;
+
+// Called once per batch, with the timer paused
+void keepRoom(SaveFlash &saveFlash, uint32_t *batches) {
+  if (++*batches % BATCHES_PER_LOG != 0) return;
+  uint32_t start, end;
+  if (saveFlash.range(&start, &end)) saveFlash.erase(end);
+}
+
+void stageLines(bench::State &state, bool newline) {
+  SerialCom serialCom;
+  SaveFlash saveFlash(&serialCom);
+  saveFlash.begin();
+
+  size_t lineLen = strlen(LINE) + 1;
+  size_t staged = 0;
+  uint32_t batches = 0;
+  for (auto _ : state) {
+    if (staged + lineLen > SaveFlash::FLUSH_BYTES) {
+      state.pauseTiming();
+      saveFlash.sync();
+      keepRoom(saveFlash, &batches);
+      staged = 0;
+      state.resumeTiming();
+    }
+    if (newline) {
+      saveFlash.writeLine(LINE);
+    } else {
+      saveFlash.writeData(LINE_LF);
+    }
+    staged += lineLen;
+  }
+  saveFlash.sync();
+}
+
+void SaveFlash_writeLine(bench::State &state) { stageLines(state, true); }
+BENCHMARK(SaveFlash_writeLine);
+
+void SaveFlash_writeData(bench::State &state) { stageLines(state, false); }
+BENCHMARK(SaveFlash_writeData);
+
+// One iteration is a batch of FLUSH_BYTES written to the log file
+void SaveFlash_syncBatch(bench::State &state) {
+  SerialCom serialCom;
+  SaveFlash saveFlash(&serialCom);
+  saveFlash.begin();
+
+  size_t lineLen = strlen(LINE) + 1;
+  uint32_t batches = 0;
+  for (auto _ : state) {
+    state.pauseTiming();
+    keepRoom(saveFlash, &batches);
+    for (size_t staged = 0; staged + lineLen <= SaveFlash::FLUSH_BYTES;
+         staged += lineLen) {
+      saveFlash.writeLine(LINE);
+    }
+    state.resumeTiming();
+    saveFlash.sync();
+  }
+}
+BENCHMARK(SaveFlash_syncBatch);
+
+}  // namespace
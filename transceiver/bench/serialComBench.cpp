@@ -0,0 +1,161 @@
+// Splitting serial input into lines with SerialCom::readLine(): a steady
+// stream of telemetry records, short commands, and lines too long to keep.
+// One iteration is one line handed out, except for the link rate and the
+// randomised check at the end.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "SerialCom.hpp"
+#include "bench.hpp"
+#include "benchSerial.hpp"
+
+namespace {
+
+void readLines(bench::State &state, const std::string &feed) {
+  benchSerial().feed(feed);
+  SerialCom serialCom;
+  for (auto _ : state) {
+    size_t len = 0;
+    const char *line = serialCom.readLine(&len);
+    bench::doNotOptimize(line);
+    bench::doNotOptimize(len);
+  }
+  benchSerial().feed("");
+}
+
+void SerialCom_readLineTelemetry(bench::State &state) {
+  readLines(state,
+            "data t=21.43 rh=48.2 p=1013.2 bat=3.97\n"
+            "data t=21.44 rh=48.1 p=1013.2 bat=3.97\r\n"
+            "data t=21.46 rh=48.1 p=1013.3 bat=3.96\n");
+}
+BENCHMARK(SerialCom_readLineTelemetry);
+
+void SerialCom_readLineCommand(bench::State &state) {
+  readLines(state, "stats\nupdate sf 9\r\nairtime 1\n");
+}
+BENCHMARK(SerialCom_readLineCommand);
+
+// A full line of MAX_LINE bytes, as a large data record
+void SerialCom_readLineMax(bench::State &state) {
+  std::string line = "data " + std::string(SerialCom::MAX_LINE - 5, 'x');
+  readLines(state, line + "\n");
+}
+BENCHMARK(SerialCom_readLineMax);
+
+// Every other line is too long and dropped, the short ones come out
+void SerialCom_readLineOverlong(bench::State &state) {
+  std::string junk(2 * SerialCom::MAX_LINE, 'z');
+  readLines(state, junk + "\ndata t=21.43\n");
+}
+BENCHMARK(SerialCom_readLineOverlong);
+
+// Telemetry at 921600 baud, 92160 B/s, read every 10 ms: one iteration is a
+// burst of 922 bytes split into all the lines it completes. The time per
+// iteration over 10 ms is the share of a core the reader needs to keep up.
+void SerialCom_readLine921600(bench::State &state) {
+  constexpr size_t BURST = 922;
+  benchSerial().feed(
+      "data t=21.43 rh=48.2 p=1013.2 bat=3.97\n"
+      "data t=21.44 rh=48.1 p=1013.2 bat=3.97\r\n"
+      "data t=21.46 rh=48.1 p=1013.3 bat=3.96\n");
+  SerialCom serialCom;
+  for (auto _ : state) {
+    benchSerial().arrive(BURST);
+    size_t len = 0;
+    while (const char *line = serialCom.readLine(&len)) {
+      bench::doNotOptimize(line);
+      bench::doNotOptimize(len);
+    }
+  }
+  benchSerial().feed("");
+}
+BENCHMARK(SerialCom_readLine921600);
+
+// Randomised check of the line splitting rather than a benchmark: 200k lines
+// of 1 to 855 bytes with \n, \r or \r\n endings, arriving in bursts of 1 to
+// 2048 bytes. One iteration reads all of them. Every line up to MAX_LINE has
+// to come out intact and in order, every longer one has to be counted as
+// dropped once. Anything else aborts the run.
+struct RandomLines {
+  std::string text;
+  std::vector<std::pair<size_t, size_t>> kept;  // offset and length in text
+  uint32_t dropped = 0;
+};
+
+const RandomLines &randomLines() {
+  static const RandomLines lines = [] {
+    constexpr size_t COUNT = 200'000;
+    constexpr size_t MAX_LEN = 855;
+    static const char *const endings[] = {"\n", "\r", "\r\n"};
+
+    RandomLines lines;
+    std::mt19937 rng(1);
+    lines.text.reserve(COUNT * (MAX_LEN / 2 + 2));
+    for (size_t i = 0; i < COUNT; i++) {
+      // Mostly lines that fit, like real input, plus enough long ones to
+      // cross the limit and the ring end in every possible place
+      size_t len = rng() % 4 == 0 ? 1 + rng() % MAX_LEN
+                                  : 1 + rng() % SerialCom::MAX_LINE;
+      size_t offset = lines.text.size();
+      for (size_t j = 0; j < len; j++) {
+        lines.text += static_cast<char>(' ' + rng() % 95);  // printable
+      }
+      lines.text += endings[rng() % 3];
+      if (len <= SerialCom::MAX_LINE) {
+        lines.kept.emplace_back(offset, len);
+      } else {
+        lines.dropped++;
+      }
+    }
+    return lines;
+  }();
+  return lines;
+}
+
+[[noreturn]] void checkFailed(const char *what, size_t line) {
+  fprintf(stderr, "SerialCom_readLineRandom: %s at line %zu\n", what, line);
+  abort();
+}
+
+void SerialCom_readLineRandom(bench::State &state) {
+  state.pauseTiming();
+  const RandomLines &lines = randomLines();
+  std::mt19937 rng(2);
+  benchSerial().feed(lines.text);
+  state.resumeTiming();
+
+  for (auto _ : state) {
+    SerialCom serialCom;
+    size_t next = 0;
+    size_t left = lines.text.size();
+    while (left > 0) {
+      size_t burst = std::min<size_t>(left, 1 + rng() % 2048);
+      benchSerial().arrive(burst);
+      left -= burst;
+      size_t len = 0;
+      while (const char *line = serialCom.readLine(&len)) {
+        if (next == lines.kept.size()) checkFailed("extra line", next);
+        auto [offset, expected] = lines.kept[next];
+        if (len != expected ||
+            memcmp(line, lines.text.data() + offset, len) != 0) {
+          checkFailed("wrong line", next);
+        }
+        next++;
+      }
+    }
+    if (next != lines.kept.size()) checkFailed("missing line", next);
+    if (serialCom.stats().droppedLines != lines.dropped) {
+      checkFailed("wrong dropped count", next);
+    }
+  }
+  benchSerial().feed("");
+}
+BENCHMARK(SerialCom_readLineRandom);
+
+}  // namespace
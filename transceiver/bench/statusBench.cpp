@@ -0,0 +1,86 @@
+// The per-beacon work of Control::statusTask(): encoding the Status frame,
+// with and without the ADR link report, and turning it into the text line
+// printed on serial.
+
+#include "SerialCom.hpp"
+#include "bench.hpp"
+#include "frame.hpp"
+
+namespace {
+
+constexpr size_t BUFFER_SIZE = frame::HEADER_SIZE + frame::STATUS_SIZE +
+                               frame::LINK_REPORT_SIZE + frame::CRC_SIZE;
+
+frame::Status beaconStatus() {
+  frame::Status status;
+  status.rssi = -97;
+  status.battery = 83;
+  status.mode = frame::Mode::Transceive;
+  status.health = frame::Health::Ok;
+  return status;
+}
+
+void Status_encode(bench::State &state) {
+  uint8_t buffer[BUFFER_SIZE];
+  frame::Status status = beaconStatus();
+  uint8_t seq = 0;
+  for (auto _ : state) {
+    frame::Header header = {frame::Type::Status, 3, seq++};
+    size_t len = frame::encodeStatus(header, status, buffer, sizeof(buffer));
+    bench::doNotOptimize(len);
+    bench::clobberMemory();
+  }
+}
+BENCHMARK(Status_encode);
+
+void Status_encodeWithReport(bench::State &state) {
+  uint8_t buffer[BUFFER_SIZE];
+  frame::Status status = beaconStatus();
+  frame::LinkReport report = {2, 5, 7, 3};
+  uint8_t seq = 0;
+  for (auto _ : state) {
+    frame::Header header = {frame::Type::Status, 3, seq++};
+    size_t len =
+        frame::encodeStatus(header, status, buffer, sizeof(buffer), &report);
+    bench::doNotOptimize(len);
+    bench::clobberMemory();
+  }
+}
+BENCHMARK(Status_encodeWithReport);
+
+void Status_toText(bench::State &state) {
+  uint8_t buffer[BUFFER_SIZE];
+  char text[frame::MAX_TEXT];
+  frame::Header header = {frame::Type::Status, 3, 42};
+  frame::encodeStatus(header, beaconStatus(), buffer, sizeof(buffer));
+  for (auto _ : state) {
+    size_t len = frame::toText(header, buffer + frame::HEADER_SIZE,
+                               frame::STATUS_SIZE, text, sizeof(text));
+    bench::doNotOptimize(len);
+    bench::clobberMemory();
+  }
+}
+BENCHMARK(Status_toText);
+
+// Everything statusTask() does per beacon before it queues the frame
+void Status_beacon(bench::State &state) {
+  SerialCom serialCom;
+  uint8_t buffer[BUFFER_SIZE];
+  char text[frame::MAX_TEXT];
+  frame::Status status = beaconStatus();
+  frame::LinkReport report = {2, 5, 7, 3};
+  uint8_t seq = 0;
+  for (auto _ : state) {
+    frame::Header header = {frame::Type::Status, 3, seq++};
+    size_t len =
+        frame::encodeStatus(header, status, buffer, sizeof(buffer), &report);
+    frame::toText(header, buffer + frame::HEADER_SIZE, frame::STATUS_SIZE,
+                  text, sizeof(text));
+    serialCom.sendData(text);
+    serialCom.sendData("\n");
+    bench::doNotOptimize(len);
+  }
+}
+BENCHMARK(Status_beacon);
+
+}  // namespace
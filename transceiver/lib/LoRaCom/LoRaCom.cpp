@@ -14,50 +14,304 @@ LoRaCom::LoRaCom() {
 
 void LoRaCom::RxTxCallback(void) {
   if (instance) {
+    if (instance->m_cadMode) {
+      instance->channelScanned();
+      return;
+    }
     if (instance->TxMode) {
       int state = instance->radio->finishTransmit();
-      state |= instance->radio->startReceive();
+      portENTER_CRITICAL_ISR(&instance->m_txMux);
+      instance->m_txQueue.finish(instance->m_txCurrent,
+                                 state == RADIOLIB_ERR_NONE);
       instance->TxMode = false;
-      if (state == RADIOLIB_ERR_NONE) {
-        ESP_LOGI(TAG, "Transmission finished");
-      } else {
-        ESP_LOGE(TAG, "Transmission failed, code: %d", state);
-      }
+      portEXIT_CRITICAL_ISR(&instance->m_txMux);
+      // No logging in interrupt context, tx_sent and tx_failed count it
+      metrics::add(state == RADIOLIB_ERR_NONE ? metrics::Counter::TxSent
+                                              : metrics::Counter::TxFailed);
 
+      // Keep the radio busy while anything is queued, listen otherwise
+      if (!instance->startNextTx()) instance->radio->startReceive();
+      instance->wakeBackoffTask(true);
       return;
     }
-    instance->RxFlag = true;
+    instance->receivePacket();
+    if (instance->m_rxTask) {
+      BaseType_t woken = pdFALSE;
+      vTaskNotifyGiveFromISR(instance->m_rxTask, &woken);
+      portYIELD_FROM_ISR(woken);
+    }
   }
 }
 
-void LoRaCom::sendMessage(const char *msg) {
-  if (!RxFlag && radioInitialised) {
-    if (msg[0] != '\0') {
-      int state = radio->startTransmit(msg);
-      instance->TxMode = true;
-      if (state == RADIOLIB_ERR_NONE) {
-        ESP_LOGI(TAG, "Transmitting: <%s>", msg);
-      } else {
-        ESP_LOGE(TAG, "Failed to begin transmission, code: %d", state);
-      }
+// Drain the radio FIFO into the ring right away, so the next packet cannot
+// overwrite it before the LoRa task gets to run
+void LoRaCom::receivePacket() {
+  RxPacket *slot = m_rxRing.beginWrite();
+  if (slot != nullptr) {
+    size_t len = std::min(radio->getPacketLength(), RxPacket::MAX_LEN);
+    int state = radio->readData(slot->data, len);
+    if (state == RADIOLIB_ERR_NONE) {
+      slot->len = static_cast<uint8_t>(len);
+      slot->rssi = static_cast<int16_t>(radio->getRSSI());
+      slot->snr = radio->getSNR();
+      slot->timestampUs = micros();
+      m_rxRing.commitWrite();
+      metrics::add(metrics::Counter::RxFrames);
+      metrics::set(metrics::Gauge::RxDepth, m_rxRing.size());
+    } else {
+      m_rxErrors++;
+      metrics::add(metrics::Counter::RxErrors);
     }
+  } else {
+    metrics::add(metrics::Counter::RxOverflows);
   }
+  // A full ring drops the packet, it stays counted in rxOverflows()
+  if (!m_configuring) radio->startReceive();
 }
 
-bool LoRaCom::checkTxMode() {
-  return TxMode;  // Return the current transmission mode status
+TxHandle LoRaCom::sendMessage(const char *msg, TxPriority priority) {
+  return sendMessage(reinterpret_cast<const uint8_t *>(msg), strlen(msg),
+                     priority);
+}
+
+TxHandle LoRaCom::sendMessage(const uint8_t *data, size_t len,
+                              TxPriority priority, uint32_t originUs) {
+  if (!radioInitialised || len == 0) return TxHandle();
+
+  portENTER_CRITICAL(&m_txMux);
+  uint32_t dropped = m_txQueue.stats().dropped;
+  TxHandle handle = m_txQueue.push(data, len, priority, micros(), originUs);
+  dropped = m_txQueue.stats().dropped - dropped;  // this one, or evicted
+  size_t depth = m_txQueue.depth();
+  portEXIT_CRITICAL(&m_txMux);
+
+  if (handle.valid()) metrics::add(metrics::Counter::TxQueued);
+  if (dropped > 0) metrics::add(metrics::Counter::TxDropped, dropped);
+  metrics::set(metrics::Gauge::TxDepth, depth);
+
+  if (!handle.valid()) {
+    ESP_LOGW(TAG, "TX queue full, dropped %u bytes",
+             static_cast<unsigned>(len));
+    return handle;
+  }
+  startNextTx();
+  wakeBackoffTask(false);
+  return handle;
+}
+
+// Start the next queued packet unless the radio is already transmitting.
+// Returns true if the radio is transmitting or scanning afterwards.
+bool LoRaCom::startNextTx() {
+  while (true) {
+    bool scan = false;
+    portENTER_CRITICAL_SAFE(&m_txMux);
+    if (TxMode) {
+      portEXIT_CRITICAL_SAFE(&m_txMux);
+      return true;
+    }
+    if (m_configuring) {
+      portEXIT_CRITICAL_SAFE(&m_txMux);
+      return false;  // endConfigure() starts the queue again
+    }
+
+    uint32_t now = micros();
+    if (m_backingOff && static_cast<int32_t>(now - m_backoffUntilUs) >= 0) {
+      m_backingOff = false;
+    }
+    m_waiting = false;
+    m_txPacket = nullptr;
+    TxHandle handle;
+    for (size_t p = 0; p < TX_PRIORITIES; p++) {
+      TxPriority priority = static_cast<TxPriority>(p);
+      TxPacket *head = m_txQueue.front(priority);
+      if (head == nullptr) continue;
+      uint32_t airtimeUs = airtime::timeOnAirUs(m_modem, head->len);
+      uint32_t waitUs = 0;
+      if (m_backingOff && priority != TxPriority::Sync) {
+        waitUs = m_backoffUntilUs - now;
+      } else if (m_txGate) {
+        waitUs = m_txGate(m_txGateContext, priority, airtimeUs, now);
+      }
+      if (waitUs == 0) {
+        waitUs = m_dutyCycle.waitUs(priority, airtimeUs, now);
+        if (waitUs > 0 && !head->deferred) {
+          head->deferred = true;
+          m_dutyCycle.defer(priority);
+        }
+      }
+      if (waitUs == 0) {
+        m_txPacket = m_txQueue.pop(priority, now, &handle);
+        break;
+      }
+      if (!m_waiting ||
+          static_cast<int32_t>(now + waitUs - m_wakeAtUs) < 0) {
+        m_waiting = true;
+        m_wakeAtUs = now + waitUs;
+      }
+    }
+    if (m_txPacket == nullptr) {
+      portEXIT_CRITICAL_SAFE(&m_txMux);
+      return false;  // backoffTask() starts what waits
+    }
+
+    m_waiting = false;  // looked at again once this one is done
+    metrics::set(metrics::Gauge::TxDepth, m_txQueue.depth());
+    m_txCurrent = handle;
+    TxMode = true;  // claims the radio
+    if (m_listenBeforeTalk && m_txPacket->priority != TxPriority::Sync) {
+      scan = m_txPacket->cadTries < CAD_TRIES;
+      if (!scan) m_cadForced++;
+    }
+    m_cadMode = scan;
+    portEXIT_CRITICAL_SAFE(&m_txMux);
+
+    if (scan) {
+      int state = radio->startChannelScan();
+      if (state == RADIOLIB_ERR_NONE) return true;  // channelScanned() next
+      m_cadMode = false;  // send it unscanned
+    }
+    if (transmit()) return true;
+  }
 }
 
-bool LoRaCom::getMessage(char *buffer, size_t len) {
-  if (RxFlag && radioInitialised) {
-    int state = radio->readData(reinterpret_cast<uint8_t *>(buffer), len);
-    RxFlag = false;
-    state |= radio->startReceive();
-    return (state == RADIOLIB_ERR_NONE);
+bool LoRaCom::transmit() {
+  int state = radio->startTransmit(m_txPacket->data, m_txPacket->len);
+  if (state == RADIOLIB_ERR_NONE) {
+    uint32_t now = micros();
+    portENTER_CRITICAL_SAFE(&m_txMux);
+    m_dutyCycle.charge(m_txPacket->priority,
+                       airtime::timeOnAirUs(m_modem, m_txPacket->len), now);
+    portEXIT_CRITICAL_SAFE(&m_txMux);
+    metrics::record(metrics::Histogram::TxWaitUs, now - m_txPacket->queuedUs);
+    if (m_txPacket->originUs != 0) {
+      metrics::record(metrics::Histogram::SerialToAirUs,
+                      now - m_txPacket->originUs);
+    }
+    return true;
   }
+
+  portENTER_CRITICAL_SAFE(&m_txMux);
+  m_txQueue.finish(m_txCurrent, false);
+  TxMode = false;
+  portEXIT_CRITICAL_SAFE(&m_txMux);
+  metrics::add(metrics::Counter::TxFailed);
   return false;
 }
 
+// Channel activity detection for m_txCurrent is done
+void LoRaCom::channelScanned() {
+  int state = radio->getChannelScanResult();
+  m_cadMode = false;
+  if (state != RADIOLIB_LORA_DETECTED) {
+    if (!transmit() && !startNextTx()) radio->startReceive();
+    wakeBackoffTask(true);
+    return;
+  }
+
+  // Someone is talking, listen to them and try again later
+  portENTER_CRITICAL_ISR(&m_txMux);
+  uint32_t slotUs = airtime::timeOnAirUs(m_modem, m_txPacket->len);
+  uint8_t tries = ++m_txPacket->cadTries;
+  m_cadBusy++;
+  long window = 1L << std::min(tries, BACKOFF_MAX_EXP);
+  uint32_t backoffUs = slotUs * random(1, window + 1);
+  m_backoffUntilUs = micros() + backoffUs;
+  m_backingOff = true;
+  m_backoffTotalUs += backoffUs;
+  m_txQueue.requeue(m_txCurrent);
+  TxMode = false;
+  portEXIT_CRITICAL_ISR(&m_txMux);
+
+  // Only a due Sync packet goes out now
+  if (!startNextTx()) radio->startReceive();
+  wakeBackoffTask(true);
+}
+
+void LoRaCom::wakeBackoffTask(bool fromIsr) {
+  if (!m_waiting || m_backoffTask == nullptr) return;
+  if (fromIsr) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(m_backoffTask, &woken);
+    portYIELD_FROM_ISR(woken);
+  } else {
+    xTaskNotifyGive(m_backoffTask);
+  }
+}
+
+void LoRaCom::backoffTask() {
+  m_backoffTask = xTaskGetCurrentTaskHandle();
+  while (true) {
+    portENTER_CRITICAL(&m_txMux);
+    bool waiting = m_waiting && !TxMode && !m_configuring;
+    int32_t leftUs = static_cast<int32_t>(m_wakeAtUs - micros());
+    portEXIT_CRITICAL(&m_txMux);
+
+    // The radio listens while packets wait, it only leaves receive if one
+    // starts. Whoever takes the radio next looks at the rest again.
+    if (waiting && leftUs <= 0) {
+      startNextTx();
+      continue;
+    }
+    TickType_t wait = portMAX_DELAY;
+    if (waiting) wait = pdMS_TO_TICKS((leftUs + 999) / 1000);
+    ulTaskNotifyTake(pdTRUE, wait);
+  }
+}
+
+void LoRaCom::setTxGate(TxGate gate, void *context) {
+  portENTER_CRITICAL(&m_txMux);
+  m_txGate = gate;
+  m_txGateContext = context;
+  portEXIT_CRITICAL(&m_txMux);
+}
+
+TxState LoRaCom::txState(TxHandle handle) {
+  portENTER_CRITICAL(&m_txMux);
+  TxState state = m_txQueue.state(handle);
+  portEXIT_CRITICAL(&m_txMux);
+  return state;
+}
+
+void LoRaCom::setDutyCycle(uint16_t permille) {
+  portENTER_CRITICAL(&m_txMux);
+  m_dutyCycle.setLimit(permille, micros());
+  portEXIT_CRITICAL(&m_txMux);
+  // Whatever waited for the old budget looks again
+  startNextTx();
+  wakeBackoffTask(false);
+}
+
+AirtimeStats LoRaCom::airtimeStats() {
+  portENTER_CRITICAL(&m_txMux);
+  AirtimeStats stats = m_dutyCycle.stats(micros());
+  portEXIT_CRITICAL(&m_txMux);
+  return stats;
+}
+
+bool LoRaCom::setDwellLimit(uint32_t limitUs) {
+  m_dwellLimitUs = limitUs;
+  return fitsDwell(modem());
+}
+
+bool LoRaCom::fitsDwell(const airtime::Modem &modem) const {
+  return m_dwellLimitUs == 0 ||
+         airtime::timeOnAirUs(modem, TxPacket::MAX_LEN) <= m_dwellLimitUs;
+}
+
+TxStats LoRaCom::txStats() {
+  portENTER_CRITICAL(&m_txMux);
+  TxStats stats = m_txQueue.stats();
+  stats.cadBusy = m_cadBusy;
+  stats.cadForced = m_cadForced;
+  stats.backoffTotalUs = m_backoffTotalUs;
+  portEXIT_CRITICAL(&m_txMux);
+  return stats;
+}
+
+bool LoRaCom::checkTxMode() {
+  return TxMode;  // Return the current transmission mode status
+}
+
 int32_t LoRaCom::getRssi() {
   return radio->getRSSI();  // Return the last received signal strength
 }
@@ -87,3 +341,102 @@ bool LoRaCom::setFrequency(float freqMHz) {
     return false;
   }
 }
+
+// Claims the idle radio for a change of modem settings
+bool LoRaCom::beginConfigure() {
+  if (!radioInitialised) return false;
+  portENTER_CRITICAL(&m_txMux);
+  bool idle = !TxMode && !m_configuring;
+  if (idle) m_configuring = true;
+  portEXIT_CRITICAL(&m_txMux);
+  if (!idle) return false;
+
+  radio->standby();
+  return true;
+}
+
+// Keeps the time on air in step with the radio, during a change only
+void LoRaCom::setModemSf(uint8_t spreadingFactor) {
+  portENTER_CRITICAL(&m_txMux);
+  m_modem.sf = spreadingFactor;
+  portEXIT_CRITICAL(&m_txMux);
+}
+
+void LoRaCom::setModemBw(float bandwidthKHz) {
+  portENTER_CRITICAL(&m_txMux);
+  m_modem.bwHz = airtime::bandwidthHz(bandwidthKHz);
+  portEXIT_CRITICAL(&m_txMux);
+}
+
+void LoRaCom::endConfigure() {
+  portENTER_CRITICAL(&m_txMux);
+  m_configuring = false;
+  portEXIT_CRITICAL(&m_txMux);
+  if (!startNextTx()) radio->startReceive();
+  wakeBackoffTask(false);
+}
+
+bool LoRaCom::setSpreadingFactor(uint8_t spreadingFactor) {
+  if (!beginConfigure()) return false;
+  int state = m_setSpreadingFactor(radio, spreadingFactor);
+  if (state == RADIOLIB_ERR_NONE) setModemSf(spreadingFactor);
+  endConfigure();
+
+  if (state == RADIOLIB_ERR_NONE) {
+    ESP_LOGI(TAG, "Spreading factor set to %u", spreadingFactor);
+    return true;
+  } else {
+    ESP_LOGE(TAG, "Failed to set spreading factor with code: %d", state);
+    return false;
+  }
+}
+
+bool LoRaCom::setBandwidth(float bandwidthKHz) {
+  if (!beginConfigure()) return false;
+  int state = m_setBandwidth(radio, bandwidthKHz);
+  if (state == RADIOLIB_ERR_NONE) setModemBw(bandwidthKHz);
+  endConfigure();
+
+  if (state == RADIOLIB_ERR_NONE) {
+    ESP_LOGI(TAG, "Bandwidth set to %.1f kHz", bandwidthKHz);
+    return true;
+  } else {
+    ESP_LOGE(TAG, "Failed to set bandwidth with code: %d", state);
+    return false;
+  }
+}
+
+bool LoRaCom::setModem(uint8_t spreadingFactor, float bandwidthKHz,
+                       int8_t powerDbm) {
+  if (!beginConfigure()) return false;
+  int state = m_setSpreadingFactor(radio, spreadingFactor);
+  if (state == RADIOLIB_ERR_NONE) {
+    setModemSf(spreadingFactor);
+    state = m_setBandwidth(radio, bandwidthKHz);
+  }
+  if (state == RADIOLIB_ERR_NONE) {
+    setModemBw(bandwidthKHz);
+    state = radio->setOutputPower(powerDbm);
+  }
+  endConfigure();
+
+  if (state == RADIOLIB_ERR_NONE) {
+    ESP_LOGI(TAG, "Modem set to SF%u, %.1f kHz, %d dBm", spreadingFactor,
+             bandwidthKHz, powerDbm);
+    return true;
+  } else {
+    ESP_LOGE(TAG, "Failed to set modem with code: %d", state);
+    return false;
+  }
+}
+
+airtime::Modem LoRaCom::modem() {
+  portENTER_CRITICAL(&m_txMux);
+  airtime::Modem modem = m_modem;
+  portEXIT_CRITICAL(&m_txMux);
+  return modem;
+}
+
+uint32_t LoRaCom::timeOnAirUs(size_t len) {
+  return airtime::timeOnAirUs(modem(), len);
+}
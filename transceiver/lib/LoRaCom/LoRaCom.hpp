@@ -5,7 +5,12 @@
 #include <Arduino.h>
 #include <RadioLib.h>
 
+#include "airtime.hpp"
+#include "dutyCycle.hpp"
 #include "esp_log.h"
+#include "metrics.hpp"
+#include "rxRing.hpp"
+#include "txQueue.hpp"
 
 class LoRaCom {
  public:
@@ -20,8 +25,18 @@ class LoRaCom {
     radio = new RadioType((BUSY == -1) ? new Module(csPin, intPin, RST)
                                        : new Module(csPin, intPin, RST, BUSY));
 
-    int state = static_cast<RadioType *>(radio)->begin(freqMHz, 500, 7, 5, 0x34,
-                                                       power, 20);
+    int state = static_cast<RadioType *>(radio)->begin(
+        freqMHz, BOOT_MODEM.bwHz / 1000.0f, BOOT_MODEM.sf, BOOT_MODEM.cr, 0x34,
+        power, BOOT_MODEM.preamble);
+    m_modem = BOOT_MODEM;
+
+    // PhysicalLayer has no modem setters, so bind the ones of this radio
+    m_setSpreadingFactor = [](PhysicalLayer *radio, uint8_t sf) -> int16_t {
+      return static_cast<RadioType *>(radio)->setSpreadingFactor(sf);
+    };
+    m_setBandwidth = [](PhysicalLayer *radio, float bwKHz) -> int16_t {
+      return static_cast<RadioType *>(radio)->setBandwidth(bwKHz);
+    };
 
     radio->setPacketReceivedAction(RxTxCallback);
     // radio->setPacketSentAction(TxCallback);
@@ -37,32 +52,171 @@ class LoRaCom {
     }
   }
 
-  void sendMessage(const char *msg);  // overloaded function
-  bool getMessage(char *buffer, size_t len);
+  // Queue a packet, it goes out as soon as the radio is free and nothing of
+  // a higher priority is waiting. The handle tells how it went.
+  //
+  // With listen before talk on, every packet waits for a channel activity
+  // detection first. When it finds another packet on air the radio goes back
+  // to receive it, and nothing is sent for 1 to 2^n airtimes of the packet,
+  // picked at random, n being its busy scans so far (at most
+  // BACKOFF_MAX_EXP). After CAD_TRIES busy scans it is sent anyway. Sync
+  // packets skip both.
+  //
+  // With a duty cycle limit, a packet also waits for the airtime budget of
+  // its class, see DutyCycle.
+  //
+  // `originUs` is micros() when the data came in over serial, the time until
+  // it is on air goes to metrics::Histogram::SerialToAirUs. 0 if it did not.
+  TxHandle sendMessage(const char *msg,
+                       TxPriority priority = TxPriority::Data);
+  TxHandle sendMessage(const uint8_t *data, size_t len,
+                       TxPriority priority = TxPriority::Data,
+                       uint32_t originUs = 0);
+  TxState txState(TxHandle handle);
+  TxStats txStats();
+  // Oldest received packet or nullptr, valid until popMessage()
+  const RxPacket *peekMessage() { return m_rxRing.front(); }
+  void popMessage() {
+    m_rxRing.pop();
+    metrics::set(metrics::Gauge::RxDepth, m_rxRing.size());
+  }
   int32_t getRssi();
 
+  // Packets dropped because the ring was full, packets with a bad CRC or
+  // failed read, and the most packets ever waiting at once
+  uint32_t rxOverflows() const { return m_rxRing.overflows(); }
+  uint32_t rxErrors() const { return m_rxErrors; }
+  uint32_t rxHighWater() const { return m_rxRing.highWater(); }
+
   bool setOutGain(int8_t gain);
   bool setFrequency(float freqMHz);
 
-  // not supported for the physical layer
-  bool setSpreadingFactor(uint8_t spreadingFactor) { return false; }
-  bool setBandwidth(float bandwidth) { return false; }
+  // The radio is put in standby for the change and listens again afterwards.
+  // False while a packet is on air, try again once it is done.
+  bool setSpreadingFactor(uint8_t spreadingFactor);
+  bool setBandwidth(float bandwidthKHz);
+  // All three in one go, for ADR
+  bool setModem(uint8_t spreadingFactor, float bandwidthKHz, int8_t powerDbm);
+  // Of a packet of `len` bytes at the current settings
+  uint32_t timeOnAirUs(size_t len);
+
+  // Share of the time the radio may transmit, in permille, 0 for no limit.
+  // There is none at 915 MHz, EU868 sub-bands allow 1 % (10) or 0.1 % (1).
+  void setDutyCycle(uint16_t permille);
+  AirtimeStats airtimeStats();
+
+  // Longest a packet may be on air, 0 for no limit, which is the default. Only
+  // frequency hopping channels have one, US915 below 500 kHz allows DWELL_US.
+  // Commander refuses modem settings a full packet would not fit, so nothing
+  // is checked per packet. False if the current settings already break it.
+  bool setDwellLimit(uint32_t limitUs);
+  uint32_t dwellLimitUs() const { return m_dwellLimitUs; }
+  // Whether a full packet at `modem` fits the limit, true without one
+  bool fitsDwell(const airtime::Modem &modem) const;
+  // What the packets go out with right now
+  airtime::Modem modem();
 
   bool checkTxMode();
 
+  // Task notified (xTaskNotifyGive) from the DIO1 interrupt whenever a packet
+  // was added to the receive ring
+  void setReceiveTask(TaskHandle_t task) { m_rxTask = task; }
+
+  // The object the DIO1 interrupt is handed to, the last one constructed. A
+  // host process running several nodes points it at the node that runs.
+  static LoRaCom *interruptTarget() { return instance; }
+  static void setInterruptTarget(LoRaCom *lora) { instance = lora; }
+
+  void setListenBeforeTalk(bool enabled) { m_listenBeforeTalk = enabled; }
+  bool listenBeforeTalk() const { return m_listenBeforeTalk; }
+
+  // Decides when a packet may start, for TDMA: microseconds to wait, 0 for
+  // now. Called in task or DIO1 context inside a critical section. Of the
+  // packets first in their class, the highest priority one it lets go now
+  // is sent.
+  typedef uint32_t (*TxGate)(void *context, TxPriority priority,
+                             uint32_t airtimeUs, uint32_t nowUs);
+  void setTxGate(TxGate gate, void *context);
+
+  // Starts what waited for a backoff or the gate once it may go, runs
+  // forever, see Control::begin()
+  void backoffTask();
+
+  // What begin() sets: SF7, 500 kHz, 4/5, 20 symbols of preamble
+  static constexpr airtime::Modem BOOT_MODEM{7, 500'000, 5, 20};
+  // US915 dwell time, what "dwell on" sets
+  static constexpr uint32_t DWELL_US = 400'000;
+
+  static constexpr uint8_t CAD_TRIES = 8;
+  static constexpr uint8_t BACKOFF_MAX_EXP = 5;
+
  private:
   PhysicalLayer *radio;
   inline static LoRaCom *instance = nullptr;
 
   bool radioInitialised = false;
 
-  volatile bool RxFlag = false;
-
   volatile bool TxMode = false;
 
+  static constexpr size_t RX_RING_SLOTS = 8;
+  RxRing<RX_RING_SLOTS> m_rxRing;
+  volatile uint32_t m_rxErrors = 0;
+  TaskHandle_t m_rxTask = nullptr;
+
+  static constexpr size_t TX_QUEUE_SLOTS = 8;
+  TxQueue<TX_QUEUE_SLOTS> m_txQueue;
+  TxHandle m_txCurrent;  // packet on air while TxMode is set
+  TxPacket *m_txPacket = nullptr;  // and its slot
+  portMUX_TYPE m_txMux = portMUX_INITIALIZER_UNLOCKED;
+
+  // Listen before talk. TxMode stays set during the scan, so nothing else
+  // takes the radio. A busy channel puts m_txCurrent back at the head of its
+  // class, and only Sync packets go out until m_backoffUntilUs, with the
+  // radio in receive meanwhile.
+  volatile bool m_listenBeforeTalk = true;
+  volatile bool m_cadMode = false;  // scanning for m_txCurrent
+  bool m_backingOff = false;
+  uint32_t m_backoffUntilUs = 0;
+  uint32_t m_cadBusy = 0;
+  uint32_t m_cadForced = 0;
+  uint64_t m_backoffTotalUs = 0;
+
+  // Settings the packets go out with, changed only while m_configuring
+  airtime::Modem m_modem = BOOT_MODEM;
+  DutyCycle m_dutyCycle;
+  uint32_t m_dwellLimitUs = 0;
+
+  TxGate m_txGate = nullptr;
+  void *m_txGateContext = nullptr;
+
+  // Set when queued packets wait for the backoff or the gate, the earliest
+  // may go at m_wakeAtUs
+  bool m_waiting = false;
+  uint32_t m_wakeAtUs = 0;
+  TaskHandle_t m_backoffTask = nullptr;
+
+  // Set while the modem is reconfigured, keeps startNextTx() and
+  // receivePacket() off the radio
+  volatile bool m_configuring = false;
+  int16_t (*m_setSpreadingFactor)(PhysicalLayer *, uint8_t) = nullptr;
+  int16_t (*m_setBandwidth)(PhysicalLayer *, float) = nullptr;
+
   static void RxTxCallback(void);
+  void receivePacket();  // DIO1 context
+  bool startNextTx();    // task or DIO1 context
+  bool transmit();       // m_txCurrent once claimed, task or DIO1 context
+  void channelScanned();  // DIO1 context
+  void wakeBackoffTask(bool fromIsr);
+  bool beginConfigure();
+  void setModemSf(uint8_t spreadingFactor);
+  void setModemBw(float bandwidthKHz);
+  void endConfigure();
 
   static constexpr const char *TAG = "LORA_COMM";
 };
 
+static_assert(airtime::timeOnAirUs(LoRaCom::BOOT_MODEM, TxPacket::MAX_LEN) <=
+                  LoRaCom::DWELL_US,
+              "A full packet must fit the dwell time, so it can be turned on");
+
 #endif
\ No newline at end of file
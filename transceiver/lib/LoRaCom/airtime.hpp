@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Time on air of a LoRa packet, SX126x datasheet section 6.1.4. Everything is
+// constexpr, so a fixed profile costs nothing at run time:
+//
+//   static_assert(airtime::timeOnAirUs(LoRaCom::BOOT_MODEM, 255) < 400'000);
+//
+// Integer math only, the result is rounded up to the next microsecond.
+
+namespace airtime {
+
+struct Modem {
+  uint8_t sf = 7;
+  uint32_t bwHz = 500'000;
+  uint8_t cr = 5;  // 4/cr, 5..8 like RadioLib
+  uint16_t preamble = 8;
+  bool implicitHeader = false;
+  bool crc = true;
+};
+
+// RadioLib takes the bandwidth in kHz, 7.8 kHz being 7812.5 Hz is close
+// enough at that bandwidth
+constexpr uint32_t bandwidthHz(float bwKHz) {
+  return static_cast<uint32_t>(bwKHz * 1000.0f + 0.5f);
+}
+
+// RadioLib turns low data rate optimisation on for symbols of 16 ms or more
+constexpr bool lowDataRate(const Modem &modem) {
+  return (uint64_t{1} << modem.sf) * 1000 >= uint64_t{16} * modem.bwHz;
+}
+
+constexpr uint32_t symbolUs(const Modem &modem) {
+  return static_cast<uint32_t>((uint64_t{1'000'000} << modem.sf) /
+                               modem.bwHz);
+}
+
+// Preamble, sync word and the payload symbols, in quarter symbols as the
+// preamble ends on one
+constexpr uint32_t quarterSymbols(const Modem &modem, size_t len) {
+  const int32_t sf = modem.sf;
+  int32_t bits = 8 * static_cast<int32_t>(len) + (modem.crc ? 16 : 0) -
+                 4 * sf + (modem.implicitHeader ? 0 : 20);
+  int32_t bitsPerSymbol = 4 * sf;
+  uint32_t overhead = 4 * modem.preamble + 25 + 32;  // + 6.25 + 8
+  if (sf >= 7) {
+    bits += 8;
+    if (lowDataRate(modem)) bitsPerSymbol = 4 * (sf - 2);
+    overhead = 4 * modem.preamble + 17 + 32;  // + 4.25 + 8
+  }
+  uint32_t blocks = bits > 0 ? (bits + bitsPerSymbol - 1) / bitsPerSymbol : 0;
+  return overhead + 4 * blocks * modem.cr;
+}
+
+// Saturates at UINT32_MAX, about 71 minutes, which only the longest
+// preambles at the slowest rates reach
+constexpr uint32_t timeOnAirUs(const Modem &modem, size_t len) {
+  uint64_t scaled = (uint64_t{quarterSymbols(modem, len)} * 1'000'000)
+                    << modem.sf;
+  uint64_t divisor = uint64_t{4} * modem.bwHz;
+  uint64_t us = (scaled + divisor - 1) / divisor;
+  return us < UINT32_MAX ? static_cast<uint32_t>(us) : UINT32_MAX;
+}
+
+}  // namespace airtime
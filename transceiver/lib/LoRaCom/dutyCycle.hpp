@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "txQueue.hpp"
+
+// Airtime budget for regional duty cycle limits, one token bucket per
+// priority class.
+//
+// With a limit of `permille`, a class may keep the channel busy for
+// permille / 1000 * SHARE_PERCENT / 100 of the time. Its bucket fills at that
+// rate up to WINDOW_S worth of it, and every packet takes its time on air out
+// when it starts. A packet waits until its bucket holds enough, or until the
+// bucket is full for one that is longer than the whole bucket. What one class
+// leaves unused is not lent to the others, so a busy class can not starve
+// the rest.
+//
+// Time on air is counted per class even without a limit. Not thread safe,
+// LoRaCom guards it with a critical section.
+
+struct AirtimeStats {
+  uint16_t permille = 0;  // 0: no limit
+  uint64_t usedUs[TX_PRIORITIES] = {};      // time on air since boot
+  uint32_t remainingUs[TX_PRIORITIES] = {};  // budget left now
+  uint32_t deferred[TX_PRIORITIES] = {};     // packets that had to wait
+};
+
+inline const char *priorityName(TxPriority priority) {
+  static const char *const NAMES[TX_PRIORITIES] = {"sync", "command", "data",
+                                                   "status"};
+  return NAMES[static_cast<size_t>(priority)];
+}
+
+class DutyCycle {
+ public:
+  static constexpr uint32_t WINDOW_S = 60;  // bucket size in time at the rate
+  // Of the budget, per class in TxPriority order: Sync, Command, Data, Status
+  static constexpr uint8_t SHARE_PERCENT[TX_PRIORITIES] = {10, 20, 50, 20};
+
+  // 0 lifts the limit, the buckets start full
+  void setLimit(uint16_t permille, uint32_t nowUs) {
+    m_permille = permille;
+    m_refilledUs = nowUs;
+    for (size_t p = 0; p < TX_PRIORITIES; p++) m_tokens[p] = capacity(p);
+  }
+  uint16_t limit() const { return m_permille; }
+
+  // Microseconds until a packet of `airtimeUs` fits the budget, 0 for now
+  uint32_t waitUs(TxPriority priority, uint32_t airtimeUs, uint32_t nowUs) {
+    if (m_permille == 0) return 0;
+    refill(nowUs);
+    size_t p = static_cast<size_t>(priority);
+    int64_t need = static_cast<int64_t>(airtimeUs) * SCALE;
+    int64_t full = capacity(p);
+    if (m_tokens[p] >= std::min(need, full)) return 0;
+    int64_t rate = rateOf(p);
+    return static_cast<uint32_t>(
+        (std::min(need, full) - m_tokens[p] + rate - 1) / rate);
+  }
+
+  void defer(TxPriority priority) {
+    m_deferred[static_cast<size_t>(priority)]++;
+  }
+
+  // A packet of that class started
+  void charge(TxPriority priority, uint32_t airtimeUs, uint32_t nowUs) {
+    size_t p = static_cast<size_t>(priority);
+    m_usedUs[p] += airtimeUs;
+    if (m_permille == 0) return;
+    refill(nowUs);
+    m_tokens[p] -= static_cast<int64_t>(airtimeUs) * SCALE;
+  }
+
+  AirtimeStats stats(uint32_t nowUs) {
+    if (m_permille != 0) refill(nowUs);
+    AirtimeStats stats;
+    stats.permille = m_permille;
+    for (size_t p = 0; p < TX_PRIORITIES; p++) {
+      stats.usedUs[p] = m_usedUs[p];
+      stats.remainingUs[p] =
+          m_permille == 0 ? UINT32_MAX
+                          : static_cast<uint32_t>(
+                                std::max<int64_t>(m_tokens[p], 0) / SCALE);
+      stats.deferred[p] = m_deferred[p];
+    }
+    return stats;
+  }
+
+ private:
+  // Tokens are microseconds of airtime times SCALE, so the rate of a class
+  // is permille * percent per microsecond
+  static constexpr int64_t SCALE = 100'000;
+
+  int64_t rateOf(size_t p) const {
+    return static_cast<int64_t>(m_permille) * SHARE_PERCENT[p];
+  }
+  int64_t capacity(size_t p) const {
+    return int64_t{WINDOW_S} * 1'000'000 * rateOf(p);
+  }
+
+  void refill(uint32_t nowUs) {
+    uint32_t elapsedUs = nowUs - m_refilledUs;
+    m_refilledUs = nowUs;
+    for (size_t p = 0; p < TX_PRIORITIES; p++) {
+      m_tokens[p] = std::min(m_tokens[p] + elapsedUs * rateOf(p), capacity(p));
+    }
+  }
+
+  uint16_t m_permille = 0;
+  uint32_t m_refilledUs = 0;
+  int64_t m_tokens[TX_PRIORITIES] = {};  // may go below 0 for a long packet
+  uint64_t m_usedUs[TX_PRIORITIES] = {};
+  uint32_t m_deferred[TX_PRIORITIES] = {};
+};
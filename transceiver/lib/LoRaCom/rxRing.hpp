@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// One received packet, filled straight from the radio FIFO
+struct RxPacket {
+  static constexpr size_t MAX_LEN = 255;  // SX126x FIFO
+
+  uint8_t data[MAX_LEN];
+  uint8_t len;
+  int16_t rssi;          // dBm
+  float snr;             // dB
+  uint32_t timestampUs;  // micros() when DIO1 fired
+};
+
+// Lock-free single producer (DIO1 interrupt) / single consumer (LoRa task)
+// ring of packet slots. The producer fills a slot in place and publishes it,
+// the consumer reads it in place and releases it, so packets are never
+// copied after leaving the radio.
+//
+// head and tail run freely and wrap at 2^32, Capacity must be a power of two.
+template <size_t Capacity>
+class RxRing {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+ public:
+  // ----- Producer -----
+  // Slot to fill, nullptr (and an overflow counted) when the ring is full
+  RxPacket *beginWrite() {
+    uint32_t head = m_head.load(std::memory_order_relaxed);
+    uint32_t tail = m_tail.load(std::memory_order_acquire);
+    if (head - tail == Capacity) {
+      m_overflows.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    return &m_slots[head & (Capacity - 1)];
+  }
+
+  // Publish the slot returned by beginWrite()
+  void commitWrite() {
+    uint32_t head = m_head.load(std::memory_order_relaxed) + 1;
+    m_head.store(head, std::memory_order_release);
+
+    uint32_t used = head - m_tail.load(std::memory_order_relaxed);
+    if (used > m_highWater.load(std::memory_order_relaxed)) {
+      m_highWater.store(used, std::memory_order_relaxed);
+    }
+  }
+
+  // ----- Consumer -----
+  // Oldest packet, nullptr if empty. Stays valid until pop().
+  const RxPacket *front() const {
+    uint32_t tail = m_tail.load(std::memory_order_relaxed);
+    if (m_head.load(std::memory_order_acquire) == tail) return nullptr;
+    return &m_slots[tail & (Capacity - 1)];
+  }
+
+  void pop() {
+    uint32_t tail = m_tail.load(std::memory_order_relaxed);
+    if (m_head.load(std::memory_order_acquire) == tail) return;
+    m_tail.store(tail + 1, std::memory_order_release);
+  }
+
+  // ----- Statistics -----
+  size_t size() const {
+    return m_head.load(std::memory_order_acquire) -
+           m_tail.load(std::memory_order_acquire);
+  }
+  static constexpr size_t capacity() { return Capacity; }
+  uint32_t overflows() const {
+    return m_overflows.load(std::memory_order_relaxed);
+  }
+  uint32_t highWater() const {
+    return m_highWater.load(std::memory_order_relaxed);
+  }
+
+ private:
+  RxPacket m_slots[Capacity];
+  std::atomic<uint32_t> m_head{0};  // written by the producer only
+  std::atomic<uint32_t> m_tail{0};  // written by the consumer only
+  std::atomic<uint32_t> m_overflows{0};
+  std::atomic<uint32_t> m_highWater{0};
+};
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Priority classes, lower value goes out first
+enum class TxPriority : uint8_t {
+  Sync = 0,  // TDMA superframe start, goes out at its exact time
+  Command = 1,
+  Data = 2,
+  Status = 3,
+};
+
+constexpr size_t TX_PRIORITIES = 4;
+
+enum class TxState : uint8_t {
+  Unknown,  // invalid handle, or the slot was reused for a later packet
+  Queued,
+  Sending,
+  Done,
+  Failed,   // the radio refused or did not finish the transmission
+  Dropped,  // queue full, or evicted by a higher priority packet
+};
+
+// Returned by LoRaCom::sendMessage() to check on a packet later
+struct TxHandle {
+  static constexpr uint8_t NONE = 0xFF;
+  static constexpr uint8_t DROPPED = 0xFE;  // not queued, reads as Dropped
+
+  uint8_t slot = NONE;
+  uint8_t generation = 0;
+
+  // Refers to a queued packet
+  bool valid() const { return slot < DROPPED; }
+};
+
+struct TxPacket {
+  static constexpr size_t MAX_LEN = 255;  // SX126x FIFO
+
+  uint8_t data[MAX_LEN];
+  uint8_t len = 0;
+  TxPriority priority = TxPriority::Data;
+  TxState state = TxState::Unknown;
+  uint8_t generation = 0;
+  // The packet before this one was evicted, its handle reads as Dropped
+  bool evicted = false;
+  uint32_t queuedUs = 0;  // micros() when queued
+  uint32_t originUs = 0;  // micros() when its data came in, 0 if unknown
+  uint8_t cadTries = 0;   // busy channel scans so far, kept by LoRaCom
+  bool deferred = false;  // waited for the airtime budget, kept by LoRaCom
+};
+
+struct TxStats {
+  uint32_t queued = 0;
+  uint32_t started = 0;
+  uint32_t sent = 0;
+  uint32_t failed = 0;
+  uint32_t dropped = 0;
+  uint32_t depth = 0;     // packets waiting right now
+  uint32_t maxDepth = 0;  // most packets ever waiting
+  uint64_t waitTotalUs = 0;  // queue -> radio, over all started packets
+  uint32_t waitMaxUs = 0;
+  // Listen before talk, filled in by LoRaCom
+  uint32_t cadBusy = 0;         // channel scans that found a packet on air
+  uint32_t cadForced = 0;       // packets sent anyway after LoRaCom::CAD_TRIES
+  uint64_t backoffTotalUs = 0;  // waited after a busy channel
+};
+
+// Fixed pool of packet slots with one FIFO per priority class. Not thread
+// safe, LoRaCom guards it with a critical section.
+//
+// Finished slots keep their final state until they are reused. Slots are
+// handed out round robin so the result of a packet stays readable through
+// its handle for as long as possible. A packet evicted for a higher priority
+// one stays Dropped until its slot is reused once more.
+template <size_t Slots>
+class TxQueue {
+  static_assert(Slots > 0 && Slots < TxHandle::DROPPED,
+                "Slots must fit a TxHandle");
+
+ public:
+  TxHandle push(const uint8_t *data, size_t len, TxPriority priority,
+                uint32_t nowUs, uint32_t originUs = 0) {
+    if (len == 0 || len > TxPacket::MAX_LEN) {
+      m_stats.dropped++;
+      return TxHandle{TxHandle::DROPPED, 0};
+    }
+
+    bool evicted = false;
+    int slot = freeSlot();
+    if (slot < 0) {
+      slot = evictBelow(priority);
+      evicted = slot >= 0;
+    }
+    if (slot < 0) {
+      m_stats.dropped++;
+      return TxHandle{TxHandle::DROPPED, 0};
+    }
+
+    TxPacket &packet = m_slots[slot];
+    packet.evicted = evicted;
+    memcpy(packet.data, data, len);
+    packet.len = static_cast<uint8_t>(len);
+    packet.priority = priority;
+    packet.state = TxState::Queued;
+    packet.generation++;
+    packet.queuedUs = nowUs;
+    packet.originUs = originUs;
+    packet.cadTries = 0;
+    packet.deferred = false;
+
+    Fifo &fifo = m_fifos[static_cast<size_t>(priority)];
+    fifo.slots[(fifo.head + fifo.count) % Slots] = static_cast<uint8_t>(slot);
+    fifo.count++;
+
+    m_stats.queued++;
+    m_stats.depth++;
+    if (m_stats.depth > m_stats.maxDepth) m_stats.maxDepth = m_stats.depth;
+    return TxHandle{static_cast<uint8_t>(slot), packet.generation};
+  }
+
+  // Highest priority packet, marked Sending. nullptr when empty.
+  TxPacket *pop(uint32_t nowUs, TxHandle *handle) {
+    for (size_t p = 0; p < TX_PRIORITIES; p++) {
+      TxPacket *packet = pop(static_cast<TxPriority>(p), nowUs, handle);
+      if (packet != nullptr) return packet;
+    }
+    return nullptr;
+  }
+
+  // Oldest packet of one class, marked Sending. nullptr when there is none.
+  TxPacket *pop(TxPriority priority, uint32_t nowUs, TxHandle *handle) {
+    Fifo &fifo = m_fifos[static_cast<size_t>(priority)];
+    if (fifo.count == 0) return nullptr;
+    uint8_t slot = fifo.slots[fifo.head];
+    fifo.head = (fifo.head + 1) % Slots;
+    fifo.count--;
+    m_stats.depth--;
+
+    TxPacket &packet = m_slots[slot];
+    packet.state = TxState::Sending;
+    if (packet.cadTries == 0) {  // not back from requeue()
+      uint32_t waitUs = nowUs - packet.queuedUs;
+      m_stats.started++;
+      m_stats.waitTotalUs += waitUs;
+      if (waitUs > m_stats.waitMaxUs) m_stats.waitMaxUs = waitUs;
+    }
+
+    *handle = TxHandle{slot, packet.generation};
+    return &packet;
+  }
+
+  // Next packet pop() would take of that class, nullptr when there is none
+  const TxPacket *front(TxPriority priority) const {
+    const Fifo &fifo = m_fifos[static_cast<size_t>(priority)];
+    return fifo.count == 0 ? nullptr : &m_slots[fifo.slots[fifo.head]];
+  }
+  TxPacket *front(TxPriority priority) {
+    Fifo &fifo = m_fifos[static_cast<size_t>(priority)];
+    return fifo.count == 0 ? nullptr : &m_slots[fifo.slots[fifo.head]];
+  }
+
+  // Puts a packet that could not go out yet back at the head of its class
+  void requeue(TxHandle handle) {
+    if (state(handle) != TxState::Sending) return;
+    TxPacket &packet = m_slots[handle.slot];
+    Fifo &fifo = m_fifos[static_cast<size_t>(packet.priority)];
+    fifo.head = (fifo.head + Slots - 1) % Slots;
+    fifo.slots[fifo.head] = handle.slot;
+    fifo.count++;
+    m_stats.depth++;
+    packet.state = TxState::Queued;
+  }
+
+  void finish(TxHandle handle, bool ok) {
+    if (state(handle) != TxState::Sending) return;
+    m_slots[handle.slot].state = ok ? TxState::Done : TxState::Failed;
+    if (ok) {
+      m_stats.sent++;
+    } else {
+      m_stats.failed++;
+    }
+  }
+
+  TxState state(TxHandle handle) const {
+    if (handle.slot == TxHandle::DROPPED) return TxState::Dropped;
+    if (!handle.valid() || handle.slot >= Slots) return TxState::Unknown;
+    const TxPacket &packet = m_slots[handle.slot];
+    if (packet.generation == handle.generation) return packet.state;
+    if (packet.evicted &&
+        static_cast<uint8_t>(packet.generation - 1) == handle.generation) {
+      return TxState::Dropped;
+    }
+    return TxState::Unknown;
+  }
+
+  size_t depth() const { return m_stats.depth; }
+  const TxStats &stats() const { return m_stats; }
+
+ private:
+  struct Fifo {
+    uint8_t slots[Slots];
+    size_t head = 0;
+    size_t count = 0;
+  };
+
+  bool inUse(const TxPacket &packet) const {
+    return packet.state == TxState::Queued || packet.state == TxState::Sending;
+  }
+
+  int freeSlot() {
+    for (size_t i = 0; i < Slots; i++) {
+      size_t slot = (m_nextSlot + i) % Slots;
+      if (!inUse(m_slots[slot])) {
+        m_nextSlot = (slot + 1) % Slots;
+        return static_cast<int>(slot);
+      }
+    }
+    return -1;
+  }
+
+  // Drop the oldest packet of the lowest class below `priority`
+  int evictBelow(TxPriority priority) {
+    for (size_t p = TX_PRIORITIES; p-- > static_cast<size_t>(priority) + 1;) {
+      Fifo &fifo = m_fifos[p];
+      if (fifo.count == 0) continue;
+      uint8_t slot = fifo.slots[fifo.head];
+      fifo.head = (fifo.head + 1) % Slots;
+      fifo.count--;
+      m_stats.depth--;
+      m_stats.dropped++;
+      m_slots[slot].state = TxState::Dropped;
+      return slot;
+    }
+    return -1;
+  }
+
+  TxPacket m_slots[Slots];
+  Fifo m_fifos[TX_PRIORITIES];
+  size_t m_nextSlot = 0;
+  TxStats m_stats;
+};
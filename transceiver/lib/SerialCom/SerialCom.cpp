@@ -1,5 +1,10 @@
 #include "SerialCom.hpp"
 
+#include <algorithm>
+#include <cstring>
+
+#include "metrics.hpp"
+
 SerialCom::SerialCom() {}
 
 void SerialCom::init(unsigned long baud) {
@@ -8,32 +13,130 @@ void SerialCom::init(unsigned long baud) {
   ESP_LOGI(TAG, "Serial communication initialised at %lu baud", m_baud);
 }
 
-bool SerialCom::getData(char *buffer, const size_t maxBuffer, int *_rxIndex) {
-  // Read all available characters
-  while (COMM_INTERFACE.available()) {
-    char c = COMM_INTERFACE.read();
+const char *SerialCom::readLine(size_t *len) {
+  while (true) {
+    size_t end;
+    if (!findLineEnd(&end)) {
+      size_t pending = m_head - m_tail;
+      if (m_discarding || pending > MAX_LINE) {
+        // Too long for a command, drop it up to the next line ending
+        if (!m_discarding) {
+          m_stats.droppedLines++;
+          metrics::add(metrics::Counter::SerialDropped);
+          ESP_LOGW(TAG, "Dropping line longer than %u bytes",
+                   static_cast<unsigned>(MAX_LINE));
+        }
+        m_discarding = true;
+        m_stats.droppedBytes += pending;
+        m_tail = m_scan = m_head;
+      }
+      if (fill() == 0) return nullptr;
+      continue;
+    }
 
-    // If it's a newline (end of command), handle the buffer
-    if (c == '\n' || c == '\r') {
-      // Null-terminate the buffer and process
-      buffer[*_rxIndex] = '\0';
-      return true;
-    } else {
-      // Add the character to the buffer (with overflow check)
-      if (*_rxIndex < (maxBuffer - 1)) {
-        buffer[(*_rxIndex)++] = c;
-      } else {
-        // Buffer overflow case, reset it
-        *_rxIndex = 0;
-        ESP_LOGE(TAG, "Buffer overflow!");
-        break;
+    size_t start = m_tail;
+    size_t length = end - start;
+    m_tail = m_scan = end + 1;
+
+    if (m_discarding || length > MAX_LINE) {
+      if (!m_discarding) {
+        m_stats.droppedLines++;
+        metrics::add(metrics::Counter::SerialDropped);
+        ESP_LOGW(TAG, "Dropping line longer than %u bytes",
+                 static_cast<unsigned>(MAX_LINE));
       }
+      m_stats.droppedBytes += length;
+      m_discarding = false;
+      continue;
     }
+    if (length == 0) continue;  // "\r\n" or blank line
+
+    const char *line;
+    size_t offset = start & (RX_RING_SIZE - 1);
+    if (offset + length < RX_RING_SIZE) {
+      // Terminate in place over the line ending
+      m_ring[end & (RX_RING_SIZE - 1)] = '\0';
+      line = &m_ring[offset];
+    } else {
+      size_t first = RX_RING_SIZE - offset;
+      memcpy(m_lineCopy, &m_ring[offset], first);
+      memcpy(m_lineCopy + first, m_ring, length - first);
+      m_lineCopy[length] = '\0';
+      line = m_lineCopy;
+    }
+
+    m_stats.lines++;
+    metrics::add(metrics::Counter::SerialLines);
+    if (len) *len = length;
+    return line;
+  }
+}
+
+// Look for '\n' or '\r' between m_scan and m_head, memchr does the heavy
+// lifting on each contiguous part of the ring
+bool SerialCom::findLineEnd(size_t *end) {
+  while (m_scan != m_head) {
+    size_t offset = m_scan & (RX_RING_SIZE - 1);
+    size_t count = std::min(m_head - m_scan, RX_RING_SIZE - offset);
+    const char *chunk = &m_ring[offset];
+
+    const char *lf = static_cast<const char *>(memchr(chunk, '\n', count));
+    size_t limit = lf ? static_cast<size_t>(lf - chunk) : count;
+    const char *cr = static_cast<const char *>(memchr(chunk, '\r', limit));
+    const char *hit = cr ? cr : lf;
+    if (hit) {
+      *end = m_scan + (hit - chunk);
+      return true;
+    }
+    m_scan += count;
   }
   return false;
 }
 
+// Bulk read whatever the driver holds into the free part of the ring
+size_t SerialCom::fill() {
+  size_t total = 0;
+  while (true) {
+    size_t space = RX_RING_SIZE - (m_head - m_tail);
+    size_t available = COMM_INTERFACE.available();
+    if (space == 0 || available == 0) break;
+
+    size_t offset = m_head & (RX_RING_SIZE - 1);
+    size_t count = std::min({space, available, RX_RING_SIZE - offset});
+    size_t n = COMM_INTERFACE.read(reinterpret_cast<uint8_t *>(&m_ring[offset]),
+                                   count);
+    if (n == 0) break;
+    m_head += n;
+    total += n;
+  }
+  m_stats.bytesIn += total;
+  return total;
+}
+
 void SerialCom::sendData(const char *data) {
   COMM_INTERFACE.print(data);
   // ESP_LOGI(TAG, "Sent: %s", data);
-}
\ No newline at end of file
+}
+
+void SerialCom::sendData(const char *data, size_t len) {
+  COMM_INTERFACE.write(reinterpret_cast<const uint8_t *>(data), len);
+}
+
+bool SerialCom::connected() { return static_cast<bool>(COMM_INTERFACE); }
+
+void SerialCom::onReceive(std::function<void()> callback) {
+  m_onReceive = std::move(callback);
+#if ARDUINO_USB_MODE && ARDUINO_USB_CDC_ON_BOOT
+  // HWCDC only takes a plain event handler, no context pointer
+  instance = this;
+  COMM_INTERFACE.onEvent(
+      ARDUINO_HW_CDC_RX_EVENT,
+      [](void *, esp_event_base_t, int32_t, void *) {
+        if (instance && instance->m_onReceive) instance->m_onReceive();
+      });
+#else
+  COMM_INTERFACE.onReceive([this] {
+    if (m_onReceive) m_onReceive();
+  });
+#endif
+}
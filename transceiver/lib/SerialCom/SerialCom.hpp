@@ -2,22 +2,65 @@
 
 #include <Arduino.h>
 
+#include <functional>
+
 #include "esp_log.h"
 
 #define COMM_INTERFACE Serial
 
+struct SerialStats {
+  uint32_t bytesIn = 0;       // bytes taken from the driver
+  uint32_t lines = 0;         // lines handed out by readLine()
+  uint32_t droppedLines = 0;  // longer than MAX_LINE
+  uint32_t droppedBytes = 0;  // bytes of the dropped lines
+};
+
 class SerialCom {
  public:
+  static constexpr size_t MAX_LINE = 255;  // longer lines are dropped
+
   SerialCom();
 
   void init(unsigned long baud = 115200);
 
-  bool getData(char *buffer, const size_t bufferSize, int *_rxIndex);
+  // Next complete line, without its line ending and null terminated, or
+  // nullptr if none is buffered yet. The line stays valid until the next
+  // call. Bytes are only taken from the driver while no complete line is
+  // waiting here, so a slow consumer leaves them in the driver buffer (and
+  // USB CDC then holds off the host) instead of losing them.
+  const char *readLine(size_t *len = nullptr);
+  const SerialStats &stats() const { return m_stats; }
 
   void sendData(const char *data);
+  void sendData(const char *data, size_t len);
+
+  // True while a host has the port open (USB CDC), always true on a UART
+  bool connected();
+
+  // Called by the serial driver (not an ISR) whenever new bytes arrive
+  void onReceive(std::function<void()> callback);
 
  private:
   unsigned long m_baud;
 
+  // Bulk reads land in a ring. m_tail is the start of the current line,
+  // m_scan where the end of line search resumes, m_head the end of the
+  // data. All three run freely and are masked on access.
+  static constexpr size_t RX_RING_SIZE = 1024;  // power of two
+  static_assert((RX_RING_SIZE & (RX_RING_SIZE - 1)) == 0, "power of two");
+  char m_ring[RX_RING_SIZE];
+  size_t m_head = 0;
+  size_t m_tail = 0;
+  size_t m_scan = 0;
+  bool m_discarding = false;  // inside a line that was too long
+  char m_lineCopy[MAX_LINE + 1];  // for the rare line that wraps the ring
+  SerialStats m_stats;
+
+  bool findLineEnd(size_t *end);
+  size_t fill();
+
+  std::function<void()> m_onReceive;
+  inline static SerialCom *instance = nullptr;  // for the USB CDC event
+
   static constexpr const char *TAG = "SerialCom";
 };
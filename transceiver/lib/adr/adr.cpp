@@ -0,0 +1,387 @@
+#include "adr.hpp"
+
+#include <algorithm>
+
+namespace adr {
+
+namespace {
+
+// Timeouts in status intervals
+constexpr float PEER_TIMEOUT = 6.0f;  // a peer still counts as part of the net
+constexpr float LOST_AFTER = 3.5f;    // a known peer went quiet
+constexpr float FALLBACK_AFTER = 6.0f;  // nobody heard at all, start scanning
+constexpr float SCAN_DWELL = 2.5f;    // per rate while scanning
+
+constexpr uint8_t ORDER_COPIES = 3;
+constexpr uint32_t ORDER_GAP_MS = 200;     // between copies, after the airtime
+constexpr uint32_t SWITCH_SLACK_MS = 300;  // after the last copy
+
+constexpr float SIGMA_PRIOR_DB = 3.0f;  // SNR spread until a link has samples
+constexpr float SIGMA_MIN_DB = 1.0f;
+constexpr uint16_t MIN_SAMPLES = 3;
+constexpr float MAX_OFFSET_DB = 6.0f;   // collisions are not fixed by margin
+constexpr uint16_t MIN_EXPECTED = 20;   // frames per loss measurement
+constexpr float MAX_LOAD = TARGET_LOSS / 2;  // pure ALOHA loses about twice
+                                             // the load to collisions
+constexpr float NOISE_FIGURE_DB = 6.0f;
+constexpr float SNR_RELIABLE_DB = 5.0f;  // SX126x SNR saturates above this
+
+bool reached(uint32_t nowMs, uint32_t atMs) {
+  return static_cast<int32_t>(nowMs - atMs) >= 0;
+}
+
+// Only the order of epochs matters, they wrap
+bool newer(uint8_t a, uint8_t b) { return static_cast<int8_t>(a - b) > 0; }
+
+float noiseFloorDbm(uint8_t rate) {
+  return -174.0f + 10.0f * std::log10(RATES[rate].bwKHz * 1000.0f) +
+         NOISE_FIGURE_DB;
+}
+
+}  // namespace
+
+Adr::Adr(uint16_t nodeId, uint32_t beaconMs)
+    : m_nodeId(nodeId), m_beaconMs(beaconMs) {}
+
+void Adr::setEnabled(bool enabled, uint32_t nowMs) {
+  m_enabled = enabled;
+  m_pending = false;
+  m_copiesLeft = 0;
+  m_scanning = false;
+  m_lastHeardMs = nowMs;
+  m_lastDecisionMs = nowMs;
+}
+
+void Adr::setSlowestRate(uint8_t rate) {
+  m_slowestRate = std::min<uint8_t>(rate, RATE_COUNT - 1);
+}
+
+/* ================================= INPUT ================================= */
+
+void Adr::onFrame(uint16_t from, uint16_t seq, float rssi, float snr,
+                  uint32_t nowMs) {
+  m_lastHeardMs = nowMs;
+  m_framesHeard++;
+  m_scanning = false;  // found the network on this rate
+
+  Peer *peer = findOrAdd(from, nowMs);
+  uint16_t gap = seq - peer->lastSeq;
+  if (peer->samples > 0 && gap > 0 && gap < 64) {
+    peer->expected += gap;
+  } else {
+    peer->expected++;  // first frame, or the peer restarted
+  }
+  peer->received++;
+  peer->lastSeq = seq;
+  peer->lastHeardMs = nowMs;
+  peer->lost = false;
+
+  // Above a few dB the reported SNR saturates, the RSSI over the noise floor
+  // keeps going
+  float noiseDbm = noiseFloorDbm(m_setting.rate);
+  float value = snr < SNR_RELIABLE_DB ? snr : std::max(snr, rssi - noiseDbm);
+
+  // Running mean for the first samples, then an exponential one
+  peer->samples++;
+  float alpha = 1.0f / std::min<uint16_t>(peer->samples, 8);
+  float delta = value - peer->snrMean;
+  peer->snrMean += alpha * delta;
+  peer->snrVar = (1.0f - alpha) * (peer->snrVar + alpha * delta * delta);
+}
+
+void Adr::onReport(uint16_t from, const frame::LinkReport &report,
+                   uint32_t nowMs) {
+  Peer *peer = findOrAdd(from, nowMs);
+  peer->report = report;
+  peer->hasReport = true;
+}
+
+void Adr::onOrder(uint16_t from, const frame::RateOrder &order,
+                  uint32_t nowMs) {
+  if (!m_enabled || order.rate > m_slowestRate) return;
+
+  // The newest epoch wins, two coordinators with the same one are settled by
+  // the lower ID
+  const Setting &latest = m_pending ? m_next : m_setting;
+  bool accept = m_scanning || newer(order.epoch, latest.epoch) ||
+                (order.epoch == latest.epoch && from < m_orderFrom &&
+                 m_pending);
+  if (!accept) return;
+
+  m_next.rate = order.rate;
+  m_next.powerDbm = std::clamp(order.powerDbm, POWER_MIN, POWER_MAX);
+  m_next.epoch = order.epoch;
+  m_pending = true;
+  m_switchAtMs = nowMs + order.delayMs;
+  m_orderFrom = from;
+  m_copiesLeft = 0;  // someone else's order replaces ours
+}
+
+/* ================================= OUTPUT ================================ */
+
+frame::LinkReport Adr::report(uint32_t nowMs) {
+  uint32_t expected = 0;
+  uint32_t received = 0;
+  for (const Peer &peer : m_peers) {
+    if (!active(peer, nowMs)) continue;
+    expected += peer.expected;
+    received += std::min(peer.received, peer.expected);
+  }
+
+  // Close the loop on the packet error rate: more margin while the loss is
+  // above target, give it back slowly once it is well below
+  uint8_t lossPercent = 0;
+  if (expected >= MIN_EXPECTED) {
+    float loss = static_cast<float>(expected - received) / expected;
+    lossPercent = static_cast<uint8_t>(loss * 100.0f + 0.5f);
+    if (loss > TARGET_LOSS) {
+      m_offsetDb = std::min(m_offsetDb + 1.0f, MAX_OFFSET_DB);
+    } else if (loss < TARGET_LOSS / 2) {
+      m_offsetDb = std::max(m_offsetDb - 0.5f, 0.0f);
+    }
+    for (Peer &peer : m_peers) {
+      peer.expected = 0;
+      peer.received = 0;
+    }
+  }
+
+  return frame::LinkReport{m_setting.rate, m_setting.epoch, ownExcess(),
+                           lossPercent};
+}
+
+bool Adr::poll(uint32_t nowMs, uint32_t orderAirtimeMs,
+               frame::RateOrder *order) {
+  if (!m_enabled) return false;
+
+  if (m_pending && reached(nowMs, m_switchAtMs)) {
+    m_pending = false;
+    switchTo(m_next, nowMs);
+  }
+
+  // Lost the network: try every rate at full power until a frame comes in
+  uint32_t fallbackMs = static_cast<uint32_t>(FALLBACK_AFTER * m_beaconMs);
+  uint32_t dwellMs = static_cast<uint32_t>(SCAN_DWELL * m_beaconMs);
+  if (!m_scanning && !m_pending && nowMs - m_lastHeardMs > fallbackMs) {
+    m_scanning = true;
+    m_scanSinceMs = nowMs - dwellMs;  // move on right away
+  }
+  if (m_scanning && nowMs - m_scanSinceMs >= dwellMs) {
+    m_scanSinceMs = nowMs;
+    Setting next = m_setting;
+    next.rate = (m_setting.rate + 1) % (m_slowestRate + 1);
+    next.powerDbm = POWER_MAX;
+    switchTo(next, nowMs);
+    m_lastHeardMs = nowMs - fallbackMs;  // keep scanning until a frame
+    return false;
+  }
+  if (m_scanning) return false;
+
+  // Copies of our own order, each with the time left until the switch
+  if (m_copiesLeft > 0 && reached(nowMs, m_nextCopyMs)) {
+    uint32_t left = m_switchAtMs - nowMs;
+    left = left > orderAirtimeMs ? left - orderAirtimeMs : 0;
+    *order = frame::RateOrder{m_next.rate, m_next.powerDbm, m_next.epoch,
+                              static_cast<uint16_t>(std::min<uint32_t>(
+                                  left, UINT16_MAX))};
+    m_copiesLeft--;
+    m_nextCopyMs = nowMs + orderAirtimeMs + ORDER_GAP_MS;
+    return true;
+  }
+
+  if (m_pending || nowMs - m_lastDecisionMs < m_beaconMs) return false;
+
+  // Slowest rate the frames heard, and this node's beacon, still fit in
+  float perSecond = (m_framesHeard + 1) * 1000.0f / (nowMs - m_lastDecisionMs);
+  float baseAirtimeMs = orderAirtimeMs / airtimeFactor(m_setting.rate);
+  uint8_t slowest = 0;
+  while (slowest < m_slowestRate &&
+         perSecond * baseAirtimeMs * airtimeFactor(slowest + 1) / 1000.0f <=
+             MAX_LOAD) {
+    slowest++;
+  }
+  m_lastDecisionMs = nowMs;
+  m_framesHeard = 0;
+
+  Setting next;
+  if (!coordinator(nowMs) || !decide(nowMs, slowest, &next)) return false;
+  m_next = next;
+  m_pending = true;
+  m_orderFrom = m_nodeId;
+  m_switchAtMs = nowMs + ORDER_COPIES * (orderAirtimeMs + ORDER_GAP_MS) +
+                 orderAirtimeMs + SWITCH_SLACK_MS;
+  m_copiesLeft = ORDER_COPIES;
+  m_nextCopyMs = nowMs;
+  return false;  // the first copy goes out on the next tick
+}
+
+/* ============================== DIAGNOSTICS ============================== */
+
+bool Adr::coordinator(uint32_t nowMs) const {
+  for (const Peer &peer : m_peers) {
+    if (active(peer, nowMs) && peer.id < m_nodeId) return false;
+  }
+  return true;
+}
+
+size_t Adr::peers(uint32_t nowMs) const {
+  size_t count = 0;
+  for (const Peer &peer : m_peers) {
+    if (active(peer, nowMs)) count++;
+  }
+  return count;
+}
+
+/* ================================ PRIVATE ================================ */
+
+Adr::Peer *Adr::find(uint16_t id) {
+  for (Peer &peer : m_peers) {
+    if (peer.id == id) return &peer;
+  }
+  return nullptr;
+}
+
+Adr::Peer *Adr::findOrAdd(uint16_t id, uint32_t nowMs) {
+  if (Peer *peer = find(id)) return peer;
+
+  // A free slot, or the one heard from longest ago
+  Peer *slot = &m_peers[0];
+  for (Peer &peer : m_peers) {
+    if (peer.id == 0) {
+      slot = &peer;
+      break;
+    }
+    if (nowMs - peer.lastHeardMs > nowMs - slot->lastHeardMs) slot = &peer;
+  }
+  *slot = Peer();
+  slot->id = id;
+  slot->lastHeardMs = nowMs;
+  return slot;
+}
+
+bool Adr::active(const Peer &peer, uint32_t nowMs) const {
+  return peer.id != 0 && nowMs - peer.lastHeardMs <=
+                             static_cast<uint32_t>(PEER_TIMEOUT * m_beaconMs);
+}
+
+// Weakest link this node hears, in dB above the margin it needs
+int8_t Adr::ownExcess() const {
+  float floorDb = demodFloorDb(RATES[m_setting.rate].sf);
+  float excess = NO_EXCESS;
+  bool any = false;
+  for (const Peer &peer : m_peers) {
+    if (peer.id == 0 || peer.samples == 0) continue;
+    float sigma = peer.samples < MIN_SAMPLES
+                      ? SIGMA_PRIOR_DB
+                      : std::max(std::sqrt(peer.snrVar), SIGMA_MIN_DB);
+    float link = peer.snrMean - TARGET_Z * sigma - floorDb - m_offsetDb;
+    excess = any ? std::min(excess, link) : link;
+    any = true;
+  }
+  if (!any) return NO_EXCESS;
+  return static_cast<int8_t>(std::clamp(std::floor(excess), -127.0f, 127.0f));
+}
+
+void Adr::switchTo(const Setting &setting, uint32_t nowMs) {
+  // Everyone changes power together and the noise floor moves with the
+  // bandwidth, so the SNR of every link shifts by the same known amount
+  float shiftDb = setting.powerDbm - m_setting.powerDbm +
+                  noiseFloorDbm(m_setting.rate) - noiseFloorDbm(setting.rate);
+  for (Peer &peer : m_peers) {
+    peer.snrMean += shiftDb;
+  }
+  m_setting = setting;
+  m_lastHeardMs = nowMs;  // give the new rate time to hear someone
+}
+
+// Coordinator: the rate and power for the whole network, no slower than
+// `slowest`. False to keep the current one.
+bool Adr::decide(uint32_t nowMs, uint8_t slowest, Setting *next) {
+  uint32_t lostMs = static_cast<uint32_t>(LOST_AFTER * m_beaconMs);
+  *next = m_setting;
+  next->epoch = m_setting.epoch + 1;
+
+  // Slower than allowed since the dwell limit came on
+  if (m_setting.rate > m_slowestRate) {
+    next->rate = m_slowestRate;
+    next->powerDbm = POWER_MAX;
+    return true;
+  }
+
+  // A peer that went quiet is most likely out of range of this rate
+  bool lost = false;
+  for (Peer &peer : m_peers) {
+    if (!active(peer, nowMs) || peer.lost) continue;
+    if (nowMs - peer.lastHeardMs > lostMs) {
+      peer.lost = true;
+      lost = true;
+    }
+  }
+  if (lost) {
+    next->rate = std::max(m_setting.rate, std::min<uint8_t>(
+                                              m_setting.rate + 1, slowest));
+    next->powerDbm = POWER_MAX;
+    return *next != m_setting;
+  }
+
+  // Weakest link in the network, from reports made at the current setting.
+  // Missing ones still allow slowing down, not speeding up.
+  int excess = ownExcess();
+  bool complete = excess != NO_EXCESS;
+  bool stale = false;
+  for (const Peer &peer : m_peers) {
+    if (!active(peer, nowMs) || peer.lost) continue;
+    if (!peer.hasReport || peer.report.epoch != m_setting.epoch ||
+        peer.report.excessDb == NO_EXCESS) {
+      complete = false;
+      stale = stale || (peer.hasReport &&
+                        newer(m_setting.epoch, peer.report.epoch));
+      continue;
+    }
+    excess = excess == NO_EXCESS ? peer.report.excessDb
+                                 : std::min<int>(excess, peer.report.excessDb);
+  }
+
+  if (excess != NO_EXCESS) {
+    // Power that puts the weakest link right at its margin, at each rate
+    float current = gainDb(m_setting.rate);
+    auto neededPower = [&](uint8_t rate) {
+      return m_setting.powerDbm - (excess + gainDb(rate) - current);
+    };
+
+    // Fastest rate that closes it at full power. Faster than now needs some
+    // excess to spare, and goes one step at a time.
+    uint8_t rate = slowest;
+    while (rate > 0 && neededPower(rate - 1) <= POWER_MAX) rate--;
+    if (rate < m_setting.rate) {
+      rate = m_setting.rate - 1;
+      if (!complete || neededPower(rate) + HYSTERESIS_DB > POWER_MAX) {
+        rate = m_setting.rate;
+      }
+    }
+
+    // Lowest power for it. More power right away, less only on full
+    // information, with some excess to spare and by a few dB at once.
+    float power = std::ceil(neededPower(rate));
+    if (rate < m_setting.rate) {
+      power = std::ceil(neededPower(rate) + HYSTERESIS_DB);
+    } else if (rate == m_setting.rate && power < m_setting.powerDbm) {
+      power = std::ceil(neededPower(rate) + HYSTERESIS_DB);
+      if (!complete || m_setting.powerDbm - power < HYSTERESIS_DB) {
+        power = m_setting.powerDbm;
+      }
+    }
+    next->rate = rate;
+    next->powerDbm =
+        static_cast<int8_t>(std::clamp<float>(power, POWER_MIN, POWER_MAX));
+    if (*next != m_setting) return true;
+  }
+
+  if (stale) {
+    // Someone missed the last order, repeat it with the same epoch
+    *next = m_setting;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace adr
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "frame.hpp"
+
+// Adaptive data rate for a network that shares one modem profile.
+//
+// Every node can only hear packets sent with its own spreading factor and
+// bandwidth, so the whole network moves between the data rates in RATES
+// together. The loop:
+//
+//   1. Each node measures every peer it hears: SNR (mean and spread) and the
+//      frames it missed, from gaps in the sequence numbers.
+//   2. Its status beacon carries a LinkReport: how many dB its weakest link
+//      has above the margin that keeps the packet error rate at TARGET_LOSS.
+//      That margin is z * spread plus a correction that grows while the
+//      measured loss stays above the target.
+//   3. The node with the lowest ID it has heard of acts as coordinator. It
+//      takes the smallest excess of all fresh reports, picks the fastest rate
+//      that still closes the weakest link at POWER_MAX and then the lowest
+//      power for it, and broadcasts a Rate order a few times.
+//   4. Everyone switches at the time given in the order.
+//
+// Slower rates are only used while the traffic heard still fits: on a shared
+// channel every doubling of the airtime also doubles the collisions. Going
+// faster is one step per decision and only once every known peer has
+// reported from the current epoch, going slower is immediate. A known peer
+// that falls silent moves the network one rate slower at full power. A node
+// that hears nobody at all scans through the rates until it finds the
+// network again.
+//
+// Not thread safe and free of RTOS calls, Control guards it with a critical
+// section and passes the time in.
+
+namespace adr {
+
+struct DataRate {
+  uint8_t sf;
+  float bwKHz;
+};
+
+// Fastest first, each step about 2.5 to 3 dB more sensitive
+constexpr DataRate RATES[] = {
+    {7, 500.0f},  {8, 500.0f},  {9, 500.0f},  {10, 500.0f},
+    {10, 250.0f}, {10, 125.0f}, {11, 125.0f}, {12, 125.0f},
+};
+constexpr uint8_t RATE_COUNT = sizeof(RATES) / sizeof(RATES[0]);
+
+constexpr int8_t POWER_MIN = 2;  // dBm
+constexpr int8_t POWER_MAX = 22;
+
+constexpr float TARGET_LOSS = 0.05f;
+constexpr float TARGET_Z = 1.64f;  // one sided, 5 % of packets below margin
+constexpr float HYSTERESIS_DB = 2.0f;  // excess kept before going cheaper
+constexpr int8_t NO_EXCESS = -128;  // no link measured yet
+
+// Minimum SNR to demodulate, SX126x datasheet
+constexpr float demodFloorDb(uint8_t sf) { return -7.5f - 2.5f * (sf - 7); }
+
+// How much weaker a signal `rate` still decodes than RATES[0]
+inline float gainDb(uint8_t rate) {
+  return demodFloorDb(RATES[0].sf) - demodFloorDb(RATES[rate].sf) +
+         10.0f * std::log10(RATES[0].bwKHz / RATES[rate].bwKHz);
+}
+
+// Time on air of the same frame at `rate` relative to RATES[0], by symbol time
+inline float airtimeFactor(uint8_t rate) {
+  return static_cast<float>(1u << (RATES[rate].sf - RATES[0].sf)) *
+         RATES[0].bwKHz / RATES[rate].bwKHz;
+}
+
+struct Setting {
+  uint8_t rate = 0;
+  int8_t powerDbm = POWER_MAX;
+  uint8_t epoch = 0;
+
+  bool operator!=(const Setting &other) const {
+    return rate != other.rate || powerDbm != other.powerDbm;
+  }
+};
+
+class Adr {
+ public:
+  static constexpr uint32_t TICK_MS = 100;  // poll() interval
+  static constexpr size_t MAX_PEERS = 16;
+
+  // `beaconMs` is the status interval, all timeouts are multiples of it
+  Adr(uint16_t nodeId, uint32_t beaconMs);
+
+  void setEnabled(bool enabled, uint32_t nowMs);
+  bool enabled() const { return m_enabled; }
+
+  // Slowest of RATES it may use, all of them by default. Lower while the
+  // radio has a dwell limit a full packet at the slower ones would break.
+  // Has to be the same on every node, orders for slower rates are ignored.
+  void setSlowestRate(uint8_t rate);
+  uint8_t slowestRate() const { return m_slowestRate; }
+
+  // What the radio should be set to right now
+  const Setting &setting() const { return m_setting; }
+
+  // ----- Input -----
+  // Every valid frame heard, with the radio's figures for it
+  void onFrame(uint16_t from, uint16_t seq, float rssi, float snr,
+               uint32_t nowMs);
+  void onReport(uint16_t from, const frame::LinkReport &report,
+                uint32_t nowMs);
+  void onOrder(uint16_t from, const frame::RateOrder &order, uint32_t nowMs);
+
+  // ----- Output -----
+  // For the next status beacon, also closes the loss measurement window
+  frame::LinkReport report(uint32_t nowMs);
+
+  // Runs the timers and, on the coordinator, the decision. True when `order`
+  // should be broadcast now. `orderAirtimeMs` is the time on air of a Rate
+  // frame at the current rate.
+  bool poll(uint32_t nowMs, uint32_t orderAirtimeMs, frame::RateOrder *order);
+
+  // ----- Diagnostics -----
+  bool coordinator(uint32_t nowMs) const;
+  bool scanning() const { return m_scanning; }
+  float marginOffsetDb() const { return m_offsetDb; }
+  size_t peers(uint32_t nowMs) const;
+
+ private:
+  struct Peer {
+    uint16_t id = 0;  // 0 when the slot is free
+    uint32_t lastHeardMs = 0;
+    uint16_t lastSeq = 0;
+    bool lost = false;  // already slowed the network down for it
+
+    // Link towards this node, corrected on every switch
+    uint16_t samples = 0;
+    float snrMean = 0;
+    float snrVar = 0;
+    uint16_t expected = 0;  // frames sent, from sequence numbers
+    uint16_t received = 0;
+
+    // Its last report
+    bool hasReport = false;
+    frame::LinkReport report;
+  };
+
+  Peer *find(uint16_t id);
+  Peer *findOrAdd(uint16_t id, uint32_t nowMs);
+  bool active(const Peer &peer, uint32_t nowMs) const;
+  int8_t ownExcess() const;
+  void switchTo(const Setting &setting, uint32_t nowMs);
+  bool decide(uint32_t nowMs, uint8_t slowest, Setting *next);
+
+  uint16_t m_nodeId;
+  uint32_t m_beaconMs;
+  bool m_enabled = false;
+  uint8_t m_slowestRate = RATE_COUNT - 1;
+
+  Setting m_setting;
+  Peer m_peers[MAX_PEERS];
+  uint32_t m_lastHeardMs = 0;  // any frame at all
+  uint32_t m_framesHeard = 0;  // since the last decision, for the load
+  float m_offsetDb = 0;        // margin added while loss is above target
+
+  // Order waiting for its switch time
+  bool m_pending = false;
+  Setting m_next;
+  uint32_t m_switchAtMs = 0;
+  uint16_t m_orderFrom = 0;
+
+  // Coordinator
+  uint32_t m_lastDecisionMs = 0;
+  uint8_t m_copiesLeft = 0;  // of the order being announced
+  uint32_t m_nextCopyMs = 0;
+
+  // Looking for the network after hearing nothing for a while
+  bool m_scanning = false;
+  uint32_t m_scanSinceMs = 0;
+};
+
+}  // namespace adr
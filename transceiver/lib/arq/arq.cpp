@@ -0,0 +1,344 @@
+#include "arq.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace arq {
+
+namespace {
+
+constexpr uint16_t SACK_BITS = 16;
+
+// Sequence numbers wrap, only differences mean something
+int8_t distance(uint8_t from, uint8_t to) {
+  return static_cast<int8_t>(to - from);
+}
+
+bool reached(uint32_t nowMs, uint32_t atMs) {
+  return static_cast<int32_t>(nowMs - atMs) >= 0;
+}
+
+}  // namespace
+
+/* ================================ SENDING ================================ */
+
+bool Arq::send(uint16_t to, frame::Type kind, const char *text, size_t len,
+               uint32_t nowMs) {
+  if (len > MAX_TEXT) return false;
+  Slot *slot = nullptr;
+  for (Slot &candidate : m_slots) {
+    if (!candidate.used) {
+      slot = &candidate;
+      break;
+    }
+  }
+  if (slot == nullptr) return false;
+
+  Peer *peer = findOrAdd(to, nowMs);
+  slot->used = true;
+  slot->peer = peer;
+  slot->seq = peer->nextSeq++;
+  slot->kind = static_cast<uint8_t>(kind);
+  slot->tries = 0;
+  slot->resendNow = false;
+  slot->len = static_cast<uint8_t>(len);
+  memcpy(slot->text, text, len);
+  return true;
+}
+
+bool Arq::poll(uint32_t nowMs, Outgoing *out) {
+  // Retransmissions first, they hold the window back. Then new frames in
+  // sequence order.
+  Slot *best = nullptr;
+  for (Slot &slot : m_slots) {
+    if (!slot.used || slot.tries == 0) continue;
+    if (!slot.resendNow &&
+        !reached(nowMs, slot.sentAtMs + timeoutMs(*slot.peer))) {
+      continue;
+    }
+    if (slot.tries >= MAX_TRIES) {
+      Peer *peer = slot.peer;
+      slot.used = false;
+      m_stats.failed++;
+      updateBase(peer);
+      continue;
+    }
+    if (best == nullptr || slot.sentAtMs - best->sentAtMs > UINT32_MAX / 2) {
+      best = &slot;  // the one waiting longest
+    }
+  }
+  if (best != nullptr) {
+    m_stats.retransmitted++;
+    if (best->resendNow) {
+      m_stats.fastRetransmits++;
+    } else if (best->seq == best->peer->base && best->peer->backoff < 7) {
+      best->peer->backoff++;  // once per round, not for every frame in it
+    }
+  } else {
+    for (Slot &slot : m_slots) {
+      if (!slot.used || slot.tries > 0 || !inWindow(slot)) continue;
+      if (best == nullptr || best->peer != slot.peer ||
+          distance(best->seq, slot.seq) < 0) {
+        best = &slot;
+      }
+    }
+    if (best != nullptr) m_stats.sent++;
+  }
+
+  if (best != nullptr) {
+    best->tries++;
+    best->resendNow = false;
+    best->sentAtMs = nowMs;
+    fill(best->peer, out);
+    out->arq.seq = best->seq;
+    out->arq.kind = best->kind;
+    memcpy(out->text, best->text, best->len);
+    out->len = best->len;
+    return true;
+  }
+
+  // Nothing went back in time to carry an acknowledgement
+  for (Peer &peer : m_peers) {
+    if (peer.id == 0 || !peer.ackDue || !reached(nowMs, peer.ackAtMs)) {
+      continue;
+    }
+    fill(&peer, out);
+    out->arq.seq = peer.base;
+    out->arq.kind = frame::ARQ_ACK_ONLY;
+    out->len = 0;
+    m_stats.acksOnly++;
+    return true;
+  }
+  return false;
+}
+
+uint32_t Arq::nextEventMs(uint32_t nowMs) const {
+  uint32_t next = NO_EVENT;
+  auto until = [&](uint32_t atMs) {
+    uint32_t left = reached(nowMs, atMs) ? 0 : atMs - nowMs;
+    next = std::min(next, left);
+  };
+
+  for (const Slot &slot : m_slots) {
+    if (!slot.used) continue;
+    if (slot.tries == 0) {
+      if (inWindow(slot)) next = 0;
+    } else {
+      until(slot.resendNow ? nowMs : slot.sentAtMs + timeoutMs(*slot.peer));
+    }
+  }
+  for (const Peer &peer : m_peers) {
+    if (peer.id != 0 && peer.ackDue) until(peer.ackAtMs);
+  }
+  return next;
+}
+
+/* =============================== RECEIVING =============================== */
+
+bool Arq::onFrame(uint16_t from, const frame::ArqHeader &arq,
+                  uint32_t nowMs) {
+  Peer *peer = findOrAdd(from, nowMs);
+  if (arq.hasAck) handleAck(peer, arq.ack, arq.sack, nowMs);
+  if (arq.kind == frame::ARQ_ACK_ONLY) return false;
+
+  // Acknowledge it, whether it is new or not, the sender is waiting
+  if (!peer->ackDue) {
+    peer->ackDue = true;
+    peer->ackAtMs = nowMs + ACK_DELAY_MS;
+  }
+
+  // A new stream: the first frame from this peer, one that restarted, or a
+  // sequence number that cannot belong to the current stream
+  int8_t ahead = distance(peer->expected, arq.seq);
+  bool restart = !peer->synced || ahead > SACK_BITS || ahead < -2 * WINDOW ||
+                 (arq.start && static_cast<uint8_t>(arq.seq - peer->startSeq) >=
+                                   WINDOW);
+  if (restart) {
+    peer->synced = true;
+    peer->startSeq = arq.seq;
+    peer->expected = arq.seq;
+    peer->received = 0;
+    ahead = 0;
+  }
+
+  bool fresh = false;
+  if (ahead == 0) {
+    // Frames that arrived early move `expected` along with this one
+    fresh = true;
+    bool next = true;
+    while (next) {
+      peer->expected++;
+      next = peer->received & 1;
+      peer->received >>= 1;
+    }
+  } else if (ahead > 0) {
+    uint16_t bit = 1u << (ahead - 1);
+    fresh = (peer->received & bit) == 0;
+    peer->received |= bit;
+  }
+
+  if (fresh) {
+    m_stats.delivered++;
+  } else {
+    m_stats.duplicates++;
+  }
+  return fresh;
+}
+
+/* ================================ STATE ================================== */
+
+size_t Arq::queued() const {
+  size_t count = 0;
+  for (const Slot &slot : m_slots) {
+    if (slot.used) count++;
+  }
+  return count;
+}
+
+uint32_t Arq::rtoMs(uint16_t peer) const {
+  const Peer *state = find(peer);
+  return state ? state->rtoMs : RTO_INITIAL_MS;
+}
+
+float Arq::srttMs(uint16_t peer) const {
+  const Peer *state = find(peer);
+  return state && state->hasRtt ? state->srttMs : 0.0f;
+}
+
+/* ================================ PRIVATE ================================ */
+
+Arq::Peer *Arq::find(uint16_t id) {
+  for (Peer &peer : m_peers) {
+    if (peer.id == id) return &peer;
+  }
+  return nullptr;
+}
+
+const Arq::Peer *Arq::find(uint16_t id) const {
+  for (const Peer &peer : m_peers) {
+    if (peer.id == id) return &peer;
+  }
+  return nullptr;
+}
+
+Arq::Peer *Arq::findOrAdd(uint16_t id, uint32_t nowMs) {
+  Peer *peer = find(id);
+  if (peer == nullptr) {
+    // A free entry, or the one unused for longest together with its frames
+    peer = &m_peers[0];
+    for (Peer &candidate : m_peers) {
+      if (candidate.id == 0) {
+        peer = &candidate;
+        break;
+      }
+      if (nowMs - candidate.lastUsedMs > nowMs - peer->lastUsedMs) {
+        peer = &candidate;
+      }
+    }
+    for (Slot &slot : m_slots) {
+      if (slot.used && slot.peer == peer) {
+        slot.used = false;
+        m_stats.failed++;
+      }
+    }
+    *peer = Peer();
+    peer->id = id;
+    m_seed = m_seed * 1103515245u + 12345u;
+    peer->nextSeq = peer->base = static_cast<uint8_t>(m_seed >> 16);
+  }
+  peer->lastUsedMs = nowMs;
+  return peer;
+}
+
+void Arq::handleAck(Peer *peer, uint8_t ack, uint16_t sack, uint32_t nowMs) {
+  // An ack past anything sent is from before a restart of either side. One
+  // behind the oldest frame still here points at a frame given up on, its
+  // sack is still good.
+  int8_t ahead = distance(peer->nextSeq, ack);
+  if (ahead > 0 || ahead < -2 * static_cast<int>(SACK_BITS)) return;
+
+  peer->heardAck = true;
+  bool any = false;
+  const Slot *newest = nullptr;
+  for (Slot &slot : m_slots) {
+    if (!slot.used || slot.peer != peer || slot.tries == 0) continue;
+    int8_t past = distance(ack, slot.seq);
+    bool acked = past < 0 ||
+                 (past > 0 && past <= SACK_BITS && (sack >> (past - 1)) & 1);
+    if (!acked) continue;
+
+    if (newest == nullptr ||
+        static_cast<int32_t>(slot.sentAtMs - newest->sentAtMs) > 0) {
+      newest = &slot;
+    }
+    slot.used = false;
+    m_stats.acked++;
+    any = true;
+  }
+  if (!any) return;
+
+  // The newest frame is the one this ack answers, the older ones had theirs
+  // lost. Karn: a frame sent more than once gives no clean round trip.
+  if (newest->tries == 1) measureRtt(peer, nowMs - newest->sentAtMs);
+  if (static_cast<int32_t>(newest->sentAtMs - peer->newestAckedMs) > 0) {
+    peer->newestAckedMs = newest->sentAtMs;
+  }
+  peer->backoff = 0;  // the link works again, back to the measured RTO
+  updateBase(peer);
+
+  // Frames sent before one that already arrived are most likely lost
+  for (Slot &slot : m_slots) {
+    if (slot.used && slot.peer == peer && slot.tries > 0 &&
+        static_cast<int32_t>(peer->newestAckedMs - slot.sentAtMs) > 0) {
+      slot.resendNow = true;
+    }
+  }
+}
+
+void Arq::updateBase(Peer *peer) {
+  uint8_t base = peer->nextSeq;
+  for (const Slot &slot : m_slots) {
+    if (slot.used && slot.peer == peer && distance(slot.seq, base) > 0) {
+      base = slot.seq;
+    }
+  }
+  peer->base = base;
+}
+
+void Arq::measureRtt(Peer *peer, uint32_t sampleMs) {
+  float sample = static_cast<float>(sampleMs);
+  if (!peer->hasRtt) {
+    peer->hasRtt = true;
+    peer->srttMs = sample;
+    peer->rttVarMs = sample / 2;
+  } else {
+    peer->rttVarMs = 0.75f * peer->rttVarMs +
+                     0.25f * std::fabs(peer->srttMs - sample);
+    peer->srttMs = 0.875f * peer->srttMs + 0.125f * sample;
+  }
+  float rto = peer->srttMs + 4.0f * peer->rttVarMs;
+  peer->rtoMs = static_cast<uint32_t>(
+      std::clamp<float>(rto, RTO_MIN_MS, RTO_MAX_MS));
+}
+
+bool Arq::inWindow(const Slot &slot) const {
+  return distance(slot.peer->base, slot.seq) < WINDOW;
+}
+
+uint32_t Arq::timeoutMs(const Peer &peer) const {
+  return std::min(peer.rtoMs << peer.backoff, RTO_MAX_MS);
+}
+
+// Addressing and the acknowledgement for the other direction, which this
+// frame carries from now on
+void Arq::fill(Peer *peer, Outgoing *out) {
+  out->arq.to = peer->id;
+  out->arq.ack = peer->expected;
+  out->arq.sack = peer->received;
+  out->arq.hasAck = peer->synced;
+  out->arq.start = !peer->heardAck;
+  peer->ackDue = false;
+}
+
+}  // namespace arq
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "frame.hpp"
+
+// Reliable transfers to one peer at a time, selective repeat ARQ.
+//
+// Every peer has its own 8 bit sequence space in each direction. Up to
+// WINDOW frames are in flight to a peer at once. Frames to a peer carry the
+// state of the opposite direction: `ack`, the first frame not yet received,
+// and `sack`, a bitmap of the ones after it that did arrive. When there is
+// no frame going back within ACK_DELAY_MS an ack only frame is sent instead.
+//
+// Frames that were not acknowledged within the retransmit timeout go out
+// again, the timeout is estimated from the round trip times like TCP does
+// (RFC 6298, Karn's rule, doubled on every timeout until the next ack). A
+// frame the sack shows
+// a later frame overtook is sent again right away. After MAX_TRIES it is
+// given up.
+//
+// The receiver hands every frame up once, in the order they arrive, and
+// drops duplicates. Streams begin at a random sequence number and carry the
+// `start` flag until the first acknowledgement, so a peer that restarted is
+// not mistaken for duplicates of its old stream.
+//
+// Not thread safe and free of RTOS calls, Control guards it with a critical
+// section and passes the time in.
+
+namespace arq {
+
+constexpr uint8_t WINDOW = 8;         // frames in flight per peer
+constexpr size_t SLOTS = 16;          // frames waiting or in flight, all peers
+constexpr size_t MAX_PEERS = 8;
+constexpr size_t MAX_TEXT = frame::MAX_PAYLOAD - frame::ARQ_SIZE;
+constexpr uint32_t ACK_DELAY_MS = 250;  // for a frame to ride along on
+constexpr uint32_t RTO_INITIAL_MS = 3000;
+constexpr uint32_t RTO_MIN_MS = 500;
+constexpr uint32_t RTO_MAX_MS = 60'000;
+constexpr uint8_t MAX_TRIES = 8;
+constexpr uint32_t NO_EVENT = UINT32_MAX;
+
+// A frame poll() wants sent, the text is a copy
+struct Outgoing {
+  frame::ArqHeader arq;
+  char text[MAX_TEXT];
+  size_t len;
+};
+
+struct Stats {
+  uint32_t sent = 0;           // new frames, first transmission
+  uint32_t retransmitted = 0;  // all transmissions after the first
+  uint32_t fastRetransmits = 0;  // of those, started by a sack
+  uint32_t acked = 0;
+  uint32_t failed = 0;  // given up after MAX_TRIES
+  uint32_t acksOnly = 0;
+  uint32_t delivered = 0;   // frames handed up
+  uint32_t duplicates = 0;  // frames dropped as already handed up
+};
+
+class Arq {
+ public:
+  // `seed` picks the first sequence numbers, it should differ on every boot
+  Arq(uint16_t nodeId, uint32_t seed) : m_nodeId(nodeId), m_seed(seed) {}
+
+  // Queues `text` (up to MAX_TEXT bytes) for `to`. False if all slots are
+  // taken.
+  bool send(uint16_t to, frame::Type kind, const char *text, size_t len,
+            uint32_t nowMs);
+
+  // An Arq frame addressed to this node. Handles its acknowledgement, true
+  // when the text it carries is new and should be handled.
+  bool onFrame(uint16_t from, const frame::ArqHeader &arq, uint32_t nowMs);
+
+  // The next frame to send, retransmissions first. Call until it returns
+  // false.
+  bool poll(uint32_t nowMs, Outgoing *out);
+
+  // Milliseconds until poll() has something, NO_EVENT when nothing is
+  // waiting
+  uint32_t nextEventMs(uint32_t nowMs) const;
+
+  const Stats &stats() const { return m_stats; }
+  size_t queued() const;
+  // Retransmit timeout towards `peer`, RTO_INITIAL_MS until measured
+  uint32_t rtoMs(uint16_t peer) const;
+  float srttMs(uint16_t peer) const;
+
+ private:
+  struct Peer {
+    uint16_t id = 0;  // 0 when the slot is free
+    uint32_t lastUsedMs = 0;
+
+    // Sending to it
+    uint8_t nextSeq = 0;  // of the next new frame
+    uint8_t base = 0;     // oldest not acknowledged
+    bool heardAck = false;  // until then frames carry `start`
+    bool hasRtt = false;
+    float srttMs = 0;
+    float rttVarMs = 0;
+    uint32_t rtoMs = RTO_INITIAL_MS;
+    uint8_t backoff = 0;  // timeouts since the last ack, doubles the RTO
+    uint32_t newestAckedMs = 0;  // send time of the latest frame acked
+
+    // Receiving from it
+    bool synced = false;    // heard a frame of its stream
+    uint8_t startSeq = 0;   // where that stream began
+    uint8_t expected = 0;   // every frame before it arrived
+    uint16_t received = 0;  // bit i: expected + 1 + i arrived
+    bool ackDue = false;
+    uint32_t ackAtMs = 0;
+  };
+
+  struct Slot {
+    bool used = false;
+    Peer *peer = nullptr;
+    uint8_t seq = 0;
+    uint8_t kind = 0;
+    uint8_t tries = 0;  // transmissions so far
+    bool resendNow = false;
+    uint32_t sentAtMs = 0;
+    uint8_t len = 0;
+    char text[MAX_TEXT];
+  };
+
+  Peer *find(uint16_t id);
+  const Peer *find(uint16_t id) const;
+  Peer *findOrAdd(uint16_t id, uint32_t nowMs);
+  void handleAck(Peer *peer, uint8_t ack, uint16_t sack, uint32_t nowMs);
+  void updateBase(Peer *peer);
+  void measureRtt(Peer *peer, uint32_t sampleMs);
+  bool inWindow(const Slot &slot) const;
+  uint32_t timeoutMs(const Peer &peer) const;
+  void fill(Peer *peer, Outgoing *out);
+
+  uint16_t m_nodeId;
+  uint32_t m_seed;
+  Peer m_peers[MAX_PEERS];
+  Slot m_slots[SLOTS];
+  Stats m_stats;
+};
+
+}  // namespace arq
@@ -0,0 +1,34 @@
+#include "batcher.hpp"
+
+#include <cstring>
+
+bool Batcher::add(const char *record, size_t len, uint32_t nowMs) {
+  size_t needed = m_len == 0 ? len : m_len + 1 + len;
+  if (needed > m_capacity) {
+    if (m_len > 0) m_stats.full++;
+    return false;
+  }
+
+  if (m_len == 0) {
+    m_firstMs = nowMs;
+  } else {
+    m_buffer[m_len++] = SEPARATOR;
+  }
+  memcpy(m_buffer + m_len, record, len);
+  m_len += len;
+  m_stats.records++;
+  return true;
+}
+
+uint32_t Batcher::dueInMs(uint32_t nowMs) const {
+  uint32_t waited = nowMs - m_firstMs;
+  return waited >= m_budgetMs ? 0 : m_budgetMs - waited;
+}
+
+const char *Batcher::take(size_t *len) {
+  m_buffer[m_len] = '\0';
+  *len = m_len;
+  m_len = 0;
+  m_stats.batches++;
+  return m_buffer;
+}
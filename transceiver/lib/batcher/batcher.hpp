@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "frame.hpp"
+
+// Collects data records into one frame payload, separated by '\n'.
+//
+// A short telemetry line is smaller than the preamble, header and CRC of the
+// frame it goes out in, so several lines share one. A batch is sent once it
+// is full or once its oldest record has waited `budgetMs`. A budget of 0
+// gives every record a frame of its own.
+//
+// Not thread safe and free of RTOS calls, only the serial task uses it.
+
+class Batcher {
+ public:
+  static constexpr size_t CAPACITY = frame::MAX_PAYLOAD;
+  static constexpr char SEPARATOR = '\n';
+
+  struct Stats {
+    uint32_t records = 0;
+    uint32_t batches = 0;
+    uint32_t full = 0;  // batches sent because the next record did not fit
+  };
+
+  void setBudget(uint32_t budgetMs) { m_budgetMs = budgetMs; }
+  uint32_t budget() const { return m_budgetMs; }
+  // Smaller batches for payloads that need room for a header of their own
+  void setCapacity(size_t capacity) {
+    m_capacity = capacity < CAPACITY ? capacity : CAPACITY;
+  }
+
+  // False if the record has to wait for take(), it does not fit next to the
+  // ones already here. Records longer than the capacity never fit.
+  bool add(const char *record, size_t len, uint32_t nowMs);
+
+  bool empty() const { return m_len == 0; }
+
+  // Milliseconds until the batch is due, 0 when it should go now
+  uint32_t dueInMs(uint32_t nowMs) const;
+
+  // The batch, NUL terminated and valid until the next add(), then empty
+  const char *take(size_t *len);
+
+  const Stats &stats() const { return m_stats; }
+
+ private:
+  char m_buffer[CAPACITY + 1];
+  size_t m_len = 0;
+  size_t m_capacity = CAPACITY;
+  uint32_t m_firstMs = 0;  // when the oldest record came in
+  uint32_t m_budgetMs = 0;
+  Stats m_stats;
+};
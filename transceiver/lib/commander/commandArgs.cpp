@@ -0,0 +1,126 @@
+#include "commandArgs.hpp"
+
+namespace cmd {
+
+namespace {
+
+constexpr uint32_t MAX_MANTISSA = 999'999'999;  // nine digits fit a uint32
+
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+// Strips the sign, returns true if it was '-'
+bool takeSign(std::string_view *text) {
+  if (text->empty()) return false;
+  char c = text->front();
+  if (c != '-' && c != '+') return false;
+  text->remove_prefix(1);
+  return c == '-';
+}
+
+}  // namespace
+
+const char *argErrorName(ArgError error) {
+  switch (error) {
+    case ArgError::Ok:
+      return "ok";
+    case ArgError::Missing:
+      return "missing";
+    case ArgError::Invalid:
+      return "not a number";
+    case ArgError::OutOfRange:
+      return "out of range";
+  }
+  return "unknown";
+}
+
+ArgError parseInt(std::string_view text, int32_t min, int32_t max,
+                  int32_t *out) {
+  if (text.empty()) return ArgError::Missing;
+  bool negative = takeSign(&text);
+  if (text.empty()) return ArgError::Invalid;
+
+  // Saturate instead of overflowing, anything this large is out of range
+  int64_t value = 0;
+  for (char c : text) {
+    if (!isDigit(c)) return ArgError::Invalid;
+    if (value <= INT32_MAX) value = value * 10 + (c - '0');
+  }
+  if (negative) value = -value;
+
+  if (value < min || value > max) return ArgError::OutOfRange;
+  *out = static_cast<int32_t>(value);
+  return ArgError::Ok;
+}
+
+ArgError parseUint(std::string_view text, uint32_t min, uint32_t max,
+                   uint32_t *out) {
+  if (text.empty()) return ArgError::Missing;
+
+  uint64_t value = 0;
+  for (char c : text) {
+    if (!isDigit(c)) return ArgError::Invalid;
+    if (value <= UINT32_MAX) value = value * 10 + (c - '0');
+  }
+
+  if (value < min || value > max) return ArgError::OutOfRange;
+  *out = static_cast<uint32_t>(value);
+  return ArgError::Ok;
+}
+
+ArgError parseHex(std::string_view text, uint32_t min, uint32_t max,
+                  uint32_t *out) {
+  if (text.empty()) return ArgError::Missing;
+
+  uint64_t value = 0;
+  for (char c : text) {
+    int digit = -1;
+    if (isDigit(c)) digit = c - '0';
+    if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+    if (digit < 0) return ArgError::Invalid;
+    if (value <= UINT32_MAX) value = value * 16 + digit;
+  }
+
+  if (value < min || value > max) return ArgError::OutOfRange;
+  *out = static_cast<uint32_t>(value);
+  return ArgError::Ok;
+}
+
+ArgError parseFloat(std::string_view text, float min, float max, float *out) {
+  if (text.empty()) return ArgError::Missing;
+  bool negative = takeSign(&text);
+
+  uint32_t mantissa = 0;
+  int exponent = 0;  // power of ten applied to the mantissa
+  size_t digits = 0;
+  bool point = false;
+  for (char c : text) {
+    if (c == '.' && !point) {
+      point = true;
+      continue;
+    }
+    if (!isDigit(c)) return ArgError::Invalid;
+    digits++;
+    if (mantissa <= MAX_MANTISSA / 10) {
+      mantissa = mantissa * 10 + (c - '0');
+      if (point) exponent--;
+    } else if (!point) {
+      exponent++;
+    }
+  }
+  if (digits == 0) return ArgError::Invalid;
+
+  // One rounding step only, so "915.125" comes out exact
+  float value = static_cast<float>(mantissa);
+  float scale = 1.0f;
+  for (int i = exponent; i < 0; i++) scale *= 10.0f;
+  for (int i = 0; i < exponent; i++) value *= 10.0f;
+  value /= scale;
+  if (negative) value = -value;
+
+  if (value < min || value > max) return ArgError::OutOfRange;
+  *out = value;
+  return ArgError::Ok;
+}
+
+}  // namespace cmd
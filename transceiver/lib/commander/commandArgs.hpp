@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// Typed parsing of command arguments straight from a token. Unlike atoi/atof
+// these reject trailing garbage ("12dB"), report values outside the allowed
+// range instead of wrapping them, and never touch the heap.
+
+namespace cmd {
+
+enum class ArgError : uint8_t {
+  Ok,
+  Missing,     // no token left
+  Invalid,     // not a number
+  OutOfRange,  // a number, but outside [min, max]
+};
+
+const char *argErrorName(ArgError error);
+
+// Decimal integer with an optional sign
+ArgError parseInt(std::string_view text, int32_t min, int32_t max,
+                  int32_t *out);
+
+// Decimal integer without a sign, for offsets and counts
+ArgError parseUint(std::string_view text, uint32_t min, uint32_t max,
+                   uint32_t *out);
+
+// Hexadecimal integer without a prefix, for node IDs as they are printed
+ArgError parseHex(std::string_view text, uint32_t min, uint32_t max,
+                  uint32_t *out);
+
+// Decimal number with an optional sign and fraction, no exponent. Digits past
+// the ninth significant one are ignored.
+ArgError parseFloat(std::string_view text, float min, float max, float *out);
+
+}  // namespace cmd
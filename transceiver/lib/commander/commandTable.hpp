@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Compile time perfect hash over the names of a handler map.
+//
+// makeTable() searches for a seed that sends every name to its own slot of a
+// power-of-two table. A lookup is then one hash of the token, one table read
+// and one compare to reject names that are not in the map. Entries only need
+// a `name` member.
+
+namespace cmd {
+
+// FNV-1a, the seed is mixed into the offset basis
+constexpr uint32_t hash(std::string_view text, uint32_t seed) {
+  uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+  for (char c : text) {
+    h ^= static_cast<uint8_t>(c);
+    h *= 16777619u;
+  }
+  return h;
+}
+
+constexpr size_t tableSize(size_t entries) {
+  size_t size = 1;
+  while (size < 2 * entries) size <<= 1;
+  return size;
+}
+
+template <size_t N>
+struct Table {
+  static constexpr size_t SIZE = tableSize(N);
+  static constexpr uint32_t NO_SEED = 0xFFFFFFFF;
+
+  uint32_t seed = NO_SEED;
+  uint8_t slots[SIZE] = {};  // entry index + 1, 0 when empty
+
+  constexpr bool valid() const { return seed != NO_SEED; }
+
+  // Index into `entries`, the map the table was built from. -1 if `token` is
+  // not in it.
+  template <typename Entry>
+  int find(const Entry (&entries)[N], std::string_view token) const {
+    uint8_t slot = slots[hash(token, seed) & (SIZE - 1)];
+    if (slot == 0 || token != entries[slot - 1].name) return -1;
+    return slot - 1;
+  }
+};
+
+template <typename Entry, size_t N>
+constexpr Table<N> makeTable(const Entry (&entries)[N]) {
+  static_assert(N < 0xFF, "too many entries for one table");
+
+  Table<N> table;
+  for (uint32_t seed = 0; seed < 0x10000; seed++) {
+    uint8_t slots[Table<N>::SIZE] = {};
+    bool collision = false;
+    for (size_t i = 0; i < N && !collision; i++) {
+      size_t slot = hash(entries[i].name, seed) & (Table<N>::SIZE - 1);
+      collision = slots[slot] != 0;
+      slots[slot] = static_cast<uint8_t>(i + 1);
+    }
+    if (collision) continue;
+
+    table.seed = seed;
+    for (size_t i = 0; i < Table<N>::SIZE; i++) table.slots[i] = slots[i];
+    return table;
+  }
+  return table;  // seed stays NO_SEED, checked by the caller
+}
+
+}  // namespace cmd
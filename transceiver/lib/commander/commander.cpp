@@ -1,12 +1,16 @@
 #include "commander.hpp"
 
 Commander::Commander(SerialCom* serialCom, LoRaCom* loraCom) {
-  memset(m_command, 0, sizeof(m_command));  // Initialize command buffer
-  m_serialCom = serialCom;                  // Initialize the SerialCom instance
-  m_loraCom = loraCom;                      // Initialize the LoRaCom instance
+  m_serialCom = serialCom;  // Initialize the SerialCom instance
+  m_loraCom = loraCom;      // Initialize the LoRaCom instance
   ESP_LOGD(TAG, "Commander initialised");
 }
 
+void Commander::onMode(ModeHandler handler, void* context) {
+  m_modeHandler = handler;
+  m_modeContext = context;
+}
+
 void Commander::handle_command_help() {
   handle_help(command_handler);  // Call the generic help handler
 }
@@ -19,98 +23,75 @@ void Commander::handle_set_help() {
   handle_help(set_handler);  // Call the generic help handler
 }
 
-void Commander::handle_help(const HandlerMap* handler) {
-  String helpText = "\nAvailable commands:\n";
-  for (const HandlerMap* cmd = handler; cmd->name != nullptr; ++cmd) {
-    helpText +=
-        "- <" + String(cmd->name) + ">\n";  // Append command names to help text
+template <size_t N>
+void Commander::handle_help(const HandlerMap (&handler)[N]) {
+  char helpText[128];
+  size_t len = snprintf(helpText, sizeof(helpText), "\nAvailable commands:\n");
+  for (const HandlerMap& cmd : handler) {
+    if (len >= sizeof(helpText)) break;
+    len += snprintf(helpText + len, sizeof(helpText) - len, "- <%s>\n",
+                    cmd.name);  // Append command names to help text
   }
-  ESP_LOGI(TAG, "%s", helpText.c_str());
+  ESP_LOGI(TAG, "%s", helpText);
 }
 
 void Commander::handle_update() {
   ESP_LOGD(TAG, "Update command executed");
-  checkCommand(update_handler);
+  runMappedCommand(update_handler, update_table);
 }
 
 void Commander::handle_set() {
   ESP_LOGD(TAG, "Set command executed");
-  checkCommand(set_handler);  // Check and run the set command
+  runMappedCommand(set_handler, set_table);  // Check and run the set command
 }
 
 void Commander::handle_update_gain() {
   ESP_LOGD(TAG, "Update gain command executing");
 
-  char* data = readAndRemove();  // Read and remove the command token
-
-  // convert to integer
-  if (data == nullptr) {
-    ESP_LOGW(TAG, "Empty data received for gain update, expecting <int8_t>");
-    return;
-  }
-
-  int8_t gain = static_cast<int8_t>(atoi(data));  // Convert to int8_t
-  m_loraCom->setOutGain(gain);                    // Set the gain in LoRaCom
+  int32_t gain;
+  if (!readInt("gain", -9, 22, &gain)) return;  // SX1262 limits in dBm
+  m_loraCom->setOutGain(static_cast<int8_t>(gain));  // Set the gain in LoRaCom
 }
 
 void Commander::handle_update_freqMhz() {
   ESP_LOGD(TAG, "Update freqMhz command executing");
 
-  char* data = readAndRemove();  // Read and remove the command token
-
-  // convert to integer
-  if (data == nullptr) {
-    ESP_LOGW(TAG, "Empty data received for gain update, expecting <float>");
-    return;
-  }
-
-  float freqMhz = static_cast<float>(atof(data));  // Cast to float
-  m_loraCom->setFrequency(freqMhz);                // Set the gain in LoRaCom
+  float freqMhz;
+  if (!readFloat("freqMhz", 150.0f, 960.0f, &freqMhz)) return;
+  m_loraCom->setFrequency(freqMhz);  // Set the frequency in LoRaCom
 }
 
 void Commander::handle_update_spreadingFactor() {
   // Implementation for updating spreading factor
   ESP_LOGD(TAG, "Update spreading factor command executing");
 
-  char* data = readAndRemove();  // Read and remove the command token
-
-  // convert to integer
-  if (data == nullptr) {
-    ESP_LOGW(TAG, "Empty data received for gain update, expecting <uint8_t>");
-    return;
-  }
-
-  uint8_t spreadingFactor = static_cast<uint8_t>(atoi(data));  // Cast to float
-  m_loraCom->setSpreadingFactor(spreadingFactor);  // Set the gain in LoRaCom
+  int32_t spreadingFactor;
+  if (!readInt("sf", 5, 12, &spreadingFactor)) return;
+  airtime::Modem modem = m_loraCom->modem();
+  modem.sf = static_cast<uint8_t>(spreadingFactor);
+  if (!checkDwell(modem)) return;
+  m_loraCom->setSpreadingFactor(static_cast<uint8_t>(spreadingFactor));
 }
 
 void Commander::handle_update_bandwidthKHz() {
   // Implementation for updating bandwidth
   ESP_LOGD(TAG, "Update bandwidth command executing");
 
-  char* data = readAndRemove();  // Read and remove the command token
-
-  // convert to integer
-  if (data == nullptr) {
-    ESP_LOGW(TAG, "Empty data received for gain update, expecting <float>");
-    return;
-  }
-
-  float bandwidthKhz = static_cast<float>(atof(data));  // Cast to float
-  m_loraCom->setBandwidth(bandwidthKhz);  // Set the gain in LoRaCom
+  float bandwidthKhz;
+  if (!readFloat("bwKHz", 7.8f, 500.0f, &bandwidthKhz)) return;
+  airtime::Modem modem = m_loraCom->modem();
+  modem.bwHz = airtime::bandwidthHz(bandwidthKhz);
+  if (!checkDwell(modem)) return;
+  m_loraCom->setBandwidth(bandwidthKhz);  // Set the bandwidth in LoRaCom
 }
 #ifdef SFTU
 void Commander::handle_set_OUTPUT() {
   ESP_LOGD(TAG, "Set output command executing");
-  char* data = readAndRemove();  // Read and remove the command token
 
-  // convert to integer
-  if (data == nullptr) {
-    ESP_LOGW(TAG, "Empty data received for output set, expecting <uint8_t>");
-    return;
-  }
+  int32_t output;
+  if (!readInt("output", 0, 1, &output)) return;
 
-  bool state = ((atoi(data)) == 1) ? true : false;
+  bool state = output == 1;
   ESP_LOGI(TAG, "Setting output to %s", state ? "ON" : "OFF");
 }
 #else
@@ -120,65 +101,201 @@ void Commander::handle_set_OUTPUT() {
 #endif
 
 void Commander::handle_mode() {
-  // Implementation for mode command
-  ESP_LOGD(TAG, "Mode command not implemented yet");
+  ESP_LOGD(TAG, "Mode command executing");
+
+  std::string_view name = readAndRemove();
+  for (uint8_t i = 0; i <= static_cast<uint8_t>(frame::Mode::Tdma); i++) {
+    frame::Mode mode = static_cast<frame::Mode>(i);
+    if (name != frame::modeName(mode)) continue;
+    if (m_modeHandler == nullptr) {
+      ESP_LOGW(TAG, "Mode <%s> not supported by this build",
+               frame::modeName(mode));
+      return;
+    }
+    m_modeHandler(m_modeContext, mode);
+    return;
+  }
+  ESP_LOGW(TAG, "Usage: mode transceive|transmit|receive|sweep|tdma");
 }
 
-void Commander::checkCommand(const HandlerMap* handler_) {
-  char* token = readAndRemove();
-  if (token != nullptr) {
-    runMappedCommand(token, handler_);  // Run the mapped command
+// "airtime <percent>" limits the share of time this node transmits, 0 lifts
+// the limit. Without argument, or after setting it, the airtime per class.
+void Commander::handle_airtime() {
+  ESP_LOGD(TAG, "Airtime command executing");
+
+  std::string_view arg = readAndRemove();
+  if (!arg.empty()) {
+    float percent;
+    if (cmd::parseFloat(arg, 0.0f, 100.0f, &percent) != cmd::ArgError::Ok) {
+      ESP_LOGW(TAG, "Usage: airtime [percent], 0 to 100");
+      return;
+    }
+    m_loraCom->setDutyCycle(static_cast<uint16_t>(percent * 10.0f + 0.5f));
+  }
+
+  AirtimeStats stats = m_loraCom->airtimeStats();
+  if (stats.permille == 0) {
+    ESP_LOGI(TAG, "Airtime: no limit");
   } else {
-    ESP_LOGW(TAG,
-             "No command provided, type <help> after action for a list of "
-             "commands. eg: <command help>, <command update help>, etc.");
+    ESP_LOGI(TAG, "Airtime: limit %.1f %%, over %u s", stats.permille / 10.0f,
+             static_cast<unsigned>(DutyCycle::WINDOW_S));
+  }
+  for (size_t p = 0; p < TX_PRIORITIES; p++) {
+    TxPriority priority = static_cast<TxPriority>(p);
+    if (stats.permille == 0) {
+      ESP_LOGI(TAG, "  %-7s used %llu ms", priorityName(priority),
+               static_cast<unsigned long long>(stats.usedUs[p] / 1000));
+      continue;
+    }
+    ESP_LOGI(TAG, "  %-7s used %llu ms, %u ms left of %u %%, %u deferred",
+             priorityName(priority),
+             static_cast<unsigned long long>(stats.usedUs[p] / 1000),
+             static_cast<unsigned>(stats.remainingUs[p] / 1000),
+             DutyCycle::SHARE_PERCENT[p],
+             static_cast<unsigned>(stats.deferred[p]));
   }
 }
 
-void Commander::runMappedCommand(char* command, const HandlerMap* handler) {
-  // Call the mapped command handler
-  for (const HandlerMap* cmd = handler; cmd->name != nullptr; ++cmd) {
-    if (c_cmp(command, cmd->name)) {
-      return (this->*cmd->handler)();  // Call the corresponding handler
+// "stats" prints the metrics since boot or the last "stats reset", which
+// prints them as well and then starts a new window
+void Commander::handle_stats() {
+  ESP_LOGD(TAG, "Stats command executing");
+
+  std::string_view action = readAndRemove();
+  if (!action.empty() && action != "reset") {
+    ESP_LOGW(TAG, "Usage: stats [reset]");
+    return;
+  }
+
+  uint32_t now = millis();
+  metrics::Snapshot snap = metrics::snapshot(now);
+  ESP_LOGI(TAG, "Stats over %.1f s", snap.windowMs / 1000.0f);
+
+  // Counters and gauges a line at a time, as many as fit
+  char line[96];
+  size_t len = 0;
+  auto append = [&](const char *name, long value, long max, bool gauge) {
+    char item[48];
+    int n = gauge ? snprintf(item, sizeof(item), " %s=%ld/%ld", name, value,
+                             max)
+                  : snprintf(item, sizeof(item), " %s=%ld", name, value);
+    if (len + n >= sizeof(line)) {
+      ESP_LOGI(TAG, "%s", line);
+      len = 0;
     }
+    len += snprintf(line + len, sizeof(line) - len, "%s", item);
+  };
+  for (size_t i = 0; i < metrics::COUNTERS; i++) {
+    append(metrics::name(static_cast<metrics::Counter>(i)),
+           static_cast<long>(snap.counters[i]), 0, false);
   }
+  for (size_t i = 0; i < metrics::GAUGES; i++) {
+    append(metrics::name(static_cast<metrics::Gauge>(i)), snap.gauges[i],
+           snap.gaugeMax[i], true);  // now/max
+  }
+  if (len > 0) ESP_LOGI(TAG, "%s", line);
+
+  for (size_t i = 0; i < metrics::HISTOGRAMS; i++) {
+    const metrics::HistogramSnapshot &h = snap.histograms[i];
+    ESP_LOGI(TAG, " %s n=%u p50<=%u p90<=%u p99<=%u max=%u",
+             metrics::name(static_cast<metrics::Histogram>(i)),
+             static_cast<unsigned>(h.count),
+             static_cast<unsigned>(h.percentile(500)),
+             static_cast<unsigned>(h.percentile(900)),
+             static_cast<unsigned>(h.percentile(990)),
+             static_cast<unsigned>(h.max));
+  }
+
+  if (action == "reset") metrics::reset(now);
 }
 
-char* Commander::readAndRemove() {
-  if (m_command == nullptr || *m_command == nullptr) return nullptr;
+/* ================================ PARSING ================================ */
 
-  char* start = *m_command;
+void Commander::checkCommand() {
+  runMappedCommand(command_handler, command_table);
+}
 
-  // Skip leading spaces
-  while (*start == ' ') start++;
+template <size_t N>
+void Commander::runMappedCommand(const HandlerMap (&handler)[N],
+                                 const cmd::Table<N>& table) {
+  std::string_view token = readAndRemove();
+  if (token.empty()) {
+    ESP_LOGW(TAG,
+             "No command provided, type <help> after action for a list of "
+             "commands. eg: <command help>, <command update help>, etc.");
+    return;
+  }
 
-  // If we reached the end, return nullptr
-  if (*start == '\0') {
-    *m_command = nullptr;
-    return nullptr;
+  int index = table.find(handler, token);
+  if (index < 0) {
+    ESP_LOGW(TAG, "Unknown command <%.*s>", static_cast<int>(token.size()),
+             token.data());
+    return;
   }
+  (this->*handler[index].handler)();  // Call the corresponding handler
+}
 
-  // Find the end of the current token
-  char* end = start;
-  while (*end != ' ' && *end != '\0') end++;
+bool Commander::readInt(const char* what, int32_t min, int32_t max,
+                        int32_t* out) {
+  std::string_view token = readAndRemove();
+  cmd::ArgError error = cmd::parseInt(token, min, max, out);
+  if (error == cmd::ArgError::Ok) return true;
+
+  ESP_LOGW(TAG, "%s <%.*s> %s, expecting an integer in [%ld, %ld]", what,
+           static_cast<int>(token.size()), token.data(),
+           cmd::argErrorName(error), static_cast<long>(min),
+           static_cast<long>(max));
+  return false;
+}
 
-  // If we found a space, null-terminate the token and update buffer
-  if (*end == ' ') {
-    *end = '\0';           // Null-terminate the current token
-    *m_command = end + 1;  // Point to the rest of the string
-  } else {
-    // No more tokens after this one
-    *m_command = nullptr;
+// With a dwell limit, settings a full packet would not fit are refused here
+// rather than failing packets later
+bool Commander::checkDwell(const airtime::Modem& modem) {
+  if (m_loraCom->fitsDwell(modem)) return true;
+
+  ESP_LOGW(TAG,
+           "SF%u at %.1f kHz takes %u ms for a full packet, over the %u ms "
+           "dwell limit, dwell off lifts it",
+           modem.sf, modem.bwHz / 1000.0f,
+           static_cast<unsigned>(
+               airtime::timeOnAirUs(modem, TxPacket::MAX_LEN) / 1000),
+           static_cast<unsigned>(m_loraCom->dwellLimitUs() / 1000));
+  return false;
+}
+
+bool Commander::readFloat(const char* what, float min, float max, float* out) {
+  std::string_view token = readAndRemove();
+  cmd::ArgError error = cmd::parseFloat(token, min, max, out);
+  if (error == cmd::ArgError::Ok) return true;
+
+  ESP_LOGW(TAG, "%s <%.*s> %s, expecting a number in [%g, %g]", what,
+           static_cast<int>(token.size()), token.data(),
+           cmd::argErrorName(error), min, max);
+  return false;
+}
+
+std::string_view Commander::readAndRemove() {
+  // Skip leading spaces
+  size_t start = m_command.find_first_not_of(' ');
+  if (start == std::string_view::npos) {
+    m_command = std::string_view();
+    return m_command;
   }
+  m_command.remove_prefix(start);
 
-  return start;
+  // The token runs up to the next space, the rest is kept for later calls
+  size_t end = std::min(m_command.find(' '), m_command.size());
+  std::string_view token = m_command.substr(0, end);
+  m_command.remove_prefix(end);
+  return token;
 }
 
 void Commander::setCommand(const char* buffer) {
   if (buffer != nullptr) {
-    *m_command = strdup(buffer);
-    ESP_LOGD(TAG, "Command set: %s", *m_command);
+    m_command = buffer;
+    ESP_LOGD(TAG, "Command set: %s", buffer);
   } else {
+    m_command = std::string_view();
     ESP_LOGW(TAG, "Attempted to set a null buffer");
   }
 }
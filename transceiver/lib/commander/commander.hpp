@@ -3,23 +3,33 @@
 #include <Arduino.h>
 
 #include <cstring>
+#include <string_view>
 
 #include "LoRaCom.hpp"
 #include "SerialCom.hpp"
-
-#define c_cmp(a, b) (strcmp(a, b) == 0)
+#include "commandArgs.hpp"
+#include "commandTable.hpp"
+#include "frame.hpp"
+#include "metrics.hpp"
 
 class Commander {
  public:
   Commander(SerialCom *serialCom, LoRaCom *loraCom);
 
+  // Called by "mode <name>", the owner switches the node over
+  typedef void (*ModeHandler)(void *context, frame::Mode mode);
+  void onMode(ModeHandler handler, void *context);
+
  private:
-  char *m_command[128];  // Buffer to store the command
+  // Unparsed rest of the caller's buffer, tokens are views into it
+  std::string_view m_command;
 
   uint16_t m_timeout = 20'000;  // 20 second timeout for commands
 
   SerialCom *m_serialCom;  // Pointer to SerialCom instance
   LoRaCom *m_loraCom;      // Pointer to LoRaCom instance
+  ModeHandler m_modeHandler = nullptr;
+  void *m_modeContext = nullptr;
 
   typedef void (Commander::*Handler)();
 
@@ -32,8 +42,9 @@ class Commander {
   void handle_command_help();  // Command handler for "help"
   void handle_update();        // Command handler for "update" parameters
   void handle_set();           // Command handler for "set" parameters
-  void handle_mode();  // Command handler for "mode" (eg: transmit, receive,
-                       // transcieve, spectrum scan, etc")
+  void handle_mode();  // Command handler for "mode" (eg: transceive, tdma)
+  void handle_airtime();  // Command handler for "airtime" (duty cycle limit)
+  void handle_stats();    // Command handler for "stats" (metrics snapshot)
 
   // ----- Update Handlers -----
   void handle_update_help();             // Command handler for "help"
@@ -46,38 +57,55 @@ class Commander {
   void handle_set_help();
   void handle_set_OUTPUT();
 
-  void handle_help(const HandlerMap *handler);
+  template <size_t N>
+  void handle_help(const HandlerMap (&handler)[N]);
 
-  static constexpr const HandlerMap command_handler[5] = {
+  static constexpr HandlerMap command_handler[] = {
       {"help", &Commander::handle_command_help},
       {"update", &Commander::handle_update},
       {"set", &Commander::handle_set},
       {"mode", &Commander::handle_mode},
-      {nullptr, nullptr}};
+      {"airtime", &Commander::handle_airtime},
+      {"stats", &Commander::handle_stats}};
 
-  static constexpr const HandlerMap update_handler[6] = {
+  static constexpr HandlerMap update_handler[] = {
       {"help", &Commander::handle_update_help},
       {"gain", &Commander::handle_update_gain},
       {"freqMhz", &Commander::handle_update_freqMhz},
       {"sf", &Commander::handle_update_spreadingFactor},
-      {"bwKHz", &Commander::handle_update_bandwidthKHz},
-      {nullptr, nullptr}};
+      {"bwKHz", &Commander::handle_update_bandwidthKHz}};
 
-  static constexpr const HandlerMap set_handler[3] = {
+  static constexpr HandlerMap set_handler[] = {
       {"help", &Commander::handle_set_help},
-      {"output", &Commander::handle_set_OUTPUT},
-      {nullptr, nullptr}};
-
-  void runMappedCommand(char *command, const HandlerMap *handler);
+      {"output", &Commander::handle_set_OUTPUT}};
+
+  // Perfect hash tables, built by the compiler from the maps above
+  static constexpr auto command_table = cmd::makeTable(command_handler);
+  static constexpr auto update_table = cmd::makeTable(update_handler);
+  static constexpr auto set_table = cmd::makeTable(set_handler);
+  static_assert(command_table.valid() && update_table.valid() &&
+                    set_table.valid(),
+                "no collision free seed, rename a command");
+
+  template <size_t N>
+  void runMappedCommand(const HandlerMap (&handler)[N],
+                        const cmd::Table<N> &table);
+
+  // Next token parsed as a number in [min, max], logs why if it is not
+  bool readInt(const char *what, int32_t min, int32_t max, int32_t *out);
+  bool readFloat(const char *what, float min, float max, float *out);
+  // False, and logs why, if a full packet at `modem` breaks the dwell limit
+  bool checkDwell(const airtime::Modem &modem);
 
   static constexpr const char *TAG = "Commander";
 
  public:
-  void checkCommand(const HandlerMap *handler =
-                        command_handler);  // Check the command and run
-                                           // the appropriate handler
+  // Check the command and run the appropriate handler
+  void checkCommand();
 
+  // Parses `buffer` in place, it must stay valid until the command has run
   void setCommand(const char *buffer);
 
-  char *readAndRemove();
+  // Next space separated token, empty when there is none left
+  std::string_view readAndRemove();
 };
@@ -7,6 +7,46 @@ Control::Control() {
       new Commander(m_serialCom, m_LoRaCom);  // Initialize Commander instance
 
   m_saveFlash = new SaveFlash(m_serialCom);  // Initialize SaveFlash instance
+
+  // getEfuseMac() holds MAC byte 0 in the lowest byte, the last two bytes are
+  // the device specific ones
+  m_nodeId = static_cast<uint16_t>(ESP.getEfuseMac() >> 32);
+
+  m_adr = new adr::Adr(m_nodeId, status_Interval);  // off until "adr on"
+  m_batcher.setBudget(batch_Budget);
+  m_arq = new arq::Arq(m_nodeId, random(INT32_MAX));  // used by "reliable"
+  m_relay = new relay::Relay(m_nodeId, random(INT32_MAX));  // "relay <hops>"
+
+  m_fetchMutex = xSemaphoreCreateMutex();
+  m_fetchServer = new fetch::Server(
+      [](void *context, uint32_t offset, uint8_t *out, size_t len) {
+        return static_cast<SaveFlash *>(context)->read(offset, out, len);
+      },
+      m_saveFlash);
+  m_fetchClient = new fetch::Client(
+      [](void *context, const char *data, size_t len) {
+        static_cast<SerialCom *>(context)->sendData(data, len);
+      },
+      m_serialCom);
+
+  // Off until "mode tdma", then LoRaCom asks it when a frame may go out
+  m_tdma = new tdma::Tdma(m_nodeId, status_Interval);
+  m_commander->onMode(
+      [](void *context, frame::Mode mode) {
+        static_cast<Control *>(context)->setMode(mode);
+      },
+      this);
+  m_LoRaCom->setTxGate(
+      [](void *context, TxPriority priority, uint32_t airtimeUs,
+         uint32_t nowUs) {
+        Control *control = static_cast<Control *>(context);
+        portENTER_CRITICAL_SAFE(&control->m_tdmaMux);
+        uint32_t waitUs = control->m_tdma->delayUs(
+            priority == TxPriority::Sync, airtimeUs, nowUs);
+        portEXIT_CRITICAL_SAFE(&control->m_tdmaMux);
+        return waitUs;
+      },
+      this);
 }
 
 void Control::setup() {
@@ -34,6 +74,7 @@ void Control::setup() {
 
   m_saveFlash->begin();  // Initialize flash storage
 
+  ESP_LOGI(TAG, "Device %s, node ID %04X", deviceID, m_nodeId);
   ESP_LOGI(TAG, "Control setup complete");
 }
 
@@ -54,6 +95,34 @@ void Control::begin() {
     vTaskDelete(StatusTaskHandle);
   }
 
+  if (FlashTaskHandle != nullptr) {
+    vTaskDelete(FlashTaskHandle);
+  }
+
+  if (AdrTaskHandle != nullptr) {
+    vTaskDelete(AdrTaskHandle);
+  }
+
+  if (ArqTaskHandle != nullptr) {
+    vTaskDelete(ArqTaskHandle);
+  }
+
+  if (LogTaskHandle != nullptr) {
+    vTaskDelete(LogTaskHandle);
+  }
+
+  if (BackoffTaskHandle != nullptr) {
+    vTaskDelete(BackoffTaskHandle);
+  }
+
+  if (TdmaTaskHandle != nullptr) {
+    vTaskDelete(TdmaTaskHandle);
+  }
+
+  if (RelayTaskHandle != nullptr) {
+    vTaskDelete(RelayTaskHandle);
+  }
+
   // Create new tasks for serial data handling, LoRa data handling, and status
   // Higher priority = higher number, priorities should be 1-3 for user tasks
   xTaskCreate(
@@ -71,6 +140,37 @@ void Control::begin() {
       [](void *param) { static_cast<Control *>(param)->heartBeatTask(); },
       "HeartBeatTask", 2048, this, 1, &heartBeatTaskHandle);
 
+  // Writes the log staged by processData() to flash in batches
+  xTaskCreate(
+      [](void *param) {
+        static_cast<Control *>(param)->m_saveFlash->flushTask();
+      },
+      "FlashTask", 4096, this, 1, &FlashTaskHandle);
+
+  // Sends what listen before talk held back once the channel may be free
+  xTaskCreate(
+      [](void *param) {
+        static_cast<Control *>(param)->m_LoRaCom->backoffTask();
+      },
+      "BackoffTask", 2048, this, 2, &BackoffTaskHandle);
+
+  xTaskCreate([](void *param) { static_cast<Control *>(param)->adrTask(); },
+              "AdrTask", 4096, this, 1, &AdrTaskHandle);
+
+  xTaskCreate([](void *param) { static_cast<Control *>(param)->arqTask(); },
+              "ArqTask", 4096, this, 2, &ArqTaskHandle);
+
+  // Log fetches, this node's log for others and the logs it asks others for
+  xTaskCreate([](void *param) { static_cast<Control *>(param)->logTask(); },
+              "LogTask", 4096, this, 1, &LogTaskHandle);
+
+  // Syncs of the TDMA schedule while this node coordinates it
+  xTaskCreate([](void *param) { static_cast<Control *>(param)->tdmaTask(); },
+              "TdmaTask", 4096, this, 2, &TdmaTaskHandle);
+
+  xTaskCreate([](void *param) { static_cast<Control *>(param)->relayTask(); },
+              "RelayTask", 4096, this, 2, &RelayTaskHandle);
+
   ESP_LOGI(TAG, "Control begun!\n");
 
   ESP_LOGI(TAG, "Type <help> for a list of commands");
@@ -86,110 +186,949 @@ void Control::heartBeatTask() {
 }
 
 void Control::serialDataTask() {
-  char buffer[128];  // Buffer to store incoming data
-  int rxIndex = 0;   // Index to track the length of the received message
+  // The serial driver wakes this task up instead of it polling
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  m_serialCom->onReceive([self] { xTaskNotifyGive(self); });
 
   while (true) {
-    // Check for incoming data from the serial interface
-    if (m_serialCom->getData(buffer, sizeof(buffer), &rxIndex)) {
-      ESP_LOGI(TAG, "Received: %s", buffer);  // Log the received data
-      interpretMessage(buffer, true);         // Process the message
-      // clear the buffer for the next message
-      memset(buffer, 0, sizeof(buffer));
-      rxIndex = 0;  // Reset the index
+    // Handle every complete line that is already buffered
+    while (const char *line = m_serialCom->readLine()) {
+      ESP_LOGI(TAG, "Received: %s", line);  // Log the received data
+      interpretMessage(line, true);         // Process the message
     }
 
-    // Use a small delay instead of yield() to be more cooperative
-    vTaskDelay(pdMS_TO_TICKS(10));  // 10ms delay allows other tasks to run
+    // Sleep until more bytes arrive, or until the data batch is due
+    TickType_t wait = portMAX_DELAY;
+    if (!m_batcher.empty()) {
+      uint32_t dueInMs = m_batcher.dueInMs(millis());
+      if (dueInMs == 0) {
+        flushBatch();
+        continue;
+      }
+      wait = std::max<TickType_t>(1, pdMS_TO_TICKS(dueInMs));
+    }
+    ulTaskNotifyTake(pdTRUE, wait);
   }
 }
 
 void Control::loRaDataTask() {
-  char buffer[128];  // Buffer to store incoming data
-  int rxIndex = 0;   // Index to track the length of the received message
+  // DIO1 wakes this task up as soon as a packet is in the radio
+  m_LoRaCom->setReceiveTask(xTaskGetCurrentTaskHandle());
 
   while (true) {
-    // Check for incoming data from the LoRa interface
-    if (m_LoRaCom->getMessage(buffer, sizeof(buffer))) {
-      ESP_LOGD(TAG, "Received: %s", buffer);  // Log the received data
-      interpretMessage(buffer, false);        // Process the message
-      // Send the received data over serial
-      m_serialCom->sendData("Received: <");
-      m_serialCom->sendData(buffer);
-      m_serialCom->sendData(">\n");
-
-      memset(buffer, 0, sizeof(buffer));
-      rxIndex = 0;  // Reset the index
+    // Handle every packet the interrupt queued, in place
+    while (const RxPacket *packet = m_LoRaCom->peekMessage()) {
+      handleFrame(*packet);
+      metrics::record(metrics::Histogram::RxHandledUs,
+                      micros() - packet->timestampUs);
+      m_LoRaCom->popMessage();
     }
 
-    // Use a small delay instead of yield() to be more cooperative
-    vTaskDelay(pdMS_TO_TICKS(10));
+    // Sleep until the next packet
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
   }
 }
 
 void Control::statusTask() {
-  static unsigned long lastStatusTime = 0;
+  // Everything for the beacon lives in these buffers, nothing in the loop
+  // below may touch the heap
+  uint8_t buffer[frame::HEADER_SIZE + frame::STATUS_SIZE +
+                 frame::LINK_REPORT_SIZE + frame::CRC_SIZE];
+  char text[frame::MAX_TEXT];
+  TxHandle lastBeacon;
 
   while (true) {
     // Process any pending LoRa operations first
     // m_LoRaCom->processOperations();
+#ifdef HEAP_COUNTER
+    uint32_t allocations = heapCounter::allocations();
+#endif
+
+    frame::Header header = {frame::Type::Status, m_nodeId, m_txSeq++};
+    frame::Status status;
+    status.rssi = static_cast<int8_t>(
+        std::max<int32_t>(-128, std::min<int32_t>(127, m_LoRaCom->getRssi())));
+    status.battery = static_cast<uint8_t>(m_batteryLevel + 0.5f);
+    status.mode = m_mode;
+    status.health = m_status;
 
-    int32_t rssi = m_LoRaCom->getRssi();
-    String msg = String("status ") + "ID:" + deviceID +
-                 " RSSI:" + String(rssi) +
-                 " batteryLevel:" + String(m_batteryLevel) + " mode:" + m_mode +
-                 " status:" + m_status;
+    // The beacon also carries how well this node hears the others
+    frame::LinkReport report;
+    portENTER_CRITICAL(&m_adrMux);
+    bool adrEnabled = m_adr->enabled();
+    if (adrEnabled) report = m_adr->report(millis());
+    portEXIT_CRITICAL(&m_adrMux);
 
-    // Send over serial first (this should be fast)
-    m_serialCom->sendData(((msg + "\n").c_str()));
+    size_t len = frame::encodeStatus(header, status, buffer, sizeof(buffer),
+                                     adrEnabled ? &report : nullptr);
+
+    // Send over serial first (this should be fast), text only matters when
+    // someone is reading it
+    if (m_serialCom->connected()) {
+      frame::toText(header, buffer + frame::HEADER_SIZE, frame::STATUS_SIZE,
+                    text, sizeof(text));
+      m_serialCom->sendData(text);
+      m_serialCom->sendData("\n");
+    }
 
     // Try LoRa transmission with timeout protection
     // ESP_LOGD(TAG, "Starting LoRa transmission...");
-    m_LoRaCom->sendMessage(msg.c_str());
-    vTaskDelay(pdMS_TO_TICKS(status_Interval));
+    // Under a duty cycle limit the last one may still wait for its budget,
+    // a second one would only take another slot and go out stale
+    if (m_LoRaCom->txState(lastBeacon) != TxState::Queued) {
+      lastBeacon = m_LoRaCom->sendMessage(buffer, len, TxPriority::Status);
+    }
+
+#ifdef HEAP_COUNTER
+    ESP_LOGD(TAG, "Beacon heap allocations: %u",
+             static_cast<unsigned>(heapCounter::allocations() - allocations));
+#endif
+    // Nodes that powered up together would otherwise keep beaconing into
+    // each other
+    vTaskDelay(pdMS_TO_TICKS(status_Interval - status_Jitter +
+                             random(2 * status_Jitter + 1)));
   }
 }
 
+void Control::adrTask() {
+  uint8_t buffer[frame::HEADER_SIZE + frame::RATE_SIZE + frame::CRC_SIZE];
+
+  while (true) {
+    uint32_t airtimeMs = m_LoRaCom->timeOnAirUs(sizeof(buffer)) / 1000 + 1;
+    frame::RateOrder order;
+    portENTER_CRITICAL(&m_adrMux);
+    bool announce = m_adr->poll(millis(), airtimeMs, &order);
+    adr::Setting setting = m_adr->setting();
+    portEXIT_CRITICAL(&m_adrMux);
+
+    // Retried on the next tick while the radio is busy sending
+    if (setting != m_radioSetting) {
+      const adr::DataRate &rate = adr::RATES[setting.rate];
+      if (m_LoRaCom->setModem(rate.sf, rate.bwKHz, setting.powerDbm)) {
+        m_radioSetting = setting;
+      }
+    }
+
+    if (announce) {
+      frame::Header header = {frame::Type::Rate, m_nodeId, m_txSeq++};
+      size_t len = frame::encodeRate(header, order, buffer, sizeof(buffer));
+      m_LoRaCom->sendMessage(buffer, len, TxPriority::Command);
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(adr::Adr::TICK_MS));
+  }
+}
+
+void Control::arqTask() {
+  uint8_t buffer[frame::MAX_SIZE];
+  arq::Outgoing out;
+
+  while (true) {
+    // Everything due now: retransmissions, new frames, acknowledgements
+    uint32_t waitMs = arq::NO_EVENT;
+    while (true) {
+      portENTER_CRITICAL(&m_arqMux);
+      bool send = m_arq->poll(millis(), &out);
+      if (!send) waitMs = m_arq->nextEventMs(millis());
+      portEXIT_CRITICAL(&m_arqMux);
+      if (!send) break;
+
+      frame::Header header = {frame::Type::Arq, m_nodeId, m_txSeq++};
+      size_t len = frame::encodeArq(header, out.arq, out.text, out.len, buffer,
+                                    sizeof(buffer));
+      TxPriority priority = TxPriority::Command;
+      if (out.arq.kind == static_cast<uint8_t>(frame::Type::Data)) {
+        priority = TxPriority::Data;
+      }
+      m_LoRaCom->sendMessage(buffer, len, priority);
+    }
+
+    // Until the next timer, or until a frame is queued or acknowledged
+    TickType_t wait = portMAX_DELAY;
+    if (waitMs != arq::NO_EVENT) {
+      wait = std::max<TickType_t>(1, pdMS_TO_TICKS(waitMs));
+    }
+    ulTaskNotifyTake(pdTRUE, wait);
+  }
+}
+
+void Control::logTask() {
+  uint8_t buffer[frame::MAX_SIZE];
+  fetch::Outgoing out;
+
+  while (true) {
+    uint32_t now = millis();
+    xSemaphoreTake(m_fetchMutex, portMAX_DELAY);
+    // Requests for the log of another node first, then fragments of this one
+    bool request = m_fetchClient->poll(now, &out);
+    bool send = request || m_fetchServer->poll(&out);
+    uint32_t waitMs = m_fetchClient->nextEventMs(now);
+    xSemaphoreGive(m_fetchMutex);
+
+    if (!send) {
+      // Until a request times out, or until a Log frame arrives
+      TickType_t wait = portMAX_DELAY;
+      if (waitMs != fetch::NO_EVENT) {
+        wait = std::max<TickType_t>(1, pdMS_TO_TICKS(waitMs));
+      }
+      ulTaskNotifyTake(pdTRUE, wait);
+      continue;
+    }
+
+    frame::Header header = {frame::Type::Log, m_nodeId, m_txSeq++};
+    size_t len = frame::encodeLog(header, out.log, out.body, out.len, buffer,
+                                  sizeof(buffer));
+    TxHandle handle = m_LoRaCom->sendMessage(
+        buffer, len, request ? TxPriority::Command : TxPriority::Data);
+
+    // One frame in the TX queue at a time, so a fetch leaves room for the
+    // other tasks and a new request changes what goes out next right away
+    uint32_t airtimeMs = m_LoRaCom->timeOnAirUs(len) / 1000 + 1;
+    TickType_t poll = std::max<TickType_t>(1, pdMS_TO_TICKS(airtimeMs / 4));
+    TxState state = m_LoRaCom->txState(handle);
+    while (state == TxState::Queued || state == TxState::Sending) {
+      vTaskDelay(poll);
+      state = m_LoRaCom->txState(handle);
+    }
+    if (state == TxState::Dropped) vTaskDelay(pdMS_TO_TICKS(airtimeMs));
+  }
+}
+
+void Control::tdmaTask() {
+  uint8_t buffer[frame::MAX_SIZE];
+  uint16_t ids[tdma::PAGE];
+
+  while (true) {
+    frame::Sync sync;
+    size_t count = 0;
+    uint32_t waitUs = tdma::NO_EVENT;
+    uint32_t airtimeUs = m_LoRaCom->timeOnAirUs(frame::MAX_SIZE);
+    portENTER_CRITICAL(&m_tdmaMux);
+    bool announce =
+        m_tdma->poll(micros(), airtimeUs, &sync, ids, &count, &waitUs);
+    portEXIT_CRITICAL(&m_tdmaMux);
+
+    // Queued ahead of the superframe, LoRaCom holds it back to its start
+    if (announce) {
+      frame::Header header = {frame::Type::Sync, m_nodeId, m_txSeq++};
+      size_t len = frame::encodeSync(header, sync, ids, count, buffer,
+                                     sizeof(buffer));
+      m_LoRaCom->sendMessage(buffer, len, TxPriority::Sync);
+    }
+
+    // Until the next Sync is due, or until the mode changes
+    TickType_t wait = portMAX_DELAY;
+    if (waitUs != tdma::NO_EVENT) {
+      wait = std::max<TickType_t>(1, pdMS_TO_TICKS((waitUs + 999) / 1000));
+    }
+    ulTaskNotifyTake(pdTRUE, wait);
+  }
+}
+
+void Control::relayTask() {
+  relay::Outgoing out;
+
+  while (true) {
+    // Every frame whose turn came
+    uint32_t waitMs = relay::NO_EVENT;
+    while (true) {
+      portENTER_CRITICAL(&m_relayMux);
+      bool send = m_relay->poll(millis(), &out);
+      if (!send) waitMs = m_relay->nextEventMs(millis());
+      portEXIT_CRITICAL(&m_relayMux);
+      if (!send) break;
+
+      TxPriority priority = TxPriority::Data;
+      if (out.type == frame::Type::Command) priority = TxPriority::Command;
+      if (out.type == frame::Type::Status) priority = TxPriority::Status;
+      m_LoRaCom->sendMessage(out.data, out.len, priority);
+    }
+
+    // Until the next one is due, or until a frame is queued
+    TickType_t wait = portMAX_DELAY;
+    if (waitMs != relay::NO_EVENT) {
+      wait = std::max<TickType_t>(1, pdMS_TO_TICKS(waitMs));
+    }
+    ulTaskNotifyTake(pdTRUE, wait);
+  }
+}
+
+TxHandle Control::sendFrame(frame::Type type, const char *payload,
+                            uint32_t originUs) {
+  if (m_reliablePeer != 0 &&
+      (type == frame::Type::Data || type == frame::Type::Command)) {
+    // Sent, and repeated until acknowledged, by arqTask()
+    portENTER_CRITICAL(&m_arqMux);
+    bool queued = m_arq->send(m_reliablePeer, type, payload, strlen(payload),
+                              millis());
+    portEXIT_CRITICAL(&m_arqMux);
+    if (!queued) {
+      ESP_LOGE(TAG, "Reliable queue full, dropped: %s", payload);
+      return TxHandle();
+    }
+    xTaskNotifyGive(ArqTaskHandle);
+    return TxHandle();
+  }
+
+  uint8_t buffer[frame::MAX_SIZE];
+  frame::Header header = {type, m_nodeId, m_txSeq++};
+  size_t len = frame::encodeText(header, payload, strlen(payload), buffer,
+                                 sizeof(buffer));
+  if (len == 0) {
+    ESP_LOGE(TAG, "Payload too long for one frame: %s", payload);
+    return TxHandle();
+  }
+
+  TxPriority priority = TxPriority::Data;
+  if (type == frame::Type::Command) priority = TxPriority::Command;
+  if (type == frame::Type::Status) priority = TxPriority::Status;
+  return m_LoRaCom->sendMessage(buffer, len, priority, originUs);
+}
+
 void Control::interpretMessage(const char *buffer, bool relayMsgLoRa) {
   m_commander->setCommand(buffer);  // Set the command in the commander
-  char *token = m_commander->readAndRemove();
+  std::string_view token = m_commander->readAndRemove();
 
   // eg: "command update gain 22"
   // eg: "status <deviceID> <RSSI> <batteryLevel> <mode> <status>"
   // eg: "data <payload>"
 
-  if (c_cmp(token, "command")) {
+  if (token == "command") {
     if (relayMsgLoRa) {
       // send to other devices to sync parameters
-      m_LoRaCom->sendMessage(buffer);
-      while (m_LoRaCom->checkTxMode()) {
-        // wait for LoRa to finish transmitting
-        vTaskDelay(pdMS_TO_TICKS(10));  // Wait for LoRa transmission
-      }
+      // The TX queue sends it in the background, commands go out first
+      const char *args = strchr(buffer, ' ');
+      sendFrame(frame::Type::Command, args ? args + 1 : "");
     }
     // should probably wait for a success reply before changing THIS device
     ESP_LOGD(TAG, "Processing command: %s", buffer);
     m_commander->checkCommand();
-  } else if (c_cmp(token, "data")) {
+  } else if (token == "data") {
+    // Urgent commands above go out on their own, data waits for company
+    const char *record = strchr(buffer, ' ');
+    if (relayMsgLoRa && record != nullptr) queueData(record + 1);
     processData(buffer);
-  } else if (c_cmp(token, "status")) {
+  } else if (token == "status") {
     processData(buffer);
-  } else if (c_cmp(token, "help")) {
+  } else if (token == "help") {
     ESP_LOGI(TAG,
              "Message format: <type> <data1> <data2> ...\n"
              "Valid types:\n"
-             "  - flash: for flash read and save\n"
              "  - command: for device control\n"
              "  - data: for data transmission\n"
              "  - message: for standard messages\n"
-             "  - flash: to print and auto erase logs\n"
+             "  - flash [read]: to print the log as text\n"
+             "  - flash dump <offset>: to stream the stored log, from\n"
+             "    <offset> to resume an interrupted dump\n"
+             "  - flash erase <end>: to erase the log once it was received\n"
+             "    up to <end>\n"
+             "  - batch [ms]: longest a data line waits to share a frame,\n"
+             "    0 sends each alone, without argument the batch counters\n"
+             "  - reliable [<node ID>|off]: data and commands only to that\n"
+             "    node, acknowledged and repeated until they arrive\n"
+             "  - fetch <node ID> [offset] [fec]: to get the log of another\n"
+             "    node over LoRa, printed like flash dump, with erasure\n"
+             "    coding on lossy links\n"
+             "  - fetch <node ID> erase: to erase that log once it was\n"
+             "    fetched to its end, fetch alone shows the progress\n"
+             "  - adr [on|off]: adaptive data rate, without argument its\n"
+             "    state\n"
+             "  - lbt [on|off]: listen before talk, without argument the\n"
+             "    busy channel counters\n"
+             "  - dwell [on|off]: 400 ms limit per packet, for US915\n"
+             "    hopping channels, off by default\n"
+             "  - command mode tdma|transceive: send in the slots of a\n"
+             "    TDMA schedule on every node, or whenever the channel is\n"
+             "    free\n"
+             "  - tdma: the TDMA schedule and counters\n"
+             "  - relay [hops|off]: send frames heard on, for nodes out of\n"
+             "    range of each other, without argument the counters\n"
+             "  - airtime [percent]: duty cycle limit of this node, 0 for\n"
+             "    none, without argument the airtime per class. command\n"
+             "    airtime <percent> sets it on every node\n"
+             "  - stats [reset]: counters and latency histograms since\n"
+             "    boot or the last reset, reset starts a new window\n"
              "  - status: for device status\n"
              "  - help: for displaying help information");
-  } else if (c_cmp(token, "flash")) {
-    m_saveFlash->readFile();
-    m_saveFlash->removeFile();  // Update the flash storage
-    m_saveFlash->begin();       // Reinitialize the flash storage
+  } else if (token == "flash") {
+    handleFlash();
+  } else if (token == "adr") {
+    handleAdr();
+  } else if (token == "lbt") {
+    handleLbt();
+  } else if (token == "dwell") {
+    handleDwell();
+  } else if (token == "tdma") {
+    handleTdma();
+  } else if (token == "relay") {
+    handleRelay();
+  } else if (token == "airtime" || token == "stats") {
+    // Same as the command, but only on this node
+    m_commander->setCommand(buffer);
+    m_commander->checkCommand();
+  } else if (token == "batch") {
+    handleBatch();
+  } else if (token == "reliable") {
+    handleReliable();
+  } else if (token == "fetch") {
+    handleFetch();
+  }
+}
+
+// "flash [read]", "flash dump [offset]" or "flash erase <end>", erasing is a
+// separate step so a dump that was cut off can be resumed. "read" is the same
+// as "dump" unless the log is compressed.
+void Control::handleFlash() {
+  std::string_view action = m_commander->readAndRemove();
+  std::string_view arg = m_commander->readAndRemove();
+
+  uint32_t offset = 0;
+  if (!arg.empty() &&
+      cmd::parseUint(arg, 0, UINT32_MAX, &offset) != cmd::ArgError::Ok) {
+    ESP_LOGW(TAG, "Bad flash offset <%.*s>", static_cast<int>(arg.size()),
+             arg.data());
+    return;
+  }
+
+  if (action.empty() || action == "read") {
+    m_saveFlash->dump(offset, true);
+  } else if (action == "dump") {
+    m_saveFlash->dump(offset);
+  } else if (action == "erase" && !arg.empty()) {
+    m_saveFlash->erase(offset);
+  } else {
+    ESP_LOGW(TAG,
+             "Usage: flash [read] | flash dump <offset> | flash erase <end>");
+  }
+}
+
+// "adr on", "adr off" or "adr" for its state. Every node of the network has
+// to run it, the rate only changes for all of them at once.
+void Control::handleAdr() {
+  std::string_view action = m_commander->readAndRemove();
+  uint32_t now = millis();
+
+  portENTER_CRITICAL(&m_adrMux);
+  if (action == "on" || action == "off") {
+    m_adr->setEnabled(action == "on", now);
+  }
+  bool enabled = m_adr->enabled();
+  adr::Setting setting = m_adr->setting();
+  bool coordinator = m_adr->coordinator(now);
+  bool scanning = m_adr->scanning();
+  float offsetDb = m_adr->marginOffsetDb();
+  size_t peers = m_adr->peers(now);
+  uint8_t slowest = m_adr->slowestRate();
+  portEXIT_CRITICAL(&m_adrMux);
+
+  if (!action.empty() && action != "on" && action != "off") {
+    ESP_LOGW(TAG, "Usage: adr [on|off]");
+    return;
+  }
+  const adr::DataRate &rate = adr::RATES[setting.rate];
+  ESP_LOGI(TAG,
+           "ADR %s: DR%u (SF%u, %.0f kHz), %d dBm, epoch %u, %u peers, "
+           "margin +%.1f dB, down to DR%u%s%s",
+           enabled ? "on" : "off", setting.rate, rate.sf, rate.bwKHz,
+           setting.powerDbm, setting.epoch, static_cast<unsigned>(peers),
+           offsetDb, slowest, coordinator ? ", coordinator" : "",
+           scanning ? ", scanning" : "");
+}
+
+// "lbt on", "lbt off" or "lbt" for the counters. Off, packets go out
+// without checking the channel first.
+void Control::handleLbt() {
+  std::string_view action = m_commander->readAndRemove();
+  if (action == "on" || action == "off") {
+    m_LoRaCom->setListenBeforeTalk(action == "on");
+  } else if (!action.empty()) {
+    ESP_LOGW(TAG, "Usage: lbt [on|off]");
+    return;
+  }
+
+  TxStats stats = m_LoRaCom->txStats();
+  ESP_LOGI(TAG,
+           "Listen before talk %s: channel busy %u times for %u packets, "
+           "%llu ms backoff, %u sent anyway",
+           m_LoRaCom->listenBeforeTalk() ? "on" : "off",
+           static_cast<unsigned>(stats.cadBusy),
+           static_cast<unsigned>(stats.started),
+           static_cast<unsigned long long>(stats.backoffTotalUs / 1000),
+           static_cast<unsigned>(stats.cadForced));
+}
+
+// "dwell on", "dwell off" or "dwell" for its state. On, "update sf" and
+// "update bwKHz" refuse settings a full packet would not fit in
+// LoRaCom::DWELL_US, and ADR leaves out the rates it would not fit at. Every
+// node of the network has to have the same.
+void Control::handleDwell() {
+  std::string_view action = m_commander->readAndRemove();
+  if (action == "on" || action == "off") {
+    if (!m_LoRaCom->setDwellLimit(action == "on" ? LoRaCom::DWELL_US : 0)) {
+      ESP_LOGW(TAG, "The current settings already break the dwell limit");
+    }
+    // ADR keeps to the rates a full packet fits at
+    uint8_t slowest = 0;
+    while (slowest + 1 < adr::RATE_COUNT &&
+           m_LoRaCom->fitsDwell(adrModem(adr::RATES[slowest + 1]))) {
+      slowest++;
+    }
+    portENTER_CRITICAL(&m_adrMux);
+    m_adr->setSlowestRate(slowest);
+    portEXIT_CRITICAL(&m_adrMux);
+  } else if (!action.empty()) {
+    ESP_LOGW(TAG, "Usage: dwell [on|off]");
+    return;
+  }
+
+  uint32_t limitUs = m_LoRaCom->dwellLimitUs();
+  uint32_t fullUs = m_LoRaCom->timeOnAirUs(TxPacket::MAX_LEN);
+  if (limitUs == 0) {
+    ESP_LOGI(TAG, "Dwell limit off, a full packet takes %u ms",
+             static_cast<unsigned>(fullUs / 1000));
+  } else {
+    ESP_LOGI(TAG, "Dwell limit %u ms, a full packet takes %u ms",
+             static_cast<unsigned>(limitUs / 1000),
+             static_cast<unsigned>(fullUs / 1000));
+  }
+}
+
+// "tdma" shows the schedule this node follows, "command mode tdma" turns it
+// on for the network
+void Control::handleTdma() {
+  uint32_t now = micros();
+  portENTER_CRITICAL(&m_tdmaMux);
+  bool enabled = m_tdma->enabled();
+  bool coordinator = m_tdma->coordinator(now);
+  bool synced = m_tdma->synced(now);
+  uint16_t coordinatorId = m_tdma->coordinatorId();
+  int slot = m_tdma->slot();
+  unsigned members = m_tdma->members();
+  uint32_t superframeUs = m_tdma->superframeUs();
+  tdma::Stats stats = m_tdma->stats();
+  portEXIT_CRITICAL(&m_tdmaMux);
+
+  if (!enabled) {
+    ESP_LOGI(TAG, "TDMA off, mode %s", frame::modeName(m_mode));
+    return;
+  }
+  ESP_LOGI(TAG,
+           "TDMA %s%s, coordinator %04X, slot %d of %u, superframe %u ms: "
+           "%u Syncs sent, %u followed, %u joined, %u expired",
+           synced ? "synced" : "unsynced", coordinator ? ", coordinating" : "",
+           coordinatorId, slot, members,
+           static_cast<unsigned>(superframeUs / 1000),
+           static_cast<unsigned>(stats.superframes),
+           static_cast<unsigned>(stats.syncs),
+           static_cast<unsigned>(stats.joined),
+           static_cast<unsigned>(stats.expired));
+}
+
+relay::Stats Control::relayStats() {
+  portENTER_CRITICAL(&m_relayMux);
+  relay::Stats stats = m_relay->stats();
+  portEXIT_CRITICAL(&m_relayMux);
+  return stats;
+}
+
+// "relay <hops>" sends status, data and command frames on until they took
+// that many hops, "relay off" stops and "relay" shows the counters
+void Control::handleRelay() {
+  std::string_view arg = m_commander->readAndRemove();
+  uint32_t hops = 0;
+  if (!arg.empty() && arg != "off" &&
+      cmd::parseUint(arg, 1, frame::MAX_HOPS, &hops) != cmd::ArgError::Ok) {
+    ESP_LOGW(TAG, "Usage: relay [1..%u|off]", frame::MAX_HOPS);
+    return;
+  }
+
+  portENTER_CRITICAL(&m_relayMux);
+  if (!arg.empty()) m_relay->setMaxHops(static_cast<uint8_t>(hops));
+  uint8_t maxHops = m_relay->maxHops();
+  relay::Stats stats = m_relay->stats();
+  portEXIT_CRITICAL(&m_relayMux);
+
+  if (maxHops == 0) {
+    ESP_LOGI(TAG, "Relay off");
+  } else {
+    ESP_LOGI(TAG, "Relay up to %u hops", maxHops);
+  }
+  ESP_LOGI(TAG,
+           "Heard %u, copies dropped %u, relayed %u, left to others %u, no "
+           "room %u",
+           static_cast<unsigned>(stats.heard),
+           static_cast<unsigned>(stats.duplicates),
+           static_cast<unsigned>(stats.relayed),
+           static_cast<unsigned>(stats.suppressed),
+           static_cast<unsigned>(stats.dropped));
+}
+
+// "command mode <name>" from the serial side or another node
+void Control::setMode(frame::Mode mode) {
+  m_mode = mode;
+  portENTER_CRITICAL(&m_tdmaMux);
+  m_tdma->setEnabled(mode == frame::Mode::Tdma, micros());
+  portEXIT_CRITICAL(&m_tdmaMux);
+  if (TdmaTaskHandle != nullptr) xTaskNotifyGive(TdmaTaskHandle);
+  ESP_LOGI(TAG, "Mode %s", frame::modeName(mode));
+}
+
+// "batch <ms>" sets the latency budget, "batch" shows it with the counters
+void Control::handleBatch() {
+  std::string_view arg = m_commander->readAndRemove();
+  if (!arg.empty()) {
+    uint32_t budgetMs = 0;
+    if (cmd::parseUint(arg, 0, 60'000, &budgetMs) != cmd::ArgError::Ok) {
+      ESP_LOGW(TAG, "Usage: batch [0..60000 ms]");
+      return;
+    }
+    m_batcher.setBudget(budgetMs);
+  }
+
+  const Batcher::Stats &stats = m_batcher.stats();
+  ESP_LOGI(TAG, "Batch budget %u ms: %u records in %u frames, %u sent full",
+           static_cast<unsigned>(m_batcher.budget()),
+           static_cast<unsigned>(stats.records),
+           static_cast<unsigned>(stats.batches),
+           static_cast<unsigned>(stats.full));
+}
+
+// "reliable <node ID>" sends data and commands to that node only, with
+// acknowledgements. "reliable off" broadcasts them again, "reliable" shows
+// the counters.
+void Control::handleReliable() {
+  std::string_view arg = m_commander->readAndRemove();
+  if (arg == "off") {
+    m_reliablePeer = 0;
+  } else if (!arg.empty()) {
+    uint32_t peer = 0;
+    if (cmd::parseHex(arg, 1, UINT16_MAX, &peer) != cmd::ArgError::Ok) {
+      ESP_LOGW(TAG, "Usage: reliable [<node ID in hex>|off]");
+      return;
+    }
+    m_reliablePeer = static_cast<uint16_t>(peer);
+  }
+  // Leave room for the ARQ header next to a full batch
+  if (!m_batcher.empty()) flushBatch();
+  m_batcher.setCapacity(m_reliablePeer ? arq::MAX_TEXT : Batcher::CAPACITY);
+
+  portENTER_CRITICAL(&m_arqMux);
+  arq::Stats stats = m_arq->stats();
+  size_t queued = m_arq->queued();
+  uint32_t rtoMs = m_arq->rtoMs(m_reliablePeer);
+  float srttMs = m_arq->srttMs(m_reliablePeer);
+  portEXIT_CRITICAL(&m_arqMux);
+
+  if (m_reliablePeer == 0) {
+    ESP_LOGI(TAG, "Reliable off");
+  } else {
+    ESP_LOGI(TAG, "Reliable to %04X: srtt %.0f ms, rto %u ms", m_reliablePeer,
+             srttMs, static_cast<unsigned>(rtoMs));
+  }
+  ESP_LOGI(TAG,
+           "Sent %u, repeated %u (%u on sack), acked %u, failed %u, queued "
+           "%u, acks %u, received %u, duplicates %u",
+           static_cast<unsigned>(stats.sent),
+           static_cast<unsigned>(stats.retransmitted),
+           static_cast<unsigned>(stats.fastRetransmits),
+           static_cast<unsigned>(stats.acked),
+           static_cast<unsigned>(stats.failed),
+           static_cast<unsigned>(queued),
+           static_cast<unsigned>(stats.acksOnly),
+           static_cast<unsigned>(stats.delivered),
+           static_cast<unsigned>(stats.duplicates));
+}
+
+// "fetch <node ID> [offset] [fec]" gets the log of another node over LoRa,
+// "fetch <node ID> erase" clears it there afterwards and "fetch" shows the
+// progress and counters of both sides
+void Control::handleFetch() {
+  std::string_view arg = m_commander->readAndRemove();
+  uint32_t peer = 0;
+  uint32_t from = 0;
+  bool fec = false;
+  bool erase = false;
+  bool usage = !arg.empty() &&
+               cmd::parseHex(arg, 1, UINT16_MAX, &peer) != cmd::ArgError::Ok;
+  for (arg = m_commander->readAndRemove(); !usage && !arg.empty();
+       arg = m_commander->readAndRemove()) {
+    if (arg == "fec") {
+      fec = true;
+    } else if (arg == "erase") {
+      erase = true;
+    } else {
+      usage = cmd::parseUint(arg, 0, UINT32_MAX, &from) != cmd::ArgError::Ok;
+    }
+  }
+  if (usage) {
+    ESP_LOGW(TAG, "Usage: fetch [<node ID in hex> [offset] [fec] | erase]");
+    return;
+  }
+
+  if (peer != 0) {
+    // Long enough for the node to finish the frame it is sending
+    uint32_t timeoutMs =
+        1000 + 4 * (m_LoRaCom->timeOnAirUs(frame::MAX_SIZE) / 1000);
+    xSemaphoreTake(m_fetchMutex, portMAX_DELAY);
+    bool started =
+        erase ? m_fetchClient->peer() == peer &&
+                    m_fetchClient->erase(timeoutMs, millis())
+              : m_fetchClient->fetch(static_cast<uint16_t>(peer), from, fec,
+                                     timeoutMs, millis());
+    xSemaphoreGive(m_fetchMutex);
+    if (started) {
+      xTaskNotifyGive(LogTaskHandle);
+    } else if (erase) {
+      ESP_LOGW(TAG, "Fetch the log of %04X to its end before erasing it",
+               static_cast<unsigned>(peer));
+    } else {
+      ESP_LOGW(TAG, "Fetch busy or out of memory");
+    }
+    return;
+  }
+
+  xSemaphoreTake(m_fetchMutex, portMAX_DELAY);
+  fetch::Client::State state = m_fetchClient->state();
+  uint16_t fetchPeer = m_fetchClient->peer();
+  uint32_t offset = m_fetchClient->offset();
+  uint32_t target = m_fetchClient->target();
+  fetch::ClientStats client = m_fetchClient->stats();
+  fetch::ServerStats server = m_fetchServer->stats();
+  float lossRate = m_fetchServer->lossRate();
+  xSemaphoreGive(m_fetchMutex);
+
+  static const char *const STATES[] = {"idle", "fetching", "erasing"};
+  ESP_LOGI(TAG,
+           "Fetch %s, %04X at %u of %u: %u requests, %u fragments (%u "
+           "repeats, %u rebuilt), %u timeouts",
+           STATES[static_cast<size_t>(state)], fetchPeer,
+           static_cast<unsigned>(offset), static_cast<unsigned>(target),
+           static_cast<unsigned>(client.requests),
+           static_cast<unsigned>(client.fragments),
+           static_cast<unsigned>(client.duplicates),
+           static_cast<unsigned>(client.decoded),
+           static_cast<unsigned>(client.timeouts));
+  ESP_LOGI(TAG,
+           "Served %u windows in %u rounds: %u fragments, %u parity, loss "
+           "%.0f%%, erased %u times",
+           static_cast<unsigned>(server.windows),
+           static_cast<unsigned>(server.rounds),
+           static_cast<unsigned>(server.fragments),
+           static_cast<unsigned>(server.parity), lossRate * 100,
+           static_cast<unsigned>(server.erased));
+}
+
+void Control::queueData(const char *record) {
+  size_t len = strlen(record);
+  uint32_t now = millis();
+  if (!m_batcher.add(record, len, now)) {
+    // No room next to the waiting ones, send those first
+    if (!m_batcher.empty()) flushBatch();
+    if (!m_batcher.add(record, len, now)) {
+      ESP_LOGE(TAG, "Data record too long for one frame: %s", record);
+      return;
+    }
+  }
+  if (m_batchOriginUs == 0) m_batchOriginUs = micros();
+  if (m_batcher.dueInMs(now) == 0) flushBatch();  // no budget, no waiting
+}
+
+void Control::flushBatch() {
+  size_t len = 0;
+  const char *batch = m_batcher.take(&len);
+  sendFrame(frame::Type::Data, batch, m_batchOriginUs);
+  m_batchOriginUs = 0;
+}
+
+// A data frame holds one or more records, each is handled like a "data" line
+// of its own
+void Control::handleRecords(const char *text) {
+  const char *record = text + strlen("data ");
+  char line[frame::MAX_TEXT];
+  while (true) {
+    const char *end = strchr(record, Batcher::SEPARATOR);
+    size_t len = end ? end - record : strlen(record);
+    snprintf(line, sizeof(line), "data %.*s", static_cast<int>(len), record);
+
+    processData(line);
+    m_serialCom->sendData("Received: <");
+    m_serialCom->sendData(line);
+    m_serialCom->sendData(">\n");
+
+    if (end == nullptr) break;
+    record = end + 1;
+  }
+}
+
+// ADR and TDMA bookkeeping for a frame heard directly from its sender
+void Control::handleLink(const frame::Header &header, const RxPacket &packet,
+                         const uint8_t *payload, size_t payloadLen) {
+  // Every frame is a link measurement, reports and orders drive the rate
+  frame::LinkReport report;
+  frame::RateOrder order;
+  uint32_t now = millis();
+  portENTER_CRITICAL(&m_adrMux);
+  m_adr->onFrame(header.nodeId, header.seq, packet.rssi, packet.snr, now);
+  if (header.type == frame::Type::Status &&
+      frame::decodeLinkReport(payload, payloadLen, &report)) {
+    m_adr->onReport(header.nodeId, report, now);
+  }
+  if (header.type == frame::Type::Rate &&
+      frame::decodeRate(payload, payloadLen, &order)) {
+    m_adr->onOrder(header.nodeId, order, now);
+  }
+  portEXIT_CRITICAL(&m_adrMux);
+
+  // Any frame makes its sender a TDMA member, a Sync sets the schedule. It
+  // began on air a time on air before DIO1 fired.
+  frame::Sync sync;
+  const uint8_t *ids = nullptr;
+  size_t count = 0;
+  bool isSync = header.type == frame::Type::Sync &&
+                frame::decodeSync(payload, payloadLen, &sync, &ids, &count);
+  uint32_t startUs = packet.timestampUs - m_LoRaCom->timeOnAirUs(packet.len);
+  portENTER_CRITICAL(&m_tdmaMux);
+  m_tdma->onFrame(header.nodeId, micros());
+  if (isSync) m_tdma->onSync(header.nodeId, sync, ids, count, startUs);
+  portEXIT_CRITICAL(&m_tdmaMux);
+}
+
+void Control::handleFrame(const RxPacket &packet) {
+  frame::Header header;
+  const uint8_t *payload = nullptr;
+  size_t payloadLen = 0;
+  uint8_t unpacked[frame::MAX_PAYLOAD];
+  if (!frame::decode(packet.data, packet.len, &header, &payload, &payloadLen,
+                     unpacked)) {
+    ESP_LOGW(TAG, "Dropped malformed frame (%u bytes)",
+             static_cast<unsigned>(packet.len));
+    metrics::add(metrics::Counter::RxMalformed);
+    return;
+  }
+
+  // Only frames heard directly measure the link or make a TDMA member
+  if (header.hops == 0) handleLink(header, packet, payload, payloadLen);
+
+  // Copies that came the long way round end here, new frames may go on
+  if (relay::relayed(header.type)) {
+    uint32_t airtimeMs = m_LoRaCom->timeOnAirUs(packet.len) / 1000 + 1;
+    portENTER_CRITICAL(&m_relayMux);
+    bool fresh = m_relay->onFrame(header, packet.data, packet.len, packet.rssi,
+                                  airtimeMs, millis());
+    bool queued = m_relay->nextEventMs(millis()) != relay::NO_EVENT;
+    portEXIT_CRITICAL(&m_relayMux);
+    if (queued) xTaskNotifyGive(RelayTaskHandle);
+    if (!fresh) return;
+  }
+
+  // Reliable transfers: the acknowledgement it carries, and its text handed
+  // on only the first time it arrives
+  if (header.type == frame::Type::Arq) {
+    frame::ArqHeader arq;
+    const uint8_t *text = nullptr;
+    size_t textLen = 0;
+    if (!frame::decodeArq(payload, payloadLen, &arq, &text, &textLen) ||
+        arq.to != m_nodeId) {
+      return;
+    }
+    portENTER_CRITICAL(&m_arqMux);
+    bool fresh = m_arq->onFrame(header.nodeId, arq, millis());
+    portEXIT_CRITICAL(&m_arqMux);
+    xTaskNotifyGive(ArqTaskHandle);  // an ack is due, or the window moved
+    if (!fresh) return;
+
+    header.type = static_cast<frame::Type>(arq.kind);
+    payload = text;
+    payloadLen = textLen;
+  }
+
+  if (header.type == frame::Type::Log) {
+    handleLogFrame(header.nodeId, payload, payloadLen);
+    return;
+  }
+
+  char text[frame::MAX_TEXT];
+  frame::toText(header, payload, payloadLen, text, sizeof(text));
+  ESP_LOGD(TAG, "Received: %s", text);  // Log the received data
+
+  switch (header.type) {
+    case frame::Type::Command:
+      // Relayed by another device, apply it here as well. The payload is the
+      // command without the "command " prefix.
+      ESP_LOGD(TAG, "Processing command: %s", text);
+      m_commander->setCommand(text + strlen("command "));
+      m_commander->checkCommand();
+      break;
+    case frame::Type::Data:
+      handleRecords(text);
+      return;
+    case frame::Type::Status:
+      processData(text);
+      break;
+    case frame::Type::Rate:
+    case frame::Type::Sync:
+      return;  // handled by ADR and TDMA above, nothing for the serial side
+    default:
+      ESP_LOGW(TAG, "Unknown frame type %u from %04X",
+               static_cast<unsigned>(header.type), header.nodeId);
+      return;
+  }
+
+  // Send the received data over serial
+  m_serialCom->sendData("Received: <");
+  m_serialCom->sendData(text);
+  m_serialCom->sendData(">\n");
+}
+
+// Requests for this node's log, and answers to a fetch this node started
+void Control::handleLogFrame(uint16_t from, const uint8_t *payload,
+                             size_t len) {
+  frame::LogHeader log;
+  const uint8_t *body = nullptr;
+  size_t bodyLen = 0;
+  if (!frame::decodeLog(payload, len, &log, &body, &bodyLen) ||
+      log.to != m_nodeId) {
+    return;
+  }
+
+  // The flash is read before taking the mutex, LogTask holds it while it
+  // reads fragments and the flash mutex is always taken second
+  uint32_t start = 0;
+  uint32_t end = 0;
+  switch (static_cast<fetch::Op>(log.op)) {
+    case fetch::Op::Get:
+      if (!m_saveFlash->range(&start, &end)) return;
+      xSemaphoreTake(m_fetchMutex, portMAX_DELAY);
+      m_fetchServer->onGet(from, log.transfer, body, bodyLen, start, end);
+      xSemaphoreGive(m_fetchMutex);
+      break;
+    case fetch::Op::Missing:
+      xSemaphoreTake(m_fetchMutex, portMAX_DELAY);
+      m_fetchServer->onMissing(from, log.transfer, body, bodyLen);
+      xSemaphoreGive(m_fetchMutex);
+      break;
+    case fetch::Op::Erase: {
+      uint32_t received = 0;
+      xSemaphoreTake(m_fetchMutex, portMAX_DELAY);
+      bool fresh = m_fetchServer->eraseEnd(from, log.transfer, body, bodyLen,
+                                           &received);
+      xSemaphoreGive(m_fetchMutex);
+      if (fresh) {
+        bool erased = m_saveFlash->erase(received);
+        m_saveFlash->range(&start, &end);
+        xSemaphoreTake(m_fetchMutex, portMAX_DELAY);
+        m_fetchServer->onErased(from, log.transfer, erased, end);
+        xSemaphoreGive(m_fetchMutex);
+      }
+      break;
+    }
+    default:
+      xSemaphoreTake(m_fetchMutex, portMAX_DELAY);
+      m_fetchClient->onFrame(from, log, body, bodyLen, millis());
+      xSemaphoreGive(m_fetchMutex);
+      break;
   }
+  xTaskNotifyGive(LogTaskHandle);
 }
 
 void Control::processData(const char *buffer) {
@@ -197,17 +1136,18 @@ void Control::processData(const char *buffer) {
   ESP_LOGD(TAG, "Processing data");
 
   // remove the "data" prefix
-  const char *dataStart = strchr(buffer, ' ') + 1;  // Find the first space
-  if (dataStart == nullptr) {
+  const char *space = strchr(buffer, ' ');  // Find the first space
+  if (space == nullptr) {
     ESP_LOGE(TAG, "Invalid data format: %s", buffer);
     return;  // Invalid format, return early
   }
+  const char *dataStart = space + 1;
 
   m_serialCom->sendData(buffer);  // Send the data part over serial
   m_serialCom->sendData("\n");
 
-  // save dataStart to flash
-  m_saveFlash->writeData((dataStart + String("\n")).c_str());
+  // save dataStart to flash, written behind by the flash task
+  m_saveFlash->writeLine(dataStart);
 
   ESP_LOGI(TAG, "Data processing complete");
 }
\ No newline at end of file
@@ -2,23 +2,35 @@
 
 #include <Arduino.h>
 
+#include <atomic>
 #include <cstring>
 
 #include "../pin_defs.hpp"
 #include "LoRaCom.hpp"
 #include "SerialCom.hpp"
+#include "adr.hpp"
+#include "arq.hpp"
+#include "batcher.hpp"
 #include "commander.hpp"
 #include "esp_log.h"
+#include "frame.hpp"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "heapCounter.hpp"
+#include "logFetch.hpp"
+#include "metrics.hpp"
+#include "relay.hpp"
 #include "saveFlash.hpp"
+#include "tdma.hpp"
 
 #define c_cmp(a, b) (strcmp(a, b) == 0)
 
-// this will be the data that is sent over LoRa in both directions on loop
+// Serial side is text, LoRa side is binary frames (see frame.hpp)
 
 // eg: "command update gain 22"
-// eg: "status <deviceID> <RSSI> <batteryLevel> <mode> <status>"
+// eg: "status ID:<nodeId> SEQ:<seq> RSSI:<RSSI> batteryLevel:<batteryLevel>
+//      mode:<mode> status:<status>"
 // eg: "data <payload>"
 
 // struct Data {
@@ -45,16 +57,36 @@ class Control {
   void setup();
   void begin();
 
+  // The counters "relay" shows
+  relay::Stats relayStats();
+
  private:
   SerialCom *m_serialCom;
   LoRaCom *m_LoRaCom;
   Commander *m_commander;
   SaveFlash *m_saveFlash;
+  adr::Adr *m_adr;  // guarded by m_adrMux
+  portMUX_TYPE m_adrMux = portMUX_INITIALIZER_UNLOCKED;
+  adr::Setting m_radioSetting;  // what the radio was last set to
+  Batcher m_batcher;            // data records waiting to go out, serial task
+  uint32_t m_batchOriginUs = 0;  // micros() when its oldest record came in
+  arq::Arq *m_arq;              // guarded by m_arqMux
+  portMUX_TYPE m_arqMux = portMUX_INITIALIZER_UNLOCKED;
+  uint16_t m_reliablePeer = 0;  // data and commands go only here, 0 = all
+  fetch::Server *m_fetchServer;  // this node's log for others
+  fetch::Client *m_fetchClient;  // the log of another node, "fetch"
+  SemaphoreHandle_t m_fetchMutex;  // guards both
+  tdma::Tdma *m_tdma;              // guarded by m_tdmaMux, "mode tdma"
+  portMUX_TYPE m_tdmaMux = portMUX_INITIALIZER_UNLOCKED;
+  relay::Relay *m_relay;  // guarded by m_relayMux, "relay <hops>"
+  portMUX_TYPE m_relayMux = portMUX_INITIALIZER_UNLOCKED;
 
   unsigned long serial_Interval = 100;
   unsigned long lora_Interval = 100;
   unsigned long status_Interval = 10'000;
+  unsigned long status_Jitter = 1'000;  // beacons come every interval +- this
   unsigned long heartBeat_Interval = 250;
+  unsigned long batch_Budget = 500;  // longest a data record waits for others
 
   static constexpr const char *TAG = "Control";
 
@@ -62,21 +94,80 @@ class Control {
   TaskHandle_t LoRaTaskHandle = nullptr;
   TaskHandle_t StatusTaskHandle = nullptr;
   TaskHandle_t heartBeatTaskHandle = nullptr;
+  TaskHandle_t FlashTaskHandle = nullptr;
+  TaskHandle_t AdrTaskHandle = nullptr;
+  TaskHandle_t ArqTaskHandle = nullptr;
+  TaskHandle_t LogTaskHandle = nullptr;
+  TaskHandle_t BackoffTaskHandle = nullptr;
+  TaskHandle_t TdmaTaskHandle = nullptr;
+  TaskHandle_t RelayTaskHandle = nullptr;
 
   void serialDataTask();
   void loRaDataTask();
   void statusTask();
   void heartBeatTask();
+  void adrTask();
+  void arqTask();
+  void logTask();
+  void tdmaTask();
+  void relayTask();
 
   void interpretMessage(const char *buffer, bool relayMsgLoRa = true);
+  void handleFrame(const RxPacket &packet);
+  void handleLink(const frame::Header &header, const RxPacket &packet,
+                  const uint8_t *payload, size_t payloadLen);
   void processData(const char *buffer);
-
-  String deviceID = "transceiver";  // Unique identifier for the device
+  void handleFlash();
+  void handleAdr();
+  void handleLbt();
+  void handleDwell();
+  void handleBatch();
+  void handleReliable();
+  void handleFetch();
+  void handleTdma();
+  void handleRelay();
+  void setMode(frame::Mode mode);
+  void handleLogFrame(uint16_t from, const uint8_t *payload, size_t len);
+  void queueData(const char *record);
+  void flushBatch();
+  void handleRecords(const char *text);
+  // `originUs` as for LoRaCom::sendMessage()
+  TxHandle sendFrame(frame::Type type, const char *payload,
+                     uint32_t originUs = 0);
+
+  static constexpr size_t DEVICE_ID_SIZE = 16;
+  char deviceID[DEVICE_ID_SIZE] = "transceiver";  // Human readable name
+  uint16_t m_nodeId = 0;  // short ID used on air, last two bytes of the MAC
+  // Sequence number of the next frame sent, taken by every task that sends
+  std::atomic<uint16_t> m_txSeq{0};
 
   // Mode of operation (transmit, receive, transceive, etc.)
-  String m_mode = "transceive";
-  String m_status = "ok";  // Status of the device (e.g., "ok", "error", etc.)
+  frame::Mode m_mode = frame::Mode::Transceive;
+  frame::Health m_status = frame::Health::Ok;  // Status of the device
   float m_batteryLevel = 100.0;  // Battery level as a percentage (0-100)
 
   // Data payload;
-};
\ No newline at end of file
+};
+
+// Control moves the radio between the ADR rates, keeping the coding rate and
+// preamble begin() set
+constexpr airtime::Modem adrModem(const adr::DataRate &rate) {
+  airtime::Modem modem = LoRaCom::BOOT_MODEM;
+  modem.sf = rate.sf;
+  modem.bwHz = airtime::bandwidthHz(rate.bwKHz);
+  return modem;
+}
+// With "dwell on" ADR keeps to the rates a full packet fits the limit at
+static_assert(airtime::timeOnAirUs(adrModem(adr::RATES[0]),
+                                   TxPacket::MAX_LEN) <= LoRaCom::DWELL_US,
+              "A full packet must fit the dwell time at the fastest ADR rate");
+
+// The shortest frame at the fastest modem the radio takes (SF5, 500 kHz)
+constexpr uint32_t shortestFrameUs() {
+  airtime::Modem modem = LoRaCom::BOOT_MODEM;
+  modem.sf = 5;
+  modem.bwHz = 500'000;
+  return airtime::timeOnAirUs(modem, frame::HEADER_SIZE + frame::CRC_SIZE);
+}
+static_assert(relay::CACHE_MS * 1000ull / shortestFrameUs() < 0x10000,
+              "The frame seq must not wrap while relays remember it");
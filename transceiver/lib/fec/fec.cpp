@@ -0,0 +1,189 @@
+#include "fec.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace fec {
+
+namespace {
+
+// GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1, generator 2
+struct Tables {
+  uint8_t exp[512];  // doubled, so exp[log a + log b] needs no modulo
+  uint8_t log[256];
+
+  constexpr Tables() : exp(), log() {
+    unsigned x = 1;
+    for (unsigned i = 0; i < 255; i++) {
+      exp[i] = exp[i + 255] = static_cast<uint8_t>(x);
+      log[x] = static_cast<uint8_t>(i);
+      x <<= 1;
+      if (x & 0x100) x ^= 0x11D;
+    }
+    exp[510] = exp[511] = exp[0];
+  }
+};
+
+constexpr Tables GF;
+
+uint8_t mul(uint8_t a, uint8_t b) {
+  if (a == 0 || b == 0) return 0;
+  return GF.exp[GF.log[a] + GF.log[b]];
+}
+
+uint8_t inv(uint8_t a) { return GF.exp[255 - GF.log[a]]; }
+
+// Generator entry for parity fragment j and data fragment i. Row and column
+// labels never meet (bit 5 is set in one and clear in the other), so every
+// square part of the matrix can be inverted.
+uint8_t coefficient(size_t j, size_t i) {
+  return inv(static_cast<uint8_t>((MAX_DATA + j) ^ i));
+}
+
+// c * x for every byte x, split by nibble
+struct Product {
+  uint8_t low[16];
+  uint8_t high[16];
+
+  // Multiplying distributes over xor, so the tables follow from c * 2^b
+  explicit Product(uint8_t c) {
+    uint8_t power[8];
+    power[0] = c;
+    for (int b = 1; b < 8; b++) {
+      uint8_t x = power[b - 1];
+      power[b] = static_cast<uint8_t>((x << 1) ^ (x & 0x80 ? 0x1D : 0));
+    }
+    low[0] = high[0] = 0;
+    for (int b = 0; b < 4; b++) {
+      for (int n = 0; n < (1 << b); n++) {
+        low[(1 << b) | n] = low[n] ^ power[b];
+        high[(1 << b) | n] = high[n] ^ power[b + 4];
+      }
+    }
+  }
+  uint8_t operator()(uint8_t x) const { return low[x & 15] ^ high[x >> 4]; }
+};
+
+// dst += c * src
+void mulAdd(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len) {
+  if (c == 0) return;
+  if (c == 1) {
+    for (size_t i = 0; i < len; i++) dst[i] ^= src[i];
+    return;
+  }
+  Product product(c);
+  for (size_t i = 0; i < len; i++) dst[i] ^= product(src[i]);
+}
+
+// dst *= c
+void scale(uint8_t *dst, uint8_t c, size_t len) {
+  if (c == 1) return;
+  Product product(c);
+  for (size_t i = 0; i < len; i++) dst[i] = product(dst[i]);
+}
+
+}  // namespace
+
+/* ================================ CODING ================================= */
+
+void encode(const uint8_t *const data[], size_t k, uint8_t *const parity[],
+            size_t first, size_t count, size_t len) {
+  for (size_t j = 0; j < count; j++) {
+    memset(parity[j], 0, len);
+    for (size_t i = 0; i < k; i++) {
+      mulAdd(parity[j], data[i], coefficient(first + j, i), len);
+    }
+  }
+}
+
+bool decode(uint8_t *const fragments[], const bool present[], size_t k,
+            size_t m, size_t len) {
+  size_t missing[MAX_PARITY];  // data fragments to rebuild
+  size_t rows[MAX_PARITY];     // parity fragments to rebuild them from
+  size_t lost = 0;
+  for (size_t i = 0; i < k; i++) {
+    if (present[i]) continue;
+    if (lost == MAX_PARITY) return false;
+    missing[lost++] = i;
+  }
+  if (lost == 0) return true;
+  size_t found = 0;
+  for (size_t j = 0; j < m && found < lost; j++) {
+    if (present[k + j]) rows[found++] = j;
+  }
+  if (found < lost) return false;
+
+  // What the missing fragments add to each parity fragment, into the
+  // missing fragments' buffers
+  for (size_t r = 0; r < lost; r++) {
+    uint8_t *out = fragments[missing[r]];
+    memcpy(out, fragments[k + rows[r]], len);
+    for (size_t i = 0; i < k; i++) {
+      if (present[i]) mulAdd(out, fragments[i], coefficient(rows[r], i), len);
+    }
+  }
+
+  // Solve for them, Gauss-Jordan on the matrix and the buffers together
+  uint8_t a[MAX_PARITY][MAX_PARITY];
+  for (size_t r = 0; r < lost; r++) {
+    for (size_t t = 0; t < lost; t++) {
+      a[r][t] = coefficient(rows[r], missing[t]);
+    }
+  }
+  for (size_t t = 0; t < lost; t++) {
+    size_t pivot = t;
+    while (a[pivot][t] == 0) pivot++;  // the matrix is invertible
+    if (pivot != t) {
+      std::swap_ranges(a[t], a[t] + lost, a[pivot]);
+      std::swap_ranges(fragments[missing[t]], fragments[missing[t]] + len,
+                       fragments[missing[pivot]]);
+    }
+
+    uint8_t factor = inv(a[t][t]);
+    for (size_t c = 0; c < lost; c++) a[t][c] = mul(a[t][c], factor);
+    scale(fragments[missing[t]], factor, len);
+
+    for (size_t r = 0; r < lost; r++) {
+      uint8_t c = a[r][t];
+      if (r == t || c == 0) continue;
+      for (size_t col = 0; col < lost; col++) a[r][col] ^= mul(c, a[t][col]);
+      mulAdd(fragments[missing[r]], fragments[missing[t]], c, len);
+    }
+  }
+  return true;
+}
+
+/* ============================== REDUNDANCY =============================== */
+
+size_t parityFor(size_t k, float lossRate, float target) {
+  if (lossRate <= 0.0f) return 0;
+  if (lossRate >= 1.0f) return MAX_PARITY;
+
+  double p = lossRate;
+  for (size_t m = 0; m < MAX_PARITY; m++) {
+    // Probability of at most m of the k + m fragments lost, term by term
+    size_t n = k + m;
+    double term = 1.0;
+    for (size_t i = 0; i < n; i++) term *= 1.0 - p;  // none lost
+    double whole = term;
+    for (size_t x = 1; x <= m; x++) {
+      term *= static_cast<double>(n - x + 1) / x * p / (1.0 - p);
+      whole += term;
+    }
+    if (whole >= target) return m;
+  }
+  return MAX_PARITY;
+}
+
+void LossEstimate::update(uint32_t sent, uint32_t received) {
+  if (sent == 0) return;
+  float sample = 1.0f - static_cast<float>(std::min(received, sent)) / sent;
+  if (!m_measured) {
+    m_rate = sample;
+    m_measured = true;
+  } else {
+    m_rate += (sample - m_rate) / 4;
+  }
+}
+
+}  // namespace fec
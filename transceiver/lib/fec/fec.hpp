@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Erasure code for bulk transfers: systematic Reed-Solomon over GF(2^8) with
+// a Cauchy generator matrix.
+//
+// A block is `k` data fragments of the same length followed by up to
+// MAX_PARITY parity fragments. Any k of them rebuild the block. The data
+// fragments go out unchanged, a receiver that got all of them does no work.
+// Parity fragment j is computed from row j of the generator, and that row is
+// the same whatever the number of parity fragments m is, so a sender can add
+// more parity to a block later without changing what it already sent.
+//
+// Multiplying a fragment by a coefficient goes through two 16 entry tables,
+// one per nibble: two loads and two xors per byte, no branches, no
+// multiplier. That is the shuffle-table layout SIMD versions use. The
+// RISC-V core of the ESP32-C3 has no vector unit, but the 32 bytes of table
+// stay in cache where a full 64 KB product table would not fit.
+//
+// Not thread safe and free of RTOS calls.
+
+namespace fec {
+
+constexpr size_t MAX_DATA = 32;    // fragments per block
+constexpr size_t MAX_PARITY = 16;  // parity fragments per block
+// Chance of a block getting through without another round trip that
+// parityFor() aims at by default. Fewer rounds for some extra airtime, worth
+// it when the receiver cannot answer right away.
+constexpr float BLOCK_TARGET = 0.9f;
+
+// Fills parity fragments `first` to `first + count - 1` of the block
+void encode(const uint8_t *const data[], size_t k, uint8_t *const parity[],
+            size_t first, size_t count, size_t len);
+
+// Rebuilds the missing data fragments. `fragments` holds k data fragments
+// followed by `m` parity fragments, those with `present[i]` false are
+// outputs (data) or ignored (parity). False if fewer than k arrived.
+bool decode(uint8_t *const fragments[], const bool present[], size_t k,
+            size_t m, size_t len);
+
+// Parity fragments for a block of `k` so that it arrives whole with at least
+// probability `target` when fragments are lost independently at `lossRate`.
+// MAX_PARITY if even that falls short.
+size_t parityFor(size_t k, float lossRate, float target = BLOCK_TARGET);
+
+// Fragment loss seen by the receiver, averaged over the last few blocks
+class LossEstimate {
+ public:
+  void update(uint32_t sent, uint32_t received);
+  float rate() const { return m_rate; }
+
+ private:
+  float m_rate = 0.1f;  // until measured, a poor link
+  bool m_measured = false;
+};
+
+}  // namespace fec
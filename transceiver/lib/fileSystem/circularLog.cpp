@@ -0,0 +1,310 @@
+#include "circularLog.hpp"
+
+#include <algorithm>
+
+#include "frame.hpp"
+
+namespace {
+
+// Largest record, with its length and CRC
+constexpr size_t RECORD_BUFFER = 2 + CircularLog::MAX_RECORD + 2;
+
+uint16_t readLe16(const uint8_t *in) { return in[0] | (in[1] << 8); }
+
+void writeLe16(uint8_t *out, uint16_t value) {
+  out[0] = value & 0xFF;
+  out[1] = value >> 8;
+}
+
+}  // namespace
+
+/* ================================= MOUNT ================================= */
+
+bool CircularLog::begin() {
+  uint32_t start = micros();
+  m_partition = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, m_label);
+  if (m_partition == nullptr) {
+    ESP_LOGE(TAG, "No partition labelled \"%s\"", m_label);
+    return false;
+  }
+  m_sectors = m_partition->size / SECTOR_SIZE;
+  m_count = 0;
+  m_head = m_sectors - 1;  // so an empty log starts in sector 0
+  m_headSeq = NO_SEQ;
+  m_offset = 0;
+  m_lastRecord = 0;
+  m_end = 0;
+
+  // The sectors in use are one run around the ring, from the lowest seq to
+  // the highest
+  uint32_t minSeq = 0;
+  bool found = false;
+  for (uint32_t sector = 0; sector < m_sectors; sector++) {
+    uint32_t seq, base;
+    if (!readHeader(sector, &seq, &base)) continue;
+    if (!found || seq > m_headSeq) {
+      m_head = sector;
+      m_headSeq = seq;
+      m_end = base;
+    }
+    if (!found || seq < minSeq) minSeq = seq;
+    found = true;
+  }
+  if (found) {
+    m_count = std::min(m_headSeq - minSeq + 1, m_sectors);
+    m_tail = (m_head + m_sectors - (m_count - 1)) % m_sectors;
+    uint32_t headBytes = 0;
+    m_offset = scanSector(m_head, &m_lastRecord, &headBytes);
+    m_end += headBytes;
+  }
+
+  m_stats.mountUs = micros() - start;
+  ESP_LOGI(TAG, "Mounted \"%s\": %u of %u sectors used, head %u+%u, %u us",
+           m_label, static_cast<unsigned>(m_count),
+           static_cast<unsigned>(m_sectors), static_cast<unsigned>(m_head),
+           static_cast<unsigned>(m_offset),
+           static_cast<unsigned>(m_stats.mountUs));
+  return true;
+}
+
+bool CircularLog::readHeader(uint32_t sector, uint32_t *seq, uint32_t *base) {
+  uint32_t header[3];
+  if (esp_partition_read(m_partition, address(sector, 0), header,
+                         sizeof(header)) != ESP_OK) {
+    return false;
+  }
+  *seq = header[1];
+  *base = header[2];
+  return header[0] == MAGIC && header[1] != NO_SEQ;
+}
+
+size_t CircularLog::scanSector(uint32_t sector, size_t *last,
+                               uint32_t *dataBytes) {
+  uint8_t record[RECORD_BUFFER];
+  size_t offset = SECTOR_HEADER;
+  while (offset + RECORD_OVERHEAD <= SECTOR_SIZE) {
+    uint16_t len;
+    if (!readRecord(address(sector, offset), &len, record)) {
+      return len == BLANK ? offset : SECTOR_SIZE;
+    }
+    *last = offset;
+    *dataBytes += len;
+    offset += RECORD_OVERHEAD + len;
+  }
+  return SECTOR_SIZE;
+}
+
+// False for blank flash (len BLANK) and for damaged records (len 0)
+bool CircularLog::readRecord(size_t address, uint16_t *len, uint8_t *data) {
+  uint8_t lenBytes[2];
+  *len = 0;
+  if (esp_partition_read(m_partition, address, lenBytes, 2) != ESP_OK) {
+    return false;
+  }
+  uint16_t dataLen = readLe16(lenBytes);
+  if (dataLen == BLANK) {
+    *len = BLANK;
+    return false;
+  }
+
+  size_t offset = address % SECTOR_SIZE;
+  if (dataLen == 0 || dataLen > MAX_RECORD ||
+      offset + RECORD_OVERHEAD + dataLen > SECTOR_SIZE) {
+    m_stats.corruptRecords++;
+    return false;
+  }
+
+  // The CRC covers the length as well
+  if (esp_partition_read(m_partition, address, data,
+                         RECORD_OVERHEAD + dataLen) != ESP_OK) {
+    return false;
+  }
+  if (frame::crc16(data, 2 + dataLen) != readLe16(data + 2 + dataLen)) {
+    m_stats.corruptRecords++;
+    return false;
+  }
+  *len = dataLen;
+  return true;
+}
+
+/* ================================= WRITE ================================= */
+
+// Erase the sector after the head and start writing there. When the ring is
+// full that is the oldest sector.
+bool CircularLog::nextSector() {
+  uint32_t next = (m_head + 1) % m_sectors;
+  if (m_count == m_sectors) {
+    m_tail = (m_tail + 1) % m_sectors;
+    m_count--;
+    m_stats.overwrittenSectors++;
+  }
+
+  esp_err_t err = esp_partition_erase_range(m_partition, address(next, 0),
+                                            SECTOR_SIZE);
+  m_stats.erases++;
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Erasing sector %u failed: %s", static_cast<unsigned>(next),
+             esp_err_to_name(err));
+    return false;
+  }
+
+  uint32_t seq = m_headSeq + 1;  // NO_SEQ + 1 == 0
+  uint32_t header[3] = {MAGIC, seq, m_end};
+  err = esp_partition_write(m_partition, address(next, 0), header,
+                            sizeof(header));
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Writing sector header failed: %s", esp_err_to_name(err));
+    return false;
+  }
+
+  if (m_count == 0) m_tail = next;
+  m_head = next;
+  m_headSeq = seq;
+  m_count++;
+  m_offset = SECTOR_HEADER;
+  m_lastRecord = 0;
+  return true;
+}
+
+bool CircularLog::append(const char *data, size_t len) {
+  if (m_partition == nullptr) return false;
+
+  uint8_t record[RECORD_BUFFER];
+  while (len > 0) {
+    size_t room = 0;
+    if (m_count > 0 && m_offset + RECORD_OVERHEAD < SECTOR_SIZE) {
+      room = SECTOR_SIZE - m_offset - RECORD_OVERHEAD;
+    }
+
+    // Split at a line end where possible, so every sector starts with a
+    // whole line. A line that does not fit the head sector goes to the next.
+    size_t piece = std::min({len, MAX_RECORD, room});
+    if (piece < len) {
+      size_t end = piece;
+      while (end > 0 && data[end - 1] != '\n') end--;
+      if (end > 0) {
+        piece = end;
+      } else if (piece == room && room < std::min(len, MAX_RECORD)) {
+        piece = 0;
+      }
+    }
+    if (piece == 0) {
+      if (!nextSector()) return false;
+      continue;
+    }
+
+    writeLe16(record, piece);
+    memcpy(record + 2, data, piece);
+    writeLe16(record + 2 + piece, frame::crc16(record, 2 + piece));
+    esp_err_t err = esp_partition_write(
+        m_partition, address(m_head, m_offset), record,
+        RECORD_OVERHEAD + piece);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Writing record failed: %s", esp_err_to_name(err));
+      return false;
+    }
+
+    m_lastRecord = m_offset;
+    m_offset += RECORD_OVERHEAD + piece;
+    m_end += piece;
+    m_stats.records++;
+    data += piece;
+    len -= piece;
+  }
+  return true;
+}
+
+bool CircularLog::clear() {
+  if (m_partition == nullptr) return false;
+
+  for (uint32_t i = 0; i < m_count; i++) {
+    uint32_t sector = (m_tail + i) % m_sectors;
+    esp_err_t err = esp_partition_erase_range(m_partition, address(sector, 0),
+                                              SECTOR_SIZE);
+    m_stats.erases++;
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Erasing sector %u failed: %s",
+               static_cast<unsigned>(sector), esp_err_to_name(err));
+      return false;
+    }
+  }
+  ESP_LOGI(TAG, "Erased %u sectors", static_cast<unsigned>(m_count));
+  m_count = 0;
+  m_offset = 0;
+  m_lastRecord = 0;
+  m_end = 0;
+  return true;
+}
+
+/* ================================= READ ================================== */
+
+uint32_t CircularLog::startOffset() {
+  // The tail sector, or the first one after it an interrupted erase left
+  // behind
+  for (uint32_t i = 0; i < m_count; i++) {
+    uint32_t seq, base;
+    if (readHeader((m_tail + i) % m_sectors, &seq, &base) &&
+        seq == m_headSeq - (m_count - 1 - i)) {
+      return base;
+    }
+  }
+  return m_end;
+}
+
+bool CircularLog::read(uint32_t from, uint32_t to, Sink sink, void *context) {
+  if (m_partition == nullptr) return false;
+
+  // Offsets relative to the oldest byte, so they compare correctly even when
+  // the absolute ones wrap
+  uint32_t start = startOffset();
+  uint32_t first = from - start;
+  uint32_t last = to - start;
+
+  uint8_t record[RECORD_BUFFER];
+  for (uint32_t i = 0; i < m_count; i++) {
+    uint32_t sector = (m_tail + i) % m_sectors;
+    uint32_t seq, base;
+    if (!readHeader(sector, &seq, &base) ||
+        seq != m_headSeq - (m_count - 1 - i)) {
+      continue;
+    }
+
+    uint32_t position = base - start;
+    if (position >= last) break;
+    size_t offset = SECTOR_HEADER;
+    uint16_t len;
+    while (offset + RECORD_OVERHEAD <= SECTOR_SIZE && position < last &&
+           readRecord(address(sector, offset), &len, record)) {
+      // Only the part of the record inside [first, last)
+      uint32_t begin = std::max(position, first);
+      uint32_t end = std::min<uint32_t>(position + len, last);
+      if (begin < end) {
+        sink(context, reinterpret_cast<const char *>(record + 2) +
+                          (begin - position),
+             end - begin);
+      }
+      position += len;
+      offset += RECORD_OVERHEAD + len;
+    }
+  }
+  return true;
+}
+
+size_t CircularLog::readTail(char *out, size_t size) {
+  if (m_partition == nullptr || m_count == 0 || m_lastRecord == 0) return 0;
+
+  uint8_t record[RECORD_BUFFER];
+  uint16_t len;
+  if (!readRecord(address(m_head, m_lastRecord), &len, record)) return 0;
+  size_t copy = std::min<size_t>(len, size);
+  memcpy(out, record + 2 + len - copy, copy);
+  return copy;
+}
+
+size_t CircularLog::totalBytes() { return m_sectors * SECTOR_SIZE; }
+
+size_t CircularLog::usedBytes() {
+  if (m_count == 0) return 0;
+  return (m_count - 1) * SECTOR_SIZE + m_offset;
+}
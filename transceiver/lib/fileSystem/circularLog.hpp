@@ -0,0 +1,85 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "logStore.hpp"
+
+struct CircularLogStats {
+  uint32_t records = 0;             // appended since boot
+  uint32_t erases = 0;              // sector erases since boot
+  uint32_t overwrittenSectors = 0;  // oldest data dropped to make room
+  uint32_t corruptRecords = 0;      // bad CRC seen by mount or read
+  uint32_t mountUs = 0;
+};
+
+// The log as records in a raw flash partition used as a ring of sectors.
+//
+//   sector: | magic:32 | seq:32 | base:32 | record | record | ... | 0xFF ... |
+//   record: | len:16 | data[len] | crc16:16 |
+//
+// Sectors are filled in order and erased just before they are reused, so
+// every sector is erased once per lap and never more often. When the ring is
+// full the sector holding the oldest data is erased next. seq counts up by
+// one per sector (also across clear()), the highest one is the head. base is
+// the log offset of the sector's first data byte, so offsets stay valid while
+// older sectors are overwritten.
+//
+// Mounting reads every sector header and then scans the head sector only, so
+// it takes the same time no matter how much is stored. A record cut short by
+// a power loss fails its CRC, the rest of that sector is then skipped and
+// writing carries on in the next one.
+class CircularLog : public LogStore {
+ public:
+  static constexpr size_t SECTOR_SIZE = 4096;
+  static constexpr size_t MAX_RECORD = 512;  // data bytes per record
+
+  explicit CircularLog(const char *label) : m_label(label) {}
+
+  bool begin() override;
+  bool append(const char *data, size_t len) override;
+  uint32_t startOffset() override;
+  uint32_t endOffset() override { return m_end; }
+  bool read(uint32_t from, uint32_t to, Sink sink, void *context) override;
+  size_t readTail(char *out, size_t size) override;
+  bool clear() override;
+
+  size_t totalBytes() override;
+  size_t usedBytes() override;
+
+  const CircularLogStats &stats() const { return m_stats; }
+
+ private:
+  static constexpr const char *TAG = "CircularLog";
+  static constexpr uint32_t MAGIC = 0x32474F4C;  // "LOG2"
+  static constexpr size_t SECTOR_HEADER = 12;
+  static constexpr size_t RECORD_OVERHEAD = 4;  // len + crc
+  static constexpr uint16_t BLANK = 0xFFFF;
+  static constexpr uint32_t NO_SEQ = 0xFFFFFFFF;
+
+  bool readHeader(uint32_t sector, uint32_t *seq, uint32_t *base);
+  // Offset of the first free byte, SECTOR_SIZE if the sector is full or
+  // damaged. `last` gets the offset of the last good record, `dataBytes` the
+  // data they hold.
+  size_t scanSector(uint32_t sector, size_t *last, uint32_t *dataBytes);
+  bool readRecord(size_t address, uint16_t *len, uint8_t *data);
+  bool nextSector();
+  size_t address(uint32_t sector, size_t offset) const {
+    return sector * SECTOR_SIZE + offset;
+  }
+
+  const char *m_label;
+  const esp_partition_t *m_partition = nullptr;
+  uint32_t m_sectors = 0;
+
+  uint32_t m_count = 0;    // sectors holding data, 0 when empty
+  uint32_t m_tail = 0;     // oldest sector
+  uint32_t m_head = 0;     // sector being written
+  uint32_t m_headSeq = NO_SEQ;
+  size_t m_offset = 0;     // next free byte in the head sector
+  size_t m_lastRecord = 0; // offset of the newest record, 0 if none
+  uint32_t m_end = 0;      // log offset after the newest byte
+
+  CircularLogStats m_stats;
+};
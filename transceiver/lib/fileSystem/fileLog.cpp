@@ -0,0 +1,87 @@
+#include "fileLog.hpp"
+
+bool FileLog::begin() {
+  if (!LittleFS.begin()) {
+    ESP_LOGW(TAG, "LittleFS Mount Failed, attempting to format...");
+    if (LittleFS.format()) {
+      ESP_LOGI(TAG, "LittleFS formatted successfully");
+      if (!LittleFS.begin()) {
+        ESP_LOGE(TAG, "LittleFS Mount Failed even after format");
+        return false;
+      }
+    } else {
+      ESP_LOGE(TAG, "LittleFS format failed");
+      return false;
+    }
+  }
+  m_free = totalBytes() - usedBytes();
+
+  File file = LittleFS.open(m_fileName, FILE_READ);
+  m_size = file ? file.size() : 0;
+  return true;
+}
+
+bool FileLog::append(const char *data, size_t len) {
+  if (len >= m_free) {
+    ESP_LOGE(TAG, "Not enough space to write data");
+    return false;
+  }
+
+  File file = LittleFS.open(m_fileName, FILE_APPEND);
+  if (!file) {
+    ESP_LOGE(TAG, "Failed to open file for appending");
+    return false;
+  }
+  bool ok = file.write(reinterpret_cast<const uint8_t *>(data), len) == len;
+  file.close();
+  if (!ok) {
+    ESP_LOGE(TAG, "Write failed");
+    return false;
+  }
+  m_free -= len;
+  m_size += len;
+  return true;
+}
+
+bool FileLog::read(uint32_t from, uint32_t to, Sink sink, void *context) {
+  File file = LittleFS.open(m_fileName, FILE_READ);
+  if (!file) {
+    ESP_LOGE(TAG, "Failed to open file for reading");
+    return false;
+  }
+
+  char buffer[512];
+  size_t left = to > from ? to - from : 0;
+  file.seek(from);
+  while (left > 0) {
+    size_t len = file.readBytes(buffer, std::min(left, sizeof(buffer)));
+    if (len == 0) break;
+    sink(context, buffer, len);
+    left -= len;
+  }
+  file.close();
+  return left == 0;
+}
+
+size_t FileLog::readTail(char *out, size_t size) {
+  File file = LittleFS.open(m_fileName, FILE_READ);
+  if (!file) return 0;
+
+  size_t fileSize = file.size();
+  size_t len = std::min(fileSize, size);
+  file.seek(fileSize - len);
+  len = file.readBytes(out, len);
+  file.close();
+  return len;
+}
+
+bool FileLog::clear() {
+  if (!LittleFS.remove(m_fileName)) {
+    ESP_LOGE(TAG, "Failed to remove file: %s", m_fileName);
+    return false;
+  }
+  ESP_LOGI(TAG, "File removed successfully: %s", m_fileName);
+  m_free = totalBytes() - usedBytes();
+  m_size = 0;
+  return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "LittleFS.h"
+#include "esp_log.h"
+#include "logStore.hpp"
+
+// The log as one ever growing LittleFS file. Appends fail once the file
+// system is full, until the file is removed.
+class FileLog : public LogStore {
+ public:
+  explicit FileLog(const char *fileName) : m_fileName(fileName) {}
+
+  bool begin() override;
+  bool append(const char *data, size_t len) override;
+  uint32_t startOffset() override { return 0; }
+  uint32_t endOffset() override { return m_size; }
+  bool read(uint32_t from, uint32_t to, Sink sink, void *context) override;
+  size_t readTail(char *out, size_t size) override;
+  bool clear() override;
+
+  size_t totalBytes() override { return LittleFS.totalBytes(); }
+  size_t usedBytes() override { return LittleFS.usedBytes(); }
+
+ private:
+  static constexpr const char *TAG = "FileLog";
+
+  const char *m_fileName;
+  size_t m_free = 0;
+  uint32_t m_size = 0;  // of the file
+};
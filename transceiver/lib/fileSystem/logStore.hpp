@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Where SaveFlash keeps the log. FileLog appends to a LittleFS file,
+// CircularLog writes records to a raw partition and overwrites the oldest
+// data once it is full. Build with -D RAW_LOG to use the latter.
+//
+// Offsets count the bytes appended since the log was last cleared. They do
+// not move when CircularLog drops old data, so a reader can stop and carry
+// on later from the offset it got to.
+class LogStore {
+ public:
+  typedef void (*Sink)(void *context, const char *data, size_t len);
+
+  virtual ~LogStore() = default;
+
+  virtual bool begin() = 0;  // mount, formats if needed
+  virtual bool append(const char *data, size_t len) = 0;
+  virtual uint32_t startOffset() = 0;  // oldest byte still stored
+  virtual uint32_t endOffset() = 0;    // one past the newest byte
+  // Passes the bytes in [from, to) to `sink` in order, in pieces of at most
+  // a few hundred bytes. `from` must not be before startOffset().
+  virtual bool read(uint32_t from, uint32_t to, Sink sink, void *context) = 0;
+  // Up to `size` of the last bytes written, returns how many were copied
+  virtual size_t readTail(char *out, size_t size) = 0;
+  virtual bool clear() = 0;
+
+  virtual size_t totalBytes() = 0;
+  virtual size_t usedBytes() = 0;
+};
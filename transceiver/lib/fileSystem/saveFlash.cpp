@@ -1,25 +1,23 @@
 #include "saveFlash.hpp"
 
+#include "metrics.hpp"
+
 SaveFlash::SaveFlash(SerialCom *serialCom) {
   m_serialCom = serialCom;  // Initialize the SerialCom pointer
-  // Constructor implementation
+  m_flushMutex = xSemaphoreCreateMutex();
+  for (Stage &stage : m_stages) {
+    memcpy(stage.buffer, logCodec::DICTIONARY, logCodec::DICT_SIZE);
+  }
+#ifdef RAW_LOG
+  m_store = new CircularLog("log");
+#else
+  m_store = new FileLog(fileName);
+#endif
 }
 
 void SaveFlash::begin() {
-  if (!LittleFS.begin()) {
-    ESP_LOGW(TAG, "LittleFS Mount Failed, attempting to format...");
-    if (LittleFS.format()) {
-      ESP_LOGI(TAG, "LittleFS formatted successfully");
-      if (!LittleFS.begin()) {
-        ESP_LOGE(TAG, "LittleFS Mount Failed even after format");
-        return;
-      }
-    } else {
-      ESP_LOGE(TAG, "LittleFS format failed");
-      return;
-    }
-  }
-  m_initialised = true;
+  m_initialised = m_store->begin();
+  if (!m_initialised) return;
 
   updateStorage();
   newLog();
@@ -30,60 +28,23 @@ void SaveFlash::newLog() {
     ESP_LOGW(TAG, "File system not initialised");
     return;
   }
+  sync();  // the last line may still be staged
 
-  // Check if file exists and get its size
-  File file = LittleFS.open(fileName, FILE_READ);
-  if (!file) {
-    // File doesn't exist, create it with "New Log"
-    ESP_LOGI(TAG, "File doesn't exist, creating new log");
-    writeData("New Log\n");
-    return;
-  }
-
-  // Check if file is empty
-  size_t fileSize = file.size();
-  if (fileSize == 0) {
-    file.close();
-    ESP_LOGI(TAG, "File is empty, adding new log");
+  // Only the end of the log is needed to find its last line
+  char tail[64];
+  size_t len = m_store->readTail(tail, sizeof(tail) - 1);
+  while (len > 0 && isspace(static_cast<unsigned char>(tail[len - 1]))) len--;
+  tail[len] = '\0';
+  if (len == 0) {
+    ESP_LOGI(TAG, "Log is empty, creating new log");
     writeData("New Log\n");
     return;
   }
 
-  // Read the last line efficiently by seeking near the end
-  String lastLine;
-  file.seek(0, SeekEnd);  // Go to end of file
-
-  // Read backwards to find the last line (simple approach: read last 50 bytes)
-  size_t readSize = min(fileSize, (size_t)50);
-  file.seek(fileSize - readSize);
-
-  String endContent = file.readString();
-  file.close();
-  // Extract the last line
-  int lastNewlineIndex = endContent.lastIndexOf('\n');
-  if (lastNewlineIndex != -1) {
-    // If there's content after the last newline, that's the last line
-    if (lastNewlineIndex < endContent.length() - 1) {
-      lastLine = endContent.substring(lastNewlineIndex + 1);
-    } else {
-      // The file ends with a newline, so find the second-to-last newline
-      String beforeLastNewline = endContent.substring(0, lastNewlineIndex);
-      int secondLastNewlineIndex = beforeLastNewline.lastIndexOf('\n');
-      if (secondLastNewlineIndex != -1) {
-        lastLine = beforeLastNewline.substring(secondLastNewlineIndex + 1);
-      } else {
-        // No second newline found, the entire content before last newline is
-        // the last line
-        lastLine = beforeLastNewline;
-      }
-    }
-  } else {
-    lastLine = endContent;  // No newline found, entire content is the last line
-  }
-
   // Check if last line is already "New Log"
-  lastLine.trim();  // Remove any whitespace
-  if (lastLine.equals("New Log")) {
+  const char *lastLine = strrchr(tail, '\n');
+  lastLine = lastLine ? lastLine + 1 : tail;
+  if (strcmp(lastLine, "New Log") == 0) {
     ESP_LOGI(TAG, "Last line already 'New Log', skipping");
     return;
   }
@@ -92,79 +53,317 @@ void SaveFlash::newLog() {
   writeData("New Log\n");
 }
 
-void SaveFlash::writeData(const String &data) {
+bool SaveFlash::erase(uint32_t received) {
   if (!m_initialised) {
     ESP_LOGW(TAG, "File system not initialised");
-    return;
+    return false;
   }
 
-  if (data.length() < m_free) {
-    File file = LittleFS.open(fileName, FILE_APPEND);
-    if (!file) {
-      ESP_LOGE(TAG, "Failed to open file for appending");
-      return;
-    }
-    if (file.print(data)) {
-      ESP_LOGD(TAG, "Data written successfully");
-      m_free -= data.length();
-    } else {
-      ESP_LOGE(TAG, "Write failed");
-    }
-    file.close();
+  // Staged lines belong to the old log, nothing is written while erasing
+  xSemaphoreTake(m_flushMutex, portMAX_DELAY);
+  flush();
+  uint32_t end = m_store->endOffset();
+  bool erased = false;
+  if (received != end) {
+    ESP_LOGW(TAG, "Not erasing, the log ends at %u but %u was acknowledged",
+             static_cast<unsigned>(end), static_cast<unsigned>(received));
   } else {
-    ESP_LOGE(TAG, "Not enough space to write data");
-    return;
+    erased = m_store->clear();
+  }
+  xSemaphoreGive(m_flushMutex);
+
+  if (erased) {
+    updateStorage();
+    newLog();
   }
+  return erased;
 }
 
-void SaveFlash::removeFile() {
+bool SaveFlash::range(uint32_t *start, uint32_t *end) {
+  if (!m_initialised) return false;
+  xSemaphoreTake(m_flushMutex, portMAX_DELAY);
+  flush();
+  *start = m_store->startOffset();
+  *end = m_store->endOffset();
+  xSemaphoreGive(m_flushMutex);
+  return true;
+}
+
+bool SaveFlash::read(uint32_t from, uint8_t *out, size_t len) {
+  if (!m_initialised) return false;
+
+  struct Copy {
+    uint8_t *out;
+    size_t left;
+  } copy = {out, len};
+  xSemaphoreTake(m_flushMutex, portMAX_DELAY);
+  uint32_t start = m_store->startOffset();
+  uint32_t end = m_store->endOffset();
+  bool ok = from - start <= end - start && len <= end - from &&
+            m_store->read(
+                from, from + len,
+                [](void *context, const char *data, size_t size) {
+                  Copy *copy = static_cast<Copy *>(context);
+                  size = std::min(size, copy->left);
+                  memcpy(copy->out, data, size);
+                  copy->out += size;
+                  copy->left -= size;
+                },
+                &copy);
+  xSemaphoreGive(m_flushMutex);
+  return ok && copy.left == 0;
+}
+
+void SaveFlash::updateStorage() {
   if (!m_initialised) {
     ESP_LOGW(TAG, "File system not initialised");
     return;
   }
 
-  if (LittleFS.remove(fileName)) {
-    ESP_LOGI(TAG, "File removed successfully: %s", fileName);
-    updateStorage();
-  } else {
-    ESP_LOGE(TAG, "Failed to remove file: %s", fileName);
-  }
+  m_total = m_store->totalBytes();
+  m_used = m_store->usedBytes();
+  m_free = m_total - m_used;
+
+  ESP_LOGI(TAG, "\nTotal: %u bytes\nUsed: %u bytes\nFree: %u bytes",
+           static_cast<unsigned>(m_total), static_cast<unsigned>(m_used),
+           static_cast<unsigned>(m_free));
 }
 
-void SaveFlash::updateStorage() {
+void SaveFlash::dump(uint32_t from, bool decode) {
   if (!m_initialised) {
     ESP_LOGW(TAG, "File system not initialised");
     return;
   }
 
-  m_total = LittleFS.totalBytes();
-  m_used = LittleFS.usedBytes();
-  m_free = m_total - m_used;
+  xSemaphoreTake(m_flushMutex, portMAX_DELAY);
+  flush();  // include the lines still staged in RAM
+  uint32_t start = m_store->startOffset();
+  uint32_t end = m_store->endOffset();
+  xSemaphoreGive(m_flushMutex);
+  if (from - start > end - start) from = start;  // overwritten or bad offset
+
+  char line[64];
+  snprintf(line, sizeof(line), "--- log %u %u ---\n",
+           static_cast<unsigned>(from), static_cast<unsigned>(end));
+  m_serialCom->sendData(line);
 
-  ESP_LOGI(TAG, "\nTotal: %d bytes\nUsed: %d bytes\nFree: %d bytes", m_total,
-           m_used, m_free);
+  auto send = [](void *context, const char *data, size_t len) {
+    static_cast<SerialCom *>(context)->sendData(data, len);
+  };
+#ifndef LOG_COMPRESS
+  (void)decode;  // nothing is compressed
+#endif
+
+  // A chunk at a time with the mutex given back in between, for the other
+  // readers. The flush task runs at a lower priority than the serial task,
+  // so a batch that is due is written here, or the stage would fill up. A
+  // decoder keeps the mutex until it is done with the block it is in, it
+  // uses m_packed and the spare stage.
+  uint32_t startUs = micros();
+  uint32_t pos = from;
+  uint32_t badBlocks = 0;
+  while (pos != end) {
+    xSemaphoreTake(m_flushMutex, portMAX_DELAY);
+    if (dueInMs() == 0) flush();
+    // Ring overwritten or log erased since the last chunk
+    if (pos - m_store->startOffset() > m_store->endOffset() -
+                                           m_store->startOffset()) {
+      xSemaphoreGive(m_flushMutex);
+      break;
+    }
+#ifdef LOG_COMPRESS
+    if (decode) {
+      // Empty while the mutex is held
+      logCodec::Decoder decoder(m_packed, m_stages[m_active ^ 1].buffer, send,
+                                m_serialCom);
+      do {
+        uint32_t to = end - pos > DUMP_CHUNK ? pos + DUMP_CHUNK : end;
+        m_store->read(
+            pos, to,
+            [](void *context, const char *data, size_t len) {
+              static_cast<logCodec::Decoder *>(context)->feed(data, len);
+            },
+            &decoder);
+        pos = to;
+      } while (pos != end && !decoder.idle());
+      badBlocks += decoder.badBlocks();
+      xSemaphoreGive(m_flushMutex);
+      continue;
+    }
+#endif
+    uint32_t to = end - pos > DUMP_CHUNK ? pos + DUMP_CHUNK : end;
+    m_store->read(pos, to, send, m_serialCom);
+    pos = to;
+    xSemaphoreGive(m_flushMutex);
+  }
+  uint32_t elapsedUs = micros() - startUs;
+  if (badBlocks > 0) {
+    ESP_LOGW(TAG, "Skipped %u damaged blocks",
+             static_cast<unsigned>(badBlocks));
+  }
+
+  uint32_t bytes = pos - from;
+  uint32_t rate = elapsedUs > 0 ? static_cast<uint64_t>(bytes) * 1'000'000 /
+                                      elapsedUs
+                                : 0;
+  snprintf(line, sizeof(line), "--- end %u: %u B in %u ms, %u B/s ---\n",
+           static_cast<unsigned>(pos), static_cast<unsigned>(bytes),
+           static_cast<unsigned>(elapsedUs / 1000), static_cast<unsigned>(rate));
+  m_serialCom->sendData(line);
+}
+
+/* ============================ WRITE BEHIND =============================== */
+
+void SaveFlash::writeData(const char *data) {
+  stage(data, strlen(data), false);
 }
 
-void SaveFlash::readFile() {
+void SaveFlash::writeLine(const char *line) {
+  stage(line, strlen(line), true);
+}
+
+void SaveFlash::stage(const char *data, size_t len, bool newline) {
   if (!m_initialised) {
     ESP_LOGW(TAG, "File system not initialised");
+    portENTER_CRITICAL(&m_stageMux);
+    m_stats.droppedLines++;
+    portEXIT_CRITICAL(&m_stageMux);
     return;
   }
 
-  File file = LittleFS.open(fileName, FILE_READ);
-  if (!file) {
-    ESP_LOGE(TAG, "Failed to open file for reading");
+  size_t total = len + (newline ? 1 : 0);
+  uint32_t now = millis();
+  bool wake = false;
+  bool staged = false;
+
+  portENTER_CRITICAL(&m_stageMux);
+  Stage &stage = m_stages[m_active];
+  if (stage.len + total <= STAGE_SIZE) {
+    // Wake the flush task to start the age timer, or to write a full batch
+    wake = stage.len == 0 ||
+           (stage.len < FLUSH_BYTES && stage.len + total >= FLUSH_BYTES);
+    if (stage.len == 0) stage.sinceMs = now;
+    memcpy(stage.data() + stage.len, data, len);
+    if (newline) stage.data()[stage.len + len] = '\n';
+    stage.len += total;
+    stage.lines++;
+    m_stats.bytesBuffered += total;
+    staged = true;
+  } else {
+    m_stats.droppedLines++;
+  }
+  portEXIT_CRITICAL(&m_stageMux);
+
+  if (!staged) {
+    ESP_LOGW(TAG, "Log staging full, dropped %u bytes",
+             static_cast<unsigned>(total));
     return;
   }
-  ESP_LOGI(TAG, "Reading file: %s", fileName);
-  m_serialCom->sendData("--------------------------------\n");
-  while (file.available()) {
-    String line = file.readStringUntil('\n');
-    line += '\n';  // Add the newline back
-    m_serialCom->sendData(line.c_str());
+  if (wake && m_flushTask) xTaskNotifyGive(m_flushTask);
+}
+
+// Writes the active stage while the writers move on to the other one. The
+// caller holds m_flushMutex, so the other stage is always empty here.
+bool SaveFlash::flush() {
+  portENTER_CRITICAL(&m_stageMux);
+  Stage &stage = m_stages[m_active];
+  if (stage.len == 0) {
+    portEXIT_CRITICAL(&m_stageMux);
+    return true;
+  }
+  m_active ^= 1;
+  portEXIT_CRITICAL(&m_stageMux);
+
+  uint32_t start = micros();
+  const char *out = stage.data();
+  size_t outLen = stage.len;
+#ifdef LOG_COMPRESS
+  // Stored as plain text when it does not get smaller
+  size_t packedLen = logCodec::compress(stage.buffer, stage.len, m_packed,
+                                        sizeof(m_packed), m_hashTable);
+  if (packedLen > 0) {
+    out = reinterpret_cast<const char *>(m_packed);
+    outLen = packedLen;
+  }
+#endif
+  uint32_t compressUs = micros() - start;
+  bool ok = m_store->append(out, outLen);
+  uint32_t elapsedUs = micros() - start;
+
+  portENTER_CRITICAL(&m_stageMux);
+  m_stats.bytesBuffered -= stage.len;
+  if (ok) {
+    m_stats.bytesWritten += stage.len;
+    m_stats.bytesStored += outLen;
+    m_stats.linesWritten += stage.lines;
+    m_stats.flushes++;
+    if (stage.lines > m_stats.maxLinesPerFlush) {
+      m_stats.maxLinesPerFlush = stage.lines;
+    }
+    m_stats.lastFlushUs = elapsedUs;
+    m_stats.totalFlushUs += elapsedUs;
+    m_stats.totalCompressUs += compressUs;
+    if (elapsedUs > m_stats.maxFlushUs) m_stats.maxFlushUs = elapsedUs;
+  } else {
+    m_stats.droppedLines += stage.lines;
+  }
+  portEXIT_CRITICAL(&m_stageMux);
+
+  if (ok) {
+    metrics::add(metrics::Counter::FlashWrites);
+    metrics::record(metrics::Histogram::FlashWriteUs, elapsedUs);
+  } else {
+    metrics::add(metrics::Counter::FlashDropped, stage.lines);
+  }
+
+  ESP_LOGD(TAG, "Flushed %u lines, %u bytes as %u in %u us",
+           static_cast<unsigned>(stage.lines), static_cast<unsigned>(stage.len),
+           static_cast<unsigned>(outLen), static_cast<unsigned>(elapsedUs));
+  stage.len = 0;
+  stage.lines = 0;
+  return ok;
+}
+
+void SaveFlash::sync() {
+  xSemaphoreTake(m_flushMutex, portMAX_DELAY);
+  flush();
+  xSemaphoreGive(m_flushMutex);
+}
+
+void SaveFlash::flushTask() {
+  m_flushTask = xTaskGetCurrentTaskHandle();
+
+  while (true) {
+    uint32_t dueMs = dueInMs();
+    if (dueMs == 0) {
+      sync();
+      continue;
+    }
+
+    // Sleep until the batch is due, or until a writer fills it up
+    TickType_t wait =
+        dueMs == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(dueMs);
+    ulTaskNotifyTake(pdTRUE, wait);
   }
-  m_serialCom->sendData("--------------------------------\n");
-  file.close();
+}
+
+// 0 once the active stage should be written, UINT32_MAX while it is empty
+uint32_t SaveFlash::dueInMs() {
+  portENTER_CRITICAL(&m_stageMux);
+  size_t staged = m_stages[m_active].len;
+  uint32_t age = millis() - m_stages[m_active].sinceMs;
+  portEXIT_CRITICAL(&m_stageMux);
+
+  if (staged == 0) return UINT32_MAX;
+  if (staged >= FLUSH_BYTES || age >= MAX_AGE_MS) return 0;
+  return MAX_AGE_MS - age;
+}
+
+FlashLogStats SaveFlash::stats() {
+  portENTER_CRITICAL(&m_stageMux);
+  FlashLogStats stats = m_stats;
+  portEXIT_CRITICAL(&m_stageMux);
+  return stats;
 }
 
 // void SaveFlash::sendCommand(const char *command) {
@@ -1,22 +1,93 @@
+#pragma once
+
 #include <Arduino.h>
 
-#include "LittleFS.h"
 #include "SerialCom.hpp"
+#include "circularLog.hpp"
 #include "esp_log.h"
+#include "fileLog.hpp"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "logCodec.hpp"
+
+struct FlashLogStats {
+  uint32_t bytesBuffered = 0;  // staged in RAM right now
+  uint32_t bytesWritten = 0;
+  uint32_t bytesStored = 0;  // after compression
+  uint32_t linesWritten = 0;
+  uint32_t droppedLines = 0;  // staging full, or the file system is not up
+  uint32_t flushes = 0;
+  uint32_t maxLinesPerFlush = 0;
+  uint32_t lastFlushUs = 0;  // LogStore::append() of one batch
+  uint32_t maxFlushUs = 0;
+  uint64_t totalFlushUs = 0;
+  uint64_t totalCompressUs = 0;  // part of totalFlushUs
+};
 
+// Log lines are staged in RAM and written to flash in batches by flushTask(),
+// so the tasks that produce them never wait for the flash.
+//
+// There are two staging buffers. Writers fill one while the flush task appends
+// the other to the LogStore in one go (FileLog: a single open/write/close,
+// which LittleFS commits atomically). A batch is written once it holds
+// FLUSH_BYTES, once its first line is MAX_AGE_MS old, or on sync().
+//
+// On power loss at most the lines staged in the last MAX_AGE_MS (plus a batch
+// being written at that moment) are lost, never more than 2 * STAGE_SIZE
+// bytes. Lines already in the log are never corrupted.
+//
+// With LOG_COMPRESS each batch is compressed before it is appended (see
+// logCodec.hpp), which costs m_packed and m_hashTable, about 6 KiB of RAM.
 class SaveFlash {
  public:
+  static constexpr size_t STAGE_SIZE = 4096;  // one flash sector
+  static constexpr size_t FLUSH_BYTES = STAGE_SIZE / 2;
+  static constexpr uint32_t MAX_AGE_MS = 2000;
+  static constexpr uint32_t DUMP_CHUNK = 1024;
+
   SaveFlash(SerialCom *serialCom);
   void begin();
   void newLog();
-  void writeData(const String &data);
-  void removeFile();
-  void readFile();
+  void writeData(const char *data);  // staged as is
+  void writeLine(const char *line);  // staged with a '\n' appended
+  void sync();                       // write everything staged, blocking
+
+  // Streams the log from offset `from` to its current end over serial:
+  //
+  //   --- log <from> <end> ---\n
+  //   <end - from raw bytes>
+  //   --- end <end>: <bytes> B in <ms> ms, <rate> B/s ---\n
+  //
+  // A host that lost the connection asks again from `from` plus the bytes it
+  // got. An offset that was already overwritten starts at the oldest data.
+  //
+  // The log is read DUMP_CHUNK bytes at a time, and new lines are written
+  // in between, so none are dropped during a long dump. If the ring
+  // overwrites what is left to send, or the log is erased, the dump stops
+  // early and the trailer's <end> is where it did.
+  //
+  // Offsets count stored bytes. With LOG_COMPRESS `decode` turns blocks back
+  // into text on the way out, which is for reading, not for resuming. Without
+  // it the host gets the stored bytes and decodes them itself.
+  void dump(uint32_t from = 0, bool decode = false);
+  // Clears the log once the host confirms it received everything up to
+  // `received`. Refuses if anything was logged after that.
+  bool erase(uint32_t received);
+  // Offsets of the oldest and one past the newest stored byte, after
+  // writing what is staged. For "fetch", which reads the log in pieces.
+  bool range(uint32_t *start, uint32_t *end);
+  // Copies `len` stored bytes from `from`, false if they are not all there
+  bool read(uint32_t from, uint8_t *out, size_t len);
   void updateStorage();
   //   void sendCommand();
 
+  void flushTask();  // runs forever, see Control::begin()
+  FlashLogStats stats();
+
  private:
   SerialCom *m_serialCom;  // Pointer to SerialCom instance
+  LogStore *m_store;       // FileLog, or CircularLog with RAW_LOG
 
   const char *TAG = "SaveFlash";
   const char *fileName = "/log.txt";
@@ -25,4 +96,35 @@ class SaveFlash {
   size_t m_used = 0;
   size_t m_total = 0;
   size_t m_free = 0;
-};
\ No newline at end of file
+
+  // ----- Staging -----
+  // The lines follow a copy of the dictionary, so a batch can be compressed
+  // in place and a block decoded into a spare stage
+  struct Stage {
+    uint8_t buffer[logCodec::DICT_SIZE + STAGE_SIZE];
+    size_t len = 0;
+    uint32_t lines = 0;
+    uint32_t sinceMs = 0;  // millis() when the first line went in
+
+    char *data() {
+      return reinterpret_cast<char *>(buffer) + logCodec::DICT_SIZE;
+    }
+  };
+
+  void stage(const char *data, size_t len, bool newline);
+  bool flush();
+  uint32_t dueInMs();
+
+  Stage m_stages[2];
+  uint8_t m_active = 0;  // stage the writers fill
+  portMUX_TYPE m_stageMux = portMUX_INITIALIZER_UNLOCKED;
+  SemaphoreHandle_t m_flushMutex;  // one batch written at a time
+  TaskHandle_t m_flushTask = nullptr;
+  FlashLogStats m_stats;
+
+#ifdef LOG_COMPRESS
+  // Both only used under m_flushMutex
+  uint8_t m_packed[STAGE_SIZE];  // a compressed batch, or a block being read
+  uint16_t m_hashTable[logCodec::HASH_SIZE];
+#endif
+};
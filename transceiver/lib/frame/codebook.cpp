@@ -0,0 +1,122 @@
+#include "codebook.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+namespace frame {
+
+namespace {
+
+constexpr uint8_t FIRST_CODE = 0x80;
+constexpr uint8_t ESCAPE = 0xFF;
+
+// Trained by `sim --codebook` (sim/codebookBench.cpp) on the data and
+// command payloads it generates, by picking, 127 times, the substring that
+// saves the most bytes. It prints the table as it is here. Sorted by first
+// byte, longest first, so the first hit while encoding is the longest one.
+constexpr std::string_view CODEBOOK[] = {
+    " force:", " temp:", " hum:", " v:3.", " id:", " v:", ".0", ".1", ".2",
+    ".3", ".4", ".5", ".6", ".7", ".8", ".9", "00", "01", "03", "04", "06",
+    "11.", "16.", "10", "11", "12", "13", "14", "15", "16", "17", "18", "19",
+    "25.", "28.", "29.", "2.", "20", "21", "22", "23", "24", "25", "26", "27",
+    "28", "29", "30.", "300", "3.", "30", "31", "32", "33", "34", "35", "36",
+    "37", "38", "39", "4.", "40", "41", "42", "43", "44", "46", "47", "49",
+    "55.", "50", "51", "52", "53", "54", "55", "56", "57", "58", "59", "60",
+    "61", "64", "66", "67", "68", "7.", "70", "71", "72", "73", "74", "75",
+    "76", "77", "78", "79", "80", "81", "82", "83", "84", "85", "86", "87",
+    "88", "89", "90", "91", "92", "93", "94", "95", "96", "97", "98", "99",
+    "bwKHz ", "et output ", "freqMhz ", "gain ", "help", "stats", "set ", "sf ",
+    "t:", "update ",
+};
+constexpr size_t ENTRIES = sizeof(CODEBOOK) / sizeof(CODEBOOK[0]);
+static_assert(ENTRIES <= ESCAPE - FIRST_CODE, "codebook too large");
+
+// Entries starting with byte c are [first[c], first[c + 1])
+struct Index {
+  uint8_t first[0x81] = {};
+};
+
+constexpr Index makeIndex() {
+  Index index;
+  size_t entry = 0;
+  for (size_t c = 0; c <= 0x80; c++) {
+    while (entry < ENTRIES && static_cast<uint8_t>(CODEBOOK[entry][0]) < c) {
+      entry++;
+    }
+    index.first[c] = static_cast<uint8_t>(entry);
+  }
+  return index;
+}
+
+constexpr bool sorted() {
+  for (size_t i = 1; i < ENTRIES; i++) {
+    if (CODEBOOK[i - 1][0] > CODEBOOK[i][0]) return false;
+    if (CODEBOOK[i - 1][0] == CODEBOOK[i][0] &&
+        CODEBOOK[i - 1].size() < CODEBOOK[i].size()) {
+      return false;
+    }
+  }
+  return true;
+}
+static_assert(sorted(), "codebook must be sorted by first byte, longest first");
+
+constexpr Index INDEX = makeIndex();
+
+}  // namespace
+
+size_t pack(const uint8_t *in, size_t len, uint8_t *out, size_t size) {
+  std::string_view text(reinterpret_cast<const char *>(in), len);
+  size_t limit = std::min(size, len > 0 ? len - 1 : 0);  // must be shorter
+  size_t n = 0;
+
+  for (size_t i = 0; i < len;) {
+    uint8_t c = in[i];
+    if (c >= FIRST_CODE) {
+      if (n + 2 > limit) return 0;
+      out[n++] = ESCAPE;
+      out[n++] = c;
+      i++;
+      continue;
+    }
+
+    size_t code = ENTRIES;
+    for (size_t e = INDEX.first[c]; e < INDEX.first[c + 1]; e++) {
+      if (text.compare(i, CODEBOOK[e].size(), CODEBOOK[e]) == 0) {
+        code = e;
+        break;
+      }
+    }
+    if (n + 1 > limit) return 0;
+    if (code < ENTRIES) {
+      out[n++] = static_cast<uint8_t>(FIRST_CODE + code);
+      i += CODEBOOK[code].size();
+    } else {
+      out[n++] = c;
+      i++;
+    }
+  }
+  return n;
+}
+
+size_t unpack(const uint8_t *in, size_t len, uint8_t *out, size_t size) {
+  size_t n = 0;
+  for (size_t i = 0; i < len; i++) {
+    uint8_t c = in[i];
+    if (c < FIRST_CODE) {
+      if (n + 1 > size) return 0;
+      out[n++] = c;
+    } else if (c == ESCAPE) {
+      if (++i >= len || n + 1 > size) return 0;
+      out[n++] = in[i];
+    } else {
+      size_t code = c - FIRST_CODE;
+      if (code >= ENTRIES || n + CODEBOOK[code].size() > size) return 0;
+      memcpy(out + n, CODEBOOK[code].data(), CODEBOOK[code].size());
+      n += CODEBOOK[code].size();
+    }
+  }
+  return n;
+}
+
+}  // namespace frame
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Packing of data and command payloads with a static codebook.
+//
+// Payloads are ASCII text, so bytes 0x80..0xFE are free to stand for one of
+// 127 strings that are frequent in our traffic: the keys of the telemetry
+// lines, the command words and pairs of digits. 0xFF escapes a byte >= 0x80
+// that really is in the text. Both ends share the table, nothing is sent
+// along with a frame.
+//
+// Unpacking never produces more than `size` bytes and reads every input byte
+// once, so it is safe to run on whatever arrives over the air.
+
+namespace frame {
+
+// Returns the packed length, 0 if packing does not make it shorter or does
+// not fit into `size`
+size_t pack(const uint8_t *in, size_t len, uint8_t *out, size_t size);
+
+// Returns the text length, 0 if `in` is damaged or does not fit into `size`
+size_t unpack(const uint8_t *in, size_t len, uint8_t *out, size_t size);
+
+}  // namespace frame
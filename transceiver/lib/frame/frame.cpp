@@ -0,0 +1,375 @@
+#include "frame.hpp"
+
+#include <cstdio>
+
+#include "codebook.hpp"
+
+namespace frame {
+
+uint16_t crc16(const uint8_t *data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= static_cast<uint16_t>(data[i]) << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+/* ================================ ENCODING =============================== */
+
+size_t encode(const Header &header, const uint8_t *payload, size_t len,
+              uint8_t *out, size_t size) {
+  size_t total = HEADER_SIZE + len + CRC_SIZE;
+  if (len > MAX_PAYLOAD || total > size) return 0;
+
+  out[0] = (VERSION << 4) | (static_cast<uint8_t>(header.type) & 0x0F);
+  out[1] = header.hops;
+  out[2] = header.nodeId & 0xFF;
+  out[3] = header.nodeId >> 8;
+  out[4] = header.seq & 0xFF;
+  out[5] = header.seq >> 8;
+  if (len > 0) memcpy(out + HEADER_SIZE, payload, len);
+
+  uint16_t crc = crc16(out, HEADER_SIZE + len);
+  out[HEADER_SIZE + len] = crc & 0xFF;
+  out[HEADER_SIZE + len + 1] = crc >> 8;
+  return total;
+}
+
+size_t encodeStatus(const Header &header, const Status &status, uint8_t *out,
+                    size_t size, const LinkReport *report) {
+  uint8_t payload[STATUS_SIZE + LINK_REPORT_SIZE] = {
+      static_cast<uint8_t>(status.rssi), status.battery,
+      static_cast<uint8_t>(status.mode), static_cast<uint8_t>(status.health)};
+  size_t len = STATUS_SIZE;
+  if (report != nullptr) {
+    payload[len++] = report->rate;
+    payload[len++] = report->epoch;
+    payload[len++] = static_cast<uint8_t>(report->excessDb);
+    payload[len++] = report->lossPercent;
+  }
+  return encode(header, payload, len, out, size);
+}
+
+size_t encodeRate(const Header &header, const RateOrder &order, uint8_t *out,
+                  size_t size) {
+  const uint8_t payload[RATE_SIZE] = {
+      order.rate, static_cast<uint8_t>(order.powerDbm), order.epoch,
+      static_cast<uint8_t>(order.delayMs & 0xFF),
+      static_cast<uint8_t>(order.delayMs >> 8)};
+  return encode(header, payload, sizeof(payload), out, size);
+}
+
+size_t encodeText(const Header &header, const char *text, size_t len,
+                  uint8_t *out, size_t size) {
+  uint8_t packed[MAX_PAYLOAD];
+  size_t packedLen = len <= MAX_PAYLOAD
+                         ? pack(reinterpret_cast<const uint8_t *>(text), len,
+                                packed, sizeof(packed))
+                         : 0;
+  if (packedLen == 0) {
+    return encode(header, reinterpret_cast<const uint8_t *>(text), len, out,
+                  size);
+  }
+
+  size_t total = encode(header, packed, packedLen, out, size);
+  if (total == 0) return 0;
+  // The flag is covered by the CRC as well
+  out[0] |= PACKED;
+  uint16_t crc = crc16(out, total - CRC_SIZE);
+  out[total - CRC_SIZE] = crc & 0xFF;
+  out[total - CRC_SIZE + 1] = crc >> 8;
+  return total;
+}
+
+size_t encodeArq(const Header &header, const ArqHeader &arq, const char *text,
+                 size_t len, uint8_t *out, size_t size) {
+  if (len > MAX_PAYLOAD - ARQ_SIZE) return 0;
+  char payload[MAX_PAYLOAD];
+  payload[0] = arq.to & 0xFF;
+  payload[1] = arq.to >> 8;
+  payload[2] = arq.seq;
+  payload[3] = arq.ack;
+  payload[4] = arq.sack & 0xFF;
+  payload[5] = arq.sack >> 8;
+  payload[6] = (arq.hasAck ? 0x80 : 0) | (arq.start ? 0x40 : 0) |
+               (arq.kind & 0x3F);
+  if (len > 0) memcpy(payload + ARQ_SIZE, text, len);
+  // The codebook passes binary bytes through, so the header can go along
+  return encodeText(header, payload, ARQ_SIZE + len, out, size);
+}
+
+size_t encodeLog(const Header &header, const LogHeader &log,
+                 const uint8_t *body, size_t len, uint8_t *out, size_t size) {
+  if (len > MAX_PAYLOAD - LOG_SIZE) return 0;
+  char payload[MAX_PAYLOAD];
+  payload[0] = log.to & 0xFF;
+  payload[1] = log.to >> 8;
+  payload[2] = log.op;
+  payload[3] = log.transfer;
+  if (len > 0) memcpy(payload + LOG_SIZE, body, len);
+  // Log text packs like data lines do, parity and headers pass through
+  return encodeText(header, payload, LOG_SIZE + len, out, size);
+}
+
+size_t encodeSync(const Header &header, const Sync &sync, const uint16_t *ids,
+                  size_t count, uint8_t *out, size_t size) {
+  if (count > (MAX_PAYLOAD - SYNC_SIZE) / 2) return 0;
+  uint8_t payload[MAX_PAYLOAD];
+  payload[0] = sync.slotUs & 0xFF;
+  payload[1] = (sync.slotUs >> 8) & 0xFF;
+  payload[2] = (sync.slotUs >> 16) & 0xFF;
+  payload[3] = sync.slotUs >> 24;
+  payload[4] = sync.guardUs & 0xFF;
+  payload[5] = sync.guardUs >> 8;
+  payload[6] = sync.members;
+  payload[7] = sync.join;
+  payload[8] = sync.first;
+  for (size_t i = 0; i < count; i++) {
+    payload[SYNC_SIZE + 2 * i] = ids[i] & 0xFF;
+    payload[SYNC_SIZE + 2 * i + 1] = ids[i] >> 8;
+  }
+  return encode(header, payload, SYNC_SIZE + 2 * count, out, size);
+}
+
+void setHops(uint8_t *frame, size_t len, uint8_t hops) {
+  if (len < HEADER_SIZE + CRC_SIZE) return;
+  frame[1] = hops;
+  size_t body = len - CRC_SIZE;
+  uint16_t crc = crc16(frame, body);
+  frame[body] = crc & 0xFF;
+  frame[body + 1] = crc >> 8;
+}
+
+/* ================================ DECODING =============================== */
+
+bool decode(const uint8_t *in, size_t len, Header *header,
+            const uint8_t **payload, size_t *payloadLen, uint8_t *scratch) {
+  if (len < HEADER_SIZE + CRC_SIZE || (in[0] >> 4) != VERSION ||
+      in[1] > MAX_HOPS) {
+    return false;
+  }
+
+  size_t body = len - CRC_SIZE;
+  uint16_t crc = in[body] | (in[body + 1] << 8);
+  if (crc != crc16(in, body)) return false;
+
+  header->type = static_cast<Type>(in[0] & 0x07);
+  header->packed = (in[0] & PACKED) != 0;
+  header->hops = in[1];
+  header->nodeId = in[2] | (in[3] << 8);
+  header->seq = in[4] | (in[5] << 8);
+  *payload = in + HEADER_SIZE;
+  *payloadLen = body - HEADER_SIZE;
+  if (!header->packed) return true;
+
+  // Bounded by MAX_PAYLOAD, a sender never packs more than that
+  *payloadLen = unpack(*payload, *payloadLen, scratch, MAX_PAYLOAD);
+  *payload = scratch;
+  return *payloadLen > 0;
+}
+
+bool decodeStatus(const uint8_t *payload, size_t len, Status *status) {
+  if (len < STATUS_SIZE) return false;
+  status->rssi = static_cast<int8_t>(payload[0]);
+  status->battery = payload[1];
+  status->mode = static_cast<Mode>(payload[2]);
+  status->health = static_cast<Health>(payload[3]);
+  return true;
+}
+
+bool decodeLinkReport(const uint8_t *payload, size_t len, LinkReport *report) {
+  if (len < STATUS_SIZE + LINK_REPORT_SIZE) return false;
+  payload += STATUS_SIZE;
+  report->rate = payload[0];
+  report->epoch = payload[1];
+  report->excessDb = static_cast<int8_t>(payload[2]);
+  report->lossPercent = payload[3];
+  return true;
+}
+
+bool decodeRate(const uint8_t *payload, size_t len, RateOrder *order) {
+  if (len < RATE_SIZE) return false;
+  order->rate = payload[0];
+  order->powerDbm = static_cast<int8_t>(payload[1]);
+  order->epoch = payload[2];
+  order->delayMs = payload[3] | (payload[4] << 8);
+  return true;
+}
+
+bool decodeArq(const uint8_t *payload, size_t len, ArqHeader *arq,
+               const uint8_t **text, size_t *textLen) {
+  if (len < ARQ_SIZE) return false;
+  arq->to = payload[0] | (payload[1] << 8);
+  arq->seq = payload[2];
+  arq->ack = payload[3];
+  arq->sack = payload[4] | (payload[5] << 8);
+  arq->kind = payload[6] & 0x3F;
+  arq->hasAck = (payload[6] & 0x80) != 0;
+  arq->start = (payload[6] & 0x40) != 0;
+  *text = payload + ARQ_SIZE;
+  *textLen = len - ARQ_SIZE;
+  return true;
+}
+
+bool decodeLog(const uint8_t *payload, size_t len, LogHeader *log,
+               const uint8_t **body, size_t *bodyLen) {
+  if (len < LOG_SIZE) return false;
+  log->to = payload[0] | (payload[1] << 8);
+  log->op = payload[2];
+  log->transfer = payload[3];
+  *body = payload + LOG_SIZE;
+  *bodyLen = len - LOG_SIZE;
+  return true;
+}
+
+bool decodeSync(const uint8_t *payload, size_t len, Sync *sync,
+                const uint8_t **ids, size_t *count) {
+  if (len < SYNC_SIZE || (len - SYNC_SIZE) % 2 != 0) return false;
+  sync->slotUs = payload[0] | (payload[1] << 8) | (payload[2] << 16) |
+                 (static_cast<uint32_t>(payload[3]) << 24);
+  sync->guardUs = payload[4] | (payload[5] << 8);
+  sync->members = payload[6];
+  sync->join = payload[7];
+  sync->first = payload[8];
+  *ids = payload + SYNC_SIZE;
+  *count = (len - SYNC_SIZE) / 2;
+  return true;
+}
+
+/* ================================== TEXT ================================= */
+
+const char *modeName(Mode mode) {
+  switch (mode) {
+    case Mode::Transceive:
+      return "transceive";
+    case Mode::Transmit:
+      return "transmit";
+    case Mode::Receive:
+      return "receive";
+    case Mode::FreqSweep:
+      return "sweep";
+    case Mode::Tdma:
+      return "tdma";
+  }
+  return "unknown";
+}
+
+const char *healthName(Health health) {
+  switch (health) {
+    case Health::Ok:
+      return "ok";
+    case Health::Warning:
+      return "warning";
+    case Health::Error:
+      return "error";
+    case Health::LowBattery:
+      return "lowBattery";
+  }
+  return "unknown";
+}
+
+size_t toText(const Header &header, const uint8_t *payload, size_t len,
+              char *out, size_t size) {
+  if (size == 0) return 0;
+  int written = 0;
+
+  switch (header.type) {
+    case Type::Status: {
+      Status status;
+      if (!decodeStatus(payload, len, &status)) {
+        written = snprintf(out, size, "status ID:%04X <malformed>",
+                           header.nodeId);
+        break;
+      }
+      written = snprintf(
+          out, size,
+          "status ID:%04X SEQ:%u RSSI:%d batteryLevel:%u mode:%s status:%s",
+          header.nodeId, header.seq, status.rssi, status.battery,
+          modeName(status.mode), healthName(status.health));
+      break;
+    }
+    case Type::Data:
+    case Type::Command:
+      written = snprintf(out, size, "%s %.*s",
+                         header.type == Type::Data ? "data" : "command",
+                         static_cast<int>(len),
+                         reinterpret_cast<const char *>(payload));
+      break;
+    case Type::Rate: {
+      RateOrder order;
+      if (!decodeRate(payload, len, &order)) {
+        written = snprintf(out, size, "rate ID:%04X <malformed>",
+                           header.nodeId);
+        break;
+      }
+      written = snprintf(out, size, "rate DR%u power:%d epoch:%u",
+                         order.rate, order.powerDbm, order.epoch);
+      break;
+    }
+    case Type::Arq: {
+      ArqHeader arq;
+      const uint8_t *text = nullptr;
+      size_t textLen = 0;
+      if (!decodeArq(payload, len, &arq, &text, &textLen)) {
+        written = snprintf(out, size, "arq ID:%04X <malformed>",
+                           header.nodeId);
+        break;
+      }
+      if (arq.kind == ARQ_ACK_ONLY) {
+        written = snprintf(out, size, "ack ID:%04X to:%04X ack:%u sack:%04X",
+                           header.nodeId, arq.to, arq.ack, arq.sack);
+        break;
+      }
+      Header inner = header;
+      inner.type = static_cast<Type>(arq.kind);
+      if (inner.type != Type::Data && inner.type != Type::Command) {
+        written = snprintf(out, size, "arq ID:%04X kind:%u", header.nodeId,
+                           arq.kind);
+        break;
+      }
+      return toText(inner, text, textLen, out, size);
+    }
+    case Type::Log: {
+      LogHeader log;
+      const uint8_t *body = nullptr;
+      size_t bodyLen = 0;
+      if (!decodeLog(payload, len, &log, &body, &bodyLen)) {
+        written = snprintf(out, size, "log ID:%04X <malformed>",
+                           header.nodeId);
+        break;
+      }
+      written = snprintf(out, size, "log ID:%04X to:%04X op:%u transfer:%u "
+                         "bytes:%u", header.nodeId, log.to, log.op,
+                         log.transfer, static_cast<unsigned>(bodyLen));
+      break;
+    }
+    case Type::Sync: {
+      Sync sync;
+      const uint8_t *ids = nullptr;
+      size_t count = 0;
+      if (!decodeSync(payload, len, &sync, &ids, &count)) {
+        written = snprintf(out, size, "sync ID:%04X <malformed>",
+                           header.nodeId);
+        break;
+      }
+      written = snprintf(out, size, "sync ID:%04X slot:%luus members:%u "
+                         "join:%u first:%u ids:%u", header.nodeId,
+                         static_cast<unsigned long>(sync.slotUs),
+                         sync.members, sync.join, sync.first,
+                         static_cast<unsigned>(count));
+      break;
+    }
+    default:
+      written = snprintf(out, size, "unknown type:%u from ID:%04X",
+                         static_cast<unsigned>(header.type), header.nodeId);
+      break;
+  }
+
+  if (written < 0) written = 0;
+  return std::min(static_cast<size_t>(written), size - 1);
+}
+
+}  // namespace frame
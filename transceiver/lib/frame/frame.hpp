@@ -0,0 +1,196 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Binary over-the-air frame, little endian:
+//
+//   | ver:4 packed:1 type:3 | hops:8 | nodeId:16 | seq:16 | payload... |
+//   | crc16:16 |
+//
+// The CRC is CRC-16/CCITT-FALSE over everything before it. Old text
+// messages start with a letter and are rejected by the version check before
+// the CRC is even looked at, and so are version 1 frames, which had a one
+// byte seq and no hops.
+// `hops` counts the relays a frame passed (see relay.hpp), nodeId and seq
+// stay those of the node that sent it first. seq counts every frame a node
+// sends, at the fastest rate the radio takes it cannot wrap within the relay
+// cache time.
+//
+// Status payload: | rssi:s8 | battery %:8 | mode:8 | status:8 |
+// followed by a LinkReport when the sender runs ADR (see adr.hpp):
+//   | rate:8 | epoch:8 | excess dB:s8 | loss %:8 |
+// Rate payload, an ADR switch order: | rate:8 | power dBm:s8 | epoch:8 |
+//   delay ms:16 |
+// Data and command payloads are the raw text that followed "data "/"command ",
+// or that text run through pack() (see codebook.hpp) when `packed` is set.
+// Unpacked frames are the same as before the flag existed.
+// A data payload holds one or more records separated by '\n' (batcher.hpp).
+// Arq payload, a frame of a reliable transfer (see arq.hpp):
+//   | to:16 | seq:8 | ack:8 | sack:16 | hasAck:1 start:1 kind:6 | text... |
+// kind is the Type of the text (data or command), ARQ_ACK_ONLY when there is
+// none. Packing covers the whole payload.
+// Log payload, remote log retrieval (see logFetch.hpp):
+//   | to:16 | op:8 | transfer:8 | body... |
+// packed like Arq.
+// Sync payload, the start of a TDMA superframe (see tdma.hpp):
+//   | slot us:32 | guard us:16 | members:8 | join:8 | first:8 |
+//   | member ID:16 x n |
+// the IDs holding member slots first to first + n - 1.
+
+namespace frame {
+
+constexpr uint8_t VERSION = 2;
+
+constexpr size_t HEADER_SIZE = 6;
+constexpr size_t CRC_SIZE = 2;
+constexpr size_t MAX_SIZE = 255;  // SX126x FIFO
+constexpr size_t MAX_PAYLOAD = MAX_SIZE - HEADER_SIZE - CRC_SIZE;
+constexpr size_t STATUS_SIZE = 4;
+constexpr size_t LINK_REPORT_SIZE = 4;
+constexpr size_t RATE_SIZE = 5;
+constexpr size_t ARQ_SIZE = 7;
+constexpr size_t LOG_SIZE = 4;
+constexpr size_t SYNC_SIZE = 9;
+constexpr uint8_t ARQ_ACK_ONLY = 0;
+constexpr uint8_t PACKED = 0x08;  // in the type nibble
+constexpr uint8_t MAX_HOPS = 3;
+
+// Longest line toText() produces
+constexpr size_t MAX_TEXT = MAX_PAYLOAD + 16;
+
+enum class Type : uint8_t {
+  Status = 1,
+  Data = 2,
+  Command = 3,
+  Rate = 4,
+  Arq = 5,
+  Log = 6,
+  Sync = 7,
+};
+
+enum class Mode : uint8_t {
+  Transceive = 0,
+  Transmit = 1,
+  Receive = 2,
+  FreqSweep = 3,
+  Tdma = 4,  // transceive in the slots of a TDMA schedule
+};
+
+enum class Health : uint8_t {
+  Ok = 0,
+  Warning = 1,
+  Error = 2,
+  LowBattery = 3,
+};
+
+struct Header {
+  Type type;
+  uint16_t nodeId;
+  uint16_t seq;
+  bool packed = false;  // set by decode()
+  uint8_t hops = 0;      // relays passed, up to MAX_HOPS
+};
+
+struct Status {
+  int8_t rssi;      // dBm of the last packet received
+  uint8_t battery;  // percent
+  Mode mode;
+  Health health;
+};
+
+struct LinkReport {
+  uint8_t rate;         // data rate in use, index into adr::RATES
+  uint8_t epoch;        // of the last switch order applied
+  int8_t excessDb;      // weakest link above its target margin
+  uint8_t lossPercent;  // frames missed from all peers
+};
+
+struct RateOrder {
+  uint8_t rate;
+  int8_t powerDbm;
+  uint8_t epoch;
+  uint16_t delayMs;  // from the end of this frame to the switch
+};
+
+struct ArqHeader {
+  uint16_t to;    // the only node that handles it
+  uint8_t seq;    // of this frame in the stream to `to`
+  uint8_t ack;    // every frame from `to` before this one arrived
+  uint16_t sack;  // bit i: frame ack + 1 + i arrived as well
+  uint8_t kind;   // Type of the text, or ARQ_ACK_ONLY
+  bool hasAck;    // ack and sack are valid, the sender heard from `to`
+  bool start;     // seq is near the start of a new stream
+};
+
+struct LogHeader {
+  uint16_t to;       // the only node that handles it
+  uint8_t op;        // fetch::Op
+  uint8_t transfer;  // set by the gateway, echoed by the node
+};
+
+struct Sync {
+  uint32_t slotUs;   // length of every slot, guard included
+  uint16_t guardUs;  // of that
+  uint8_t members;   // member slots, after the sync slot
+  uint8_t join;      // join slots, after the member slots
+  uint8_t first;     // member slot of the first ID carried
+};
+
+// Returns the frame length, 0 if it does not fit into `size`
+size_t encode(const Header &header, const uint8_t *payload, size_t len,
+              uint8_t *out, size_t size);
+size_t encodeStatus(const Header &header, const Status &status, uint8_t *out,
+                    size_t size, const LinkReport *report = nullptr);
+size_t encodeRate(const Header &header, const RateOrder &order, uint8_t *out,
+                  size_t size);
+// Same as encode() for a text payload, packed if that makes it shorter
+size_t encodeText(const Header &header, const char *text, size_t len,
+                  uint8_t *out, size_t size);
+size_t encodeArq(const Header &header, const ArqHeader &arq, const char *text,
+                 size_t len, uint8_t *out, size_t size);
+size_t encodeLog(const Header &header, const LogHeader &log,
+                 const uint8_t *body, size_t len, uint8_t *out, size_t size);
+size_t encodeSync(const Header &header, const Sync &sync, const uint16_t *ids,
+                  size_t count, uint8_t *out, size_t size);
+
+// Rewrites the hop count of an encoded frame, and its CRC
+void setHops(uint8_t *frame, size_t len, uint8_t hops);
+
+// Checks version and CRC. `payload` points into `in`, or into `scratch`
+// (MAX_PAYLOAD bytes) for a packed frame.
+bool decode(const uint8_t *in, size_t len, Header *header,
+            const uint8_t **payload, size_t *payloadLen, uint8_t *scratch);
+bool decodeStatus(const uint8_t *payload, size_t len, Status *status);
+// False if the beacon carries no report
+bool decodeLinkReport(const uint8_t *payload, size_t len, LinkReport *report);
+bool decodeRate(const uint8_t *payload, size_t len, RateOrder *order);
+// `text` points into `payload`
+bool decodeArq(const uint8_t *payload, size_t len, ArqHeader *arq,
+               const uint8_t **text, size_t *textLen);
+// `body` points into `payload`
+bool decodeLog(const uint8_t *payload, size_t len, LogHeader *log,
+               const uint8_t **body, size_t *bodyLen);
+// `ids` points into `payload`, two bytes per ID, use syncId()
+bool decodeSync(const uint8_t *payload, size_t len, Sync *sync,
+                const uint8_t **ids, size_t *count);
+inline uint16_t syncId(const uint8_t *ids, size_t i) {
+  return ids[2 * i] | (ids[2 * i + 1] << 8);
+}
+
+// Human readable form, same wording as the serial commands:
+//   "status ID:1A2B SEQ:7 RSSI:-40 batteryLevel:100 mode:transceive status:ok"
+//   "data <payload>", "command <payload>", "rate DR3 power:14 epoch:7"
+// Arq frames read like the data or command they carry, or
+//   "ack ID:1A2B to:3C4D ack:12 sack:0005"
+// Log frames as "log ID:1A2B to:3C4D op:5 transfer:9 bytes:245", Sync
+// frames as "sync ID:1A2B slot:112000us members:12 join:2 first:0 ids:12"
+// Returns the text length, the output is always null terminated.
+size_t toText(const Header &header, const uint8_t *payload, size_t len,
+              char *out, size_t size);
+
+const char *modeName(Mode mode);
+const char *healthName(Health health);
+
+uint16_t crc16(const uint8_t *data, size_t len);
+
+}  // namespace frame
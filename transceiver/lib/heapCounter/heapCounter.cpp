@@ -0,0 +1,84 @@
+#include "heapCounter.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<uint32_t> s_allocations{0};
+std::atomic<uint32_t> s_frees{0};
+std::atomic<uint32_t> s_bytes{0};
+
+}  // namespace
+
+namespace heapCounter {
+
+uint32_t allocations() {
+  return s_allocations.load(std::memory_order_relaxed);
+}
+
+uint32_t frees() { return s_frees.load(std::memory_order_relaxed); }
+
+uint32_t bytes() { return s_bytes.load(std::memory_order_relaxed); }
+
+}  // namespace heapCounter
+
+#ifdef HEAP_COUNTER
+
+extern "C" {
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) {
+  s_allocations.fetch_add(1, std::memory_order_relaxed);
+  s_bytes.fetch_add(size, std::memory_order_relaxed);
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  s_allocations.fetch_add(1, std::memory_order_relaxed);
+  s_bytes.fetch_add(count * size, std::memory_order_relaxed);
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  s_allocations.fetch_add(1, std::memory_order_relaxed);
+  s_bytes.fetch_add(size, std::memory_order_relaxed);
+  return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr) {
+  if (ptr != nullptr) s_frees.fetch_add(1, std::memory_order_relaxed);
+  __real_free(ptr);
+}
+
+}  // extern "C"
+
+#ifdef NATIVE
+// On the target libstdc++ is linked statically, so its operator new already
+// goes through the wrapped malloc. On the host it is a shared library whose
+// malloc calls bypass --wrap, so route new/delete through the wrappers here.
+void *operator new(size_t size) {
+  void *ptr = malloc(size ? size : 1);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return malloc(size ? size : 1);
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return malloc(size ? size : 1);
+}
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+#endif  // NATIVE
+
+#endif  // HEAP_COUNTER
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+// Counts heap allocations (malloc, calloc, realloc, and new on top of them)
+// for the whole firmware. Needs HEAP_COUNTER defined and the linker flags
+//   -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc -Wl,--wrap=free
+// otherwise all counters stay at 0.
+//
+// Counters are global, so a difference taken across a block of code only
+// belongs to that code if no other task ran in between. They are 32 bit and
+// wrap, the ESP32-C3 has no atomic instructions and 64 bit ones would go
+// through a lock on every allocation. Take differences in uint32_t.
+//
+// A debugging aid, only the native builds and the esp32-c3-devkitm-1-heap
+// env define HEAP_COUNTER.
+
+namespace heapCounter {
+
+uint32_t allocations();
+uint32_t frees();
+uint32_t bytes();  // requested by those allocations
+
+}  // namespace heapCounter
@@ -0,0 +1,237 @@
+#include "logCodec.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace logCodec {
+
+namespace {
+
+// LZ4 block format limits, kept so standard decoders accept the output
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t LAST_LITERALS = 5;  // the block always ends with literals
+constexpr size_t MF_LIMIT = 12;      // no match starts closer to the end
+constexpr uint16_t EMPTY = 0xFFFF;
+
+uint32_t read32(const uint8_t *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+uint32_t hash(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Length in LZ4's 4 bit + 255 run encoding
+uint8_t *writeLength(uint8_t *op, size_t len) {
+  for (; len >= 255; len -= 255) *op++ = 255;
+  *op++ = static_cast<uint8_t>(len);
+  return op;
+}
+
+bool readLength(const uint8_t **ip, const uint8_t *end, size_t *len) {
+  uint8_t byte;
+  do {
+    if (*ip >= end) return false;
+    byte = *(*ip)++;
+    *len += byte;
+  } while (byte == 255);
+  return true;
+}
+
+uint8_t headerCheck(const uint8_t *header) {
+  return header[1] ^ header[2] ^ header[3] ^ header[4] ^ 0xA5;
+}
+
+}  // namespace
+
+/* =============================== COMPRESS ================================ */
+
+size_t compress(const uint8_t *base, size_t len, uint8_t *out, size_t outSize,
+                uint16_t *table) {
+  if (len == 0 || len > MAX_RAW || outSize < BLOCK_HEADER) return 0;
+
+  for (size_t i = 0; i < HASH_SIZE; i++) table[i] = EMPTY;
+  for (size_t i = 0; i + MIN_MATCH <= DICT_SIZE; i++) {
+    table[hash(read32(base + i))] = static_cast<uint16_t>(i);
+  }
+
+  const uint8_t *src = base + DICT_SIZE;
+  const uint8_t *end = src + len;
+  const uint8_t *matchLimit = end - LAST_LITERALS;
+  const uint8_t *ip = src;
+  const uint8_t *anchor = src;
+  uint8_t *op = out + BLOCK_HEADER;
+  uint8_t *opEnd = out + std::min(outSize, BLOCK_HEADER + len - 1);
+
+  auto emit = [&](const uint8_t *literalEnd, size_t offset,
+                  size_t matchLen) -> bool {
+    size_t literals = literalEnd - anchor;
+    // token + both lengths + literals + offset, checked up front
+    if (op + 1 + literals / 255 + 1 + literals + 2 + matchLen / 255 + 1 >
+        opEnd) {
+      return false;
+    }
+    uint8_t *token = op++;
+    *token = static_cast<uint8_t>(std::min<size_t>(literals, 15) << 4);
+    if (literals >= 15) op = writeLength(op, literals - 15);
+    memcpy(op, anchor, literals);
+    op += literals;
+    if (matchLen == 0) return true;  // the final literals
+
+    *op++ = offset & 0xFF;
+    *op++ = offset >> 8;
+    size_t code = matchLen - MIN_MATCH;
+    *token |= static_cast<uint8_t>(std::min<size_t>(code, 15));
+    if (code >= 15) op = writeLength(op, code - 15);
+    return true;
+  };
+
+  if (len > MF_LIMIT) {
+    const uint8_t *ipLimit = end - MF_LIMIT;
+    while (ip < ipLimit) {
+      uint32_t sequence = read32(ip);
+      uint16_t &slot = table[hash(sequence)];
+      uint16_t candidate = slot;
+      slot = static_cast<uint16_t>(ip - base);
+      if (candidate == EMPTY || read32(base + candidate) != sequence) {
+        ip++;
+        continue;
+      }
+
+      const uint8_t *match = base + candidate;
+      size_t matchLen = MIN_MATCH;
+      while (ip + matchLen < matchLimit && match[matchLen] == ip[matchLen]) {
+        matchLen++;
+      }
+      if (!emit(ip, ip - match, matchLen)) return 0;
+      ip += matchLen;
+      anchor = ip;
+    }
+  }
+  if (!emit(end, 0, 0)) return 0;
+
+  size_t packedLen = op - out - BLOCK_HEADER;
+  out[0] = BLOCK_MARKER;
+  out[1] = len & 0xFF;
+  out[2] = len >> 8;
+  out[3] = packedLen & 0xFF;
+  out[4] = packedLen >> 8;
+  out[5] = headerCheck(out);
+  return op - out;
+}
+
+/* ============================== DECOMPRESS =============================== */
+
+bool decompress(const uint8_t *in, size_t inLen, uint8_t *base,
+                size_t rawLen) {
+  const uint8_t *ip = in;
+  const uint8_t *ipEnd = in + inLen;
+  uint8_t *op = base + DICT_SIZE;
+  uint8_t *opEnd = op + rawLen;
+
+  while (true) {
+    if (ip >= ipEnd) return false;
+    uint8_t token = *ip++;
+
+    size_t literals = token >> 4;
+    if (literals == 15 && !readLength(&ip, ipEnd, &literals)) return false;
+    if (literals > static_cast<size_t>(ipEnd - ip) ||
+        literals > static_cast<size_t>(opEnd - op)) {
+      return false;
+    }
+    memcpy(op, ip, literals);
+    ip += literals;
+    op += literals;
+    if (ip == ipEnd) return op == opEnd;  // the final literals
+
+    if (ipEnd - ip < 2) return false;
+    size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    size_t matchLen = token & 0x0F;
+    if (matchLen == 15 && !readLength(&ip, ipEnd, &matchLen)) return false;
+    matchLen += MIN_MATCH;
+    if (offset == 0 || offset > static_cast<size_t>(op - base) ||
+        matchLen > static_cast<size_t>(opEnd - op)) {
+      return false;
+    }
+
+    // Byte by byte, a match may overlap what it produces
+    const uint8_t *match = op - offset;
+    for (size_t i = 0; i < matchLen; i++) op[i] = match[i];
+    op += matchLen;
+  }
+}
+
+/* ================================ DECODER ================================ */
+
+Decoder::Decoder(uint8_t *packed, uint8_t *base, Sink sink, void *context)
+    : m_packed(packed), m_base(base), m_sink(sink), m_context(context) {
+  memcpy(m_base, DICTIONARY, DICT_SIZE);
+}
+
+void Decoder::feed(const char *data, size_t len) {
+  const uint8_t *in = reinterpret_cast<const uint8_t *>(data);
+  const uint8_t *end = in + len;
+
+  while (in < end) {
+    switch (m_state) {
+      case State::Text: {
+        // Pass text on up to the next block, drop bytes that are not text
+        const uint8_t *run = in;
+        while (in < end && *in != BLOCK_MARKER &&
+               (*in >= 0x20 || *in == '\n' || *in == '\r' || *in == '\t')) {
+          in++;
+        }
+        if (in > run) {
+          m_sink(m_context, reinterpret_cast<const char *>(run), in - run);
+        }
+        if (in < end && *in == BLOCK_MARKER) {
+          m_state = State::Header;
+          m_have = 0;
+        } else if (in < end) {
+          in++;  // not text
+        }
+        break;
+      }
+
+      case State::Header:
+        m_header[m_have++] = *in++;
+        if (m_have < BLOCK_HEADER) break;
+        m_rawLen = m_header[1] | (m_header[2] << 8);
+        m_packedLen = m_header[3] | (m_header[4] << 8);
+        if (m_header[5] != headerCheck(m_header) || m_rawLen == 0 ||
+            m_rawLen > MAX_RAW || m_packedLen == 0 ||
+            m_packedLen >= m_rawLen) {
+          m_badBlocks++;
+          m_state = State::Text;  // not a block header after all
+          break;
+        }
+        m_state = State::Payload;
+        m_have = 0;
+        break;
+
+      case State::Payload: {
+        size_t take = std::min<size_t>(end - in, m_packedLen - m_have);
+        memcpy(m_packed + m_have, in, take);
+        m_have += take;
+        in += take;
+        if (m_have == m_packedLen) endBlock();
+        break;
+      }
+    }
+  }
+}
+
+void Decoder::endBlock() {
+  m_state = State::Text;
+  if (!decompress(m_packed, m_packedLen, m_base, m_rawLen)) {
+    m_badBlocks++;
+    return;
+  }
+  m_sink(m_context, reinterpret_cast<const char *>(m_base + DICT_SIZE),
+         m_rawLen);
+}
+
+}  // namespace logCodec
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Compression of log batches, LZ4 block format with a preset dictionary.
+//
+// A compressed batch is stored as one block:
+//
+//   | 0x00 | rawLen:16 | packedLen:16 | check:8 | LZ4 sequences... |
+//
+// Log text never contains a 0x00 byte, so blocks and plain text (batches
+// that did not get smaller) can follow each other in any order. The check
+// byte tells a real header from a 0x00 inside a block, for reading from the
+// middle of one. Each block
+// only refers to itself and DICTIONARY, so it decodes on its own, e.g. with
+// LZ4_decompress_safe_usingDict() on a PC.
+
+namespace logCodec {
+
+constexpr uint8_t BLOCK_MARKER = 0x00;
+constexpr size_t BLOCK_HEADER = 6;
+constexpr size_t MAX_RAW = 4096;  // largest batch
+constexpr size_t HASH_BITS = 10;
+constexpr size_t HASH_SIZE = 1 << HASH_BITS;
+
+// Text the first lines of a block can refer back to, tuned to what
+// Control::processData() logs
+inline constexpr char DICTIONARY[] =
+    "New Log\n"
+    "ID:0000 SEQ:0 RSSI:-100 batteryLevel:100 mode:transceive status:ok\n"
+    "mode:transmit mode:receive mode:sweep status:warning status:error "
+    "status:lowBattery\n"
+    "0123456789.-:, \n";
+constexpr size_t DICT_SIZE = sizeof(DICTIONARY) - 1;
+
+// Compresses `len` bytes at `base + DICT_SIZE`, `base` must start with
+// DICTIONARY. Writes a whole block to `out` and returns its size, or 0 if it
+// would not be smaller than `len` (or does not fit `outSize`). `table` is
+// scratch space of HASH_SIZE entries.
+size_t compress(const uint8_t *base, size_t len, uint8_t *out, size_t outSize,
+                uint16_t *table);
+
+// Decodes the LZ4 sequences of one block into `base + DICT_SIZE`, `base`
+// must start with DICTIONARY. False if the data is damaged.
+bool decompress(const uint8_t *in, size_t inLen, uint8_t *base,
+                size_t rawLen);
+
+// Turns the stored log back into text, fed in pieces of any size. Plain text
+// passes through, blocks are collected and decoded. Bytes that are neither,
+// such as the rest of a block whose start was overwritten, are skipped.
+class Decoder {
+ public:
+  typedef void (*Sink)(void *context, const char *data, size_t len);
+
+  // `packed` holds a block while it is collected (MAX_RAW bytes), `base` is
+  // DICT_SIZE + MAX_RAW bytes for the decoded text
+  Decoder(uint8_t *packed, uint8_t *base, Sink sink, void *context);
+
+  void feed(const char *data, size_t len);
+  uint32_t badBlocks() const { return m_badBlocks; }
+  // Not in the middle of a block, so the buffers may be handed back
+  bool idle() const { return m_state == State::Text; }
+
+ private:
+  enum class State : uint8_t { Text, Header, Payload };
+
+  void endBlock();
+
+  uint8_t *m_packed;
+  uint8_t *m_base;
+  Sink m_sink;
+  void *m_context;
+
+  State m_state = State::Text;
+  uint8_t m_header[BLOCK_HEADER];
+  size_t m_have = 0;  // bytes of the header or payload collected
+  uint16_t m_rawLen = 0;
+  uint16_t m_packedLen = 0;
+  uint32_t m_badBlocks = 0;
+};
+
+}  // namespace logCodec
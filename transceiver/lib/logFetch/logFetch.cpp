@@ -0,0 +1,574 @@
+#include "logFetch.hpp"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+namespace fetch {
+
+namespace {
+
+constexpr size_t GET_SIZE = 11;
+constexpr size_t MISSING_SIZE = 2 + 3 * BLOCKS;
+constexpr size_t INFO_SIZE = 13;
+constexpr size_t SLOTS = K + fec::MAX_PARITY;  // per block, data and parity
+
+void put16(uint8_t *out, uint16_t value) {
+  out[0] = value & 0xFF;
+  out[1] = value >> 8;
+}
+
+void put32(uint8_t *out, uint32_t value) {
+  for (int i = 0; i < 4; i++) out[i] = (value >> (8 * i)) & 0xFF;
+}
+
+uint16_t get16(const uint8_t *in) { return in[0] | (in[1] << 8); }
+
+uint32_t get32(const uint8_t *in) {
+  return in[0] | (in[1] << 8) | (in[2] << 16) |
+         (static_cast<uint32_t>(in[3]) << 24);
+}
+
+uint16_t allSlots(size_t k) {
+  return k >= 16 ? 0xFFFF : static_cast<uint16_t>((1u << k) - 1);
+}
+
+size_t count(uint16_t mask) { return __builtin_popcount(mask); }
+
+// Data fragments in `block` of a window of `bytes`
+size_t fragmentsIn(size_t block, uint32_t bytes) {
+  size_t fragments = (bytes + FRAGMENT - 1) / FRAGMENT;
+  if (block * K >= fragments) return 0;
+  return std::min(K, fragments - block * K);
+}
+
+}  // namespace
+
+/* ================================= NODE ================================== */
+
+void Server::onGet(uint16_t from, uint8_t transfer, const uint8_t *body,
+                   size_t len, uint32_t logStart, uint32_t logEnd) {
+  if (len < GET_SIZE) return;
+  // The gateway heard this much of the round that completed the last window
+  if (from == m_peer && transfer == static_cast<uint8_t>(m_transfer + 1)) {
+    measure(get16(body + 9));
+  }
+
+  uint32_t start = get32(body);
+  uint32_t to = get32(body + 4);
+  if (start - logStart > logEnd - logStart) start = logStart;  // overwritten
+  uint32_t end = logEnd;
+  if (to != TO_END && to - start < end - start) end = to;
+  if (end - start > WINDOW) end = start + WINDOW;
+
+  // A repeated Get starts the window over, its answers were lost
+  m_peer = from;
+  m_transfer = transfer;
+  m_fec = body[8] != 0;
+  m_from = start;
+  m_end = end;
+  m_logEnd = logEnd;
+  m_blocks = ((end - start + FRAGMENT - 1) / FRAGMENT + K - 1) / K;
+  m_cached = -1;
+  for (size_t b = 0; b < BLOCKS; b++) {
+    m_nextParity[b] = 0;
+    m_plan[b] = Plan();
+    if (b < m_blocks) {
+      size_t k = blockSize(b);
+      plan(b, allSlots(k), static_cast<uint8_t>(k));
+    }
+  }
+  m_startInfo = true;
+  m_round = true;
+  m_answer = 0;
+  m_cursor = 0;
+  m_sent = 0;
+  m_stats.windows++;
+}
+
+void Server::onMissing(uint16_t from, uint8_t transfer, const uint8_t *body,
+                       size_t len) {
+  if (from != m_peer || transfer != m_transfer || len < MISSING_SIZE) return;
+
+  measure(get16(body));
+  for (size_t b = 0; b < m_blocks; b++) {
+    const uint8_t *entry = body + 2 + 3 * b;
+    plan(b, get16(entry + 1), entry[0]);
+  }
+  m_startInfo = false;
+  m_round = true;
+  m_cursor = 0;
+  m_sent = 0;
+  m_stats.rounds++;
+}
+
+bool Server::eraseEnd(uint16_t from, uint8_t transfer, const uint8_t *body,
+                      size_t len, uint32_t *end) {
+  if (len < 4) return false;
+  if (m_eraseDone && from == m_erasePeer && transfer == m_eraseTransfer) {
+    // The answer got lost, the log may have been cleared already
+    m_peer = from;
+    m_transfer = transfer;
+    m_answer = m_eraseResult ? ERASED : NOT_ERASED;
+    return false;
+  }
+  *end = get32(body);
+  return true;
+}
+
+void Server::onErased(uint16_t from, uint8_t transfer, bool erased,
+                      uint32_t logEnd) {
+  m_eraseDone = true;
+  m_erasePeer = from;
+  m_eraseTransfer = transfer;
+  m_eraseResult = erased;
+  if (erased) m_stats.erased++;
+
+  m_peer = from;
+  m_transfer = transfer;
+  m_from = m_end = 0;
+  m_logEnd = logEnd;
+  m_blocks = 0;
+  m_round = false;
+  m_cached = -1;
+  m_answer = erased ? ERASED : NOT_ERASED;
+}
+
+bool Server::poll(Outgoing *out) {
+  if (m_answer != 0) {
+    info(m_answer, out);
+    m_answer = 0;
+    return true;
+  }
+  if (!m_round) return false;
+  if (m_startInfo) {
+    m_startInfo = false;
+    info(0, out);
+    return true;
+  }
+
+  out->log = {m_peer, static_cast<uint8_t>(Op::Fragment), m_transfer};
+  while (m_cursor < m_blocks) {
+    size_t b = m_cursor;
+    Plan &plan = m_plan[b];
+    if (plan.data != 0) {
+      size_t slot = __builtin_ctz(plan.data);
+      plan.data &= plan.data - 1;
+      uint32_t offset = m_from + (b * K + slot) * FRAGMENT;
+      size_t len = std::min<uint32_t>(FRAGMENT, m_end - offset);
+      if (!m_read(m_context, offset, out->body + 2, len)) continue;
+      out->body[0] = static_cast<uint8_t>(b);
+      out->body[1] = static_cast<uint8_t>(slot);
+      out->len = 2 + len;
+      m_sent++;
+      m_stats.fragments++;
+      return true;
+    }
+    if (plan.parity > 0 && m_nextParity[b] < fec::MAX_PARITY &&
+        fillParity(b)) {
+      size_t k = blockSize(b);
+      const uint8_t *data[K];
+      for (size_t i = 0; i < k; i++) data[i] = m_block + i * FRAGMENT;
+      uint8_t *parity[] = {out->body + 2};
+      fec::encode(data, k, parity, m_nextParity[b], 1, FRAGMENT);
+      out->body[0] = static_cast<uint8_t>(b);
+      out->body[1] = static_cast<uint8_t>(K + m_nextParity[b]);
+      out->len = 2 + FRAGMENT;
+      m_nextParity[b]++;
+      plan.parity--;
+      m_sent++;
+      m_stats.fragments++;
+      m_stats.parity++;
+      return true;
+    }
+    m_cursor++;
+  }
+
+  m_round = false;
+  info(ROUND_END, out);
+  return true;
+}
+
+// What got through of the last round, repeats included. Nothing at all is
+// far more likely a repeated request, the first one got lost and the gateway
+// counts anew after every request.
+void Server::measure(uint16_t heard) {
+  if (m_sent > 0 && heard > 0) m_loss.update(m_sent, heard);
+}
+
+// Without erasure coding the data slots the gateway lacks. With it as many
+// fragments as the block lacks plus parity for the loss, data slots first
+// and then parity that was never sent.
+void Server::plan(size_t block, uint16_t missing, uint8_t lacking) {
+  Plan &plan = m_plan[block];
+  missing &= allSlots(blockSize(block));
+  plan = Plan();
+  if (!m_fec) {
+    plan.data = missing;
+    return;
+  }
+  if (lacking == 0) return;
+
+  size_t send = lacking + fec::parityFor(lacking, m_loss.rate());
+  while (missing != 0 && send > 0) {
+    uint16_t slot = missing & -missing;
+    plan.data |= slot;
+    missing ^= slot;
+    send--;
+  }
+  plan.parity = static_cast<uint8_t>(
+      std::min<size_t>(send, fec::MAX_PARITY - m_nextParity[block]));
+}
+
+void Server::info(uint8_t flags, Outgoing *out) {
+  out->log = {m_peer, static_cast<uint8_t>(Op::Info), m_transfer};
+  put32(out->body, m_from);
+  put32(out->body + 4, m_end);
+  put32(out->body + 8, m_logEnd);
+  out->body[12] = flags;
+  out->len = INFO_SIZE;
+}
+
+// Reads the data of `block` once for all its parity fragments
+bool Server::fillParity(size_t block) {
+  if (m_cached == static_cast<int>(block)) return true;
+  size_t k = blockSize(block);
+  uint32_t offset = m_from + block * K * FRAGMENT;
+  size_t len = std::min<uint32_t>(k * FRAGMENT, m_end - offset);
+  memset(m_block + len, 0, k * FRAGMENT - len);
+  if (!m_read(m_context, offset, m_block, len)) {
+    m_cached = -1;
+    return false;
+  }
+  m_cached = static_cast<int>(block);
+  return true;
+}
+
+size_t Server::blockSize(size_t block) const {
+  return fragmentsIn(block, m_end - m_from);
+}
+
+/* ================================ GATEWAY ================================ */
+
+Client::~Client() { delete[] m_buffer; }
+
+bool Client::fetch(uint16_t peer, uint32_t from, bool fec, uint32_t timeoutMs,
+                   uint32_t nowMs) {
+  if (m_state != State::Idle) return false;
+  if (m_buffer == nullptr) {
+    m_buffer = new (std::nothrow) uint8_t[BLOCKS * SLOTS * FRAGMENT];
+    if (m_buffer == nullptr) return false;
+  }
+
+  m_state = State::Fetching;
+  m_peer = peer;
+  m_transfer++;
+  m_fec = fec;
+  m_timeoutMs = timeoutMs;
+  m_due = true;
+  m_known = false;
+  m_next = false;
+  m_heard = 0;
+  m_silent = 0;
+  m_begun = false;
+  m_start = m_from = from;
+  m_startMs = nowMs;
+  m_fetched = false;
+  m_stats = ClientStats();
+  clearWindow();
+  return true;
+}
+
+bool Client::erase(uint32_t timeoutMs, uint32_t nowMs) {
+  if (m_state != State::Idle || !m_fetched) return false;
+  m_state = State::Erasing;
+  m_transfer++;
+  m_timeoutMs = timeoutMs;
+  m_due = true;
+  m_silent = 0;
+  m_lastMs = nowMs;
+  return true;
+}
+
+void Client::onFrame(uint16_t from, const frame::LogHeader &log,
+                     const uint8_t *body, size_t len, uint32_t nowMs) {
+  if (m_state == State::Idle || from != m_peer ||
+      log.transfer != m_transfer) {
+    return;
+  }
+  m_lastMs = nowMs;
+  m_silent = 0;
+  if (log.op == static_cast<uint8_t>(Op::Info)) {
+    onInfo(body, len, nowMs);
+  } else if (log.op == static_cast<uint8_t>(Op::Fragment) &&
+             m_state == State::Fetching) {
+    m_heard++;
+    onFragment(body, len, nowMs);
+  }
+}
+
+bool Client::poll(uint32_t nowMs, Outgoing *out) {
+  if (m_state == State::Idle) return false;
+  if (!m_due) {
+    if (nowMs - m_lastMs < m_timeoutMs) return false;
+    // Nothing heard for a while, the request or all the answers got lost
+    m_stats.timeouts++;
+    if (++m_silent > MAX_SILENT) {
+      if (m_state == State::Fetching) {
+        print("--- failed at %u ---\n", static_cast<unsigned>(m_from));
+      } else {
+        print("--- not erased, no answer ---\n");
+      }
+      finish();
+      return false;
+    }
+  }
+  m_due = false;
+  m_lastMs = nowMs;
+  m_stats.requests++;
+
+  if (m_state == State::Erasing) {
+    out->log = {m_peer, static_cast<uint8_t>(Op::Erase), m_transfer};
+    put32(out->body, m_target);
+    out->len = 4;
+    return true;
+  }
+
+  if (!m_known) {
+    if (m_next) {
+      m_next = false;
+      m_transfer++;
+      clearWindow();
+    }
+    out->log = {m_peer, static_cast<uint8_t>(Op::Get), m_transfer};
+    put32(out->body, m_from);
+    put32(out->body + 4, m_begun ? m_target : TO_END);
+    out->body[8] = m_fec ? 1 : 0;
+    put16(out->body + 9, m_heard);
+    out->len = GET_SIZE;
+    m_heard = 0;
+    return true;
+  }
+
+  out->log = {m_peer, static_cast<uint8_t>(Op::Missing), m_transfer};
+  put16(out->body, m_heard);
+  for (size_t b = 0; b < BLOCKS; b++) {
+    uint8_t *entry = out->body + 2 + 3 * b;
+    size_t k = blockSize(b);
+    if (b >= m_blocks || m_complete[b]) {
+      entry[0] = 0;
+      put16(entry + 1, 0);
+      continue;
+    }
+    size_t have = count(m_haveData[b]) + count(m_haveParity[b]);
+    entry[0] = static_cast<uint8_t>(have < k ? k - have : 0);
+    put16(entry + 1, allSlots(k) & ~m_haveData[b]);
+  }
+  out->len = MISSING_SIZE;
+  m_heard = 0;
+  return true;
+}
+
+uint32_t Client::nextEventMs(uint32_t nowMs) const {
+  if (m_state == State::Idle) return NO_EVENT;
+  if (m_due) return 0;
+  uint32_t elapsed = nowMs - m_lastMs;
+  return elapsed >= m_timeoutMs ? 0 : m_timeoutMs - elapsed;
+}
+
+void Client::onInfo(const uint8_t *body, size_t len, uint32_t nowMs) {
+  if (len < INFO_SIZE) return;
+  uint32_t from = get32(body);
+  uint32_t end = get32(body + 4);
+  uint32_t logEnd = get32(body + 8);
+  uint8_t flags = body[12];
+
+  if (m_state == State::Erasing) {
+    if (flags & ERASED) {
+      print("--- erased %u ---\n", static_cast<unsigned>(m_target));
+      m_fetched = false;
+    } else if (flags & NOT_ERASED) {
+      print("--- not erased, the log ends at %u ---\n",
+            static_cast<unsigned>(logEnd));
+    } else {
+      return;
+    }
+    finish();
+    return;
+  }
+
+  if (m_next) {
+    if (flags & ROUND_END) m_due = true;  // now the node listens
+    return;
+  }
+  if (!m_known) {
+    if (!m_begun) {
+      // An offset that was overwritten starts at the oldest data
+      m_begun = true;
+      m_start = from;
+      m_target = logEnd;
+      print("--- log %u %u ---\n", static_cast<unsigned>(from),
+            static_cast<unsigned>(logEnd));
+    } else if (from != m_from || end == from) {
+      // The log was cleared or overwritten underneath
+      print("--- failed at %u ---\n", static_cast<unsigned>(m_from));
+      finish();
+      return;
+    }
+    startWindow(from, end);
+    if (windowComplete()) windowDone(nowMs);
+    if (m_state != State::Fetching) return;
+  }
+  if (flags & ROUND_END) m_due = true;  // the node waits for the answer
+}
+
+// Fragments that arrive before the Info telling the window are placed from
+// the offset asked for, startWindow() drops them if the node moved it
+void Client::onFragment(const uint8_t *body, size_t len, uint32_t nowMs) {
+  if (m_next || len < 2) return;  // the rest of a round already done
+  size_t block = body[0];
+  size_t slot = body[1];
+  size_t bytes = len - 2;
+  if (block >= (m_known ? m_blocks : BLOCKS)) return;
+  size_t k = m_known ? blockSize(block) : K;
+
+  bool fresh = false;
+  if (slot < K) {
+    if (slot >= k || bytes > FRAGMENT) return;
+    uint16_t bit = 1u << slot;
+    fresh = !m_complete[block] && !(m_haveData[block] & bit);
+    if (fresh) {
+      memcpy(dataSlot(block, slot), body + 2, bytes);
+      m_haveData[block] |= bit;
+    }
+  } else {
+    size_t j = slot - K;
+    if (j >= fec::MAX_PARITY || bytes != FRAGMENT) return;
+    uint16_t bit = 1u << j;
+    fresh = !m_complete[block] && !(m_haveParity[block] & bit);
+    if (fresh) {
+      memcpy(paritySlot(block, j), body + 2, bytes);
+      m_haveParity[block] |= bit;
+    }
+  }
+  m_stats.fragments++;
+  if (!fresh) {
+    m_stats.duplicates++;
+    return;
+  }
+
+  if (!m_known || !blockComplete(block)) return;
+  if (windowComplete()) windowDone(nowMs);
+}
+
+void Client::startWindow(uint32_t from, uint32_t end) {
+  if (from != m_from) clearWindow();
+  m_known = true;
+  m_from = from;
+  m_end = end;
+  m_blocks = ((end - from + FRAGMENT - 1) / FRAGMENT + K - 1) / K;
+}
+
+void Client::clearWindow() {
+  for (size_t b = 0; b < BLOCKS; b++) {
+    m_haveData[b] = m_haveParity[b] = 0;
+    m_complete[b] = false;
+  }
+  // The last fragment is short, parity covers it zero padded
+  memset(m_buffer, 0, BLOCKS * K * FRAGMENT);
+}
+
+bool Client::windowComplete() {
+  for (size_t b = 0; b < m_blocks; b++) {
+    if (!blockComplete(b)) return false;
+  }
+  return true;
+}
+
+bool Client::blockComplete(size_t block) {
+  if (m_complete[block]) return true;
+  size_t k = blockSize(block);
+  size_t have = count(m_haveData[block]);
+  if (have == k) {
+    m_complete[block] = true;
+    return true;
+  }
+  if (have + count(m_haveParity[block]) < k) return false;
+
+  uint8_t *fragments[K + fec::MAX_PARITY];
+  bool present[K + fec::MAX_PARITY];
+  for (size_t i = 0; i < k; i++) {
+    fragments[i] = dataSlot(block, i);
+    present[i] = m_haveData[block] & (1u << i);
+  }
+  for (size_t j = 0; j < fec::MAX_PARITY; j++) {
+    fragments[k + j] = paritySlot(block, j);
+    present[k + j] = m_haveParity[block] & (1u << j);
+  }
+  if (!fec::decode(fragments, present, k, fec::MAX_PARITY, FRAGMENT)) {
+    return false;
+  }
+  m_stats.decoded += k - have;
+  m_haveData[block] = allSlots(k);
+  m_complete[block] = true;
+  return true;
+}
+
+// The whole window is here, out it goes and the next one is asked for
+void Client::windowDone(uint32_t nowMs) {
+  m_sink(m_context, reinterpret_cast<const char *>(dataSlot(0, 0)),
+         m_end - m_from);
+  m_from = m_end;
+  m_known = false;
+  if (m_from != m_target) {
+    m_next = true;
+    return;
+  }
+
+  uint32_t bytes = m_target - m_start;
+  uint32_t elapsedMs = nowMs - m_startMs;
+  uint32_t rate = elapsedMs > 0 ? static_cast<uint64_t>(bytes) * 1000 /
+                                      elapsedMs
+                                : 0;
+  print("--- end %u: %u B in %u ms, %u B/s ---\n",
+        static_cast<unsigned>(m_target), static_cast<unsigned>(bytes),
+        static_cast<unsigned>(elapsedMs), static_cast<unsigned>(rate));
+  m_fetched = true;
+  finish();
+}
+
+void Client::finish() {
+  m_state = State::Idle;
+  m_known = false;
+  m_next = false;
+  m_due = false;
+  delete[] m_buffer;  // a window and its parity, no need to keep it around
+  m_buffer = nullptr;
+}
+
+void Client::print(const char *format, ...) {
+  char line[64];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (len > 0) {
+    m_sink(m_context, line, std::min<size_t>(len, sizeof(line) - 1));
+  }
+}
+
+size_t Client::blockSize(size_t block) const {
+  return fragmentsIn(block, m_end - m_from);
+}
+
+uint8_t *Client::dataSlot(size_t block, size_t slot) {
+  return m_buffer + (block * K + slot) * FRAGMENT;
+}
+
+uint8_t *Client::paritySlot(size_t block, size_t slot) {
+  return m_buffer + (BLOCKS * K + block * fec::MAX_PARITY + slot) * FRAGMENT;
+}
+
+}  // namespace fetch
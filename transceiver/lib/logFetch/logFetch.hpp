@@ -0,0 +1,248 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "fec.hpp"
+#include "frame.hpp"
+
+// Remote retrieval of a node's flash log over LoRa, the radio counterpart of
+// "flash dump".
+//
+// The gateway asks for the log from an offset with Get. The node answers with
+// a window of up to WINDOW bytes: an Info frame with the byte range, the
+// fragments, then Info again to mark the end of the round. Fragment `slot` of
+// `block` holds the FRAGMENT bytes at from + (block * K + slot) * FRAGMENT,
+// slots from K on are parity of the block (see fec.hpp) when the gateway
+// asked for erasure coding. The last fragment is shorter, parity treats it as
+// zero padded.
+//
+// After every round the gateway answers with Missing: the fragments it heard,
+// and per block the data slots it lacks and how many fragments would complete
+// the block. The node sends those again, with erasure coding as many
+// fragments as the block lacks plus parity for the loss it measured, so that
+// most blocks need no further round. Once a window is whole the gateway hands
+// it on in order and asks for the next one once the node finished its round,
+// up to where the log ended when the fetch began. The radio is half duplex,
+// a request sent while the node is still sending would be lost.
+//
+// Erase carries that end. The node clears its log only if nothing was logged
+// after it (SaveFlash::erase()) and answers with Info.
+//
+// Bodies after the frame::LogHeader, little endian:
+//   Get:      | from:32 | to:32 | fec:8 | heard:16 |
+//   Missing:  | heard:16 | (lacking:8 data:16) x BLOCKS |
+//   Erase:    | end:32 |
+//   Info:     | from:32 | end:32 | logEnd:32 | flags:8 |
+//   Fragment: | block:8 | slot:8 | bytes... |
+//
+// Not thread safe and free of RTOS calls, Control guards both sides with a
+// mutex and passes the time in.
+
+namespace fetch {
+
+enum class Op : uint8_t {
+  Get = 1,
+  Missing = 2,
+  Erase = 3,
+  Info = 4,
+  Fragment = 5,
+};
+
+constexpr size_t MAX_BODY = frame::MAX_PAYLOAD - frame::LOG_SIZE;
+constexpr size_t FRAGMENT = MAX_BODY - 2;  // bytes of log per fragment
+constexpr size_t K = 16;                   // data fragments per block
+constexpr size_t BLOCKS = 4;               // per window
+constexpr size_t WINDOW = BLOCKS * K * FRAGMENT;
+constexpr uint32_t TO_END = UINT32_MAX;  // Get: up to the end of the log
+constexpr uint8_t MAX_SILENT = 6;  // requests without answer before failing
+constexpr uint32_t NO_EVENT = UINT32_MAX;
+
+// Info flags
+constexpr uint8_t ROUND_END = 0x01;  // nothing more until the next request
+constexpr uint8_t ERASED = 0x02;
+constexpr uint8_t NOT_ERASED = 0x04;
+
+// A frame poll() wants sent
+struct Outgoing {
+  frame::LogHeader log;
+  uint8_t body[MAX_BODY];
+  size_t len;
+};
+
+/* ================================= NODE ================================== */
+
+struct ServerStats {
+  uint32_t windows = 0;  // Get requests
+  uint32_t rounds = 0;   // Missing requests
+  uint32_t fragments = 0;
+  uint32_t parity = 0;  // of those
+  uint32_t erased = 0;
+};
+
+class Server {
+ public:
+  // Copies `len` bytes of the log at `offset` to `out`
+  typedef bool (*Reader)(void *context, uint32_t offset, uint8_t *out,
+                         size_t len);
+
+  Server(Reader read, void *context) : m_read(read), m_context(context) {}
+
+  // A Get addressed to this node. [logStart, logEnd) is what the log holds.
+  void onGet(uint16_t from, uint8_t transfer, const uint8_t *body, size_t len,
+             uint32_t logStart, uint32_t logEnd);
+  void onMissing(uint16_t from, uint8_t transfer, const uint8_t *body,
+                 size_t len);
+  // The end an Erase asks for, false if it is malformed or a repeat that
+  // onErased() already answered
+  bool eraseEnd(uint16_t from, uint8_t transfer, const uint8_t *body,
+                size_t len, uint32_t *end);
+  void onErased(uint16_t from, uint8_t transfer, bool erased, uint32_t logEnd);
+
+  // The next frame to send, call until it returns false
+  bool poll(Outgoing *out);
+
+  const ServerStats &stats() const { return m_stats; }
+  float lossRate() const { return m_loss.rate(); }
+
+ private:
+  struct Plan {
+    uint16_t data = 0;  // slots to send
+    uint8_t parity = 0;
+  };
+
+  void measure(uint16_t heard);
+  void plan(size_t block, uint16_t missing, uint8_t lacking);
+  void info(uint8_t flags, Outgoing *out);
+  bool fillParity(size_t block);
+  size_t blockSize(size_t block) const;  // data fragments in it
+
+  Reader m_read;
+  void *m_context;
+
+  uint16_t m_peer = 0;
+  uint8_t m_transfer = 0;
+  bool m_fec = false;
+  uint32_t m_from = 0;  // the window
+  uint32_t m_end = 0;
+  uint32_t m_logEnd = 0;
+  size_t m_blocks = 0;
+
+  bool m_startInfo = false;  // due before the fragments
+  bool m_round = false;      // fragments or the end marker still due
+  uint8_t m_answer = 0;      // Info flags waiting to go out, 0 = none
+  Plan m_plan[BLOCKS];
+  uint8_t m_nextParity[BLOCKS] = {};  // parity slots never sent yet
+  size_t m_cursor = 0;                // block poll() is at
+  uint32_t m_sent = 0;                // fragments this round
+
+  // Erase is not repeated once done, the answer is
+  uint8_t m_eraseTransfer = 0;
+  uint16_t m_erasePeer = 0;
+  bool m_eraseDone = false;
+  bool m_eraseResult = false;
+
+  int m_cached = -1;              // block in m_block
+  uint8_t m_block[K * FRAGMENT];  // its data, to make parity from
+  fec::LossEstimate m_loss;
+  ServerStats m_stats;
+};
+
+/* ================================ GATEWAY ================================ */
+
+struct ClientStats {
+  uint32_t requests = 0;  // Get, Missing and Erase frames
+  uint32_t fragments = 0;
+  uint32_t duplicates = 0;  // of those
+  uint32_t decoded = 0;     // data fragments rebuilt from parity
+  uint32_t timeouts = 0;
+};
+
+class Client {
+ public:
+  // Gets the log as text lines and raw bytes, see fetch()
+  typedef void (*Sink)(void *context, const char *data, size_t len);
+
+  enum class State : uint8_t { Idle, Fetching, Erasing };
+
+  Client(Sink sink, void *context) : m_sink(sink), m_context(context) {}
+  ~Client();
+
+  // Fetches the log of `peer` from offset `from` up to where it ends now, and
+  // writes it to the sink like "flash dump" does:
+  //
+  //   --- log <from> <end> ---\n
+  //   <end - from raw bytes>
+  //   --- end <end>: <bytes> B in <ms> ms, <rate> B/s ---\n
+  //
+  // or "--- failed at <offset> ---\n" when the node stops answering, to be
+  // fetched again from there. `timeoutMs` is how long the node may stay
+  // silent before a request is repeated. False if busy or out of memory.
+  bool fetch(uint16_t peer, uint32_t from, bool fec, uint32_t timeoutMs,
+             uint32_t nowMs);
+  // Erases the log of the node fetched last, once it was fetched to its end.
+  // Writes "--- erased <end> ---\n" or "--- not erased ... ---\n".
+  bool erase(uint32_t timeoutMs, uint32_t nowMs);
+
+  // A Log frame addressed to this node
+  void onFrame(uint16_t from, const frame::LogHeader &log, const uint8_t *body,
+               size_t len, uint32_t nowMs);
+
+  // The next request to send
+  bool poll(uint32_t nowMs, Outgoing *out);
+  // Milliseconds until poll() has something, NO_EVENT when idle
+  uint32_t nextEventMs(uint32_t nowMs) const;
+
+  State state() const { return m_state; }
+  uint16_t peer() const { return m_peer; }
+  uint32_t offset() const { return m_from; }  // everything before is out
+  uint32_t target() const { return m_target; }
+  const ClientStats &stats() const { return m_stats; }
+
+ private:
+  void onInfo(const uint8_t *body, size_t len, uint32_t nowMs);
+  void onFragment(const uint8_t *body, size_t len, uint32_t nowMs);
+  void startWindow(uint32_t from, uint32_t end);
+  void clearWindow();
+  bool blockComplete(size_t block);
+  bool windowComplete();
+  void windowDone(uint32_t nowMs);
+  void finish();
+  void print(const char *format, ...);
+  size_t blockSize(size_t block) const;
+  uint8_t *dataSlot(size_t block, size_t slot);
+  uint8_t *paritySlot(size_t block, size_t slot);
+
+  Sink m_sink;
+  void *m_context;
+
+  State m_state = State::Idle;
+  uint16_t m_peer = 0;
+  uint8_t m_transfer = 0;
+  bool m_fec = false;
+  uint32_t m_timeoutMs = 0;
+  bool m_due = false;     // a request goes out on the next poll()
+  bool m_known = false;   // the node told the window
+  bool m_next = false;    // window out, Get once the node's round is over
+  uint32_t m_lastMs = 0;  // last frame sent or heard
+  uint8_t m_silent = 0;   // requests since the node was last heard
+  uint16_t m_heard = 0;   // fragments this round, repeats included
+
+  bool m_begun = false;   // the first window was told
+  uint32_t m_start = 0;   // of the fetch
+  uint32_t m_target = 0;  // where the log ended when it began
+  uint32_t m_startMs = 0;
+  uint32_t m_from = 0;  // the window
+  uint32_t m_end = 0;
+  size_t m_blocks = 0;
+  bool m_fetched = false;  // m_peer's log is out up to m_target
+
+  // Data slots, then parity slots of every block, only while fetching
+  uint8_t *m_buffer = nullptr;
+  uint16_t m_haveData[BLOCKS] = {};
+  uint16_t m_haveParity[BLOCKS] = {};
+  bool m_complete[BLOCKS] = {};
+  ClientStats m_stats;
+};
+
+}  // namespace fetch
@@ -0,0 +1,85 @@
+#include "metrics.hpp"
+
+namespace metrics {
+
+namespace {
+
+constexpr const char *COUNTER_NAMES[COUNTERS] = {
+    "rx_frames",  "rx_errors",      "rx_overflows", "rx_malformed",
+    "tx_queued",  "tx_dropped",     "tx_sent",      "tx_failed",
+    "serial_lines", "serial_dropped", "flash_writes", "flash_dropped"};
+constexpr const char *GAUGE_NAMES[GAUGES] = {"tx_depth", "rx_depth"};
+constexpr const char *HISTOGRAM_NAMES[HISTOGRAMS] = {
+    "tx_wait_us", "serial_to_air_us", "rx_handled_us", "flash_write_us"};
+
+std::atomic<uint32_t> s_resetMs{0};
+
+}  // namespace
+
+const char *name(Counter counter) {
+  return COUNTER_NAMES[static_cast<size_t>(counter)];
+}
+
+const char *name(Gauge gauge) { return GAUGE_NAMES[static_cast<size_t>(gauge)]; }
+
+const char *name(Histogram histogram) {
+  return HISTOGRAM_NAMES[static_cast<size_t>(histogram)];
+}
+
+uint32_t HistogramSnapshot::percentile(uint32_t permille) const {
+  if (count == 0) return 0;
+  // The rank of the value, counted from 1
+  uint64_t rank = (static_cast<uint64_t>(count) * permille + 999) / 1000;
+  if (rank == 0) rank = 1;
+  uint64_t seen = 0;
+  for (size_t b = 0; b < BUCKETS; b++) {
+    seen += buckets[b];
+    if (seen < rank) continue;
+    if (b == 0) return 0;
+    // Never above the largest value seen
+    uint32_t top = b == BUCKETS - 1 ? UINT32_MAX : (uint32_t{1} << b) - 1;
+    return top < max ? top : max;
+  }
+  return max;
+}
+
+Snapshot snapshot(uint32_t nowMs) {
+  Snapshot snap;
+  snap.windowMs = nowMs - s_resetMs.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < COUNTERS; i++) {
+    snap.counters[i] = detail::counters[i].load(std::memory_order_relaxed);
+  }
+  for (size_t i = 0; i < GAUGES; i++) {
+    snap.gauges[i] = detail::gauges[i].value.load(std::memory_order_relaxed);
+    snap.gaugeMax[i] = detail::gauges[i].max.load(std::memory_order_relaxed);
+  }
+  for (size_t i = 0; i < HISTOGRAMS; i++) {
+    HistogramSnapshot &out = snap.histograms[i];
+    for (size_t b = 0; b < BUCKETS; b++) {
+      out.buckets[b] =
+          detail::histograms[i].buckets[b].load(std::memory_order_relaxed);
+      out.count += out.buckets[b];
+    }
+    out.max = detail::histograms[i].max.load(std::memory_order_relaxed);
+  }
+  return snap;
+}
+
+void reset(uint32_t nowMs) {
+  s_resetMs.store(nowMs, std::memory_order_relaxed);
+  for (std::atomic<uint32_t> &counter : detail::counters) {
+    counter.store(0, std::memory_order_relaxed);
+  }
+  for (detail::GaugeCell &gauge : detail::gauges) {
+    gauge.max.store(gauge.value.load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+  }
+  for (detail::HistogramCell &histogram : detail::histograms) {
+    for (std::atomic<uint32_t> &bucket : histogram.buckets) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    histogram.max.store(0, std::memory_order_relaxed);
+  }
+}
+
+}  // namespace metrics
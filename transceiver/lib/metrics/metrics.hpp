@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Runtime numbers for a node in the field: counters, gauges and latency
+// histograms, printed by "stats" (see Commander).
+//
+// The registry is fixed at compile time, one enum entry per metric, so an
+// update is an array index and one relaxed atomic operation, from any task
+// or the DIO1 interrupt. Without atomic instructions on the C3 the toolchain
+// masks interrupts around it instead, still a few tens of cycles. Nothing
+// allocates and nothing blocks.
+//
+// Histograms have log2 buckets: bucket b counts values of b bits, so [0],
+// [1], [2, 3], [4, 7] and so on, the last one everything from 2^30 up. A
+// percentile comes out as the upper end of its bucket, within a factor of 2.
+//
+// reset() starts a new window. An update racing with it may land on either
+// side, which is fine for windows of seconds.
+
+namespace metrics {
+
+enum class Counter : uint8_t {
+  RxFrames,     // packets taken off the radio
+  RxErrors,     // bad CRC or failed read
+  RxOverflows,  // receive ring full
+  RxMalformed,  // frames Control could not decode
+  TxQueued,
+  TxDropped,  // queue full, or evicted by a higher priority packet
+  TxSent,
+  TxFailed,
+  SerialLines,
+  SerialDropped,  // lines longer than SerialCom::MAX_LINE
+  FlashWrites,    // batches appended to the log
+  FlashDropped,   // lines lost to a failed append
+  COUNT
+};
+
+enum class Gauge : uint8_t {
+  TxDepth,  // packets waiting to be sent
+  RxDepth,  // packets waiting in the receive ring
+  COUNT
+};
+
+enum class Histogram : uint8_t {
+  TxWaitUs,       // queued until on air
+  SerialToAirUs,  // data line read until the frame holding it is on air
+  RxHandledUs,    // off the radio until Control is done with it
+  FlashWriteUs,   // one batch appended to the log
+  COUNT
+};
+
+constexpr size_t COUNTERS = static_cast<size_t>(Counter::COUNT);
+constexpr size_t GAUGES = static_cast<size_t>(Gauge::COUNT);
+constexpr size_t HISTOGRAMS = static_cast<size_t>(Histogram::COUNT);
+constexpr size_t BUCKETS = 32;
+
+const char *name(Counter counter);
+const char *name(Gauge gauge);
+const char *name(Histogram histogram);
+
+/* ================================ STORAGE ================================ */
+
+namespace detail {
+
+struct GaugeCell {
+  std::atomic<int32_t> value{0};
+  std::atomic<int32_t> max{0};  // since the last reset
+};
+
+struct HistogramCell {
+  std::atomic<uint32_t> buckets[BUCKETS] = {};
+  std::atomic<uint32_t> max{0};
+};
+
+inline std::atomic<uint32_t> counters[COUNTERS] = {};
+inline GaugeCell gauges[GAUGES];
+inline HistogramCell histograms[HISTOGRAMS];
+
+inline size_t bucket(uint32_t value) {
+  size_t bits = value == 0 ? 0 : 32 - __builtin_clz(value);
+  return bits < BUCKETS ? bits : BUCKETS - 1;
+}
+
+// Raises `cell` to `value`, retries only when another update got in between
+template <typename T>
+void raise(std::atomic<T> &cell, T value) {
+  T seen = cell.load(std::memory_order_relaxed);
+  while (value > seen &&
+         !cell.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+  }
+}
+
+}  // namespace detail
+
+/* ================================ UPDATES ================================ */
+
+inline void add(Counter counter, uint32_t n = 1) {
+  detail::counters[static_cast<size_t>(counter)].fetch_add(
+      n, std::memory_order_relaxed);
+}
+
+inline void set(Gauge gauge, int32_t value) {
+  detail::GaugeCell &cell = detail::gauges[static_cast<size_t>(gauge)];
+  cell.value.store(value, std::memory_order_relaxed);
+  detail::raise(cell.max, value);
+}
+
+inline void record(Histogram histogram, uint32_t value) {
+  detail::HistogramCell &cell =
+      detail::histograms[static_cast<size_t>(histogram)];
+  cell.buckets[detail::bucket(value)].fetch_add(1, std::memory_order_relaxed);
+  detail::raise(cell.max, value);
+}
+
+/* =============================== SNAPSHOTS =============================== */
+
+struct HistogramSnapshot {
+  uint32_t count = 0;
+  uint32_t max = 0;
+  uint32_t buckets[BUCKETS] = {};
+
+  // Upper end of the bucket holding the `permille`th value, 0 when empty
+  uint32_t percentile(uint32_t permille) const;
+};
+
+struct Snapshot {
+  uint32_t windowMs = 0;  // since boot or the last reset
+  uint32_t counters[COUNTERS] = {};
+  int32_t gauges[GAUGES] = {};
+  int32_t gaugeMax[GAUGES] = {};
+  HistogramSnapshot histograms[HISTOGRAMS];
+};
+
+Snapshot snapshot(uint32_t nowMs);
+// Zeroes everything, gauges keep their value and restart their maximum there
+void reset(uint32_t nowMs);
+
+}  // namespace metrics
@@ -0,0 +1,139 @@
+#include "relay.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace relay {
+
+namespace {
+
+int32_t since(uint32_t nowMs, uint32_t thenMs) {
+  return static_cast<int32_t>(nowMs - thenMs);
+}
+
+}  // namespace
+
+bool relayed(frame::Type type) {
+  return type == frame::Type::Status || type == frame::Type::Data ||
+         type == frame::Type::Command;
+}
+
+void Relay::setMaxHops(uint8_t hops) {
+  m_maxHops = std::min(hops, frame::MAX_HOPS);
+  if (m_maxHops > 0) return;
+  for (Pending &pending : m_pending) pending.used = false;
+}
+
+/* ================================= INPUT ================================= */
+
+bool Relay::onFrame(const frame::Header &header, const uint8_t *data,
+                    size_t len, int16_t rssi, uint32_t airtimeMs,
+                    uint32_t nowMs) {
+  m_stats.heard++;
+  if (header.nodeId == m_nodeId || seen(header.nodeId, header.seq, nowMs)) {
+    m_stats.duplicates++;
+    heardCopy(header.nodeId, header.seq);
+    return false;
+  }
+
+  Entry &entry = m_cache[m_next];
+  m_next = (m_next + 1) % CACHE;
+  entry.origin = header.nodeId;
+  entry.seq = header.seq;
+  entry.used = true;
+  entry.heardMs = nowMs;
+
+  if (header.hops < m_maxHops && rssi < RSSI_NEAR) {
+    queue(header, data, len, rssi, airtimeMs, nowMs);
+  }
+  return true;
+}
+
+/* ================================= OUTPUT ================================ */
+
+bool Relay::poll(uint32_t nowMs, Outgoing *out) {
+  for (Pending &pending : m_pending) {
+    if (!pending.used || since(nowMs, pending.dueMs) < 0) continue;
+    pending.used = false;
+    out->type = pending.type;
+    out->len = pending.len;
+    memcpy(out->data, pending.data, pending.len);
+    m_stats.relayed++;
+    return true;
+  }
+  return false;
+}
+
+uint32_t Relay::nextEventMs(uint32_t nowMs) const {
+  uint32_t wait = NO_EVENT;
+  for (const Pending &pending : m_pending) {
+    if (!pending.used) continue;
+    int32_t left = since(pending.dueMs, nowMs);
+    wait = std::min<uint32_t>(wait, std::max<int32_t>(left, 0));
+  }
+  return wait;
+}
+
+/* ================================ PRIVATE ================================ */
+
+bool Relay::seen(uint16_t origin, uint16_t seq, uint32_t nowMs) const {
+  for (const Entry &entry : m_cache) {
+    if (entry.used && entry.origin == origin && entry.seq == seq &&
+        since(nowMs, entry.heardMs) < static_cast<int32_t>(CACHE_MS)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Relay::heardCopy(uint16_t origin, uint16_t seq) {
+  for (Pending &pending : m_pending) {
+    if (!pending.used || pending.origin != origin || pending.seq != seq) {
+      continue;
+    }
+    if (++pending.copies >= SUPPRESS) {
+      pending.used = false;
+      m_stats.suppressed++;
+    }
+    return;
+  }
+}
+
+void Relay::queue(const frame::Header &header, const uint8_t *data,
+                  size_t len, int16_t rssi, uint32_t airtimeMs,
+                  uint32_t nowMs) {
+  Pending *pending = nullptr;
+  for (Pending &slot : m_pending) {
+    if (!slot.used) {
+      pending = &slot;
+      break;
+    }
+  }
+  if (pending == nullptr || len > frame::MAX_SIZE) {
+    m_stats.dropped++;
+    return;
+  }
+
+  // The weaker the frame came in, the farther the sender, the sooner
+  int32_t near = std::max<int32_t>(
+      0, std::min<int32_t>(rssi, RSSI_NEAR) - RSSI_FAR);
+  uint32_t delayMs = near * RSSI_SLOTS * airtimeMs / (RSSI_NEAR - RSSI_FAR) +
+                     random(JITTER_SLOTS * airtimeMs + 1);
+
+  pending->used = true;
+  pending->origin = header.nodeId;
+  pending->seq = header.seq;
+  pending->copies = 1;
+  pending->dueMs = nowMs + delayMs;
+  pending->type = header.type;
+  pending->len = static_cast<uint8_t>(len);
+  memcpy(pending->data, data, len);
+  frame::setHops(pending->data, len, header.hops + 1);
+}
+
+uint32_t Relay::random(uint32_t bound) {
+  m_seed = m_seed * 1103515245u + 12345u;
+  return (m_seed >> 8) % bound;
+}
+
+}  // namespace relay
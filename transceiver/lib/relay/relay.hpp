@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "frame.hpp"
+
+// Flooding over several hops, for nodes out of range of the gateway
+// ("relay <hops>" on the nodes in between).
+//
+// A relay sends status, data and command frames it hears on once more, with
+// the hop count in the header one higher, as long as that stays within its
+// limit. Node ID and sequence number stay those of the node that sent the
+// frame first, so every node can tell copies apart with a cache of the
+// (origin, seq) pairs heard in the last CACHE_MS. Copies are dropped before
+// they are handled, relaying or not, and never relayed again.
+//
+// The relay waits before sending. Weaker frames wait less, from no time for
+// RSSI_FAR up to RSSI_SLOTS airtimes for RSSI_NEAR, plus up to JITTER_SLOTS
+// at random. So the relay farthest from the sender, which reaches the most
+// new nodes, tends to go first. Frames at RSSI_NEAR or stronger are not
+// relayed, most neighbours of their sender heard them too. A relay that
+// hears SUPPRESS copies of a frame before its turn leaves it to the others.
+//
+// Rate, Sync, Arq and Log frames only make sense between neighbours and are
+// never relayed.
+//
+// Not thread safe and free of RTOS calls, Control guards it with a critical
+// section and passes the time in.
+
+namespace relay {
+
+constexpr size_t CACHE = 128;       // (origin, seq) pairs remembered
+constexpr uint32_t CACHE_MS = 5000;  // longer than a flood takes to die out
+constexpr size_t PENDING = 4;        // frames waiting for their turn
+constexpr int16_t RSSI_FAR = -120;   // dBm
+constexpr int16_t RSSI_NEAR = -100;   // and stronger, not relayed
+constexpr uint32_t RSSI_SLOTS = 8;
+constexpr uint32_t JITTER_SLOTS = 8;
+constexpr uint8_t SUPPRESS = 2;  // copies heard, the first one included
+constexpr uint32_t NO_EVENT = UINT32_MAX;
+
+// A frame poll() wants sent, ready to go on air
+struct Outgoing {
+  frame::Type type;
+  uint8_t data[frame::MAX_SIZE];
+  size_t len;
+};
+
+struct Stats {
+  uint32_t heard = 0;       // frames of the relayed types
+  uint32_t duplicates = 0;  // of those, dropped as copies
+  uint32_t relayed = 0;
+  uint32_t suppressed = 0;  // left to a relay heard first
+  uint32_t dropped = 0;     // no room to wait in
+};
+
+// Whether frames of `type` travel over more than one hop
+bool relayed(frame::Type type);
+
+class Relay {
+ public:
+  // `seed` drives the jitter, it should differ between nodes
+  Relay(uint16_t nodeId, uint32_t seed) : m_nodeId(nodeId), m_seed(seed) {}
+
+  // Hops a frame may take, up to frame::MAX_HOPS. 0 stops relaying, copies
+  // are still dropped.
+  void setMaxHops(uint8_t hops);
+  uint8_t maxHops() const { return m_maxHops; }
+
+  // A frame of a relayed type as it came off the radio. False for a copy of
+  // one heard before, or of one this node sent, which should be dropped.
+  // Otherwise the relay may queue it, `airtimeMs` being its time on air.
+  bool onFrame(const frame::Header &header, const uint8_t *data, size_t len,
+               int16_t rssi, uint32_t airtimeMs, uint32_t nowMs);
+
+  // The next frame to relay, call until it returns false
+  bool poll(uint32_t nowMs, Outgoing *out);
+  // Milliseconds until poll() has something, NO_EVENT when nothing waits
+  uint32_t nextEventMs(uint32_t nowMs) const;
+
+  const Stats &stats() const { return m_stats; }
+
+ private:
+  struct Entry {
+    uint16_t origin = 0;
+    uint16_t seq = 0;
+    bool used = false;
+    uint32_t heardMs = 0;
+  };
+
+  struct Pending {
+    bool used = false;
+    uint16_t origin = 0;
+    uint16_t seq = 0;
+    uint8_t copies = 0;
+    uint32_t dueMs = 0;
+    frame::Type type = frame::Type::Status;
+    uint8_t len = 0;
+    uint8_t data[frame::MAX_SIZE];
+  };
+
+  bool seen(uint16_t origin, uint16_t seq, uint32_t nowMs) const;
+  void heardCopy(uint16_t origin, uint16_t seq);
+  void queue(const frame::Header &header, const uint8_t *data, size_t len,
+             int16_t rssi, uint32_t airtimeMs, uint32_t nowMs);
+  uint32_t random(uint32_t bound);
+
+  uint16_t m_nodeId;
+  uint32_t m_seed;
+  uint8_t m_maxHops = 0;
+
+  Entry m_cache[CACHE];
+  size_t m_next = 0;  // cache entry to overwrite next
+  Pending m_pending[PENDING];
+  Stats m_stats;
+};
+
+}  // namespace relay
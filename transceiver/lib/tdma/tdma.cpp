@@ -0,0 +1,224 @@
+#include "tdma.hpp"
+
+#include <algorithm>
+
+namespace tdma {
+
+namespace {
+
+// Timeouts in status intervals
+constexpr uint32_t LISTEN_BEACONS = 2;
+constexpr uint32_t QUIET_BEACONS = 3;  // a lower ID no longer coordinates
+constexpr uint32_t EXPIRE_BEACONS = 6;
+
+int32_t since(uint32_t nowUs, uint32_t thenUs) {
+  return static_cast<int32_t>(nowUs - thenUs);
+}
+
+}  // namespace
+
+Tdma::Tdma(uint16_t nodeId, uint32_t beaconMs)
+    : m_nodeId(nodeId),
+      m_listenUs(LISTEN_BEACONS * beaconMs * 1000),
+      m_quietUs(QUIET_BEACONS * beaconMs * 1000),
+      m_expireUs(EXPIRE_BEACONS * beaconMs * 1000) {}
+
+void Tdma::setEnabled(bool enabled, uint32_t nowUs) {
+  if (enabled == m_enabled) return;
+  m_enabled = enabled;
+  m_enabledUs = nowUs;
+  m_leading = false;
+  m_scheduled = false;
+  m_slot = -1;
+}
+
+/* ================================= INPUT ================================= */
+
+void Tdma::onFrame(uint16_t from, uint32_t nowUs) {
+  if (from < m_nodeId) {
+    m_lowerHeard = true;
+    m_lowerHeardUs = nowUs;
+  }
+  if (m_enabled) heard(from, nowUs);
+}
+
+void Tdma::onSync(uint16_t from, const frame::Sync &sync, const uint8_t *ids,
+                  size_t count, uint32_t startUs) {
+  if (!m_enabled || (m_leading && from > m_nodeId)) return;
+  // The lowest coordinator wins while it keeps its Syncs coming
+  if (m_scheduled && from > m_syncFrom && !stale(startUs)) return;
+  if (sync.slotUs == 0 || sync.first + count > sync.members) return;
+
+  if (from != m_syncFrom) m_slot = -1;  // its table, not the last one's
+  m_leading = false;
+  m_scheduled = true;
+  m_syncFrom = from;
+  m_startUs = startUs;
+  m_slotUs = sync.slotUs;
+  m_guardUs = sync.guardUs;
+  m_members = sync.members;
+  m_join = sync.join;
+  m_slots = 1 + m_members + m_join;
+  if (m_slot >= m_members) m_slot = -1;
+  for (size_t i = 0; i < count; i++) {
+    int slot = sync.first + static_cast<int>(i);
+    if (frame::syncId(ids, i) == m_nodeId) {
+      m_slot = slot;
+    } else if (slot == m_slot) {
+      m_slot = -1;
+    }
+  }
+  m_stats.syncs++;
+}
+
+/* ================================= OUTPUT ================================ */
+
+bool Tdma::poll(uint32_t nowUs, uint32_t slotAirtimeUs, frame::Sync *sync,
+                uint16_t *ids, size_t *count, uint32_t *waitUs) {
+  *waitUs = NO_EVENT;
+  if (!m_enabled) return false;
+  if (!coordinator(nowUs)) {
+    m_leading = false;
+    // Until listening is over or the lower ID went quiet
+    int32_t leftUs = since(m_enabledUs + m_listenUs, nowUs);
+    if (m_lowerHeard) {
+      leftUs = std::max(leftUs, since(m_lowerHeardUs + m_quietUs, nowUs));
+    }
+    *waitUs = std::max<int32_t>(leftUs, 1);
+    return false;
+  }
+  if (!m_leading) {
+    m_leading = true;
+    m_scheduled = false;
+    m_nextStartUs = nowUs + LEAD_US;
+  }
+  int32_t leftUs = since(m_nextStartUs, nowUs);
+  if (leftUs > static_cast<int32_t>(LEAD_US)) {
+    *waitUs = leftUs - LEAD_US;
+    return false;
+  }
+
+  // The coordinator is a member as well
+  heard(m_nodeId, nowUs);
+  expire(nowUs);
+  uint32_t slots = 1 + m_used + JOIN_SLOTS;
+  uint64_t drift = static_cast<uint64_t>(slots) * slotAirtimeUs * DRIFT_PPM /
+                   1'000'000;
+  uint32_t guardUs = 4 * START_ERROR_US + 2 * static_cast<uint32_t>(drift);
+
+  m_scheduled = true;
+  m_syncFrom = m_nodeId;
+  m_startUs = m_nextStartUs;
+  m_slotUs = slotAirtimeUs + guardUs;
+  m_guardUs = guardUs;
+  m_members = static_cast<uint8_t>(m_used);
+  m_join = JOIN_SLOTS;
+  m_slots = slots;
+  m_slot = -1;
+  for (size_t i = 0; i < m_used; i++) {
+    if (m_table[i].id == m_nodeId) m_slot = static_cast<int>(i);
+  }
+  m_nextStartUs = m_startUs + m_slots * m_slotUs;
+
+  // The next page of the table, it wraps with the next Sync
+  if (m_page >= m_used) m_page = 0;
+  *count = std::min(PAGE, m_used - m_page);
+  for (size_t i = 0; i < *count; i++) ids[i] = m_table[m_page + i].id;
+  sync->slotUs = m_slotUs;
+  sync->guardUs = static_cast<uint16_t>(m_guardUs);
+  sync->members = m_members;
+  sync->join = m_join;
+  sync->first = static_cast<uint8_t>(m_page);
+  m_page += *count;
+
+  m_stats.superframes++;
+  *waitUs = since(m_nextStartUs - LEAD_US, nowUs);
+  return true;
+}
+
+uint32_t Tdma::delayUs(bool sync, uint32_t airtimeUs, uint32_t nowUs) {
+  if (!m_enabled || !m_scheduled) return 0;
+  if (!m_leading && stale(nowUs)) {
+    m_scheduled = false;  // lost the coordinator, send freely
+    m_slot = -1;
+    return 0;
+  }
+
+  int32_t position = since(nowUs, m_startUs);
+  if (sync) {
+    // Right at the start of the superframe it announces
+    return m_leading && position < 0 ? -position : 0;
+  }
+
+  int32_t periodUs = static_cast<int32_t>(m_slots * m_slotUs);
+  if (position >= 0) position %= periodUs;
+  uint32_t first = 1 + m_members, last = m_slots - 1;  // join slots
+  if (m_slot >= 0) first = last = 1 + m_slot;
+
+  int32_t half = static_cast<int32_t>(m_guardUs / 2);
+  for (int32_t base : {0, periodUs}) {
+    for (uint32_t slot = first; slot <= last; slot++) {
+      int32_t open = base + static_cast<int32_t>(slot * m_slotUs) + half;
+      int32_t close = base + static_cast<int32_t>((slot + 1) * m_slotUs) -
+                      half - static_cast<int32_t>(airtimeUs);
+      if (close < open) close = open;  // longer than the slot, at its start
+      if (position <= close) return position >= open ? 0 : open - position;
+    }
+  }
+  return 0;
+}
+
+/* ============================== DIAGNOSTICS ============================== */
+
+bool Tdma::coordinator(uint32_t nowUs) const {
+  if (!m_enabled ||
+      since(nowUs, m_enabledUs) < static_cast<int32_t>(m_listenUs)) {
+    return false;
+  }
+  return !m_lowerHeard ||
+         since(nowUs, m_lowerHeardUs) >= static_cast<int32_t>(m_quietUs);
+}
+
+bool Tdma::synced(uint32_t nowUs) const {
+  return m_enabled && m_scheduled && (m_leading || !stale(nowUs));
+}
+
+/* ================================ PRIVATE ================================ */
+
+void Tdma::heard(uint16_t id, uint32_t nowUs) {
+  Member *free = nullptr;
+  for (size_t i = 0; i < m_used; i++) {
+    if (m_table[i].id == id) {
+      m_table[i].lastHeardUs = nowUs;
+      return;
+    }
+    if (m_table[i].id == 0 && free == nullptr) free = &m_table[i];
+  }
+  if (free == nullptr) {
+    if (m_used == MAX_MEMBERS) return;  // joins again once a slot expires
+    free = &m_table[m_used++];
+  }
+  free->id = id;
+  free->lastHeardUs = nowUs;
+  m_stats.joined++;
+}
+
+void Tdma::expire(uint32_t nowUs) {
+  for (size_t i = 0; i < m_used; i++) {
+    Member &member = m_table[i];
+    if (member.id == 0 ||
+        since(nowUs, member.lastHeardUs) < static_cast<int32_t>(m_expireUs)) {
+      continue;
+    }
+    member.id = 0;
+    m_stats.expired++;
+  }
+  while (m_used > 0 && m_table[m_used - 1].id == 0) m_used--;
+}
+
+bool Tdma::stale(uint32_t nowUs) const {
+  return since(nowUs, m_startUs) >
+         static_cast<int32_t>(SYNC_LOST * m_slots * m_slotUs);
+}
+
+}  // namespace tdma
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "frame.hpp"
+
+// Time division multiple access, the scheduled alternative to sending
+// whenever the radio is free ("mode tdma" on every node).
+//
+// The node with the lowest ID it has heard of acts as coordinator, as for
+// ADR, and starts every superframe with a Sync frame:
+//
+//   | sync | member 0 | member 1 | ... | member N-1 | join | join |
+//
+// Each slot fits a frame of MAX_SIZE at the current rate plus the guard
+// time, only the coordinator's Sync goes out in the first one. Every node
+// the coordinator hears gets a member slot, and loses it to the next
+// newcomer once it has not been heard for a while. Nodes without a slot,
+// the coordinator learns of them through any frame, send in the join slots
+// and rely on listen before talk there.
+//
+// A Sync carries the slot length, the guard time, the slot counts and a page
+// of the member table. The pages go round, a node finds its slot within a
+// few superframes. Followers take the start of the superframe from when the
+// Sync began on air. A node that misses SYNC_LOST Syncs in a row, or is not
+// in TDMA mode, sends freely again.
+//
+// Frames start between half a guard time after the start of their slot and
+// half a guard time before its end. The guard covers both the Sync and the
+// frame starting up to START_ERROR_US late, and two clocks drifting
+// DRIFT_PPM apart over a superframe.
+//
+// Not thread safe and free of RTOS calls, Control guards it with a critical
+// section and passes the time (micros()) in.
+
+namespace tdma {
+
+constexpr size_t MAX_MEMBERS = 250;
+constexpr uint8_t JOIN_SLOTS = 2;
+// How late a frame can start: a tick of the task that starts it plus a
+// channel scan
+constexpr uint32_t START_ERROR_US = 2000;
+constexpr uint32_t DRIFT_PPM = 40;  // two crystals of +-20 ppm
+constexpr uint32_t LEAD_US = 20'000;  // Sync queued this long before its slot
+constexpr uint32_t SYNC_LOST = 3;     // superframes without Sync
+// Member IDs per Sync
+constexpr size_t PAGE = (frame::MAX_PAYLOAD - frame::SYNC_SIZE) / 2;
+constexpr uint32_t NO_EVENT = UINT32_MAX;
+
+struct Stats {
+  uint32_t superframes = 0;  // Syncs sent as coordinator
+  uint32_t syncs = 0;        // Syncs followed
+  uint32_t joined = 0;       // members added to the table
+  uint32_t expired = 0;      // and dropped from it again
+};
+
+class Tdma {
+ public:
+  // `beaconMs` is the status interval, the timeouts are multiples of it
+  Tdma(uint16_t nodeId, uint32_t beaconMs);
+
+  void setEnabled(bool enabled, uint32_t nowUs);
+  bool enabled() const { return m_enabled; }
+
+  // ----- Input -----
+  // Every valid frame heard
+  void onFrame(uint16_t from, uint32_t nowUs);
+  // A Sync frame that began on air at `startUs`
+  void onSync(uint16_t from, const frame::Sync &sync, const uint8_t *ids,
+              size_t count, uint32_t startUs);
+
+  // ----- Output -----
+  // On the coordinator, true when `sync` and the `count` IDs (up to PAGE)
+  // should be queued as the Sync of the next superframe now, with
+  // TxPriority::Sync. `slotAirtimeUs` is the time on air of a MAX_SIZE frame
+  // at the current rate. Call again after `waitUs`, NO_EVENT when disabled.
+  bool poll(uint32_t nowUs, uint32_t slotAirtimeUs, frame::Sync *sync,
+            uint16_t *ids, size_t *count, uint32_t *waitUs);
+
+  // For LoRaCom::TxGate: microseconds until a frame of `airtimeUs` may start
+  // in a slot of this node, 0 for now
+  uint32_t delayUs(bool sync, uint32_t airtimeUs, uint32_t nowUs);
+
+  // ----- Diagnostics -----
+  bool coordinator(uint32_t nowUs) const;
+  bool synced(uint32_t nowUs) const;
+  uint16_t coordinatorId() const { return m_scheduled ? m_syncFrom : 0; }
+  int slot() const { return m_slot; }  // member slot, -1 while joining
+  uint8_t members() const { return m_members; }
+  uint32_t superframeUs() const { return m_slots * m_slotUs; }
+  const Stats &stats() const { return m_stats; }
+
+ private:
+  struct Member {
+    uint16_t id = 0;  // 0 when the slot is free
+    uint32_t lastHeardUs = 0;
+  };
+
+  void heard(uint16_t id, uint32_t nowUs);
+  void expire(uint32_t nowUs);
+  bool stale(uint32_t nowUs) const;
+
+  uint16_t m_nodeId;
+  uint32_t m_listenUs;  // before acting as coordinator
+  uint32_t m_quietUs;   // a lower ID was not heard for, to act as one
+  uint32_t m_expireUs;  // silence that costs a member its slot
+
+  bool m_enabled = false;
+  uint32_t m_enabledUs = 0;
+  bool m_lowerHeard = false;  // a lower ID, so someone else coordinates
+  uint32_t m_lowerHeardUs = 0;
+
+  // Coordinator
+  bool m_leading = false;
+  uint32_t m_nextStartUs = 0;  // of the superframe after the current one
+  Member m_table[MAX_MEMBERS];
+  size_t m_used = 0;   // slots up to the last one taken
+  size_t m_page = 0;   // member slot the next Sync starts its page at
+
+  // The schedule in force, announced or heard
+  bool m_scheduled = false;
+  uint16_t m_syncFrom = 0;
+  uint32_t m_startUs = 0;  // of the current superframe
+  uint32_t m_slotUs = 0;
+  uint32_t m_guardUs = 0;
+  uint8_t m_members = 0;
+  uint8_t m_join = 0;
+  uint32_t m_slots = 0;  // sync, members and join
+  int m_slot = -1;
+
+  Stats m_stats;
+};
+
+}  // namespace tdma
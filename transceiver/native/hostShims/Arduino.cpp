@@ -0,0 +1,71 @@
+#include "Arduino.h"
+
+#include <random>
+
+#include "SPI.h"
+#include "hostKernel.hpp"
+
+SPIClass SPI;
+EspClass ESP;
+
+namespace {
+
+constexpr int PIN_COUNT = 64;
+uint8_t s_pinState[PIN_COUNT] = {};
+
+std::mt19937 &rng() {
+  static std::mt19937 gen(1);
+  return gen;
+}
+
+}  // namespace
+
+unsigned long millis() {
+  return static_cast<unsigned long>(host::Kernel::get().now() / 1000);
+}
+
+unsigned long micros() {
+  return static_cast<unsigned long>(host::Kernel::get().now());
+}
+
+void delay(uint32_t ms) { vTaskDelay(pdMS_TO_TICKS(ms)); }
+
+void delayMicroseconds(uint32_t us) {
+  host::Kernel &kernel = host::Kernel::get();
+  kernel.sleepUntil(kernel.now() + us);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) { (void)pin, (void)mode; }
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if (pin < PIN_COUNT) s_pinState[pin] = val ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin) { return pin < PIN_COUNT ? s_pinState[pin] : LOW; }
+
+long random(long howbig) {
+  if (howbig <= 0) return 0;
+  return std::uniform_int_distribution<long>(0, howbig - 1)(rng());
+}
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) return howsmall;
+  return howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed) {
+  if (seed != 0) rng().seed(seed);
+}
+
+uint64_t EspClass::getEfuseMac() {
+  host::Node *node = host::Kernel::get().currentNode();
+  uint64_t nic = node->mac;
+  if (nic == 0) {
+    // FNV-1a of the node name, so separate native instances differ
+    uint32_t hash = 2166136261u;
+    for (char c : node->name) hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    nic = hash & 0xFFFFFF;
+  }
+  // Espressif OUI 24:0A:C4 followed by the NIC specific bytes
+  return 0x24ull | 0x0Aull << 8 | 0xC4ull << 16 | (nic & 0xFFFFFF) << 24;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+// Host stand-in for the Arduino-ESP32 core used by the native build.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "HardwareSerial.h"
+#include "WString.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define F(string_literal) (string_literal)
+
+#define LOW 0x0
+#define HIGH 0x1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+// Subset of the Arduino-ESP32 `ESP` object
+class EspClass {
+ public:
+  // Factory MAC in the same byte order as on the chip: byte 0 of the MAC is
+  // the lowest byte. Unique per host node.
+  uint64_t getEfuseMac();
+};
+
+extern EspClass ESP;
+
+// Sketch entry points, called from the loopTask started by hostMain.cpp
+void setup();
+void loop();
@@ -0,0 +1,82 @@
+#pragma once
+
+// Host stand-in for the Arduino-ESP32 fs::FS / fs::File API. Files live in a
+// plain directory on the host (see host::Node::fsRoot).
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include "WString.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+class File {
+ public:
+  File() = default;
+  File(std::FILE *handle, const std::string &path);
+
+  operator bool() const { return m_handle != nullptr; }
+
+  size_t size() const;
+  size_t position() const;
+  bool seek(uint32_t pos, SeekMode mode = SeekSet);
+  int available();
+
+  int read();
+  size_t read(uint8_t *buffer, size_t size);
+  size_t readBytes(char *buffer, size_t length) {
+    return read(reinterpret_cast<uint8_t *>(buffer), length);
+  }
+  String readString();
+  String readStringUntil(char terminator);
+
+  size_t write(uint8_t c) { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size);
+  size_t print(const char *str);
+  size_t print(const String &str) { return print(str.c_str()); }
+  void flush();
+  void close();
+
+  const char *path() const { return m_path.c_str(); }
+
+ private:
+  std::shared_ptr<std::FILE> m_handle;
+  std::string m_path;
+};
+
+class FS {
+ public:
+  virtual ~FS() = default;
+
+  File open(const char *path, const char *mode = FILE_READ,
+            bool create = false);
+  File open(const String &path, const char *mode = FILE_READ,
+            bool create = false) {
+    return open(path.c_str(), mode, create);
+  }
+  bool exists(const char *path);
+  bool remove(const char *path);
+  bool rename(const char *pathFrom, const char *pathTo);
+  bool mkdir(const char *path);
+  bool rmdir(const char *path);
+
+ protected:
+  std::string hostPath(const char *path);
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::SeekCur;
+using fs::SeekEnd;
+using fs::SeekMode;
+using fs::SeekSet;
@@ -0,0 +1,185 @@
+#include "HardwareSerial.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "esp_log.h"
+#include "hostKernel.hpp"
+
+HostSerial Serial;
+
+namespace host {
+
+namespace {
+
+// stdin is read by a plain OS thread outside the scheduler, the firmware
+// polls what it collected through available()/read() like a UART FIFO.
+class StdioSerialPort : public SerialPort {
+ public:
+  void begin(unsigned long baud) override {
+    (void)baud;
+    std::call_once(m_started, [this] { start(); });
+  }
+
+  size_t available() override {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_rx.size();
+  }
+
+  int peek() override {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_rx.empty() ? -1 : m_rx.front();
+  }
+
+  size_t read(uint8_t *buffer, size_t size) override {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t count = 0;
+    while (count < size && !m_rx.empty()) {
+      buffer[count++] = m_rx.front();
+      m_rx.pop_front();
+    }
+    return count;
+  }
+
+  size_t write(const uint8_t *buffer, size_t size) override {
+    size_t done = 0;
+    while (done < size) {
+      ssize_t n = ::write(m_outFd, buffer + done, size - done);
+      if (n <= 0) break;
+      done += static_cast<size_t>(n);
+    }
+    return done;
+  }
+
+ private:
+  void start() {
+    const char *usePty = getenv("HOST_SERIAL_PTY");
+    if (usePty && usePty[0] == '1') {
+      int master = posix_openpt(O_RDWR | O_NOCTTY);
+      if (master >= 0 && grantpt(master) == 0 && unlockpt(master) == 0) {
+        m_inFd = m_outFd = master;
+        fprintf(stderr, "Serial attached to %s\n", ptsname(master));
+      } else {
+        ESP_LOGE("HostSerial", "Failed to open pty, using stdin/stdout");
+      }
+    }
+
+    std::thread([this] {
+      uint8_t chunk[256];
+      while (true) {
+        ssize_t n = ::read(m_inFd, chunk, sizeof(chunk));
+        if (n <= 0) {
+          if (m_inFd == STDIN_FILENO) return;  // stdin closed
+          usleep(10'000);                      // no pty client yet
+          continue;
+        }
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_rx.insert(m_rx.end(), chunk, chunk + n);
+        }
+        received();
+      }
+    }).detach();
+  }
+
+  std::once_flag m_started;
+  std::mutex m_mutex;
+  std::deque<uint8_t> m_rx;
+  int m_inFd = STDIN_FILENO;
+  int m_outFd = STDOUT_FILENO;
+};
+
+}  // namespace
+
+void SerialPort::onReceive(std::function<void()> callback, Node *node) {
+  std::lock_guard<std::mutex> lock(m_callbackMutex);
+  m_onReceive = std::move(callback);
+  m_node = node;
+}
+
+void SerialPort::received() {
+  std::lock_guard<std::mutex> lock(m_callbackMutex);
+  if (m_onReceive) Kernel::get().raiseIrq(m_onReceive, m_node);
+}
+
+SerialPort *stdioSerialPort() {
+  static StdioSerialPort port;
+  return &port;
+}
+
+}  // namespace host
+
+host::SerialPort *HostSerial::port() {
+  host::Node *node = host::Kernel::get().currentNode();
+  if (node->serial == nullptr) node->serial = host::stdioSerialPort();
+  return node->serial;
+}
+
+void HostSerial::begin(unsigned long baud) { port()->begin(baud); }
+
+void HostSerial::onReceive(std::function<void()> function, bool onlyOnTimeout) {
+  (void)onlyOnTimeout;
+  port()->onReceive(std::move(function),
+                    host::Kernel::get().currentNode());
+}
+
+int HostSerial::available() { return static_cast<int>(port()->available()); }
+
+int HostSerial::peek() { return port()->peek(); }
+
+int HostSerial::read() {
+  uint8_t c;
+  return port()->read(&c, 1) == 1 ? c : -1;
+}
+
+size_t HostSerial::read(uint8_t *buffer, size_t size) {
+  return port()->read(buffer, size);
+}
+
+size_t HostSerial::readBytes(char *buffer, size_t length) {
+  return port()->read(reinterpret_cast<uint8_t *>(buffer), length);
+}
+
+String HostSerial::readString() {
+  String out;
+  int c;
+  while ((c = read()) >= 0) out += static_cast<char>(c);
+  return out;
+}
+
+String HostSerial::readStringUntil(char terminator) {
+  String out;
+  int c;
+  while ((c = read()) >= 0 && c != terminator) out += static_cast<char>(c);
+  return out;
+}
+
+size_t HostSerial::write(uint8_t c) { return port()->write(&c, 1); }
+
+size_t HostSerial::write(const uint8_t *buffer, size_t size) {
+  return port()->write(buffer, size);
+}
+
+size_t HostSerial::print(const char *str) {
+  return port()->write(reinterpret_cast<const uint8_t *>(str), strlen(str));
+}
+
+size_t HostSerial::printf(const char *format, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (len < 0) return 0;
+  return write(reinterpret_cast<const uint8_t *>(buf),
+               std::min(static_cast<size_t>(len), sizeof(buf) - 1));
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+// Host stand-in for the Arduino `Serial` object. Reads and writes are routed
+// to the host::SerialPort of the current node: stdin/stdout (or a pty) in the
+// native build, in-memory pipes in the simulator.
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+#include "WString.h"
+
+namespace host {
+
+struct Node;
+
+class SerialPort {
+ public:
+  virtual ~SerialPort() = default;
+
+  virtual void begin(unsigned long baud) { (void)baud; }
+  virtual size_t available() = 0;
+  virtual int peek() = 0;
+  virtual size_t read(uint8_t *buffer, size_t size) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+  // Whether something is reading the port, like a USB CDC host with DTR set
+  virtual bool connected() { return true; }
+
+  // Run `callback` in interrupt context of `node` whenever bytes arrive
+  void onReceive(std::function<void()> callback, Node *node);
+
+ protected:
+  // Called by implementations after queueing received bytes
+  void received();
+
+ private:
+  std::mutex m_callbackMutex;  // received() may run on a reader thread
+  std::function<void()> m_onReceive;
+  Node *m_node = nullptr;
+};
+
+// Serial port on the process' stdin/stdout. Setting HOST_SERIAL_PTY=1 opens
+// a pseudo terminal instead and prints its path, so a terminal program can be
+// attached like it would to the USB CDC port of the board.
+SerialPort *stdioSerialPort();
+
+}  // namespace host
+
+class HostSerial {
+ public:
+  void begin(unsigned long baud);
+  void end() {}
+  // Like HardwareSerial::onReceive(), the callback runs from the driver
+  void onReceive(std::function<void()> function, bool onlyOnTimeout = false);
+  operator bool() { return port()->connected(); }
+
+  int available();
+  int peek();
+  int read();
+  size_t read(uint8_t *buffer, size_t size);
+  size_t readBytes(char *buffer, size_t length);
+  String readString();
+  String readStringUntil(char terminator);
+
+  size_t write(uint8_t c);
+  size_t write(const uint8_t *buffer, size_t size);
+  size_t print(const char *str);
+  size_t print(const String &str) { return print(str.c_str()); }
+  size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+  size_t print(int value) { return print(String(value)); }
+  size_t print(long value) { return print(String(value)); }
+  size_t print(unsigned long value) { return print(String(value)); }
+  size_t print(double value, int digits = 2) {
+    return print(String(value, digits));
+  }
+  size_t println() { return print("\r\n"); }
+  template <typename T>
+  size_t println(const T &value) {
+    return print(value) + println();
+  }
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+  void flush() {}
+
+ private:
+  host::SerialPort *port();
+};
+
+extern HostSerial Serial;
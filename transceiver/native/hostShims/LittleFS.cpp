@@ -0,0 +1,189 @@
+#include "LittleFS.h"
+
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+
+#include "hostKernel.hpp"
+
+fs::LittleFSFS LittleFS;
+
+namespace fs {
+
+namespace stdfs = std::filesystem;
+
+namespace {
+
+constexpr size_t BLOCK_SIZE = 4096;
+
+size_t roundUpToBlock(size_t size) {
+  return (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+}
+
+}  // namespace
+
+/* ================================= FILE ================================== */
+
+File::File(std::FILE *handle, const std::string &path)
+    : m_handle(handle, [](std::FILE *f) { std::fclose(f); }), m_path(path) {}
+
+size_t File::size() const {
+  if (!m_handle) return 0;
+  long pos = std::ftell(m_handle.get());
+  std::fseek(m_handle.get(), 0, SEEK_END);
+  long end = std::ftell(m_handle.get());
+  std::fseek(m_handle.get(), pos, SEEK_SET);
+  return end < 0 ? 0 : static_cast<size_t>(end);
+}
+
+size_t File::position() const {
+  if (!m_handle) return 0;
+  long pos = std::ftell(m_handle.get());
+  return pos < 0 ? 0 : static_cast<size_t>(pos);
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  if (!m_handle) return false;
+  // Arduino's SeekEnd counts backwards from the end of the file
+  long offset = mode == SeekEnd ? -static_cast<long>(pos) : pos;
+  int whence = mode == SeekSet ? SEEK_SET : mode == SeekCur ? SEEK_CUR : SEEK_END;
+  return std::fseek(m_handle.get(), offset, whence) == 0;
+}
+
+int File::available() {
+  if (!m_handle) return 0;
+  return static_cast<int>(size() - position());
+}
+
+int File::read() {
+  if (!m_handle) return -1;
+  int c = std::fgetc(m_handle.get());
+  return c == EOF ? -1 : c;
+}
+
+size_t File::read(uint8_t *buffer, size_t size) {
+  if (!m_handle) return 0;
+  return std::fread(buffer, 1, size, m_handle.get());
+}
+
+String File::readString() {
+  String out;
+  int c;
+  while ((c = read()) >= 0) out += static_cast<char>(c);
+  return out;
+}
+
+String File::readStringUntil(char terminator) {
+  String out;
+  int c;
+  while ((c = read()) >= 0 && c != terminator) out += static_cast<char>(c);
+  return out;
+}
+
+size_t File::write(const uint8_t *buffer, size_t size) {
+  if (!m_handle) return 0;
+  return std::fwrite(buffer, 1, size, m_handle.get());
+}
+
+size_t File::print(const char *str) {
+  return write(reinterpret_cast<const uint8_t *>(str), strlen(str));
+}
+
+void File::flush() {
+  if (m_handle) std::fflush(m_handle.get());
+}
+
+void File::close() { m_handle.reset(); }
+
+/* ================================== FS =================================== */
+
+std::string FS::hostPath(const char *path) {
+  std::string root = host::Kernel::get().currentNode()->fsRoot;
+  while (*path == '/') path++;
+  return root + "/" + path;
+}
+
+File FS::open(const char *path, const char *mode, bool create) {
+  std::string full = hostPath(path);
+  if (create) {
+    std::error_code ec;
+    stdfs::create_directories(stdfs::path(full).parent_path(), ec);
+  }
+
+  // Open in binary mode, and allow reading back what was appended
+  std::string hostMode = mode;
+  if (hostMode == FILE_READ) {
+    hostMode = "rb";
+  } else if (hostMode == FILE_APPEND) {
+    hostMode = "a+b";
+  } else {
+    hostMode = "w+b";
+  }
+
+  std::FILE *handle = std::fopen(full.c_str(), hostMode.c_str());
+  if (handle == nullptr) return File();
+  return File(handle, path);
+}
+
+bool FS::exists(const char *path) {
+  std::error_code ec;
+  return stdfs::exists(hostPath(path), ec);
+}
+
+bool FS::remove(const char *path) {
+  std::error_code ec;
+  return stdfs::remove(hostPath(path), ec);
+}
+
+bool FS::rename(const char *pathFrom, const char *pathTo) {
+  std::error_code ec;
+  stdfs::rename(hostPath(pathFrom), hostPath(pathTo), ec);
+  return !ec;
+}
+
+bool FS::mkdir(const char *path) {
+  std::error_code ec;
+  stdfs::create_directories(hostPath(path), ec);
+  return !ec;
+}
+
+bool FS::rmdir(const char *path) {
+  std::error_code ec;
+  return stdfs::remove(hostPath(path), ec);
+}
+
+/* =============================== LITTLEFS ================================ */
+
+bool LittleFSFS::begin(bool formatOnFail, const char *basePath,
+                       uint8_t maxOpenFiles, const char *partitionLabel) {
+  (void)formatOnFail, (void)basePath, (void)maxOpenFiles, (void)partitionLabel;
+  std::error_code ec;
+  stdfs::create_directories(host::Kernel::get().currentNode()->fsRoot, ec);
+  return !ec;
+}
+
+bool LittleFSFS::format() {
+  std::error_code ec;
+  const std::string &root = host::Kernel::get().currentNode()->fsRoot;
+  stdfs::remove_all(root, ec);
+  stdfs::create_directories(root, ec);
+  return !ec;
+}
+
+size_t LittleFSFS::totalBytes() {
+  return host::Kernel::get().currentNode()->fsTotalBytes;
+}
+
+size_t LittleFSFS::usedBytes() {
+  // Two blocks for the superblock pair, like a freshly formatted LittleFS
+  size_t used = 2 * BLOCK_SIZE;
+  std::error_code ec;
+  const std::string &root = host::Kernel::get().currentNode()->fsRoot;
+  for (auto it = stdfs::recursive_directory_iterator(root, ec);
+       !ec && it != stdfs::recursive_directory_iterator(); it.increment(ec)) {
+    if (it->is_regular_file(ec)) used += roundUpToBlock(it->file_size(ec));
+  }
+  return used;
+}
+
+}  // namespace fs
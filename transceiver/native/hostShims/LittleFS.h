@@ -0,0 +1,21 @@
+#pragma once
+
+#include "FS.h"
+
+namespace fs {
+
+// LittleFS on a host directory. totalBytes() comes from host::Node and
+// usedBytes() rounds every file up to whole 4 KiB blocks like the real one.
+class LittleFSFS : public FS {
+ public:
+  bool begin(bool formatOnFail = false, const char *basePath = "/littlefs",
+             uint8_t maxOpenFiles = 10, const char *partitionLabel = "spiffs");
+  bool format();
+  size_t totalBytes();
+  size_t usedBytes();
+  void end() {}
+};
+
+}  // namespace fs
+
+extern fs::LittleFSFS LittleFS;
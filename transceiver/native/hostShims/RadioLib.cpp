@@ -0,0 +1,434 @@
+#include "RadioLib.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "esp_log.h"
+
+/* ============================ PHYSICAL LAYER ============================= */
+
+int16_t PhysicalLayer::startTransmit(const char *str, uint8_t addr) {
+  return startTransmit(reinterpret_cast<const uint8_t *>(str), strlen(str),
+                       addr);
+}
+
+int16_t PhysicalLayer::startTransmit(const uint8_t *data, size_t len,
+                                     uint8_t addr) {
+  (void)data, (void)len, (void)addr;
+  return RADIOLIB_ERR_UNSUPPORTED;
+}
+
+int16_t PhysicalLayer::readData(String &str, size_t len) {
+  uint8_t buffer[RADIOLIB_SX126X_MAX_PACKET_LENGTH];
+  size_t length = len ? std::min(len, sizeof(buffer)) : getPacketLength();
+  int16_t state = readData(buffer, length);
+  str = String(reinterpret_cast<const char *>(buffer), length);
+  return state;
+}
+
+int16_t PhysicalLayer::readData(uint8_t *data, size_t len) {
+  (void)data, (void)len;
+  return RADIOLIB_ERR_UNSUPPORTED;
+}
+
+int16_t PhysicalLayer::setOutputPower(int8_t power) {
+  (void)power;
+  return RADIOLIB_ERR_UNSUPPORTED;
+}
+
+int16_t PhysicalLayer::setFrequency(float freq) {
+  (void)freq;
+  return RADIOLIB_ERR_UNSUPPORTED;
+}
+
+size_t PhysicalLayer::getPacketLength(bool update) {
+  (void)update;
+  return 0;
+}
+
+RadioLibTime_t PhysicalLayer::getTimeOnAir(size_t len) {
+  (void)len;
+  return 0;
+}
+
+/* ============================== TIME ON AIR ============================== */
+
+namespace host {
+
+Micros loraTimeOnAir(const LoRaProfile &profile, size_t len) {
+  const int sf = profile.sf;
+  const double symbolUs = std::ldexp(1000.0, sf) / profile.bwKHz;
+  // Low data rate optimisation, enabled by RadioLib for symbols >= 16 ms
+  const bool ldro = symbolUs >= 16000.0;
+  const int crc = profile.crcOn ? 1 : 0;
+  const int header = profile.implicitHeader ? 0 : 1;
+
+  double symbols;
+  if (sf <= 6) {
+    int bits = 8 * static_cast<int>(len) + 16 * crc - 4 * sf + 20 * header;
+    symbols = profile.preambleLength + 6.25 + 8 +
+              std::ceil(std::max(bits, 0) / (4.0 * sf)) * profile.cr;
+  } else {
+    int bits = 8 * static_cast<int>(len) + 16 * crc - 4 * sf + 8 + 20 * header;
+    double bitsPerSymbol = 4.0 * (ldro ? sf - 2 : sf);
+    symbols = profile.preambleLength + 4.25 + 8 +
+              std::ceil(std::max(bits, 0) / bitsPerSymbol) * profile.cr;
+  }
+  return static_cast<Micros>(std::ceil(symbols * symbolUs));
+}
+
+bool loraCompatible(const LoRaProfile &a, const LoRaProfile &b) {
+  return std::fabs(a.freqMHz - b.freqMHz) < 0.001f && a.bwKHz == b.bwKHz &&
+         a.sf == b.sf && a.syncWord == b.syncWord &&
+         a.implicitHeader == b.implicitHeader;
+}
+
+}  // namespace host
+
+/* ================================ SX126X ================================= */
+
+namespace {
+
+constexpr const char *TAG = "HostSX126x";
+
+bool validBandwidth(float bw) {
+  static const float valid[] = {7.8f,  10.4f, 15.6f,  20.8f,  31.25f,
+                                41.7f, 62.5f, 125.0f, 250.0f, 500.0f};
+  return std::any_of(std::begin(valid), std::end(valid),
+                     [bw](float v) { return std::fabs(v - bw) < 0.01f; });
+}
+
+}  // namespace
+
+SX126x::SX126x(Module *mod) : m_mod(mod) {
+  host::Kernel &kernel = host::Kernel::get();
+  m_node = kernel.currentNode();
+  if (m_node->medium == nullptr) m_node->medium = host::udpRadioMedium();
+  m_medium = m_node->medium;
+}
+
+SX126x::~SX126x() { m_medium->detach(this); }
+
+int16_t SX126x::begin(float freq, float bw, uint8_t sf, uint8_t cr,
+                      uint8_t syncWord, int8_t power, uint16_t preambleLength,
+                      float tcxoVoltage, bool useRegulatorLDO) {
+  (void)tcxoVoltage, (void)useRegulatorLDO;
+  m_state = State::Standby;
+
+  int16_t state = setFrequency(freq);
+  if (state == RADIOLIB_ERR_NONE) state = setBandwidth(bw);
+  if (state == RADIOLIB_ERR_NONE) state = setSpreadingFactor(sf);
+  if (state == RADIOLIB_ERR_NONE) state = setCodingRate(cr);
+  if (state == RADIOLIB_ERR_NONE) state = setSyncWord(syncWord);
+  if (state == RADIOLIB_ERR_NONE) state = setOutputPower(power);
+  if (state == RADIOLIB_ERR_NONE) state = setPreambleLength(preambleLength);
+  if (state != RADIOLIB_ERR_NONE) return state;
+
+  m_medium->attach(this);
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX126x::startTransmit(const uint8_t *data, size_t len, uint8_t addr) {
+  (void)addr;
+  if (len > RADIOLIB_SX126X_MAX_PACKET_LENGTH) {
+    return RADIOLIB_ERR_PACKET_TOO_LONG;
+  }
+
+  host::Kernel &kernel = host::Kernel::get();
+  host::Micros airtime = host::loraTimeOnAir(m_profile, len);
+  m_state = State::Tx;
+  uint32_t token = ++m_txToken;
+  m_medium->transmit(this, data, len, airtime);
+
+  kernel.at(
+      kernel.now() + airtime,
+      [this, token] {
+        // TxDone, the chip falls back to standby and raises DIO1
+        if (m_state != State::Tx || m_txToken != token) return;
+        m_state = State::Standby;
+        fireDio1();
+      },
+      m_node);
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX126x::finishTransmit() {
+  m_state = State::Standby;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX126x::startReceive() {
+  m_state = State::Rx;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX126x::readData(uint8_t *data, size_t len) {
+  size_t length = (len == 0 || len > m_rxLength) ? m_rxLength : len;
+  memcpy(data, m_rxBuffer, length);
+  return m_rxCrcOk ? RADIOLIB_ERR_NONE : RADIOLIB_ERR_CRC_MISMATCH;
+}
+
+int16_t SX126x::standby() {
+  m_state = State::Standby;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX126x::setOutputPower(int8_t power) {
+  if (power < -9 || power > 22) return RADIOLIB_ERR_INVALID_OUTPUT_POWER;
+  m_profile.powerDbm = power;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX126x::setFrequency(float freq) {
+  if (freq < 150.0f || freq > 960.0f) return RADIOLIB_ERR_INVALID_FREQUENCY;
+  m_profile.freqMHz = freq;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX126x::setBandwidth(float bw) {
+  if (!validBandwidth(bw)) return RADIOLIB_ERR_INVALID_BANDWIDTH;
+  m_profile.bwKHz = bw;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX126x::setSpreadingFactor(uint8_t sf) {
+  if (sf < 5 || sf > 12) return RADIOLIB_ERR_INVALID_SPREADING_FACTOR;
+  m_profile.sf = sf;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX126x::setCodingRate(uint8_t cr) {
+  if (cr < 5 || cr > 8) return RADIOLIB_ERR_INVALID_CODING_RATE;
+  m_profile.cr = cr;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX126x::setSyncWord(uint8_t syncWord) {
+  m_profile.syncWord = syncWord;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX126x::setPreambleLength(size_t preambleLength) {
+  if (preambleLength == 0 || preambleLength > 0xFFFF) {
+    return RADIOLIB_ERR_INVALID_PREAMBLE_LENGTH;
+  }
+  m_profile.preambleLength = static_cast<uint16_t>(preambleLength);
+  return RADIOLIB_ERR_NONE;
+}
+
+size_t SX126x::getPacketLength(bool update) {
+  (void)update;
+  return m_rxLength;
+}
+
+RadioLibTime_t SX126x::getTimeOnAir(size_t len) {
+  return static_cast<RadioLibTime_t>(host::loraTimeOnAir(m_profile, len));
+}
+
+int16_t SX126x::startChannelScan() {
+  host::Kernel &kernel = host::Kernel::get();
+  m_state = State::Cad;
+  m_cadDetected = m_medium->channelActive(this);
+
+  // Two symbols of listening plus the correlation, as with the default
+  // RadioLib CAD parameters
+  host::Micros symbolUs = static_cast<host::Micros>(
+      std::ldexp(1000.0, m_profile.sf) / m_profile.bwKHz);
+  kernel.at(
+      kernel.now() + symbolUs * 5 / 2,
+      [this] {
+        if (m_state != State::Cad) return;
+        m_state = State::Standby;
+        host::Kernel::get().wakeAll(m_cadWaiters);
+        fireDio1();
+      },
+      m_node);
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX126x::getChannelScanResult() {
+  return m_cadDetected ? RADIOLIB_LORA_DETECTED : RADIOLIB_CHANNEL_FREE;
+}
+
+int16_t SX126x::scanChannel() {
+  int16_t state = startChannelScan();
+  if (state != RADIOLIB_ERR_NONE) return state;
+  while (m_state == State::Cad) {
+    host::Kernel::get().block(m_cadWaiters, host::Kernel::FOREVER);
+  }
+  return getChannelScanResult();
+}
+
+bool SX126x::hostReceive(const uint8_t *data, size_t len, float rssi,
+                         float snr, bool crcOk) {
+  if (m_state != State::Rx) return false;
+
+  m_rxLength = std::min(len, sizeof(m_rxBuffer));
+  memcpy(m_rxBuffer, data, m_rxLength);
+  m_rxCrcOk = crcOk;
+  m_rssi = rssi;
+  m_snr = snr;
+  fireDio1();  // RxDone, the chip stays in continuous receive
+  return true;
+}
+
+void SX126x::fireDio1() {
+  if (m_dio1) m_dio1();
+}
+
+/* =============================== UDP MEDIUM ============================== */
+
+namespace host {
+
+namespace {
+
+// Packets are multicast to every native process on the machine. Each one is
+// delivered to the local radio after its time on air, as long as the radio
+// is still listening on a compatible profile by then.
+class UdpRadioMedium : public RadioMedium {
+ public:
+  void attach(SX126x *radio) override {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (std::find(m_radios.begin(), m_radios.end(), radio) == m_radios.end()) {
+      m_radios.push_back(radio);
+    }
+    std::call_once(m_started, [this] { start(); });
+  }
+
+  void detach(SX126x *radio) override {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_radios.erase(std::remove(m_radios.begin(), m_radios.end(), radio),
+                   m_radios.end());
+  }
+
+  void transmit(SX126x *from, const uint8_t *data, size_t len,
+                Micros airtime) override {
+    if (m_socket < 0) return;
+
+    const LoRaProfile &profile = from->hostProfile();
+    Datagram packet = {};
+    memcpy(packet.magic, "LORA", 4);
+    packet.sender = m_senderId;
+    packet.profile = profile;
+    packet.airtimeUs = static_cast<uint32_t>(airtime);
+    packet.length = static_cast<uint8_t>(len);
+    memcpy(packet.payload, data, len);
+
+    sendto(m_socket, &packet, offsetof(Datagram, payload) + len, 0,
+           reinterpret_cast<sockaddr *>(&m_group), sizeof(m_group));
+  }
+
+  bool channelActive(SX126x *radio) override {
+    (void)radio;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return Kernel::get().now() < m_busyUntil;
+  }
+
+ private:
+  struct Datagram {
+    char magic[4];
+    uint32_t sender;
+    LoRaProfile profile;
+    uint32_t airtimeUs;
+    uint8_t length;
+    uint8_t payload[RADIOLIB_SX126X_MAX_PACKET_LENGTH];
+  };
+
+  void start() {
+    const char *portEnv = getenv("HOST_RADIO_PORT");
+    uint16_t port = portEnv ? static_cast<uint16_t>(atoi(portEnv)) : 47000;
+    m_senderId = static_cast<uint32_t>(getpid()) ^ 0x5A5A0000u;
+
+    m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    int yes = 1;
+    setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    setsockopt(m_socket, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+
+    sockaddr_in local = {};
+    local.sin_family = AF_INET;
+    local.sin_port = htons(port);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    m_group = {};
+    m_group.sin_family = AF_INET;
+    m_group.sin_port = htons(port);
+    m_group.sin_addr.s_addr = inet_addr("239.255.76.67");
+
+    ip_mreq membership = {};
+    membership.imr_multiaddr = m_group.sin_addr;
+    membership.imr_interface.s_addr = htonl(INADDR_LOOPBACK);
+    in_addr loopback = {};
+    loopback.s_addr = htonl(INADDR_LOOPBACK);
+    unsigned char loop = 1;
+
+    if (m_socket < 0 ||
+        bind(m_socket, reinterpret_cast<sockaddr *>(&local), sizeof(local)) <
+            0 ||
+        setsockopt(m_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership,
+                   sizeof(membership)) < 0 ||
+        setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_IF, &loopback,
+                   sizeof(loopback)) < 0 ||
+        setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop,
+                   sizeof(loop)) < 0) {
+      ESP_LOGE(TAG, "UDP radio medium unavailable, radio is isolated");
+      if (m_socket >= 0) close(m_socket);
+      m_socket = -1;
+      return;
+    }
+
+    ESP_LOGI(TAG, "Radio medium on UDP multicast port %u", port);
+    std::thread([this] { receiveLoop(); }).detach();
+  }
+
+  void receiveLoop() {
+    Datagram packet;
+    while (true) {
+      ssize_t n = recv(m_socket, &packet, sizeof(packet), 0);
+      if (n < static_cast<ssize_t>(offsetof(Datagram, payload)) ||
+          memcmp(packet.magic, "LORA", 4) != 0 || packet.sender == m_senderId) {
+        continue;
+      }
+
+      Kernel &kernel = Kernel::get();
+      Micros end = kernel.now() + packet.airtimeUs;
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_busyUntil = std::max(m_busyUntil, end);
+      for (SX126x *radio : m_radios) {
+        kernel.at(
+            end,
+            [radio, packet] {
+              if (!loraCompatible(radio->hostProfile(), packet.profile)) return;
+              radio->hostReceive(packet.payload, packet.length, -40.0f, 10.0f);
+            },
+            radio->hostNode());
+      }
+    }
+  }
+
+  std::once_flag m_started;
+  std::mutex m_mutex;
+  std::vector<SX126x *> m_radios;
+  int m_socket = -1;
+  uint32_t m_senderId = 0;
+  sockaddr_in m_group = {};
+  Micros m_busyUntil = 0;
+};
+
+}  // namespace
+
+RadioMedium *udpRadioMedium() {
+  static UdpRadioMedium medium;
+  return &medium;
+}
+
+}  // namespace host
@@ -0,0 +1,218 @@
+#pragma once
+
+// Host stand-in for the parts of RadioLib used by LoRaCom: a PhysicalLayer
+// interface and an SX1262 that sends its packets into a host::RadioMedium
+// instead of over SPI. Error codes and signatures follow RadioLib 7.x.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "SPI.h"
+#include "WString.h"
+#include "hostKernel.hpp"
+
+#define RADIOLIB_NC (0xFFFFFFFF)
+
+#define RADIOLIB_ERR_NONE (0)
+#define RADIOLIB_ERR_UNKNOWN (-1)
+#define RADIOLIB_ERR_CHIP_NOT_FOUND (-2)
+#define RADIOLIB_ERR_PACKET_TOO_LONG (-4)
+#define RADIOLIB_ERR_TX_TIMEOUT (-5)
+#define RADIOLIB_ERR_RX_TIMEOUT (-6)
+#define RADIOLIB_ERR_CRC_MISMATCH (-7)
+#define RADIOLIB_ERR_INVALID_BANDWIDTH (-8)
+#define RADIOLIB_ERR_INVALID_SPREADING_FACTOR (-9)
+#define RADIOLIB_ERR_INVALID_CODING_RATE (-10)
+#define RADIOLIB_ERR_INVALID_FREQUENCY (-12)
+#define RADIOLIB_ERR_INVALID_OUTPUT_POWER (-13)
+#define RADIOLIB_ERR_INVALID_PREAMBLE_LENGTH (-18)
+#define RADIOLIB_ERR_UNSUPPORTED (-26)
+#define RADIOLIB_LORA_DETECTED (-701)
+#define RADIOLIB_CHANNEL_FREE (-702)
+
+#define RADIOLIB_SX126X_SYNC_WORD_PRIVATE (0x12)
+#define RADIOLIB_SX126X_MAX_PACKET_LENGTH (255)
+
+typedef unsigned long RadioLibTime_t;
+
+class Module {
+ public:
+  Module(uint32_t cs, uint32_t irq, uint32_t rst, uint32_t gpio = RADIOLIB_NC)
+      : cs(cs), irq(irq), rst(rst), gpio(gpio) {}
+
+  uint32_t cs, irq, rst, gpio;
+};
+
+class PhysicalLayer {
+ public:
+  virtual ~PhysicalLayer() = default;
+
+  int16_t startTransmit(const char *str, uint8_t addr = 0);
+  int16_t startTransmit(const String &str, uint8_t addr = 0) {
+    return startTransmit(str.c_str(), addr);
+  }
+  virtual int16_t startTransmit(const uint8_t *data, size_t len,
+                                uint8_t addr = 0);
+  virtual int16_t finishTransmit() { return RADIOLIB_ERR_UNSUPPORTED; }
+  virtual int16_t startReceive() { return RADIOLIB_ERR_UNSUPPORTED; }
+  int16_t readData(String &str, size_t len = 0);
+  virtual int16_t readData(uint8_t *data, size_t len);
+  virtual int16_t standby() { return RADIOLIB_ERR_UNSUPPORTED; }
+
+  virtual int16_t setOutputPower(int8_t power);
+  virtual int16_t setFrequency(float freq);
+
+  virtual float getRSSI() { return 0; }
+  virtual float getSNR() { return 0; }
+  virtual size_t getPacketLength(bool update = true);
+  virtual RadioLibTime_t getTimeOnAir(size_t len);
+
+  virtual void setPacketReceivedAction(void (*func)(void)) { (void)func; }
+  virtual void clearPacketReceivedAction() {}
+  virtual void setPacketSentAction(void (*func)(void)) { (void)func; }
+  virtual void clearPacketSentAction() {}
+
+  virtual int16_t startChannelScan() { return RADIOLIB_ERR_UNSUPPORTED; }
+  virtual int16_t getChannelScanResult() { return RADIOLIB_ERR_UNSUPPORTED; }
+  virtual int16_t scanChannel() { return RADIOLIB_ERR_UNSUPPORTED; }
+};
+
+namespace host {
+
+// Modem settings as programmed into the radio
+struct LoRaProfile {
+  float freqMHz = 434.0f;
+  float bwKHz = 125.0f;
+  uint8_t sf = 9;
+  uint8_t cr = 7;  // 4/cr, 5..8 like RadioLib
+  uint8_t syncWord = RADIOLIB_SX126X_SYNC_WORD_PRIVATE;
+  int8_t powerDbm = 10;
+  uint16_t preambleLength = 8;
+  bool crcOn = true;
+  bool implicitHeader = false;
+};
+
+// Time on air in microseconds, as in the SX126x datasheet (section 6.1.4)
+Micros loraTimeOnAir(const LoRaProfile &profile, size_t len);
+
+// Whether two radios are tuned so that one can demodulate the other
+bool loraCompatible(const LoRaProfile &a, const LoRaProfile &b);
+
+}  // namespace host
+
+class SX126x : public PhysicalLayer {
+ public:
+  explicit SX126x(Module *mod);
+  ~SX126x() override;
+
+  int16_t begin(float freq, float bw, uint8_t sf, uint8_t cr, uint8_t syncWord,
+                int8_t power, uint16_t preambleLength,
+                float tcxoVoltage = 1.6f, bool useRegulatorLDO = false);
+
+  using PhysicalLayer::readData;
+  using PhysicalLayer::startTransmit;
+  int16_t startTransmit(const uint8_t *data, size_t len,
+                        uint8_t addr = 0) override;
+  int16_t finishTransmit() override;
+  int16_t startReceive() override;
+  int16_t readData(uint8_t *data, size_t len) override;
+  int16_t standby() override;
+
+  int16_t setOutputPower(int8_t power) override;
+  int16_t setFrequency(float freq) override;
+  int16_t setBandwidth(float bw);
+  int16_t setSpreadingFactor(uint8_t sf);
+  int16_t setCodingRate(uint8_t cr);
+  int16_t setSyncWord(uint8_t syncWord);
+  int16_t setPreambleLength(size_t preambleLength);
+
+  float getRSSI() override { return m_rssi; }
+  float getSNR() override { return m_snr; }
+  size_t getPacketLength(bool update = true) override;
+  RadioLibTime_t getTimeOnAir(size_t len) override;
+
+  void setDio1Action(void (*func)(void)) { m_dio1 = func; }
+  void clearDio1Action() { m_dio1 = nullptr; }
+  void setPacketReceivedAction(void (*func)(void)) override { m_dio1 = func; }
+  void clearPacketReceivedAction() override { m_dio1 = nullptr; }
+  void setPacketSentAction(void (*func)(void)) override { m_dio1 = func; }
+  void clearPacketSentAction() override { m_dio1 = nullptr; }
+
+  int16_t startChannelScan() override;
+  int16_t getChannelScanResult() override;
+  int16_t scanChannel() override;
+
+  // ----- Host side, used by host::RadioMedium -----
+  enum class State { Sleep, Standby, Tx, Rx, Cad };
+
+  const host::LoRaProfile &hostProfile() const { return m_profile; }
+  State hostState() const { return m_state; }
+  host::Node *hostNode() const { return m_node; }
+
+  // End of a packet that this radio could hear, called in this radio's
+  // interrupt context. Returns false if the radio was not listening.
+  bool hostReceive(const uint8_t *data, size_t len, float rssi, float snr,
+                   bool crcOk = true);
+
+ private:
+  void fireDio1();
+
+  Module *m_mod;
+  host::Node *m_node;
+  host::RadioMedium *m_medium;
+  host::LoRaProfile m_profile;
+  State m_state = State::Sleep;
+  uint32_t m_txToken = 0;
+
+  uint8_t m_rxBuffer[RADIOLIB_SX126X_MAX_PACKET_LENGTH];
+  size_t m_rxLength = 0;
+  bool m_rxCrcOk = true;
+  float m_rssi = 0;
+  float m_snr = 0;
+  bool m_cadDetected = false;
+  host::Kernel::WaitList m_cadWaiters;
+
+  void (*m_dio1)(void) = nullptr;
+};
+
+class SX1262 : public SX126x {
+ public:
+  using SX126x::SX126x;
+
+  int16_t begin(float freq = 434.0f, float bw = 125.0f, uint8_t sf = 9,
+                uint8_t cr = 7,
+                uint8_t syncWord = RADIOLIB_SX126X_SYNC_WORD_PRIVATE,
+                int8_t power = 10, uint16_t preambleLength = 8,
+                float tcxoVoltage = 1.6f, bool useRegulatorLDO = false) {
+    return SX126x::begin(freq, bw, sf, cr, syncWord, power, preambleLength,
+                         tcxoVoltage, useRegulatorLDO);
+  }
+};
+
+namespace host {
+
+// Shared channel that host radios transmit into.
+class RadioMedium {
+ public:
+  virtual ~RadioMedium() = default;
+
+  virtual void attach(SX126x *radio) { (void)radio; }
+  virtual void detach(SX126x *radio) { (void)radio; }
+
+  // `from` started transmitting a packet lasting `airtime`. The medium calls
+  // SX126x::hostReceive() on every radio that hears it once it has ended.
+  virtual void transmit(SX126x *from, const uint8_t *data, size_t len,
+                        Micros airtime) = 0;
+
+  // Whether a channel activity detection on `radio` would see a preamble
+  virtual bool channelActive(SX126x *radio) {
+    (void)radio;
+    return false;
+  }
+};
+
+// Medium shared by all native processes on this machine through UDP
+// multicast on the loopback interface (port HOST_RADIO_PORT, default 47000).
+RadioMedium *udpRadioMedium();
+
+}  // namespace host
@@ -0,0 +1,17 @@
+#pragma once
+
+// Host stand-in for the Arduino SPI bus. The simulated radio does not sit on
+// a bus, so there is nothing to configure.
+
+#include <cstdint>
+
+class SPIClass {
+ public:
+  void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1,
+             int8_t ss = -1) {
+    (void)sck, (void)miso, (void)mosi, (void)ss;
+  }
+  void end() {}
+};
+
+extern SPIClass SPI;
@@ -0,0 +1,112 @@
+#include "WString.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+std::string toBase(unsigned long long value, bool negative,
+                   unsigned char base) {
+  if (base < 2 || base > 36) base = 10;
+  std::string out;
+  do {
+    int digit = static_cast<int>(value % base);
+    out += static_cast<char>(digit < 10 ? '0' + digit : 'a' + digit - 10);
+    value /= base;
+  } while (value != 0);
+  if (negative) out += '-';
+  std::reverse(out.begin(), out.end());
+  return out;
+}
+
+std::string fromSigned(long long value, unsigned char base) {
+  // Arduino only prints a sign for base 10, other bases show the raw bits
+  if (base == 10 && value < 0) {
+    return toBase(0ULL - static_cast<unsigned long long>(value), true, base);
+  }
+  return toBase(static_cast<unsigned long long>(value), false, base);
+}
+
+std::string fromDouble(double value, unsigned int decimalPlaces) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, value);
+  return buf;
+}
+
+}  // namespace
+
+String::String(unsigned char value, unsigned char base)
+    : m_str(toBase(value, false, base)) {}
+String::String(int value, unsigned char base)
+    : m_str(fromSigned(value, base)) {}
+String::String(unsigned int value, unsigned char base)
+    : m_str(toBase(value, false, base)) {}
+String::String(long value, unsigned char base)
+    : m_str(fromSigned(value, base)) {}
+String::String(unsigned long value, unsigned char base)
+    : m_str(toBase(value, false, base)) {}
+String::String(long long value, unsigned char base)
+    : m_str(fromSigned(value, base)) {}
+String::String(unsigned long long value, unsigned char base)
+    : m_str(toBase(value, false, base)) {}
+String::String(float value, unsigned int decimalPlaces)
+    : m_str(fromDouble(value, decimalPlaces)) {}
+String::String(double value, unsigned int decimalPlaces)
+    : m_str(fromDouble(value, decimalPlaces)) {}
+
+bool String::endsWith(const String &suffix) const {
+  if (suffix.m_str.size() > m_str.size()) return false;
+  return m_str.compare(m_str.size() - suffix.m_str.size(), std::string::npos,
+                       suffix.m_str) == 0;
+}
+
+int String::indexOf(char c, size_t from) const {
+  size_t pos = m_str.find(c, from);
+  return pos == std::string::npos ? -1 : static_cast<int>(pos);
+}
+
+int String::indexOf(const String &str, size_t from) const {
+  size_t pos = m_str.find(str.m_str, from);
+  return pos == std::string::npos ? -1 : static_cast<int>(pos);
+}
+
+int String::lastIndexOf(char c) const {
+  size_t pos = m_str.rfind(c);
+  return pos == std::string::npos ? -1 : static_cast<int>(pos);
+}
+
+int String::lastIndexOf(const String &str) const {
+  size_t pos = m_str.rfind(str.m_str);
+  return pos == std::string::npos ? -1 : static_cast<int>(pos);
+}
+
+String String::substring(size_t from) const {
+  return substring(from, m_str.size());
+}
+
+String String::substring(size_t from, size_t to) const {
+  if (from > to) std::swap(from, to);
+  if (from >= m_str.size()) return String();
+  return String(m_str.substr(from, std::min(to, m_str.size()) - from));
+}
+
+void String::trim() {
+  auto isSpace = [](unsigned char c) { return std::isspace(c) != 0; };
+  auto first = std::find_if_not(m_str.begin(), m_str.end(), isSpace);
+  auto last = std::find_if_not(m_str.rbegin(), m_str.rend(), isSpace).base();
+  m_str = (first < last) ? std::string(first, last) : std::string();
+}
+
+void String::toLowerCase() {
+  for (char &c : m_str) c = static_cast<char>(std::tolower((unsigned char)c));
+}
+
+void String::toUpperCase() {
+  for (char &c : m_str) c = static_cast<char>(std::toupper((unsigned char)c));
+}
+
+long String::toInt() const { return strtol(m_str.c_str(), nullptr, 10); }
+
+float String::toFloat() const { return strtof(m_str.c_str(), nullptr); }
@@ -0,0 +1,100 @@
+#pragma once
+
+// Host stand-in for the Arduino String class, backed by std::string. Covers
+// the subset used by the firmware.
+
+#include <cstddef>
+#include <string>
+
+class String {
+ public:
+  String() = default;
+  String(const char *cstr) : m_str(cstr ? cstr : "") {}
+  String(const char *cstr, size_t length) : m_str(cstr, length) {}
+  String(const std::string &str) : m_str(str) {}
+  explicit String(char c) : m_str(1, c) {}
+  explicit String(unsigned char value, unsigned char base = 10);
+  explicit String(int value, unsigned char base = 10);
+  explicit String(unsigned int value, unsigned char base = 10);
+  explicit String(long value, unsigned char base = 10);
+  explicit String(unsigned long value, unsigned char base = 10);
+  explicit String(long long value, unsigned char base = 10);
+  explicit String(unsigned long long value, unsigned char base = 10);
+  explicit String(float value, unsigned int decimalPlaces = 2);
+  explicit String(double value, unsigned int decimalPlaces = 2);
+
+  size_t length() const { return m_str.length(); }
+  bool isEmpty() const { return m_str.empty(); }
+  const char *c_str() const { return m_str.c_str(); }
+  bool reserve(size_t size) {
+    m_str.reserve(size);
+    return true;
+  }
+  void clear() { m_str.clear(); }
+
+  String &operator+=(const String &rhs) {
+    m_str += rhs.m_str;
+    return *this;
+  }
+  String &operator+=(const char *rhs) {
+    m_str += rhs;
+    return *this;
+  }
+  String &operator+=(char rhs) {
+    m_str += rhs;
+    return *this;
+  }
+  bool concat(const String &rhs) {
+    m_str += rhs.m_str;
+    return true;
+  }
+  bool concat(const char *rhs, size_t length) {
+    m_str.append(rhs, length);
+    return true;
+  }
+
+  friend String operator+(const String &lhs, const String &rhs) {
+    return String(lhs.m_str + rhs.m_str);
+  }
+  friend String operator+(const String &lhs, const char *rhs) {
+    return String(lhs.m_str + rhs);
+  }
+  friend String operator+(const char *lhs, const String &rhs) {
+    return String(lhs + rhs.m_str);
+  }
+  friend String operator+(const String &lhs, char rhs) {
+    return String(lhs.m_str + rhs);
+  }
+
+  bool operator==(const String &rhs) const { return m_str == rhs.m_str; }
+  bool operator==(const char *rhs) const { return m_str == rhs; }
+  bool operator!=(const String &rhs) const { return m_str != rhs.m_str; }
+  bool operator!=(const char *rhs) const { return m_str != rhs; }
+  bool equals(const String &rhs) const { return m_str == rhs.m_str; }
+  bool equals(const char *rhs) const { return m_str == rhs; }
+  bool startsWith(const String &prefix) const {
+    return m_str.compare(0, prefix.m_str.size(), prefix.m_str) == 0;
+  }
+  bool endsWith(const String &suffix) const;
+
+  char operator[](size_t index) const {
+    return index < m_str.size() ? m_str[index] : '\0';
+  }
+  char charAt(size_t index) const { return (*this)[index]; }
+
+  int indexOf(char c, size_t from = 0) const;
+  int indexOf(const String &str, size_t from = 0) const;
+  int lastIndexOf(char c) const;
+  int lastIndexOf(const String &str) const;
+  String substring(size_t from) const;
+  String substring(size_t from, size_t to) const;
+
+  void trim();
+  void toLowerCase();
+  void toUpperCase();
+  long toInt() const;
+  float toFloat() const;
+
+ private:
+  std::string m_str;
+};
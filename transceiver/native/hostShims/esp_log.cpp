@@ -0,0 +1,35 @@
+#include "esp_log.h"
+
+#include <cstdarg>
+#include <cstdio>
+
+#include "hostKernel.hpp"
+
+namespace {
+
+esp_log_level_t s_level = static_cast<esp_log_level_t>(CORE_DEBUG_LEVEL);
+
+}  // namespace
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+  (void)tag;  // one global level is enough on the host
+  s_level = level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format,
+                   ...) {
+  if (level > s_level) return;
+
+  static const char letters[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+  host::Kernel &kernel = host::Kernel::get();
+
+  char line[512];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+
+  fprintf(stderr, "[%8llu][%c][%s][%s] %s\n",
+          static_cast<unsigned long long>(kernel.now() / 1000), letters[level],
+          kernel.currentNode()->name.c_str(), tag, line);
+}
@@ -0,0 +1,204 @@
+#include "esp_partition.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "esp_log.h"
+#include "hostKernel.hpp"
+
+namespace {
+
+constexpr size_t SECTOR_SIZE = 4096;
+constexpr size_t PAGE_SIZE = 256;
+
+struct TableEntry {
+  const char *label;
+  esp_partition_type_t type;
+  uint8_t subtype;
+  uint32_t address;
+  uint32_t size;
+};
+
+// partitions_rawlog.csv
+constexpr TableEntry TABLE[] = {
+    {"spiffs", ESP_PARTITION_TYPE_DATA, 0x82, 0x290000, 0xB0000},
+    {"log", ESP_PARTITION_TYPE_DATA, 0x40, 0x340000, 0xB0000},
+};
+
+// esp_partition_t comes first so the public pointer converts back
+struct HostPartition {
+  esp_partition_t partition;
+  std::string path;
+  std::vector<uint8_t> data;
+  std::vector<uint32_t> erases;  // per sector
+  host::FlashStats stats;
+  int fd = -1;  // backing file, kept open
+  bool powerCut = false;  // writes stop after writeBudget more bytes
+  size_t writeBudget = 0;
+
+  // Mirror a changed range into the file so the content survives a restart
+  void store(size_t offset, size_t size) {
+    if (fd >= 0) pwrite(fd, data.data() + offset, size, offset);
+  }
+};
+
+// One set of partitions per node, like one flash chip per device
+std::map<std::pair<host::Node *, std::string>, std::unique_ptr<HostPartition>>
+    partitions;
+
+HostPartition *toHost(const esp_partition_t *partition) {
+  return reinterpret_cast<HostPartition *>(
+      const_cast<esp_partition_t *>(partition));
+}
+
+bool inRange(const esp_partition_t *partition, size_t offset, size_t size) {
+  return partition != nullptr && offset <= partition->size &&
+         size <= partition->size - offset;
+}
+
+}  // namespace
+
+const char *esp_err_to_name(esp_err_t code) {
+  switch (code) {
+    case ESP_OK:
+      return "ESP_OK";
+    case ESP_FAIL:
+      return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+      return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+      return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+      return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+      return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+      return "ESP_ERR_NOT_FOUND";
+  }
+  return "UNKNOWN ERROR";
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char *label) {
+  for (const TableEntry &entry : TABLE) {
+    if (entry.type != type) continue;
+    if (subtype != ESP_PARTITION_SUBTYPE_ANY && entry.subtype != subtype) {
+      continue;
+    }
+    if (label != nullptr && strcmp(label, entry.label) != 0) continue;
+
+    host::Node *node = host::Kernel::get().currentNode();
+    auto &slot = partitions[{node, entry.label}];
+    if (!slot) {
+      slot = std::make_unique<HostPartition>();
+      esp_partition_t &partition = slot->partition;
+      partition.flash_chip = nullptr;
+      partition.type = entry.type;
+      partition.subtype = static_cast<esp_partition_subtype_t>(entry.subtype);
+      partition.address = entry.address;
+      partition.size = entry.size;
+      snprintf(partition.label, sizeof(partition.label), "%s", entry.label);
+      partition.encrypted = false;
+
+      // A new chip is fully erased, an existing file keeps its content
+      slot->path = node->fsRoot + "." + entry.label + ".bin";
+      slot->data.assign(entry.size, 0xFF);
+      slot->erases.assign(entry.size / SECTOR_SIZE, 0);
+      slot->fd = open(slot->path.c_str(), O_RDWR | O_CREAT, 0644);
+      if (slot->fd < 0) {
+        ESP_LOGE("partition", "Cannot open %s", slot->path.c_str());
+      } else if (pread(slot->fd, slot->data.data(), slot->data.size(), 0) !=
+                 static_cast<ssize_t>(slot->data.size())) {
+        slot->data.assign(entry.size, 0xFF);
+        slot->store(0, slot->data.size());
+      }
+    }
+    return &slot->partition;
+  }
+  return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition,
+                             size_t src_offset, void *dst, size_t size) {
+  if (!inRange(partition, src_offset, size)) return ESP_ERR_INVALID_SIZE;
+  HostPartition *host = toHost(partition);
+  memcpy(dst, host->data.data() + src_offset, size);
+  host->stats.bytesRead += size;
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition,
+                              size_t dst_offset, const void *src, size_t size) {
+  if (!inRange(partition, dst_offset, size)) return ESP_ERR_INVALID_SIZE;
+  if (size == 0) return ESP_OK;
+  HostPartition *host = toHost(partition);
+  size_t written = size;
+  if (host->powerCut) {
+    written = std::min(size, host->writeBudget);
+    host->writeBudget -= written;
+    if (written == 0) return ESP_FAIL;
+  }
+
+  // NOR flash: programming only turns ones into zeros
+  const uint8_t *in = static_cast<const uint8_t *>(src);
+  for (size_t i = 0; i < written; i++) host->data[dst_offset + i] &= in[i];
+  host->store(dst_offset, written);
+
+  host->stats.bytesWritten += written;
+  host->stats.pagesProgrammed +=
+      (dst_offset + written - 1) / PAGE_SIZE - dst_offset / PAGE_SIZE + 1;
+  return written == size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition,
+                                    size_t offset, size_t size) {
+  if (!inRange(partition, offset, size)) return ESP_ERR_INVALID_SIZE;
+  if (offset % SECTOR_SIZE != 0 || size % SECTOR_SIZE != 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  HostPartition *host = toHost(partition);
+  if (host->powerCut && host->writeBudget == 0) return ESP_FAIL;
+
+  memset(host->data.data() + offset, 0xFF, size);
+  host->store(offset, size);
+  for (size_t sector = offset / SECTOR_SIZE;
+       sector < (offset + size) / SECTOR_SIZE; sector++) {
+    host->erases[sector]++;
+    host->stats.sectorErases++;
+  }
+  return ESP_OK;
+}
+
+namespace host {
+
+FlashStats partitionStats(const esp_partition_t *partition) {
+  if (partition == nullptr) return FlashStats();
+  HostPartition *host = toHost(partition);
+  FlashStats stats = host->stats;
+  auto [least, most] =
+      std::minmax_element(host->erases.begin(), host->erases.end());
+  stats.minSectorErases = *least;
+  stats.maxSectorErases = *most;
+  return stats;
+}
+
+void cutPowerAfter(const esp_partition_t *partition, size_t bytes) {
+  if (partition == nullptr) return;
+  toHost(partition)->powerCut = true;
+  toHost(partition)->writeBudget = bytes;
+}
+
+void restorePower(const esp_partition_t *partition) {
+  if (partition != nullptr) toHost(partition)->powerCut = false;
+}
+
+}  // namespace host
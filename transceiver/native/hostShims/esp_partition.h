@@ -0,0 +1,65 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF partition API. Partitions are files next to
+// the node's LittleFS directory ("<fsRoot>.<label>.bin") that behave like NOR
+// flash: erasing sets whole 4 KiB sectors to 0xFF, writing can only clear
+// bits. Every access is counted so flash throughput and wear can be compared
+// on the host (see host::partitionStats()).
+//
+// The table matches partitions_rawlog.csv.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "esp_err.h"
+
+typedef enum {
+  ESP_PARTITION_TYPE_APP = 0x00,
+  ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef enum {
+  ESP_PARTITION_SUBTYPE_DATA_SPIFFS = 0x82,
+  ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+typedef struct {
+  void *flash_chip;
+  esp_partition_type_t type;
+  esp_partition_subtype_t subtype;
+  uint32_t address;
+  uint32_t size;
+  char label[17];
+  bool encrypted;
+} esp_partition_t;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *partition,
+                             size_t src_offset, void *dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *partition,
+                              size_t dst_offset, const void *src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition,
+                                    size_t offset, size_t size);
+
+namespace host {
+
+struct FlashStats {
+  uint64_t bytesRead = 0;
+  uint64_t bytesWritten = 0;
+  uint64_t pagesProgrammed = 0;  // 256 byte program pages touched by writes
+  uint32_t sectorErases = 0;
+  uint32_t maxSectorErases = 0;  // erases of the most worn sector
+  uint32_t minSectorErases = 0;  // erases of the least worn sector
+};
+
+FlashStats partitionStats(const esp_partition_t *partition);
+
+// Emulates a power loss: only `bytes` more bytes reach the partition, the
+// write that crosses that stops there and fails, and so does everything
+// after it until restorePower(). Checks that a log survives a torn record.
+void cutPowerAfter(const esp_partition_t *partition, size_t bytes);
+void restorePower(const esp_partition_t *partition);
+
+}  // namespace host
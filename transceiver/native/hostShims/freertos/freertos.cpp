@@ -0,0 +1,212 @@
+#include <cstring>
+#include <vector>
+
+#include "../hostKernel.hpp"
+#include "queue.h"
+#include "task.h"
+
+using host::Kernel;
+using host::Micros;
+
+namespace {
+
+Micros ticksToMicros(TickType_t ticks) {
+  return static_cast<Micros>(ticks) * (1'000'000 / configTICK_RATE_HZ);
+}
+
+Micros deadlineAfter(TickType_t ticks) {
+  if (ticks == portMAX_DELAY) return Kernel::FOREVER;
+  return Kernel::get().now() + ticksToMicros(ticks);
+}
+
+Kernel::Task *toTask(TaskHandle_t handle) {
+  return reinterpret_cast<Kernel::Task *>(handle);
+}
+
+}  // namespace
+
+/* ================================= TASKS ================================= */
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char *pcName,
+                       uint32_t usStackDepth, void *pvParameters,
+                       UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask) {
+  (void)usStackDepth;  // host threads get the default stack
+  Kernel::Task *task = Kernel::get().spawn(
+      [pxTaskCode, pvParameters] { pxTaskCode(pvParameters); }, pcName,
+      uxPriority);
+  if (pxCreatedTask) *pxCreatedTask = reinterpret_cast<TaskHandle_t>(task);
+  return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode,
+                                   const char *pcName, uint32_t usStackDepth,
+                                   void *pvParameters, UBaseType_t uxPriority,
+                                   TaskHandle_t *pxCreatedTask,
+                                   BaseType_t xCoreID) {
+  (void)xCoreID;
+  return xTaskCreate(pxTaskCode, pcName, usStackDepth, pvParameters,
+                     uxPriority, pxCreatedTask);
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete) {
+  Kernel::get().remove(toTask(xTaskToDelete));
+}
+
+void vTaskDelay(TickType_t xTicksToDelay) {
+  Kernel &kernel = Kernel::get();
+  if (xTicksToDelay == 0) {
+    kernel.yield();
+    return;
+  }
+  kernel.sleepUntil(kernel.now() + ticksToMicros(xTicksToDelay));
+}
+
+void vTaskDelayUntil(TickType_t *pxPreviousWakeTime,
+                     TickType_t xTimeIncrement) {
+  *pxPreviousWakeTime += xTimeIncrement;
+  Kernel::get().sleepUntil(ticksToMicros(*pxPreviousWakeTime));
+}
+
+TickType_t xTaskGetTickCount(void) {
+  return static_cast<TickType_t>(Kernel::get().now() /
+                                 (1'000'000 / configTICK_RATE_HZ));
+}
+
+TickType_t xTaskGetTickCountFromISR(void) { return xTaskGetTickCount(); }
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  return reinterpret_cast<TaskHandle_t>(Kernel::get().current());
+}
+
+const char *pcTaskGetName(TaskHandle_t xTaskToQuery) {
+  Kernel &kernel = Kernel::get();
+  return kernel.taskName(xTaskToQuery ? toTask(xTaskToQuery)
+                                      : kernel.current());
+}
+
+void vTaskYield(void) { Kernel::get().yield(); }
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit,
+                          TickType_t xTicksToWait) {
+  return Kernel::get().notifyTake(xClearCountOnExit != pdFALSE,
+                                  deadlineAfter(xTicksToWait));
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify) {
+  Kernel::get().notifyGive(toTask(xTaskToNotify));
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify,
+                            BaseType_t *pxHigherPriorityTaskWoken) {
+  Kernel::get().notifyGive(toTask(xTaskToNotify));
+  // The woken task runs as soon as the interrupt returns anyway
+  if (pxHigherPriorityTaskWoken) *pxHigherPriorityTaskWoken = pdFALSE;
+}
+
+/* ================================ QUEUES ================================= */
+
+// Items are copied in and out by value like the real queue. No locking is
+// needed because only the baton holder (or an interrupt) ever touches it.
+struct QueueDefinition {
+  size_t length;
+  size_t itemSize;
+  std::vector<uint8_t> storage;
+  size_t head = 0;
+  size_t count = 0;
+  Kernel::WaitList senders;
+  Kernel::WaitList receivers;
+
+  bool push(const void *item) {
+    if (count == length) return false;
+    size_t tail = (head + count) % length;
+    if (itemSize > 0) memcpy(storage.data() + tail * itemSize, item, itemSize);
+    count++;
+    Kernel::get().wakeAll(receivers);
+    return true;
+  }
+
+  bool pop(void *item, bool remove) {
+    if (count == 0) return false;
+    if (itemSize > 0) memcpy(item, storage.data() + head * itemSize, itemSize);
+    if (remove) {
+      head = (head + 1) % length;
+      count--;
+      Kernel::get().wakeAll(senders);
+    }
+    return true;
+  }
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize) {
+  if (uxQueueLength == 0) return nullptr;
+  auto *queue = new QueueDefinition{uxQueueLength, uxItemSize};
+  queue->storage.resize(static_cast<size_t>(uxQueueLength) * uxItemSize);
+  return queue;
+}
+
+void vQueueDelete(QueueHandle_t xQueue) { delete xQueue; }
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue,
+                      TickType_t xTicksToWait) {
+  Micros deadline = deadlineAfter(xTicksToWait);
+  while (!xQueue->push(pvItemToQueue)) {
+    if (xTicksToWait == 0 || !Kernel::get().block(xQueue->senders, deadline)) {
+      return errQUEUE_FULL;
+    }
+  }
+  return pdPASS;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t xQueue, const void *pvItemToQueue,
+                            TickType_t xTicksToWait) {
+  return xQueueSend(xQueue, pvItemToQueue, xTicksToWait);
+}
+
+static BaseType_t queueTake(QueueHandle_t xQueue, void *pvBuffer,
+                            TickType_t xTicksToWait, bool remove) {
+  Micros deadline = deadlineAfter(xTicksToWait);
+  while (!xQueue->pop(pvBuffer, remove)) {
+    if (xTicksToWait == 0 ||
+        !Kernel::get().block(xQueue->receivers, deadline)) {
+      return errQUEUE_EMPTY;
+    }
+  }
+  return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer,
+                         TickType_t xTicksToWait) {
+  return queueTake(xQueue, pvBuffer, xTicksToWait, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t xQueue, void *pvBuffer,
+                      TickType_t xTicksToWait) {
+  return queueTake(xQueue, pvBuffer, xTicksToWait, false);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t xQueue, const void *pvItemToQueue,
+                             BaseType_t *pxHigherPriorityTaskWoken) {
+  if (pxHigherPriorityTaskWoken) *pxHigherPriorityTaskWoken = pdFALSE;
+  return xQueue->push(pvItemToQueue) ? pdPASS : errQUEUE_FULL;
+}
+
+BaseType_t xQueueReceiveFromISR(QueueHandle_t xQueue, void *pvBuffer,
+                                BaseType_t *pxHigherPriorityTaskWoken) {
+  if (pxHigherPriorityTaskWoken) *pxHigherPriorityTaskWoken = pdFALSE;
+  return xQueue->pop(pvBuffer, true) ? pdPASS : errQUEUE_EMPTY;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue) {
+  return xQueue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t xQueue) {
+  return xQueue->length - xQueue->count;
+}
+
+BaseType_t xQueueReset(QueueHandle_t xQueue) {
+  xQueue->head = 0;
+  xQueue->count = 0;
+  return pdPASS;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "queue.h"
+
+// Like FreeRTOS itself, a mutex is a queue of length one with no item data
+// that starts out full. There is no priority inheritance on the host.
+typedef QueueHandle_t SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+  SemaphoreHandle_t mutex = xQueueCreate(1, 0);
+  xQueueSend(mutex, nullptr, 0);
+  return mutex;
+}
+
+#define vSemaphoreDelete(xSemaphore) vQueueDelete(xSemaphore)
+#define xSemaphoreTake(xSemaphore, xBlockTime) \
+  xQueueReceive((xSemaphore), nullptr, (xBlockTime))
+#define xSemaphoreGive(xSemaphore) xQueueSend((xSemaphore), nullptr, 0)
@@ -0,0 +1,361 @@
+#include "hostKernel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace host {
+
+struct Kernel::Task {
+  enum class State { Ready, Running, Sleeping, Blocked, Dead };
+
+  std::string name;
+  unsigned priority = 0;
+  Node *node = nullptr;
+  Entry entry;
+
+  State state = State::Ready;
+  WaitList *waitList = nullptr;
+  uint64_t sleepToken = 0;  // invalidates stale entries in m_sleepers
+  bool timedOut = false;
+
+  uint32_t notifyValue = 0;
+  WaitList notifyWaiters;  // only ever holds the task itself
+
+  bool started = false;
+  std::condition_variable cv;        // thread backend
+  ucontext_t context;                // fiber backend
+  std::unique_ptr<char[]> stack;
+};
+
+namespace {
+
+constexpr size_t FIBER_STACK_SIZE = 256 * 1024;
+
+}  // namespace
+
+Kernel &Kernel::get() {
+  static Kernel kernel;
+  return kernel;
+}
+
+Micros Kernel::clockNow() {
+  if (m_virtual) return m_virtualNow;
+
+  static const auto start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+Micros Kernel::now() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return clockNow();
+}
+
+Node *Kernel::currentNode() {
+  return m_lastNode ? m_lastNode : &m_defaultNode;
+}
+
+const char *Kernel::taskName(Task *task) const {
+  return task ? task->name.c_str() : "isr";
+}
+
+bool Kernel::timerLater(const Timer &a, const Timer &b) {
+  return a.when != b.when ? a.when > b.when : a.order > b.order;
+}
+
+bool Kernel::sleeperLater(const Sleeper &a, const Sleeper &b) {
+  return a.when != b.when ? a.when > b.when : a.order > b.order;
+}
+
+void Kernel::enterNode(Node *node) {
+  if (m_lastNode == node) return;
+  m_lastNode = node;
+  if (node->onEnter) node->onEnter();
+}
+
+/* ================================= TASKS ================================= */
+
+Kernel::Task *Kernel::spawn(Entry entry, const char *name, unsigned priority,
+                            Node *node) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto task = std::make_unique<Task>();
+  task->name = name ? name : "";
+  task->priority = priority;
+  task->node = node ? node : currentNode();
+  task->entry = std::move(entry);
+  m_tasks.push_back(std::move(task));
+  makeReady(m_tasks.back().get());
+  m_schedCv.notify_all();
+  return m_tasks.back().get();
+}
+
+void Kernel::remove(Task *task) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (task == nullptr) task = m_current;
+  if (task == nullptr || task->state == Task::State::Dead) return;
+
+  if (task->state == Task::State::Ready) {
+    auto &queue = m_ready[task->priority];
+    queue.erase(std::remove(queue.begin(), queue.end(), task), queue.end());
+  }
+  detachFromWaitList(task);
+  task->sleepToken++;
+  task->state = Task::State::Dead;
+
+  // A deleted task never gets the baton again, its thread (or fiber) stays
+  // parked.
+  if (task == m_current) giveBack(lock, task);
+}
+
+void Kernel::makeReady(Task *task) {
+  task->state = Task::State::Ready;
+  if (m_ready.size() <= task->priority) m_ready.resize(task->priority + 1);
+  m_ready[task->priority].push_back(task);
+}
+
+void Kernel::addSleeper(Task *task, Micros when) {
+  m_sleepers.push_back({when, m_order++, task, ++task->sleepToken});
+  std::push_heap(m_sleepers.begin(), m_sleepers.end(), sleeperLater);
+}
+
+void Kernel::detachFromWaitList(Task *task) {
+  if (task->waitList == nullptr) return;
+  auto &tasks = task->waitList->tasks;
+  tasks.erase(std::remove(tasks.begin(), tasks.end(), task), tasks.end());
+  task->waitList = nullptr;
+}
+
+void Kernel::giveBack(std::unique_lock<std::mutex> &lock, Task *self) {
+  m_current = nullptr;
+  if (m_virtual) {
+    lock.unlock();
+    swapcontext(&self->context, &m_schedContext);
+    lock.lock();
+    return;
+  }
+  m_schedCv.notify_all();
+  self->cv.wait(lock, [&] { return m_current == self; });
+}
+
+void Kernel::fiberEntry() {
+  Kernel &kernel = get();
+  Task *task = kernel.m_current;
+  task->entry();
+  // Returning from a task function deletes the task
+  kernel.remove(task);
+}
+
+// Hand the baton to `task` and wait until it gives it back
+void Kernel::resume(std::unique_lock<std::mutex> &lock, Task *task) {
+  m_current = task;
+
+  if (m_virtual) {
+    if (!task->started) {
+      task->started = true;
+      task->stack.reset(new char[FIBER_STACK_SIZE]);
+      getcontext(&task->context);
+      task->context.uc_stack.ss_sp = task->stack.get();
+      task->context.uc_stack.ss_size = FIBER_STACK_SIZE;
+      task->context.uc_link = nullptr;
+      makecontext(&task->context, fiberEntry, 0);
+    }
+    lock.unlock();
+    swapcontext(&m_schedContext, &task->context);
+    lock.lock();
+    return;
+  }
+
+  if (!task->started) {
+    task->started = true;
+    std::thread([this, task] {
+      {
+        std::unique_lock<std::mutex> taskLock(m_mutex);
+        task->cv.wait(taskLock, [&] { return m_current == task; });
+      }
+      task->entry();
+      // Returning from a task function deletes the task
+      remove(task);
+    }).detach();
+  } else {
+    task->cv.notify_one();
+  }
+  m_schedCv.wait(lock, [&] { return m_current == nullptr; });
+}
+
+void Kernel::sleepUntil(Micros wakeAt) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  Task *self = m_current;
+  if (self == nullptr) return;  // not called from a task
+
+  self->state = Task::State::Sleeping;
+  addSleeper(self, wakeAt);
+  giveBack(lock, self);
+}
+
+void Kernel::yield() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  Task *self = m_current;
+  if (self == nullptr) return;
+
+  makeReady(self);
+  giveBack(lock, self);
+}
+
+bool Kernel::block(WaitList &list, Micros deadline) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  Task *self = m_current;
+  if (self == nullptr) return false;
+
+  self->state = Task::State::Blocked;
+  self->waitList = &list;
+  self->timedOut = false;
+  list.tasks.push_back(self);
+  if (deadline != FOREVER) addSleeper(self, deadline);
+  giveBack(lock, self);
+  return !self->timedOut;
+}
+
+void Kernel::wakeAll(WaitList &list) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (Task *task : list.tasks) {
+    task->waitList = nullptr;
+    task->sleepToken++;  // cancel the timeout
+    makeReady(task);
+  }
+  list.tasks.clear();
+}
+
+uint32_t Kernel::notifyTake(bool clearOnExit, Micros deadline) {
+  Task *self = m_current;
+  if (self == nullptr) return 0;
+
+  bool timedOut = false;
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      uint32_t value = self->notifyValue;
+      if (value > 0) {
+        self->notifyValue = clearOnExit ? 0 : value - 1;
+        return value;
+      }
+      if (timedOut) return 0;
+    }
+    timedOut = !block(self->notifyWaiters, deadline);
+  }
+}
+
+void Kernel::notifyGive(Task *task) {
+  if (task == nullptr) return;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (task->state == Task::State::Dead) return;
+    task->notifyValue++;
+  }
+  wakeAll(task->notifyWaiters);
+}
+
+/* ============================== INTERRUPTS =============================== */
+
+void Kernel::raiseIrq(Entry fn, Node *node) { at(0, std::move(fn), node); }
+
+void Kernel::at(Micros when, Entry fn, Node *node) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (node == nullptr) node = currentNode();
+  m_timers.push_back({when, m_order++, std::move(fn), node});
+  std::push_heap(m_timers.begin(), m_timers.end(), timerLater);
+  m_schedCv.notify_all();
+}
+
+void Kernel::runTimers(std::unique_lock<std::mutex> &lock) {
+  while (!m_timers.empty() && m_timers.front().when <= clockNow()) {
+    std::pop_heap(m_timers.begin(), m_timers.end(), timerLater);
+    Timer timer = std::move(m_timers.back());
+    m_timers.pop_back();
+
+    // Interrupt handlers run with the baton held by the scheduler, so no task
+    // is running while they execute.
+    enterNode(timer.node);
+    lock.unlock();
+    timer.fn();
+    lock.lock();
+  }
+}
+
+/* =============================== SCHEDULER =============================== */
+
+void Kernel::wakeSleepers() {
+  Micros now = clockNow();
+  while (!m_sleepers.empty() && m_sleepers.front().when <= now) {
+    std::pop_heap(m_sleepers.begin(), m_sleepers.end(), sleeperLater);
+    Sleeper sleeper = m_sleepers.back();
+    m_sleepers.pop_back();
+
+    Task *task = sleeper.task;
+    if (sleeper.token != task->sleepToken) continue;  // woken up earlier
+    if (task->state == Task::State::Blocked) {
+      detachFromWaitList(task);
+      task->timedOut = true;
+    }
+    makeReady(task);
+  }
+}
+
+Kernel::Task *Kernel::pickReady() {
+  for (size_t prio = m_ready.size(); prio-- > 0;) {
+    auto &queue = m_ready[prio];
+    if (!queue.empty()) {
+      Task *task = queue.front();
+      queue.pop_front();
+      return task;
+    }
+  }
+  return nullptr;
+}
+
+Micros Kernel::nextWakeup() {
+  while (!m_sleepers.empty() &&
+         m_sleepers.front().token != m_sleepers.front().task->sleepToken) {
+    std::pop_heap(m_sleepers.begin(), m_sleepers.end(), sleeperLater);
+    m_sleepers.pop_back();
+  }
+
+  Micros next = m_timers.empty() ? FOREVER : m_timers.front().when;
+  if (!m_sleepers.empty()) next = std::min(next, m_sleepers.front().when);
+  return next;
+}
+
+void Kernel::run(Micros until) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  while (true) {
+    runTimers(lock);
+    wakeSleepers();
+
+    Micros now = clockNow();
+    if (now >= until) break;
+
+    Task *task = pickReady();
+    if (task) {
+      task->state = Task::State::Running;
+      enterNode(task->node);
+      m_switches++;
+      resume(lock, task);
+      continue;
+    }
+
+    Micros next = std::min(nextWakeup(), until);
+    if (m_virtual) {
+      if (next == FOREVER) break;  // nothing left that could ever happen
+      m_virtualNow = std::max(m_virtualNow, next);
+    } else if (next == FOREVER) {
+      m_schedCv.wait(lock);
+    } else {
+      Micros delta = next > now ? next - now : 0;
+      m_schedCv.wait_for(lock, std::chrono::microseconds(delta));
+    }
+  }
+}
+
+}  // namespace host
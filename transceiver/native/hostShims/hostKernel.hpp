@@ -0,0 +1,164 @@
+#pragma once
+
+// Host stand-in for the FreeRTOS scheduler used by the native build.
+//
+// Every FreeRTOS task is backed by its own std::thread, but only one of them
+// holds the "baton" at a time, the same way the single-core ESP32-C3 only runs
+// one task at a time. A task gives the baton back whenever it blocks
+// (vTaskDelay, queue receive, ...), the scheduler then runs any pending
+// interrupts and hands the baton to the highest priority ready task.
+//
+// The clock is either the wall clock (native firmware build) or a virtual
+// clock that jumps straight to the next wakeup (simulator), so the same
+// firmware code runs unchanged in both. With virtual time, tasks run as
+// ucontext fibers on the scheduler thread instead, since a simulator with
+// hundreds of nodes switches tasks far too often for OS thread handoffs.
+
+#include <ucontext.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace host {
+
+using Micros = uint64_t;
+
+class SerialPort;
+class RadioMedium;
+
+// Per-node context. The native build runs a single node, the simulator runs
+// many of them inside one kernel. Tasks inherit the node of their creator.
+struct Node {
+  int id = 0;
+  std::string name = "node";
+  SerialPort *serial = nullptr;      // backend for the global `Serial`
+  std::string fsRoot = ".littlefs";  // directory standing in for LittleFS
+  size_t fsTotalBytes = 1'441'792;   // default ESP32-C3 spiffs partition size
+  RadioMedium *medium = nullptr;     // channel that new radios attach to
+  uint32_t mac = 0;                  // NIC bytes of ESP.getEfuseMac(), 0 = hash
+                                     // of the name
+
+  // Called whenever the scheduler switches to a task or interrupt of this
+  // node, used by the simulator to swap per-node globals.
+  std::function<void()> onEnter;
+};
+
+class Kernel {
+ public:
+  using Entry = std::function<void()>;
+
+  static constexpr Micros FOREVER = UINT64_MAX;
+
+  struct Task;
+
+  // Tasks blocked on one object (a queue, a notification, ...)
+  struct WaitList {
+    std::vector<Task *> tasks;
+  };
+
+  static Kernel &get();
+
+  // Must be called before run(). Virtual time makes the clock jump to the
+  // next event instead of sleeping.
+  void useVirtualTime(bool enable) { m_virtual = enable; }
+  bool virtualTime() const { return m_virtual; }
+
+  Micros now();
+
+  Task *spawn(Entry entry, const char *name, unsigned priority,
+              Node *node = nullptr);
+  void remove(Task *task);
+  Task *current() const { return m_current; }
+  Node *currentNode();
+  const char *taskName(Task *task) const;
+
+  // ----- Called from task context -----
+  void sleepUntil(Micros wakeAt);
+  void yield();
+  // Block on `list` until woken or the deadline passes. Returns false on
+  // timeout. Callers re-check their condition after waking up.
+  bool block(WaitList &list, Micros deadline);
+
+  // Wait until the notification value of the calling task is non-zero or
+  // the deadline passes. Returns the value before it was cleared (or
+  // decremented), 0 on timeout.
+  uint32_t notifyTake(bool clearOnExit, Micros deadline);
+
+  // ----- Called from tasks or interrupts -----
+  void wakeAll(WaitList &list);
+  // Increment the notification value of `task` and wake it if it waits
+  void notifyGive(Task *task);
+
+  // ----- Interrupts -----
+  // Run fn in interrupt context of `node` (default: the current node) as soon
+  // as possible. Safe from any OS thread.
+  void raiseIrq(Entry fn, Node *node = nullptr);
+  // Same as raiseIrq() but not before time `when`.
+  void at(Micros when, Entry fn, Node *node = nullptr);
+
+  // Scheduler loop, returns once the clock passes `until`.
+  void run(Micros until = FOREVER);
+
+  Node &defaultNode() { return m_defaultNode; }
+
+  // Number of times a task was given the baton
+  uint64_t contextSwitches() const { return m_switches; }
+
+ private:
+  Kernel() = default;
+
+  struct Timer {
+    Micros when;
+    uint64_t order;
+    Entry fn;
+    Node *node;
+  };
+
+  struct Sleeper {
+    Micros when;
+    uint64_t order;
+    Task *task;
+    uint64_t token;
+  };
+
+  static void fiberEntry();
+  static bool timerLater(const Timer &a, const Timer &b);
+  static bool sleeperLater(const Sleeper &a, const Sleeper &b);
+
+  void enterNode(Node *node);
+  void makeReady(Task *task);
+  void addSleeper(Task *task, Micros when);
+  void detachFromWaitList(Task *task);
+  void giveBack(std::unique_lock<std::mutex> &lock, Task *self);
+  void resume(std::unique_lock<std::mutex> &lock, Task *task);
+  void runTimers(std::unique_lock<std::mutex> &lock);
+  void wakeSleepers();
+  Task *pickReady();
+  Micros nextWakeup();
+  Micros clockNow();
+
+  std::mutex m_mutex;
+  std::condition_variable m_schedCv;
+  ucontext_t m_schedContext;  // scheduler side of fiber switches
+  bool m_virtual = false;
+  Micros m_virtualNow = 0;
+  uint64_t m_order = 0;
+  uint64_t m_switches = 0;
+
+  std::vector<std::unique_ptr<Task>> m_tasks;
+  std::vector<std::deque<Task *>> m_ready;  // FIFO per priority
+  std::vector<Sleeper> m_sleepers;          // min-heap on (when, order)
+  std::vector<Timer> m_timers;              // min-heap on (when, order)
+  Task *m_current = nullptr;
+  Node *m_lastNode = nullptr;
+
+  Node m_defaultNode;
+};
+
+}  // namespace host
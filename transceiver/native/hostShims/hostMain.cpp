@@ -0,0 +1,29 @@
+// Entry point of the native build: runs the Arduino sketch (setup() then
+// loop() forever) in a "loopTask" like the Arduino-ESP32 core does.
+//
+// Environment:
+//   HOST_NODE_NAME   name shown in log lines (default "node")
+//   HOST_FS_DIR      directory standing in for LittleFS (default .littlefs)
+//   HOST_SERIAL_PTY  set to 1 to expose Serial on a pseudo terminal
+//   HOST_RADIO_PORT  UDP port of the shared radio medium (default 47000)
+
+#include <cstdlib>
+
+#include "Arduino.h"
+#include "hostKernel.hpp"
+
+int main() {
+  host::Kernel &kernel = host::Kernel::get();
+  host::Node &node = kernel.defaultNode();
+  if (const char *name = getenv("HOST_NODE_NAME")) node.name = name;
+  if (const char *dir = getenv("HOST_FS_DIR")) node.fsRoot = dir;
+
+  kernel.spawn(
+      [] {
+        setup();
+        while (true) loop();
+      },
+      "loopTask", 1, &node);
+  kernel.run();
+  return 0;
+}
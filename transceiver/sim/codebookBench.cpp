@@ -0,0 +1,410 @@
+#include "codebookBench.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "LoRaCom.hpp"
+#include "adr.hpp"
+#include "airtime.hpp"
+#include "codebook.hpp"
+#include "frame.hpp"
+
+namespace {
+
+constexpr size_t CORPUS_PAYLOADS = 4000;
+constexpr size_t ENTRIES = 127;  // codes 0x80..0xFE
+constexpr size_t MAX_ENTRY = 10;
+
+[[noreturn]] void checkFailed(const char *what) {
+  fprintf(stderr, "codebook: %s\n", what);
+  abort();
+}
+
+/* ================================= CORPUS ================================ */
+
+struct Sensor {
+  uint64_t ms;
+  double force, temp, hum, volts;
+  bool hasHum;
+};
+
+std::string telemetryLine(Sensor &sensor, int id, std::mt19937 &rng) {
+  std::normal_distribution<double> walk(0.0, 0.05);
+  sensor.ms += 200 + rng() % 1800;
+  sensor.force += walk(rng);
+  sensor.temp += walk(rng) / 5;
+  sensor.hum += walk(rng);
+  sensor.volts = std::max(3.3, sensor.volts - (rng() % 4) * 0.001);
+  char line[96];
+  int n = snprintf(line, sizeof(line), "t:%llu id:%d force:%.3f temp:%.2f",
+                   static_cast<unsigned long long>(sensor.ms), id,
+                   sensor.force, sensor.temp);
+  if (sensor.hasHum) {
+    n += snprintf(line + n, sizeof(line) - n, " hum:%.1f", sensor.hum);
+  }
+  snprintf(line + n, sizeof(line) - n, " v:%.3f", sensor.volts);
+  return line;
+}
+
+// What "command <text>" sends, with arguments in the ranges Commander takes
+std::string commandText(std::mt19937 &rng) {
+  static const char *const BANDWIDTHS[] = {"125", "250", "500"};
+  char text[48];
+  switch (rng() % 9) {
+    case 0:
+      snprintf(text, sizeof(text), "update gain %d",
+               -9 + static_cast<int>(rng() % 32));
+      break;
+    case 1:
+      snprintf(text, sizeof(text), "update freqMhz %.1f",
+               902.0 + (rng() % 260) / 10.0);
+      break;
+    case 2:
+      snprintf(text, sizeof(text), "update sf %d", 7 + static_cast<int>(rng() % 6));
+      break;
+    case 3:
+      snprintf(text, sizeof(text), "update bwKHz %s", BANDWIDTHS[rng() % 3]);
+      break;
+    case 4:
+      snprintf(text, sizeof(text), "set output %d", static_cast<int>(rng() % 2));
+      break;
+    case 5:
+      return "help";
+    case 6:
+      return "update help";
+    case 7:
+      return "set help";
+    default:
+      return "stats";
+  }
+  return text;
+}
+
+// Data payloads of 1 to 3 telemetry lines ('\n' between them, as the
+// batcher joins them) from 8 sensors, and one command in 7. Where the
+// sensors start comes from the seed as well, so another seed reads other
+// values.
+std::vector<std::string> corpus(uint32_t seed, uint64_t startMs) {
+  std::mt19937 rng(seed);
+  std::vector<Sensor> sensors;
+  std::uniform_real_distribution<double> force(0.0, 60.0), temp(5.0, 35.0),
+      hum(20.0, 90.0), volts(3.4, 4.2);
+  for (int id = 0; id < 8; id++) {
+    sensors.push_back({startMs, force(rng), temp(rng), hum(rng), volts(rng),
+                       id % 2 == 0});
+  }
+
+  std::vector<std::string> payloads;
+  while (payloads.size() < CORPUS_PAYLOADS) {
+    if (rng() % 7 == 0) {
+      payloads.push_back(commandText(rng));
+      continue;
+    }
+    int id = rng() % sensors.size();
+    std::string payload = telemetryLine(sensors[id], id, rng);
+    for (int more = rng() % 10 < 3 ? 1 + rng() % 2 : 0; more > 0; more--) {
+      payload += '\n' + telemetryLine(sensors[id], id, rng);
+    }
+    payloads.push_back(payload);
+  }
+  return payloads;
+}
+
+/* ================================= TRAIN ================================= */
+
+// Picks, ENTRIES times, the substring that saves the most bytes (each
+// occurrence becomes one code byte) in what no earlier entry covers, and
+// covers its occurrences. The counts are kept up to date by taking out the
+// substrings that overlap each occurrence covered.
+class Trainer {
+ public:
+  explicit Trainer(const std::vector<std::string> &payloads)
+      : m_payloads(payloads) {
+    for (const std::string &payload : m_payloads) {
+      m_covered.emplace_back(payload.size(), false);
+    }
+    for (size_t p = 0; p < m_payloads.size(); p++) {
+      forEachSubstring(p, 0, m_payloads[p].size(),
+                       [&](std::string_view s) { m_counts[s]++; });
+    }
+  }
+
+  std::vector<std::string> train() {
+    std::vector<std::string> entries;
+    while (entries.size() < ENTRIES) {
+      std::string_view best;
+      size_t bestSaving = 0;
+      for (const auto &[substring, count] : m_counts) {
+        size_t saving = count * (substring.size() - 1);
+        if (saving > bestSaving ||
+            (saving == bestSaving && saving > 0 && substring < best)) {
+          best = substring;
+          bestSaving = saving;
+        }
+      }
+      if (bestSaving == 0) break;
+      entries.emplace_back(best);
+      cover(entries.back());
+    }
+    return entries;
+  }
+
+ private:
+  static bool usable(char c) { return c >= 0x20 && c < 0x7F; }
+
+  // Every substring of up to MAX_ENTRY usable, uncovered bytes in payload
+  // `p` that starts at or after `first` - MAX_ENTRY + 1 and overlaps
+  // [first, last)
+  template <typename F>
+  void forEachSubstring(size_t p, size_t first, size_t last, F &&visit) {
+    const std::string &text = m_payloads[p];
+    const std::vector<bool> &covered = m_covered[p];
+    size_t from = first >= MAX_ENTRY - 1 ? first - (MAX_ENTRY - 1) : 0;
+    for (size_t start = from; start < last; start++) {
+      for (size_t len = 1; len <= MAX_ENTRY && start + len <= text.size();
+           len++) {
+        size_t end = start + len;
+        if (covered[end - 1] || !usable(text[end - 1])) break;
+        if (len >= 2 && end > first) {
+          visit(std::string_view(text).substr(start, len));
+        }
+      }
+    }
+  }
+
+  void cover(const std::string &entry) {
+    for (size_t p = 0; p < m_payloads.size(); p++) {
+      const std::string &text = m_payloads[p];
+      for (size_t at = text.find(entry); at != std::string::npos;
+           at = text.find(entry, at)) {
+        bool free = true;
+        for (size_t i = at; i < at + entry.size(); i++) {
+          free = free && !m_covered[p][i];
+        }
+        if (!free) {
+          at++;
+          continue;
+        }
+        forEachSubstring(p, at, at + entry.size(), [&](std::string_view s) {
+          auto found = m_counts.find(s);
+          if (--found->second == 0) m_counts.erase(found);
+        });
+        for (size_t i = at; i < at + entry.size(); i++) m_covered[p][i] = true;
+        at += entry.size();
+      }
+    }
+  }
+
+  const std::vector<std::string> &m_payloads;
+  std::vector<std::vector<bool>> m_covered;
+  std::unordered_map<std::string_view, size_t> m_counts;
+};
+
+// The order codebook.cpp keeps: by first byte, longest first
+void sortLikeCodebook(std::vector<std::string> &entries) {
+  std::sort(entries.begin(), entries.end(),
+            [](const std::string &a, const std::string &b) {
+              if (a[0] != b[0]) return a[0] < b[0];
+              if (a.size() != b.size()) return a.size() > b.size();
+              return a < b;
+            });
+}
+
+// As an initialiser list for CODEBOOK, 80 columns wide
+void printCodebook(const std::vector<std::string> &entries) {
+  std::string line = "   ";
+  for (const std::string &entry : entries) {
+    std::string quoted = " \"";
+    for (char c : entry) {
+      if (c == '"' || c == '\\') quoted += '\\';
+      quoted += c;
+    }
+    quoted += "\",";
+    if (line.size() + quoted.size() > 80) {
+      printf("%s\n", line.c_str());
+      line = "   ";
+    }
+    line += quoted;
+  }
+  printf("%s\n", line.c_str());
+}
+
+/* ================================= REPORT ================================ */
+
+// Payload bytes frame::pack() would send with `entries` as the codebook
+size_t packedSize(const std::vector<std::string> &entries,
+                  const std::string &text) {
+  size_t n = 0;
+  for (size_t i = 0; i < text.size();) {
+    if (static_cast<uint8_t>(text[i]) >= 0x80) {
+      n += 2;
+      i++;
+      continue;
+    }
+    size_t match = 1;
+    for (const std::string &entry : entries) {
+      if (entry.size() > match && text.compare(i, entry.size(), entry) == 0) {
+        match = entry.size();
+        break;  // longest first
+      }
+    }
+    n++;
+    i += match;
+  }
+  return n < text.size() ? n : text.size();
+}
+
+// An ADR rate, with the coding rate and preamble LoRaCom keeps for all
+airtime::Modem rateModem(const adr::DataRate &rate) {
+  airtime::Modem modem = LoRaCom::BOOT_MODEM;
+  modem.sf = rate.sf;
+  modem.bwHz = airtime::bandwidthHz(rate.bwKHz);
+  return modem;
+}
+
+template <typename Pack>
+void report(const char *name, const std::vector<std::string> &payloads,
+            Pack &&pack) {
+  double textBytes = 0, packedBytes = 0;
+  double plainUs[adr::RATE_COUNT] = {}, packedUs[adr::RATE_COUNT] = {};
+  constexpr size_t OVERHEAD = frame::HEADER_SIZE + frame::CRC_SIZE;
+  for (const std::string &payload : payloads) {
+    size_t packed = pack(payload);
+    textBytes += payload.size();
+    packedBytes += packed;
+    for (size_t r = 0; r < adr::RATE_COUNT; r++) {
+      airtime::Modem modem = rateModem(adr::RATES[r]);
+      plainUs[r] += airtime::timeOnAirUs(modem, OVERHEAD + payload.size());
+      packedUs[r] += airtime::timeOnAirUs(modem, OVERHEAD + packed);
+    }
+  }
+  double count = payloads.size();
+  printf("%-9s payload %5.1f -> %5.1f B (%.2fx), frame %5.1f -> %5.1f B\n",
+         name, textBytes / count, packedBytes / count, textBytes / packedBytes,
+         textBytes / count + OVERHEAD, packedBytes / count + OVERHEAD);
+  for (size_t r = 0; r < adr::RATE_COUNT; r++) {
+    char rate[16];
+    snprintf(rate, sizeof(rate), "SF%u/%.0f", adr::RATES[r].sf,
+             adr::RATES[r].bwKHz);
+    printf("%9s %-8s %7.1f -> %7.1f ms per frame (%+.0f%%)\n", "", rate,
+           plainUs[r] / count / 1000,
+           packedUs[r] / count / 1000,
+           100.0 * (packedUs[r] - plainUs[r]) / plainUs[r]);
+  }
+}
+
+// Round trips through encodeText() and decode(), and random bytes into
+// unpack(), which must never write past its buffer
+void check(const std::vector<std::string> &payloads, std::mt19937 &rng) {
+  uint8_t buffer[frame::MAX_SIZE];
+  uint8_t scratch[frame::MAX_PAYLOAD];
+  for (const std::string &text : payloads) {
+    frame::Header header = {frame::Type::Data, 1, 0};
+    size_t len = frame::encodeText(header, text.data(), text.size(), buffer,
+                                   sizeof(buffer));
+    const uint8_t *payload;
+    size_t payloadLen;
+    if (len == 0 || !frame::decode(buffer, len, &header, &payload,
+                                   &payloadLen, scratch)) {
+      checkFailed("frame does not decode");
+    }
+    if (std::string_view(reinterpret_cast<const char *>(payload),
+                         payloadLen) != text) {
+      checkFailed("text differs after the round trip");
+    }
+  }
+
+  uint8_t in[frame::MAX_PAYLOAD];
+  for (int i = 0; i < 200'000; i++) {
+    size_t len = 1 + rng() % sizeof(in);
+    for (size_t b = 0; b < len; b++) in[b] = static_cast<uint8_t>(rng());
+    size_t size = 1 + rng() % sizeof(scratch);
+    if (frame::unpack(in, len, scratch, size) > size) {
+      checkFailed("unpack() wrote past its buffer");
+    }
+  }
+  printf("%zu round trips exact, 200000 random inputs to unpack() ok\n",
+         payloads.size());
+}
+
+// Microseconds per frame of encodeText(), and of decode() with unpacking
+void timing(const std::vector<std::string> &payloads) {
+  using Clock = std::chrono::steady_clock;
+  std::vector<std::vector<uint8_t>> frames;
+  uint8_t buffer[frame::MAX_SIZE];
+  uint8_t scratch[frame::MAX_PAYLOAD];
+  frame::Header header = {frame::Type::Data, 1, 0};
+
+  auto measure = [&](auto &&run) {
+    size_t rounds = 0;
+    auto start = Clock::now();
+    double seconds = 0;
+    while (seconds < 0.3) {
+      for (size_t i = 0; i < payloads.size(); i++) run(i);
+      rounds += payloads.size();
+      seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    return seconds * 1e6 / rounds;
+  };
+  double encodeUs = measure([&](size_t i) {
+    frame::encodeText(header, payloads[i].data(), payloads[i].size(), buffer,
+                      sizeof(buffer));
+  });
+  for (const std::string &text : payloads) {
+    size_t len = frame::encodeText(header, text.data(), text.size(), buffer,
+                                   sizeof(buffer));
+    frames.emplace_back(buffer, buffer + len);
+  }
+  double decodeUs = measure([&](size_t i) {
+    frame::Header out;
+    const uint8_t *payload;
+    size_t payloadLen;
+    frame::decode(frames[i].data(), frames[i].size(), &out, &payload,
+                  &payloadLen, scratch);
+  });
+  printf("host: encodeText %.2f us, decode + unpack %.2f us per frame\n",
+         encodeUs, decodeUs);
+}
+
+}  // namespace
+
+void runCodebookBench(uint32_t seed) {
+  std::vector<std::string> training = corpus(seed, 0);
+  std::vector<std::string> heldOut = corpus(seed + 1, 3'600'000);
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::string> trained = Trainer(training).train();
+  sortLikeCodebook(trained);
+  printf("Codebook trained on %zu payloads in %.1f s, as in codebook.cpp:\n",
+         training.size(),
+         std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+             .count());
+  printCodebook(trained);
+
+  printf("\nHeld out corpus, %zu payloads, CR 4/5, 20 symbol preamble\n",
+         heldOut.size());
+  report("firmware", heldOut, [](const std::string &text) {
+    uint8_t out[frame::MAX_PAYLOAD];
+    size_t len = frame::pack(reinterpret_cast<const uint8_t *>(text.data()),
+                             text.size(), out, sizeof(out));
+    return len > 0 ? len : text.size();
+  });
+  report("trained", heldOut, [&](const std::string &text) {
+    return packedSize(trained, text);
+  });
+
+  std::mt19937 rng(seed);
+  printf("\n");
+  check(heldOut, rng);
+  timing(heldOut);
+  fflush(stdout);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+// The codebook of lib/frame/codebook.cpp, run by `sim --codebook`:
+//  - generates a training corpus of data and command payloads, and a held
+//    out one from another seed with other value ranges
+//  - trains a codebook on the first and prints it the way codebook.cpp
+//    holds it, so a new table can be pasted in
+//  - reports payload and frame sizes and the time on air per frame at every
+//    ADR rate on the held out corpus, for the table in the firmware and the
+//    trained one
+//  - checks the round trip, unpack() on random input, and times both ways
+void runCodebookBench(uint32_t seed);
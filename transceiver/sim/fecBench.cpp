@@ -0,0 +1,234 @@
+#include "fecBench.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "RadioLib.h"
+#include "fec.hpp"
+#include "frame.hpp"
+
+namespace {
+
+/* =============================== THROUGHPUT ============================== */
+
+// Data bytes per second through encode(), and through decode() with `m` data
+// fragments missing, the worst case the parity can repair
+void codecThroughput(size_t k, size_t m, size_t len, std::mt19937 &rng) {
+  std::vector<std::vector<uint8_t>> block(k + m, std::vector<uint8_t>(len));
+  for (size_t i = 0; i < k; i++) {
+    for (uint8_t &byte : block[i]) byte = static_cast<uint8_t>(rng());
+  }
+  std::vector<const uint8_t *> data;
+  std::vector<uint8_t *> fragments;
+  for (size_t i = 0; i < k + m; i++) fragments.push_back(block[i].data());
+  for (size_t i = 0; i < k; i++) data.push_back(block[i].data());
+
+  using Clock = std::chrono::steady_clock;
+  auto measure = [&](auto &&run) {
+    size_t rounds = 0;
+    auto start = Clock::now();
+    double seconds = 0;
+    while (seconds < 0.3) {
+      for (int i = 0; i < 100; i++) run();
+      rounds += 100;
+      seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    return rounds * k * len / seconds / 1e6;
+  };
+
+  double encodeMBs =
+      measure([&] { fec::encode(data.data(), k, &fragments[k], 0, m, len); });
+
+  bool present[fec::MAX_DATA + fec::MAX_PARITY];
+  for (size_t i = 0; i < k + m; i++) present[i] = i >= m;
+  double decodeMBs =
+      measure([&] { fec::decode(fragments.data(), present, k, m, len); });
+
+  printf("%4zu %4zu %5zu %10.1f %10.1f\n", k, m, len, encodeMBs, decodeMBs);
+}
+
+/* ================================ TRANSFER =============================== */
+
+// One sender streams TRANSFER_BYTES to one receiver in rounds. After each
+// round the receiver answers with the fragments it has, the sender then
+// sends what is still missing. Either direction loses frames independently
+// at the same rate. A lost answer costs a timeout, then the sender asks
+// again, sending only what it had not sent before.
+constexpr size_t TRANSFER_BYTES = 16 * 1024;
+constexpr size_t FRAGMENT_BYTES = 200;
+constexpr size_t FRAGMENT_HEADER = 4;  // transfer, block, index
+constexpr size_t ANSWER_BYTES = 64;    // a bitmap per block
+constexpr size_t BLOCK = 16;           // data fragments per coded block
+constexpr double TURNAROUND_S = 0.010;
+constexpr double ANSWER_TIMEOUT_S = 1.0;
+constexpr int RUNS = 200;
+constexpr size_t FRAGMENTS =
+    (TRANSFER_BYTES + FRAGMENT_BYTES - 1) / FRAGMENT_BYTES;
+
+struct Transfer {
+  double seconds = 0;
+  uint32_t frames = 0;
+  uint32_t rounds = 0;
+};
+
+struct Link {
+  double fragmentS;
+  double answerS;
+  double delayS;  // before the receiver may answer
+  double loss;
+  std::mt19937 &rng;
+
+  bool arrives() {
+    return std::uniform_real_distribution<double>(0, 1)(rng) >= loss;
+  }
+  bool send(Transfer *transfer) {
+    transfer->frames++;
+    transfer->seconds += fragmentS;
+    return arrives();
+  }
+  // The receiver's answer, true if it got back
+  bool answer(Transfer *transfer) {
+    transfer->rounds++;
+    transfer->seconds += 2 * TURNAROUND_S + delayS + answerS;
+    if (arrives()) return true;
+    transfer->seconds += ANSWER_TIMEOUT_S;
+    return false;
+  }
+};
+
+// Every fragment the receiver reported missing goes again
+Transfer retransmit(Link &link) {
+  std::vector<bool> received(FRAGMENTS), sent(FRAGMENTS);
+  Transfer transfer;
+  size_t have = 0;
+  while (have < FRAGMENTS) {
+    for (size_t i = 0; i < FRAGMENTS; i++) {
+      if (sent[i]) continue;
+      sent[i] = true;
+      if (link.send(&transfer)) received[i] = true;
+    }
+    if (!link.answer(&transfer)) continue;
+    sent = received;
+    have = std::count(received.begin(), received.end(), true);
+  }
+  return transfer;
+}
+
+// Blocks of BLOCK data fragments. A block gets as many fragments as it still
+// lacks, counting those on their way at the estimated loss, plus the parity
+// fec::parityFor() asks for at `target`. Fragments not sent yet go first,
+// data before parity. `loss` carries over from one transfer to the next.
+Transfer erasureCoded(Link &link, fec::LossEstimate &loss, float target) {
+  constexpr size_t MOST = BLOCK + fec::MAX_PARITY;
+  struct Block {
+    size_t k;
+    bool received[MOST] = {};
+    bool sent[MOST] = {};
+    size_t have = 0;     // as of the last answer
+    size_t pending = 0;  // sent since
+  };
+  std::vector<Block> blocks((FRAGMENTS + BLOCK - 1) / BLOCK);
+  for (size_t b = 0; b < blocks.size(); b++) {
+    blocks[b].k = std::min(BLOCK, FRAGMENTS - b * BLOCK);
+  }
+
+  Transfer transfer;
+  uint32_t sent = 0, heard = 0;  // since the last answer
+  size_t done = 0;
+  while (done < blocks.size()) {
+    float p = loss.rate();
+    for (Block &block : blocks) {
+      float expected = block.have + block.pending * (1.0f - p);
+      if (expected >= block.k) continue;
+      size_t lacking = static_cast<size_t>(std::ceil(block.k - expected));
+      size_t send = lacking + fec::parityFor(lacking, p, target);
+      for (size_t i = 0; i < block.k + fec::MAX_PARITY && send > 0; i++) {
+        if (block.sent[i]) continue;
+        block.sent[i] = true;
+        block.pending++;
+        send--;
+        sent++;
+        if (link.send(&transfer)) {
+          block.received[i] = true;
+          heard++;
+        }
+      }
+    }
+    if (!link.answer(&transfer)) continue;
+
+    // The answer also counts the fragments heard, repeats included
+    loss.update(sent, heard);
+    sent = heard = 0;
+    done = 0;
+    for (Block &block : blocks) {
+      block.have = std::count(block.received, block.received + MOST, true);
+      std::copy(block.received, block.received + MOST, block.sent);
+      block.pending = 0;
+      if (block.have >= block.k) done++;
+    }
+  }
+  return transfer;
+}
+
+}  // namespace
+
+void runFecBench(uint32_t seed) {
+  std::mt19937 rng(seed);
+
+  printf("Erasure code throughput on this host, MB/s of data\n");
+  printf("%4s %4s %5s %10s %10s\n", "k", "m", "len", "encode", "decode");
+  codecThroughput(16, 4, FRAGMENT_BYTES, rng);
+  codecThroughput(16, 8, FRAGMENT_BYTES, rng);
+  codecThroughput(32, 16, FRAGMENT_BYTES, rng);
+
+  // The profile LoRaCom::begin() starts the radio with
+  host::LoRaProfile profile;
+  profile.freqMHz = 915.0f;
+  profile.bwKHz = 500.0f;
+  profile.sf = 7;
+  profile.cr = 5;
+  profile.preambleLength = 20;
+  size_t frameBytes = frame::HEADER_SIZE + FRAGMENT_HEADER + FRAGMENT_BYTES +
+                      frame::CRC_SIZE;
+  size_t answerBytes = frame::HEADER_SIZE + ANSWER_BYTES + frame::CRC_SIZE;
+  double fragmentS = host::loraTimeOnAir(profile, frameBytes) / 1e6;
+  double answerS = host::loraTimeOnAir(profile, answerBytes) / 1e6;
+
+  // Answers right away, and answers that wait for a time slot or a duty
+  // cycle budget of the receiver
+  for (double delayS : {0.0, 10.0, 30.0}) {
+    printf("\n%zu B transfer, SF%u %.0f kHz, answer after %.0f s, mean of %d "
+           "runs\n",
+           TRANSFER_BYTES, profile.sf, profile.bwKHz, delayS, RUNS);
+    printf("%5s | %9s %8s %7s %6s | %9s %8s %7s %6s\n", "loss%", "resend_s",
+           "goodput", "frames", "rounds", "fec_s", "goodput", "frames",
+           "rounds");
+    for (double lossRate : {0.0, 0.05, 0.10, 0.20, 0.30, 0.50}) {
+      Link link = {fragmentS, answerS, delayS, lossRate, rng};
+      Transfer plain, coded;
+      fec::LossEstimate loss;
+      for (int run = 0; run < RUNS; run++) {
+        Transfer a = retransmit(link);
+        Transfer b = erasureCoded(link, loss, fec::BLOCK_TARGET);
+        plain.seconds += a.seconds / RUNS;
+        plain.frames += a.frames;
+        plain.rounds += a.rounds;
+        coded.seconds += b.seconds / RUNS;
+        coded.frames += b.frames;
+        coded.rounds += b.rounds;
+      }
+      printf("%5.0f | %9.1f %8.1f %7.1f %6.2f | %9.1f %8.1f %7.1f %6.2f\n",
+             lossRate * 100, plain.seconds, TRANSFER_BYTES / plain.seconds,
+             static_cast<double>(plain.frames) / RUNS,
+             static_cast<double>(plain.rounds) / RUNS, coded.seconds,
+             TRANSFER_BYTES / coded.seconds,
+             static_cast<double>(coded.frames) / RUNS,
+             static_cast<double>(coded.rounds) / RUNS);
+    }
+  }
+  fflush(stdout);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+
+// Benchmarks for lib/fec, run by `sim --fec`:
+//  - encode and decode throughput of the erasure code on this host
+//  - goodput of a bulk transfer over a lossy link, with erasure coding
+//    against plain selective retransmission of the missing fragments
+void runFecBench(uint32_t seed);
@@ -0,0 +1,163 @@
+#include "fetchBench.hpp"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "esp_log.h"
+#include "logFetch.hpp"
+#include "simChannel.hpp"
+#include "simNode.hpp"
+
+namespace {
+
+namespace stdfs = std::filesystem;
+
+constexpr host::Micros FETCH_AT = 3'000'000;  // both nodes are up by then
+constexpr host::Micros GIVE_UP = 3600'000'000;
+constexpr host::Micros STEP = 1'000'000;
+constexpr int ERASE_TRIES = 5;
+
+// Telemetry lines like the ones a node logs
+std::string makeLog(size_t bytes, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> walk(0.0, 0.05);
+  double force = 20.0, temp = 21.0;
+  std::string log;
+  char line[96];
+  for (unsigned long long t = 0; log.size() < bytes; t += 1000) {
+    force += walk(rng);
+    temp += walk(rng) / 5;
+    snprintf(line, sizeof(line), "t:%llu id:1 force:%.3f temp:%.2f v:3.900\n",
+             t, force, temp);
+    log += line;
+  }
+  return log;
+}
+
+void runOne(uint32_t kb, uint32_t seed, double lossRate, bool fec) {
+  host::Kernel &kernel = host::Kernel::get();
+  kernel.useVirtualTime(true);
+  esp_log_level_set("*", ESP_LOG_ERROR);
+
+  stdfs::path fsRoot = stdfs::temp_directory_path() /
+                       ("lora_fetch_" + std::to_string(getpid()));
+  stdfs::create_directories(fsRoot / "node1");
+  std::string log = makeLog(kb * 1024, seed);
+  std::ofstream(fsRoot / "node1" / "log.txt", std::ios::binary) << log;
+
+  SimChannel::Config config;
+  config.lossRate = lossRate;
+  SimChannel channel(config, seed);
+  channel.layout(2, 100.0);
+
+  std::vector<std::unique_ptr<SimNode>> nodes;
+  for (int i = 0; i < 2; i++) {
+    nodes.push_back(std::make_unique<SimNode>(
+        i, &channel, (fsRoot / ("node" + std::to_string(i))).string()));
+    nodes[i]->boot(0);
+  }
+  channel.onDelivered([&](int, int to, const uint8_t *data, size_t len,
+                          host::Micros txStart) {
+    nodes[to]->delivered(data, len, txStart);
+  });
+
+  const std::string command = fec ? "fetch 0002 fec\n" : "fetch 0002\n";
+  SimNode &gateway = *nodes[0];
+  gateway.input(FETCH_AT, command);
+
+  // The windows are written in one piece each, between the status lines
+  std::string received;
+  bool collecting = false;
+  unsigned from = 0, target = 0;  // of the first fetch
+  unsigned fetchedTo = 0;         // of the last one
+  host::Micros doneAt = 0;
+  int eraseTries = 0;
+  bool erased = false, finished = false, failed = false;
+  gateway.serial().onWrite = [&](const uint8_t *data, size_t len) {
+    size_t expected = std::min<size_t>(fetch::WINDOW,
+                                       target - from - received.size());
+    if (collecting && len == expected) received.append(data, data + len);
+  };
+  gateway.onLine([&](SimNode &node, const std::string &line) {
+    unsigned a = 0, b = 0;
+    host::Micros now = kernel.now();
+    if (sscanf(line.c_str(), "--- log %u %u ---", &a, &b) == 2) {
+      if (doneAt == 0) {
+        from = a;
+        target = b;
+        collecting = true;
+      }
+      fetchedTo = b;
+    } else if (line.compare(0, 7, "--- end") == 0) {
+      collecting = false;
+      if (doneAt == 0) doneAt = now;
+      eraseTries++;
+      node.input(now + STEP, "fetch 0002 erase\n");
+    } else if (line.compare(0, 10, "--- erased") == 0) {
+      erased = finished = true;
+    } else if (line.compare(0, 14, "--- not erased") == 0) {
+      // Lines were logged since, fetch those and try again
+      if (eraseTries >= ERASE_TRIES) {
+        finished = true;
+      } else {
+        node.input(now + STEP,
+                   "fetch 0002 " + std::to_string(fetchedTo) + "\n");
+      }
+    } else if (line.compare(0, 10, "--- failed") == 0) {
+      failed = finished = true;
+    }
+  });
+
+  for (host::Micros until = STEP; !finished && until < GIVE_UP;
+       until += STEP) {
+    kernel.run(until);
+  }
+
+  // What the node had when the fetch began, booting added "New Log"
+  bool same = doneAt > 0 && received.size() == target - from &&
+              received.compare(0, log.size(), log) == 0;
+  double seconds = (doneAt - FETCH_AT) / 1e6;
+  double kbytes = received.size() / 1024.0;
+  const SimChannel::Stats &stats = channel.stats();
+  printf("%5.0f %4s %7zu %9.1f %7.2f %7.0f %7llu %6s %6s\n", lossRate * 100,
+         fec ? "fec" : "-", received.size(), doneAt ? seconds : 0.0,
+         doneAt && kbytes > 0 ? seconds / kbytes : 0.0,
+         doneAt ? received.size() / seconds : 0.0,
+         static_cast<unsigned long long>(stats.frames),
+         failed ? "failed" : same ? "ok" : "BAD",
+         erased ? std::to_string(eraseTries).c_str() : "no");
+  fflush(stdout);
+
+  std::error_code ec;
+  stdfs::remove_all(fsRoot, ec);
+}
+
+}  // namespace
+
+void runFetchBench(uint32_t kb, uint32_t seed) {
+  printf("Fetching %u KB of log from a node 100 m away, SF7 500 kHz\n", kb);
+  printf("%5s %4s %7s %9s %7s %7s %7s %6s %6s\n", "loss%", "code", "bytes",
+         "seconds", "s/KB", "B/s", "frames", "data", "erased");
+  fflush(stdout);
+  for (double lossRate : {0.0, 0.1, 0.2, 0.3}) {
+    for (bool fec : {false, true}) {
+      // The host kernel is a process-wide singleton
+      pid_t pid = fork();
+      if (pid == 0) {
+        runOne(kb, seed, lossRate, fec);
+        _exit(0);
+      }
+      int status = 0;
+      waitpid(pid, &status, 0);
+    }
+  }
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+// Remote log retrieval, run by `sim --fetch <KB>`: node 0002 boots with a
+// log of that size, node 0001 fetches it over LoRa ("fetch 0002 [fec]") and
+// then erases it. For a few loss rates, with and without erasure coding, each
+// in its own process. Prints the transfer time per KB and checks the bytes
+// against the file on node 0002.
+void runFetchBench(uint32_t kb, uint32_t seed);
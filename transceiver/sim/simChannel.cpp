@@ -0,0 +1,211 @@
+#include "simChannel.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Oldest transmission kept for interference checks, longer than any airtime
+constexpr host::Micros HISTORY_US = 30'000'000;
+
+double dbmToMw(double dbm) { return std::pow(10.0, dbm / 10.0); }
+
+}  // namespace
+
+SimChannel::SimChannel(const Config &config, uint32_t seed)
+    : m_config(config), m_rng(seed) {}
+
+void SimChannel::layout(int count, double sideM) {
+  m_count = count;
+  m_x.resize(count);
+  m_y.resize(count);
+  m_radios.assign(count, nullptr);
+  m_shadowing.assign(static_cast<size_t>(count) * count, 0.0f);
+
+  std::uniform_real_distribution<double> position(0.0, sideM);
+  std::normal_distribution<double> shadowing(0.0, m_config.shadowingDb);
+  for (int i = 0; i < count; i++) {
+    m_x[i] = position(m_rng);
+    m_y[i] = position(m_rng);
+  }
+  for (int i = 0; i < count; i++) {
+    for (int j = i + 1; j < count; j++) {
+      float s = static_cast<float>(shadowing(m_rng));
+      m_shadowing[i * count + j] = s;
+      m_shadowing[j * count + i] = s;
+    }
+  }
+}
+
+double SimChannel::demodFloorDb(uint8_t sf) {
+  // SX126x datasheet, minimum SNR per spreading factor
+  static const double floorDb[] = {-2.5, -5.0, -7.5, -10.0,
+                                   -12.5, -15.0, -17.5, -20.0};
+  return floorDb[std::clamp<int>(sf, 5, 12) - 5];
+}
+
+double SimChannel::txCurrentMa(int8_t powerDbm) {
+  // SX1262 high power PA at 3.3 V, datasheet figures and in between
+  static const double table[][2] = {{-9, 24},  {0, 26},  {10, 40},  {14, 60},
+                                    {17, 84},  {20, 102}, {22, 118}};
+  constexpr size_t count = sizeof(table) / sizeof(table[0]);
+  if (powerDbm <= table[0][0]) return table[0][1];
+  for (size_t i = 1; i < count; i++) {
+    if (powerDbm <= table[i][0]) {
+      double t = (powerDbm - table[i - 1][0]) / (table[i][0] - table[i - 1][0]);
+      return table[i - 1][1] + t * (table[i][1] - table[i - 1][1]);
+    }
+  }
+  return table[count - 1][1];
+}
+
+double SimChannel::noiseFloorDbm(float bwKHz) const {
+  return -174.0 + 10.0 * std::log10(bwKHz * 1000.0) + m_config.noiseFigureDb;
+}
+
+void SimChannel::attach(SX126x *radio) {
+  int id = radio->hostNode()->id;
+  if (id >= 0 && id < m_count) m_radios[id] = radio;
+}
+
+void SimChannel::detach(SX126x *radio) {
+  int id = radio->hostNode()->id;
+  if (id >= 0 && id < m_count && m_radios[id] == radio) m_radios[id] = nullptr;
+}
+
+void SimChannel::transmit(SX126x *from, const uint8_t *data, size_t len,
+                          host::Micros airtime) {
+  host::Kernel &kernel = host::Kernel::get();
+  host::Micros now = kernel.now();
+  prune(now);
+
+  Transmission tx;
+  tx.from = from->hostNode()->id;
+  tx.start = now;
+  tx.end = now + airtime;
+  tx.profile = from->hostProfile();
+  tx.data.assign(data, data + len);
+  tx.rxPowerDbm.resize(m_count);
+
+  std::normal_distribution<double> fading(0.0, m_config.fadingDb);
+  for (int to = 0; to < m_count; to++) {
+    if (to == tx.from) continue;
+    double dx = m_x[tx.from] - m_x[to];
+    double dy = m_y[tx.from] - m_y[to];
+    double distance = std::max(1.0, std::sqrt(dx * dx + dy * dy));
+    double loss = m_config.referenceLossDb +
+                  10.0 * m_config.pathLossExponent * std::log10(distance) +
+                  m_shadowing[tx.from * m_count + to];
+    tx.rxPowerDbm[to] =
+        static_cast<float>(tx.profile.powerDbm - loss + fading(m_rng));
+  }
+
+  m_stats.frames++;
+  m_stats.airtimeUs += airtime;
+  m_stats.txEnergyMj += airtime * txCurrentMa(tx.profile.powerDbm) * 3.3 / 1e6;
+  if (tx.start >= m_busyUntil) {
+    m_stats.busyUs += airtime;
+  } else if (tx.end > m_busyUntil) {
+    m_stats.busyUs += tx.end - m_busyUntil;
+  }
+  m_busyUntil = std::max(m_busyUntil, tx.end);
+
+  uint64_t id = m_firstId + m_transmissions.size();
+  m_transmissions.push_back(std::move(tx));
+  kernel.at(now + airtime, [this, id] { finish(id); });
+}
+
+void SimChannel::finish(uint64_t id) {
+  const Transmission &p = m_transmissions[id - m_firstId];
+  const double noise = noiseFloorDbm(p.profile.bwKHz);
+  const double floor = demodFloorDb(p.profile.sf);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+  std::vector<const Transmission *> overlapping;
+  for (const Transmission &q : m_transmissions) {
+    if (&q == &p || !overlaps(p, q)) continue;
+    if (std::fabs(q.profile.freqMHz - p.profile.freqMHz) > 0.001f) continue;
+    overlapping.push_back(&q);
+  }
+
+  for (int to = 0; to < m_count; to++) {
+    SX126x *radio = m_radios[to];
+    if (to == p.from || radio == nullptr) continue;
+    if (!host::loraCompatible(radio->hostProfile(), p.profile)) continue;
+
+    const double power = p.rxPowerDbm[to];
+    if (power - noise < floor) continue;  // out of range, not a link
+    m_stats.links++;
+
+    bool halfDuplex = false;
+    bool locked = false;
+    double interferenceMw = 0.0;
+    for (const Transmission *q : overlapping) {
+      if (q->from == to) {
+        halfDuplex = true;
+        break;
+      }
+      // Spreading factors are treated as orthogonal
+      if (q->profile.sf != p.profile.sf) continue;
+      interferenceMw += dbmToMw(q->rxPowerDbm[to]);
+      if (q->start < p.start && q->rxPowerDbm[to] - noise >= floor) {
+        locked = true;  // the demodulator synchronised on q first
+      }
+    }
+
+    if (halfDuplex) {
+      m_stats.halfDuplex++;
+      continue;
+    }
+    if (locked || (interferenceMw > 0.0 &&
+                   power - 10.0 * std::log10(interferenceMw) <
+                       m_config.captureDb)) {
+      m_stats.collided++;
+      continue;
+    }
+
+    if (m_config.lossRate > 0.0 && uniform(m_rng) < m_config.lossRate) {
+      m_stats.injectedLoss++;
+      continue;
+    }
+
+    float snr = static_cast<float>(power - noise);
+    host::Kernel::get().raiseIrq(
+        [this, radio, id, to, snr] {
+          const Transmission &tx = m_transmissions[id - m_firstId];
+          if (!radio->hostReceive(tx.data.data(), tx.data.size(),
+                                  tx.rxPowerDbm[to], snr)) {
+            m_stats.notListening++;
+            return;
+          }
+          m_stats.delivered++;
+          if (m_onDelivered) {
+            m_onDelivered(tx.from, to, tx.data.data(), tx.data.size(),
+                          tx.start);
+          }
+        },
+        radio->hostNode());
+  }
+}
+
+bool SimChannel::channelActive(SX126x *radio) {
+  host::Micros now = host::Kernel::get().now();
+  int id = radio->hostNode()->id;
+  const host::LoRaProfile &profile = radio->hostProfile();
+  const double noise = noiseFloorDbm(profile.bwKHz);
+
+  for (const Transmission &q : m_transmissions) {
+    if (q.start > now || q.end <= now || q.from == id) continue;
+    if (!host::loraCompatible(profile, q.profile)) continue;
+    if (q.rxPowerDbm[id] - noise >= demodFloorDb(profile.sf)) return true;
+  }
+  return false;
+}
+
+void SimChannel::prune(host::Micros now) {
+  while (!m_transmissions.empty() &&
+         m_transmissions.front().end + HISTORY_US < now) {
+    m_transmissions.pop_front();
+    m_firstId++;
+  }
+}
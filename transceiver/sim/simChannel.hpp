@@ -0,0 +1,97 @@
+#pragma once
+
+// Shared LoRa channel for the network simulator.
+//
+// Every transmission is kept with the power it arrives with at each node
+// (log-distance path loss, fixed per-link shadowing and per-packet fading).
+// When a packet ends, each compatible receiver gets it only if
+//   - its SNR is above the demodulation floor of the spreading factor,
+//   - the receiver did not transmit while it was on air (half duplex),
+//   - the receiver was not already locked onto an earlier packet,
+//   - it is at least `captureDb` above the sum of all overlapping packets
+//     (capture effect).
+
+#include <RadioLib.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <random>
+#include <vector>
+
+class SimChannel : public host::RadioMedium {
+ public:
+  struct Config {
+    double pathLossExponent = 2.7;
+    double referenceLossDb = 31.7;  // free space at 1 m, 915 MHz
+    double shadowingDb = 4.0;       // std deviation, fixed per link
+    double fadingDb = 2.0;          // std deviation, per packet
+    double noiseFigureDb = 6.0;
+    double captureDb = 6.0;
+    double lossRate = 0.0;  // share of otherwise good packets dropped
+  };
+
+  struct Stats {
+    uint64_t frames = 0;      // transmissions started
+    uint64_t airtimeUs = 0;   // sum of all airtimes
+    uint64_t busyUs = 0;      // time with at least one transmission on air
+    uint64_t links = 0;       // (frame, receiver) pairs within range
+    uint64_t delivered = 0;   // handed to a listening radio
+    uint64_t collided = 0;    // lost to interference or receiver lock
+    uint64_t halfDuplex = 0;  // receiver was transmitting itself
+    uint64_t notListening = 0;  // receiver radio was not in receive mode
+    uint64_t injectedLoss = 0;  // dropped at random, Config::lossRate
+    double txEnergyMj = 0;    // radio supply energy spent transmitting
+  };
+
+  // Called for every packet handed to a radio
+  using DeliveryHook = std::function<void(int from, int to, const uint8_t *data,
+                                          size_t len, host::Micros txStart)>;
+
+  SimChannel(const Config &config, uint32_t seed);
+
+  // Scatter `count` nodes uniformly over a square with sides of `sideM`
+  void layout(int count, double sideM);
+
+  void attach(SX126x *radio) override;
+  void detach(SX126x *radio) override;
+  void transmit(SX126x *from, const uint8_t *data, size_t len,
+                host::Micros airtime) override;
+  bool channelActive(SX126x *radio) override;
+
+  void onDelivered(DeliveryHook hook) { m_onDelivered = std::move(hook); }
+  const Stats &stats() const { return m_stats; }
+
+  static double demodFloorDb(uint8_t sf);
+  static double txCurrentMa(int8_t powerDbm);
+  double noiseFloorDbm(float bwKHz) const;
+
+ private:
+  struct Transmission {
+    int from;
+    host::Micros start;
+    host::Micros end;
+    host::LoRaProfile profile;
+    std::vector<uint8_t> data;
+    std::vector<float> rxPowerDbm;  // arrival power at every node
+  };
+
+  void finish(uint64_t id);
+  bool overlaps(const Transmission &a, const Transmission &b) const {
+    return a.start < b.end && b.start < a.end;
+  }
+  void prune(host::Micros now);
+
+  Config m_config;
+  std::mt19937 m_rng;
+  int m_count = 0;
+  std::vector<double> m_x, m_y;
+  std::vector<float> m_shadowing;    // m_count * m_count, symmetric
+  std::vector<SX126x *> m_radios;    // indexed by host::Node::id
+  std::deque<Transmission> m_transmissions;
+  uint64_t m_firstId = 0;  // id of m_transmissions.front()
+  host::Micros m_busyUntil = 0;
+
+  Stats m_stats;
+  DeliveryHook m_onDelivered;
+};
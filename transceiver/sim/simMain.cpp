@@ -0,0 +1,355 @@
+// Discrete-event network simulator: runs N complete firmware instances
+// (Control, Commander, SaveFlash, SerialCom, LoRaCom) on the host kernel in
+// virtual time, all sharing one simulated LoRa channel (see simChannel.hpp).
+//
+//   sim [--nodes 1,10,50,100,200] [--seconds 120] [--area 1000] [--seed 1]
+//       [--adr] [--dwell] [--data 1000] [--batch 500] [--loss 0.2] [--reliable]
+//       [--nolbt] [--tdma] [--relay 2] [--duty 1] [--trace file]
+//       [--verbose]
+//   sim --fec
+//   sim --fetch 16 [--seed 1]
+//   sim --codebook [--seed 1]
+//
+// --adr switches adaptive data rate on in every node right after boot,
+// otherwise all of them stay at the fixed profile from Control::setup().
+// --dwell turns the US915 dwell limit on ("dwell on"), which keeps ADR to
+// the rates a full packet fits in 400 ms at.
+// --data types a telemetry line into every node at random, on average every
+// that many ms. The app_rx, goodput and latency columns then only count those
+// lines, from the moment they were typed until a peer printed them. --batch
+// sets the aggregation budget for them (Control's default otherwise).
+// --loss drops that share of the packets that would have arrived, on top of
+// collisions and range. --reliable sends every node's lines to the next node
+// in the ring ("reliable <id>"), otherwise they are broadcast. Either way the
+// got% column is the share of lines the ring peer printed at least once,
+// leaving out the last 10 s of typing.
+// --nolbt switches listen before talk off ("lbt off"), the cad% column is
+// the share of transmissions that found the channel busy first and
+// backoff the mean wait in ms per packet.
+// --tdma types "command mode tdma" into every node right after boot, they
+// send in the slots of the coordinator's schedule once they heard its Sync.
+// --relay makes every node relay frames up to that many hops ("relay <n>"),
+// spread the nodes with --area to have some out of range of each other.
+// air/rx is the time on air per line a node printed and hit% the share of
+// frames the relay cache dropped as copies.
+// --duty limits every node to that percentage of airtime ("airtime <pct>"),
+// node% is the most any one node was on air.
+// --trace writes the lines the first node logs to flash to that file, the
+// traces in bench/traces were recorded that way. Give it one node count.
+// --fec runs the erasure code benchmarks in fecBench.hpp instead, --fetch
+// the remote log retrieval in fetchBench.hpp with a log of that many KB,
+// --codebook trains and reports the payload codebook (codebookBench.hpp).
+// Each node count runs in its own forked process and prints one table row.
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "codebookBench.hpp"
+#include "esp_log.h"
+#include "fecBench.hpp"
+#include "fetchBench.hpp"
+#include "simChannel.hpp"
+#include "simNode.hpp"
+
+namespace {
+
+struct Options {
+  std::vector<int> nodes = {1, 10, 50, 100, 200};
+  double seconds = 120.0;
+  double areaM = 1000.0;
+  uint32_t seed = 1;
+  bool adr = false;
+  bool dwell = false;
+  double dataMs = 0;   // mean interval of telemetry lines per node, 0 = none
+  int batchMs = -1;    // -1 keeps the firmware default
+  double lossRate = 0;
+  bool reliable = false;
+  bool lbt = true;
+  bool tdma = false;
+  int relayHops = 0;
+  double dutyPercent = 0;
+  const char *tracePath = nullptr;
+  bool verbose = false;
+  bool fec = false;
+  uint32_t fetchKb = 0;
+  bool codebook = false;
+};
+
+double percentile(std::vector<double> &samples, double p) {
+  if (samples.empty()) return 0.0;
+  size_t index = static_cast<size_t>(p * (samples.size() - 1) + 0.5);
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+void printHeader() {
+  printf(
+      "%5s %7s %7s %6s %6s %7s %6s %6s %6s %6s %7s %7s %6s %7s %6s %8s %7s "
+      "%7s %7s %7s %8s %7s %6s\n",
+      "nodes", "frames", "air%", "node%", "busy%", "links", "pdr%", "coll%", "hdx%",
+      "cad%", "backoff", "app_rx", "got%", "air/rx", "hit%", "goodput",
+      "uJ/B", "p50ms", "p90ms", "p99ms", "wakeup/s", "wall_s", "xreal");
+  fflush(stdout);
+}
+
+void runScenario(const Options &options, int count) {
+  host::Kernel &kernel = host::Kernel::get();
+  kernel.useVirtualTime(true);
+  esp_log_level_set("*", options.verbose ? ESP_LOG_INFO : ESP_LOG_ERROR);
+
+  namespace stdfs = std::filesystem;
+  stdfs::path fsRoot = stdfs::temp_directory_path() /
+                       ("lora_sim_" + std::to_string(getpid()));
+
+  SimChannel::Config config;
+  config.lossRate = options.lossRate;
+  SimChannel channel(config, options.seed);
+  channel.layout(count, options.areaM);
+
+  const host::Micros duration =
+      static_cast<host::Micros>(options.seconds * 1e6);
+  std::vector<std::unique_ptr<SimNode>> nodes;
+  std::map<std::string, host::Micros> typedAt;  // data lines, when typed
+  std::map<std::string, int> typedBy;           // and on which node
+  std::set<std::string> reachedPeer;  // printed by the next node in the ring
+  std::vector<double> latencyMs;
+  uint64_t appFrames = 0;
+  uint64_t appBytes = 0;
+
+  std::mt19937 rng(options.seed ^ 0x9E3779B9u);
+  // Nodes power up at random points within one status interval
+  std::uniform_int_distribution<host::Micros> bootAt(0, 10'000'000);
+  for (int i = 0; i < count; i++) {
+    auto node = std::make_unique<SimNode>(
+        i, &channel, (fsRoot / ("node" + std::to_string(i))).string());
+    node->onReceive([&](SimNode &receiver, const SimNode::Delivery &frame,
+                        host::Micros latency) {
+      if (options.dataMs > 0) {
+        auto typed = typedAt.find(frame.payload);
+        if (typed == typedAt.end()) return;
+        latency = kernel.now() - typed->second;
+        if (receiver.id() == (typedBy[frame.payload] + 1) % count) {
+          reachedPeer.insert(frame.payload);
+        }
+      }
+      appFrames++;
+      appBytes += frame.payload.size();
+      latencyMs.push_back(latency / 1000.0);
+    });
+    host::Micros bootTime = bootAt(rng);
+    node->boot(bootTime);
+    if (!options.lbt) node->input(bootTime, "lbt off\n");
+    if (options.dwell) node->input(bootTime, "dwell on\n");
+    if (options.relayHops > 0) {
+      node->input(bootTime,
+                  "relay " + std::to_string(options.relayHops) + "\n");
+    }
+    if (options.dutyPercent > 0) {
+      char command[32];
+      snprintf(command, sizeof(command), "airtime %g\n", options.dutyPercent);
+      node->input(bootTime, command);
+    }
+    host::Micros readyAt = bootTime + 1'000'000;
+    if (options.adr) node->input(readyAt, "adr on\n");
+    if (options.tdma) node->input(readyAt, "command mode tdma\n");
+    if (options.batchMs >= 0) {
+      node->input(readyAt, "batch " + std::to_string(options.batchMs) + "\n");
+    }
+    if (options.reliable && count > 1) {
+      char command[32];
+      snprintf(command, sizeof(command), "reliable %04X\n",
+               (i + 1) % count + 1);  // node ID = index + 1
+      node->input(readyAt, command);
+    }
+
+    // Telemetry like the lines the codebook was trained on, unique through
+    // the node and the timestamp
+    if (options.dataMs > 0) {
+      std::exponential_distribution<double> gap(1.0 / (options.dataMs * 1e3));
+      std::normal_distribution<double> walk(0.0, 0.05);
+      double force = 20.0 + i, temp = 21.0, volts = 3.9;
+      for (host::Micros t = readyAt + gap(rng); t < duration; t += gap(rng)) {
+        force += walk(rng);
+        temp += walk(rng) / 5;
+        char line[96];
+        snprintf(line, sizeof(line),
+                 "data t:%llu id:%d force:%.3f temp:%.2f v:%.3f",
+                 static_cast<unsigned long long>(t / 1000), i, force, temp,
+                 volts);
+        typedAt[line] = t;
+        typedBy[line] = i;
+        node->input(t, std::string(line) + "\n");
+      }
+    }
+    nodes.push_back(std::move(node));
+  }
+  channel.onDelivered([&](int, int to, const uint8_t *data, size_t len,
+                          host::Micros txStart) {
+    nodes[to]->delivered(data, len, txStart);
+  });
+
+  auto wallStart = std::chrono::steady_clock::now();
+  kernel.run(duration);
+  double wall = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - wallStart)
+                    .count();
+  if (options.tracePath) {
+    // The LittleFS shim keeps SaveFlash's log as a plain file
+    std::error_code ec;
+    stdfs::copy_file(fsRoot / "node0" / "log.txt", options.tracePath,
+                     stdfs::copy_options::overwrite_existing, ec);
+    if (ec) fprintf(stderr, "No trace: %s\n", ec.message().c_str());
+  }
+
+  const SimChannel::Stats &stats = channel.stats();
+  auto pct = [](uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * part / whole : 0.0;
+  };
+  uint64_t started = 0, cadBusy = 0, backoffUs = 0;
+  uint64_t relayHeard = 0, relayCopies = 0, nodeAirMaxUs = 0;
+  for (auto &node : nodes) {
+    AirtimeStats air = node->lora()->airtimeStats();
+    uint64_t airUs = 0;
+    for (uint64_t usedUs : air.usedUs) airUs += usedUs;
+    nodeAirMaxUs = std::max(nodeAirMaxUs, airUs);
+    TxStats tx = node->lora()->txStats();
+    started += tx.started;
+    cadBusy += tx.cadBusy;
+    backoffUs += tx.backoffTotalUs;
+    relay::Stats relayed = node->relayStats();
+    relayHeard += relayed.heard;
+    relayCopies += relayed.duplicates;
+  }
+  uint64_t counted = 0, reached = 0;
+  for (const auto &[line, at] : typedAt) {
+    if (at + 10'000'000 > duration) continue;
+    counted++;
+    reached += reachedPeer.count(line);
+  }
+  printf(
+      "%5d %7llu %7.2f %6.2f %6.2f %7llu %6.1f %6.1f %6.1f %6.1f %7.2f %7llu %6.1f "
+      "%7.2f %6.1f %8.1f %7.1f %7.2f %7.2f %7.2f %8.1f %7.2f %6.0f\n",
+      count, static_cast<unsigned long long>(stats.frames),
+      pct(stats.airtimeUs, duration), pct(nodeAirMaxUs, duration),
+      pct(stats.busyUs, duration),
+      static_cast<unsigned long long>(stats.links),
+      pct(stats.delivered, stats.links), pct(stats.collided, stats.links),
+      pct(stats.halfDuplex, stats.links), pct(cadBusy, started),
+      started ? backoffUs / 1000.0 / started : 0.0,
+      static_cast<unsigned long long>(appFrames), pct(reached, counted),
+      appFrames ? stats.airtimeUs / 1000.0 / appFrames : 0.0,
+      pct(relayCopies, relayHeard),
+      appBytes / options.seconds,
+      appBytes ? stats.txEnergyMj * 1000.0 / appBytes : 0.0,
+      percentile(latencyMs, 0.50), percentile(latencyMs, 0.90),
+      percentile(latencyMs, 0.99),
+      kernel.contextSwitches() / (options.seconds * count), wall,
+      options.seconds / wall);
+  fflush(stdout);
+
+  std::error_code ec;
+  stdfs::remove_all(fsRoot, ec);
+}
+
+std::vector<int> parseList(const char *arg) {
+  std::vector<int> values;
+  for (const char *p = arg; *p;) {
+    values.push_back(atoi(p));
+    p = strchr(p, ',');
+    if (p == nullptr) break;
+    p++;
+  }
+  return values;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = (i + 1 < argc) ? argv[i + 1] : "";
+    if (strcmp(arg, "--nodes") == 0) {
+      options.nodes = parseList(value), i++;
+    } else if (strcmp(arg, "--seconds") == 0) {
+      options.seconds = atof(value), i++;
+    } else if (strcmp(arg, "--area") == 0) {
+      options.areaM = atof(value), i++;
+    } else if (strcmp(arg, "--seed") == 0) {
+      options.seed = static_cast<uint32_t>(atoi(value)), i++;
+    } else if (strcmp(arg, "--data") == 0) {
+      options.dataMs = atof(value), i++;
+    } else if (strcmp(arg, "--batch") == 0) {
+      options.batchMs = atoi(value), i++;
+    } else if (strcmp(arg, "--loss") == 0) {
+      options.lossRate = atof(value), i++;
+    } else if (strcmp(arg, "--reliable") == 0) {
+      options.reliable = true;
+    } else if (strcmp(arg, "--nolbt") == 0) {
+      options.lbt = false;
+    } else if (strcmp(arg, "--tdma") == 0) {
+      options.tdma = true;
+    } else if (strcmp(arg, "--relay") == 0) {
+      options.relayHops = atoi(value), i++;
+    } else if (strcmp(arg, "--duty") == 0) {
+      options.dutyPercent = atof(value), i++;
+    } else if (strcmp(arg, "--adr") == 0) {
+      options.adr = true;
+    } else if (strcmp(arg, "--dwell") == 0) {
+      options.dwell = true;
+    } else if (strcmp(arg, "--fec") == 0) {
+      options.fec = true;
+    } else if (strcmp(arg, "--fetch") == 0) {
+      options.fetchKb = static_cast<uint32_t>(atoi(value)), i++;
+    } else if (strcmp(arg, "--codebook") == 0) {
+      options.codebook = true;
+    } else if (strcmp(arg, "--trace") == 0) {
+      options.tracePath = value, i++;
+    } else if (strcmp(arg, "--verbose") == 0) {
+      options.verbose = true;
+    } else {
+      fprintf(stderr, "Unknown option: %s\n", arg);
+      return 1;
+    }
+  }
+
+  if (options.fec) {
+    runFecBench(options.seed);
+    return 0;
+  }
+  if (options.fetchKb > 0) {
+    runFetchBench(options.fetchKb, options.seed);
+    return 0;
+  }
+  if (options.codebook) {
+    runCodebookBench(options.seed);
+    return 0;
+  }
+
+  printHeader();
+  for (int count : options.nodes) {
+    // The host kernel is a process-wide singleton, so every scenario gets a
+    // fresh process
+    pid_t pid = fork();
+    if (pid == 0) {
+      runScenario(options, count);
+      _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+  }
+  return 0;
+}
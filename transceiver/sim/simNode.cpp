@@ -0,0 +1,142 @@
+#include "simNode.hpp"
+
+/* ============================== SERIAL PORT ============================== */
+
+void SimSerialPort::inject(const std::string &data) {
+  m_rx.insert(m_rx.end(), data.begin(), data.end());
+  received();
+}
+
+size_t SimSerialPort::read(uint8_t *buffer, size_t size) {
+  size_t count = 0;
+  while (count < size && !m_rx.empty()) {
+    buffer[count++] = m_rx.front();
+    m_rx.pop_front();
+  }
+  return count;
+}
+
+size_t SimSerialPort::write(const uint8_t *buffer, size_t size) {
+  if (onWrite) onWrite(buffer, size);
+  for (size_t i = 0; i < size; i++) {
+    char c = static_cast<char>(buffer[i]);
+    if (c == '\n') {
+      if (onLine) onLine(m_line);
+      m_line.clear();
+    } else {
+      m_line += c;
+    }
+  }
+  return size;
+}
+
+/* ================================= NODE ================================== */
+
+SimNode::SimNode(int id, host::RadioMedium *medium, const std::string &fsRoot) {
+  m_node.id = id;
+  m_node.name = "n" + std::to_string(id);
+  m_node.serial = &m_serial;
+  m_node.fsRoot = fsRoot;
+  m_node.medium = medium;
+  m_node.mac = static_cast<uint32_t>(id + 1) << 8;  // node ID = id + 1
+  m_node.onEnter = [this] {
+    // LoRaCom dispatches its DIO1 interrupt through a single static pointer
+    if (m_lora) LoRaCom::setInterruptTarget(m_lora);
+  };
+  m_serial.onLine = [this](const std::string &line) { handleLine(line); };
+}
+
+void SimNode::boot(host::Micros when) {
+  host::Kernel &kernel = host::Kernel::get();
+  kernel.at(
+      when,
+      [this, &kernel] {
+        kernel.spawn(
+            [this] {
+              m_control = new Control();
+              m_lora = LoRaCom::interruptTarget();
+              m_control->setup();
+              m_control->begin();
+            },
+            "boot", 1, &m_node);
+      },
+      &m_node);
+}
+
+relay::Stats SimNode::relayStats() const {
+  if (m_control == nullptr) return relay::Stats();
+  return m_control->relayStats();
+}
+
+void SimNode::input(host::Micros when, const std::string &text) {
+  host::Kernel::get().at(
+      when, [this, text] { m_serial.inject(text); }, &m_node);
+}
+
+void SimNode::delivered(const uint8_t *data, size_t len, host::Micros txStart) {
+  // Keep the text the firmware will print for this frame
+  frame::Header header;
+  const uint8_t *payload = nullptr;
+  size_t payloadLen = 0;
+  uint8_t unpacked[frame::MAX_PAYLOAD];
+  if (!frame::decode(data, len, &header, &payload, &payloadLen, unpacked)) {
+    return;
+  }
+
+  // Fetches print the log, not the frames
+  if (header.type == frame::Type::Log) return;
+
+  // Reliable frames are printed by the node they are for, as their inner
+  // type. Duplicates are not printed, handleLine() skips them.
+  if (header.type == frame::Type::Arq) {
+    frame::ArqHeader arq;
+    const uint8_t *inner = nullptr;
+    size_t innerLen = 0;
+    if (!frame::decodeArq(payload, payloadLen, &arq, &inner, &innerLen) ||
+        arq.to != id() + 1 || arq.kind == frame::ARQ_ACK_ONLY) {
+      return;
+    }
+    header.type = static_cast<frame::Type>(arq.kind);
+    payload = inner;
+    payloadLen = innerLen;
+  }
+
+  char text[frame::MAX_TEXT];
+  size_t textLen = frame::toText(header, payload, payloadLen, text, sizeof(text));
+  if (header.type != frame::Type::Data) {
+    m_pending.push_back({std::string(text, textLen), txStart});
+    return;
+  }
+
+  // handleRecords() prints every record of a batch on a line of its own
+  std::string records(text + strlen("data "), text + textLen);
+  size_t start = 0;
+  while (true) {
+    size_t end = records.find(Batcher::SEPARATOR, start);
+    m_pending.push_back(
+        {"data " + records.substr(start, end - start), txStart});
+    if (end == std::string::npos) break;
+    start = end + 1;
+  }
+}
+
+void SimNode::handleLine(const std::string &line) {
+  if (m_onLine) m_onLine(*this, line);
+
+  // handleFrame() prints "Received: <text>" for every frame it handles
+  static const std::string prefix = "Received: <";
+  if (line.compare(0, prefix.size(), prefix) != 0) return;
+  std::string printed = line.substr(prefix.size());
+
+  // Packets the firmware never picked up are dropped from the front
+  while (!m_pending.empty()) {
+    Delivery frame = std::move(m_pending.front());
+    m_pending.pop_front();
+    if (printed.compare(0, frame.payload.size(), frame.payload) == 0) {
+      if (m_onReceive) {
+        m_onReceive(*this, frame, host::Kernel::get().now() - frame.txStart);
+      }
+      return;
+    }
+  }
+}
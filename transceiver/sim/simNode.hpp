@@ -0,0 +1,79 @@
+#pragma once
+
+// One simulated transceiver: a full Control instance with its own serial
+// port, LittleFS directory and radio, running on the shared host kernel.
+
+#include <deque>
+#include <functional>
+#include <string>
+
+#include "HardwareSerial.h"
+#include "control.hpp"
+#include "frame.hpp"
+#include "hostKernel.hpp"
+
+// In-memory UART. Bytes written by the firmware are split into lines and
+// handed to onLine, and to onWrite as they were written. inject() feeds bytes
+// to the firmware.
+class SimSerialPort : public host::SerialPort {
+ public:
+  std::function<void(const std::string &line)> onLine;
+  std::function<void(const uint8_t *data, size_t len)> onWrite;
+
+  void inject(const std::string &data);
+
+  size_t available() override { return m_rx.size(); }
+  int peek() override { return m_rx.empty() ? -1 : m_rx.front(); }
+  size_t read(uint8_t *buffer, size_t size) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+
+ private:
+  std::deque<uint8_t> m_rx;
+  std::string m_line;
+};
+
+class SimNode {
+ public:
+  struct Delivery {
+    std::string payload;  // as printed by the firmware
+    host::Micros txStart;
+  };
+
+  // Called when the firmware prints a packet it got over LoRa
+  using ReceiveHook = std::function<void(SimNode &node, const Delivery &frame,
+                                         host::Micros latency)>;
+  // Called for every line the firmware prints
+  using LineHook = std::function<void(SimNode &node, const std::string &line)>;
+
+  SimNode(int id, host::RadioMedium *medium, const std::string &fsRoot);
+
+  // Power the node on at `when`: construct Control, setup() and begin()
+  void boot(host::Micros when);
+
+  // Type `text` into the serial port at `when`
+  void input(host::Micros when, const std::string &text);
+
+  // A packet reached the radio of this node
+  void delivered(const uint8_t *data, size_t len, host::Micros txStart);
+
+  void onReceive(ReceiveHook hook) { m_onReceive = std::move(hook); }
+  void onLine(LineHook hook) { m_onLine = std::move(hook); }
+
+  int id() const { return m_node.id; }
+  host::Node &node() { return m_node; }
+  SimSerialPort &serial() { return m_serial; }
+  LoRaCom *lora() { return m_lora; }  // nullptr until booted
+  relay::Stats relayStats() const;
+
+ private:
+  void handleLine(const std::string &line);
+
+  host::Node m_node;
+  SimSerialPort m_serial;
+  Control *m_control = nullptr;
+  LoRaCom *m_lora = nullptr;
+
+  std::deque<Delivery> m_pending;  // handed to the radio, not yet printed
+  ReceiveHook m_onReceive;
+  LineHook m_onLine;
+};